@@ -1,5 +1,28 @@
 nasm -felf64 src/decode.asm -o obj/decode.o     # hex decoder
 nasm -felf64 src/encode.asm -o obj/encode.o     # hex encoder
-# nasm -felf64 src/decode58.asm -o obj/decode58.o
-g++ -std=c++14 -O3 -c src/main.cpp -o obj/main.o
-g++ -std=c++14 -O3 obj/main.o obj/decode.o obj/encode.o -o codec_test
+nasm -felf64 src/decode58.asm -o obj/decode58.o # base58 coefficients
+nasm -felf64 src/decode_sse41.asm -o obj/decode_sse41.o
+nasm -felf64 src/encode_sse41.asm -o obj/encode_sse41.o
+nasm -felf64 src/decode58_sse41.asm -o obj/decode58_sse41.o
+nasm -felf64 src/decode_avx512.asm -o obj/decode_avx512.o
+nasm -felf64 src/encode_avx512.asm -o obj/encode_avx512.o
+nasm -felf64 src/decode58_avx512.asm -o obj/decode58_avx512.o
+nasm -felf64 src/decode58_x8.asm -o obj/decode58_x8.o # 8 strings at a time
+nasm -felf64 src/sha256_x8.asm -o obj/sha256_x8.o # sha256, 8 hashes at a time
+nasm -felf64 src/sha256_shani.asm -o obj/sha256_shani.o
+nasm -felf64 src/decode_avx512vbmi.asm -o obj/decode_avx512vbmi.o
+nasm -felf64 src/encode_avx512vbmi.asm -o obj/encode_avx512vbmi.o
+nasm -felf64 src/base64.asm -o obj/base64.o     # base64, both alphabets
+nasm -felf64 src/fields.asm -o obj/fields.o     # separators of hex fields
+g++ -std=c++14 -O3 -pthread -c src/main.cpp -o obj/main.o
+g++ -std=c++14 -O3 -pthread obj/*.o -o codec_test
+mkdir -p obj/cli
+g++ -std=c++14 -O3 -pthread -c src/codec_cli.cpp -o obj/cli/codec_cli.o
+g++ -std=c++14 -O3 -pthread obj/cli/codec_cli.o $(ls obj/*.o | grep -v main.o) -lboost_program_options -o codec
+g++ -std=c++14 -O3 -c src/codec_bench.cpp -o obj/cli/codec_bench.o
+g++ -std=c++14 -O3 obj/cli/codec_bench.o $(ls obj/*.o | grep -v main.o) -lboost_program_options -o codec_bench
+mkdir -p obj/lib
+g++ -std=c++14 -O3 -fPIC -fvisibility=hidden -c src/codec.cpp -o obj/lib/codec.o
+ar rcs libnasm_codec.a obj/lib/codec.o $(ls obj/*.o | grep -v main.o)
+g++ -shared obj/lib/codec.o $(ls obj/*.o | grep -v main.o) -o libnasm_codec.so
+g++ -std=c++17 -O3 src/codec_capi_test.cpp libnasm_codec.a -o codec_capi_test
@@ -0,0 +1,330 @@
+;; extern std::size_t base64_encode_avx2(unsigned char const* in, size_t len, char* out);
+;; extern std::size_t base64_encode_url_avx2(unsigned char const* in, size_t len, char* out);
+;; extern std::size_t base64_decode_avx2(char const* in, size_t len, unsigned char* out);
+;; extern std::size_t base64_decode_url_avx2(char const* in, size_t len, unsigned char* out);
+
+;; base64_encode_avx2:
+;; RDI is address of the bytes to encode. Must be len bytes.
+;; RSI is the number of bytes (len)
+;; RDX is the address of the output (must be 4*(len/3) chars)
+;; Returns the number of bytes encoded, a multiple of 24, into 4/3 as many
+;; chars. A block reads 28 bytes and encodes 24 of them, so the blocks stop
+;; while there are at least 4 bytes left; the caller encodes the rest.
+;;
+;; base64_decode_avx2:
+;; RDI is address of the chars to decode, without padding. Must be len chars.
+;; RSI is the number of chars (len)
+;; RDX is the address of the output (must be 3*len/4 bytes)
+;; Returns the number of chars decoded, a multiple of 32, into 3/4 as many
+;; bytes. A block writes 32 bytes and keeps 24 of them, so the blocks stop
+;; while there are at least 12 chars left; the caller decodes the rest. The
+;; blocks also stop at the first block with a char that is not a digit, and
+;; the caller finds it.
+;;
+;; The _url variants take the same parameters, and use the url and filename
+;; safe alphabet: '-' and '_' in place of '+' and '/'.
+;;
+;; If this is ported to windows, the calling convention is RCX, RDX, R8 for the params
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Load the constants used by ENCODE_BASE64_BLOCK.
+;;;
+;;; %1 the offsets of the alphabet, indexed by the reduced 6-bit values
+;;;
+;;; ymm7 all bytes 13
+;;; ymm8 shuffle of 3 input bytes into each dword
+;;; ymm9, ymm10 mask and multiplier of the first and third 6-bit values
+;;; ymm11, ymm12 mask and multiplier of the second and fourth 6-bit values
+;;; ymm13 all bytes 51
+;;; ymm14 all bytes 26
+;;; ymm15 offsets of the alphabet
+
+%macro ENCODE_BASE64_CONSTANTS 1
+  vpbroadcastb ymm7, [thirteen]
+  vbroadcasti128 ymm8, [encode_shuffle]
+  vpbroadcastd ymm9, [encode_mask_ac]
+  vpbroadcastd ymm10, [encode_mul_ac]
+  vpbroadcastd ymm11, [encode_mask_bd]
+  vpbroadcastd ymm12, [encode_mul_bd]
+  vpbroadcastb ymm13, [fiftyone]
+  vpbroadcastb ymm14, [twentysix]
+  vbroadcasti128 ymm15, [%1]
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Encode 24 bytes into 32 chars. Reads 28 bytes. Uses ymm0-ymm2 as scratch.
+;;;
+;;; %1 address of the bytes to encode
+;;; %2 address of the 32 char output
+
+%macro ENCODE_BASE64_BLOCK 2
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Split every 3 bytes into four 6-bit values, one per byte
+;;;
+;;; ymm0: 12 bytes in each lane; then bytes b1 b0 b2 b1 in each dword, so
+;;;       each 6-bit value is in one 16-bit word; then the 6-bit values
+;;; ymm1: the first and third values, moved down by a high multiply
+;;; ymm2: the second and fourth values, moved up by a low multiply
+
+  vmovdqu xmm0, [%1]
+  vinserti128 ymm0, ymm0, [%1+12], 1
+  vpshufb ymm0, ymm0, ymm8
+  vpand ymm1, ymm0, ymm9
+  vpmulhuw ymm1, ymm1, ymm10
+  vpand ymm2, ymm0, ymm11
+  vpmullw ymm2, ymm2, ymm12
+  vpor ymm0, ymm1, ymm2
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Add the offset of each value's range to get its char. The ranges are
+;;; reduced to a table index: 0-25 -> 13, 26-51 -> 0, 52-61 -> 1-10, and 62
+;;; and 63 -> 11 and 12.
+;;;
+;;; ymm0: from above; then the chars
+;;; ymm1: the values less 51, saturated at 0; then the table index; then
+;;;       the offset
+;;; ymm2: mask of the values < 26; then 13 for those values
+
+  vpsubusb ymm1, ymm0, ymm13
+  vpcmpgtb ymm2, ymm14, ymm0
+  vpand ymm2, ymm2, ymm7
+  vpor ymm1, ymm1, ymm2
+  vpshufb ymm1, ymm15, ymm1
+  vpaddb ymm0, ymm0, ymm1
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  vmovdqu [%2], ymm0
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define an encoder.
+;;;
+;;; %1 name of the function
+;;; %2 %1 of ENCODE_BASE64_CONSTANTS
+
+%macro ENCODE_BASE64_FUNCTION 2
+%1:
+  ENCODE_BASE64_CONSTANTS %2
+  mov rax, rdi
+  cmp rsi, 28
+  jb .done
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; r8 address of the last block that can be read whole
+
+  lea r8, [rdi + rsi - 28]
+
+.loop:
+  cmp rdi, r8
+  ja .done
+  ENCODE_BASE64_BLOCK rdi, rdx
+  add rdi, 24
+  add rdx, 32
+  jmp .loop
+
+.done:
+  sub rdi, rax
+  mov rax, rdi
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Load the constants used by DECODE_BASE64_BLOCK.
+;;;
+;;; %1 the tables of the alphabet: the low nibble and high nibble validity
+;;;    tables, the offsets, and the digit with an offset of its own
+;;;
+;;; ymm6 shuffle of the 3 decoded bytes of each dword to the front of its lane
+;;; ymm7 permutation of the 12 decoded bytes of each lane to the front
+;;; ymm8 bits of the high nibble classes a low nibble is invalid in
+;;; ymm9 the class bit of each high nibble
+;;; ymm10 offsets, indexed by the high nibble, or 8 + it for the odd digit
+;;; ymm11 all bytes the odd digit: '/' or '_'
+;;; ymm12 all bytes 0x0f (low nibble)
+;;; ymm13 all bytes 8
+;;; ymm14, ymm15 multipliers to merge the 6-bit values
+
+%macro DECODE_BASE64_CONSTANTS 1
+  vbroadcasti128 ymm6, [decode_shuffle]
+  vmovdqu ymm7, [decode_permute]
+  vbroadcasti128 ymm8, [%1]
+  vbroadcasti128 ymm9, [decode_hi]
+  vbroadcasti128 ymm10, [%1+16]
+  vpbroadcastb ymm11, [%1+32]
+  vpbroadcastb ymm12, [lownibble]
+  vpbroadcastb ymm13, [eight]
+  vpbroadcastd ymm14, [decode_merge_pairs]
+  vpbroadcastd ymm15, [decode_merge_words]
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode 32 chars into 24 bytes. Writes 32 bytes. Uses ymm0-ymm3 as scratch.
+;;;
+;;; %1 address of the chars to decode
+;;; %2 address of the output
+;;; %3 label to jump to if any of the chars are not digits
+
+%macro DECODE_BASE64_BLOCK 3
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Check the chars. Each high nibble is a class (one bit), and each low
+;;; nibble has the bits of the classes it is not a digit in. A char is a
+;;; digit if its two lookups have no bit in common. Bytes >= 0x80 have a
+;;; class every low nibble is invalid in.
+;;;
+;;; ymm0: the chars
+;;; ymm1: high nibbles
+;;; ymm2: low nibbles; then the classes they are invalid in
+;;; ymm3: the class of the high nibbles
+
+  vmovdqu ymm0, [%1]
+  vpsrld ymm1, ymm0, 4
+  vpand ymm1, ymm1, ymm12
+  vpand ymm2, ymm0, ymm12
+  vpshufb ymm2, ymm8, ymm2
+  vpshufb ymm3, ymm9, ymm1
+  vptest ymm2, ymm3             ; ZF is clear if any char is not a digit
+  jnz %3
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Convert the digits to 6-bit values. The offset depends only on the high
+;;; nibble, except for the one digit that shares it with digits of another
+;;; range ('/' with '+', or '_' with 'P'-'Z'), which gets index 8 + it.
+;;;
+;;; ymm0: from above; then the 6-bit values
+;;; ymm1: from above; then the table index; then the offsets
+;;; ymm2: mask of the odd digit; then 8 for it
+
+  vpcmpeqb ymm2, ymm0, ymm11
+  vpand ymm2, ymm2, ymm13
+  vpor ymm1, ymm1, ymm2
+  vpshufb ymm1, ymm10, ymm1
+  vpaddb ymm0, ymm0, ymm1
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Pack every four 6-bit values into 3 bytes
+;;;
+;;; ymm0: from above; then pairs merged into 12-bit words; then the 24-bit
+;;;       value of each dword; then big endian bytes, 12 at the front of
+;;;       each lane; then 24 bytes at the front
+
+  vpmaddubsw ymm0, ymm0, ymm14
+  vpmaddwd ymm0, ymm0, ymm15
+  vpshufb ymm0, ymm0, ymm6
+  vpermd ymm0, ymm7, ymm0
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  vmovdqu [%2], ymm0
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a decoder.
+;;;
+;;; %1 name of the function
+;;; %2 %1 of DECODE_BASE64_CONSTANTS
+
+%macro DECODE_BASE64_FUNCTION 2
+%1:
+  DECODE_BASE64_CONSTANTS %2
+  mov rax, rdi
+  cmp rsi, 44
+  jb .done
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; r8 address of the last block whose 32 byte store stays in the output
+
+  lea r8, [rdi + rsi - 44]
+
+.loop:
+  cmp rdi, r8
+  ja .done
+  DECODE_BASE64_BLOCK rdi, rdx, .done
+  add rdi, 32
+  add rdx, 24
+  jmp .loop
+
+.done:
+  sub rdi, rax
+  mov rax, rdi
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endmacro
+
+default rel
+
+section   .text
+
+global base64_encode_avx2
+global base64_encode_url_avx2
+global base64_decode_avx2
+global base64_decode_url_avx2
+
+ENCODE_BASE64_FUNCTION base64_encode_avx2, encode_offsets
+ENCODE_BASE64_FUNCTION base64_encode_url_avx2, encode_offsets_url
+DECODE_BASE64_FUNCTION base64_decode_avx2, decode_tables
+DECODE_BASE64_FUNCTION base64_decode_url_avx2, decode_tables_url
+
+section   .data align=32               ; align on 256 bit boundary for avx2 instructions
+decode_permute:
+  dd 0, 1, 2, 4, 5, 6, 7, 7
+encode_shuffle:
+  db 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10
+decode_shuffle:
+  db 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, 0x80, 0x80, 0x80, 0x80
+
+  ;; the offset to add to a 6-bit value, by its reduced index: 'a' - 26,
+  ;; '0' - 52 ten times, then the offsets of 62 and 63, and 'A'
+encode_offsets:
+  db 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0
+encode_offsets_url:
+  db 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 65, 0, 0
+
+  ;; The class bit of each high nibble. 4 and 6 have the same digits
+  ;; ('A'-'O' and 'a'-'o'), and 0, 1 and 8-15 have none.
+decode_hi:
+  db 0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x08, 0x20
+  db 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01
+
+  ;; for each alphabet: the classes each low nibble is invalid in, the
+  ;; offsets, and the digit that gets an offset of its own
+decode_tables:
+  db 0x0b, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03
+  db 0x03, 0x03, 0x07, 0x35, 0x37, 0x37, 0x37, 0x35
+  db 0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 16, 0, 0, 0, 0, 0
+  db '/'
+decode_tables_url:
+  db 0x0b, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03
+  db 0x03, 0x03, 0x07, 0x37, 0x37, 0x35, 0x37, 0x27
+  db 0, 0, 17, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, -32, 0, 0
+  db '_'
+
+encode_mask_ac: dd 0x0fc0fc00
+encode_mul_ac: dd 0x04000040
+encode_mask_bd: dd 0x003f03f0
+encode_mul_bd: dd 0x01000010
+decode_merge_pairs: dd 0x01400140
+decode_merge_words: dd 0x00011000
+thirteen: db 13
+twentysix: db 26
+fiftyone: db 51
+eight: db 8
+lownibble: db 0x0f
@@ -0,0 +1,198 @@
+// The C interface of the nasm_codec library (see codec.h). Each function
+// checks the sizes and calls the dispatching C++ function of its codec.
+
+#include "codec.h"
+
+#include "codec_base58.h"
+#include "codec_base64.h"
+#include "codec_hex.h"
+#include "codec_sha256.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+codec::base58::InverseAlphabet const&
+base58_inverse(codec_base58_alphabet a)
+{
+    using namespace codec::base58;
+    static InverseAlphabet const ripple(
+        alphabet_traits<alphabet::ripple>::digits());
+    static InverseAlphabet const bitcoin(
+        alphabet_traits<alphabet::bitcoin>::digits());
+    return a == CODEC_BASE58_BITCOIN ? bitcoin : ripple;
+}
+
+char const*
+base58_digits(codec_base58_alphabet a)
+{
+    using namespace codec::base58;
+    return a == CODEC_BASE58_BITCOIN
+        ? alphabet_traits<alphabet::bitcoin>::digits()
+        : alphabet_traits<alphabet::ripple>::digits();
+}
+
+codec::base64::alphabet
+base64_alphabet(codec_base64_alphabet a)
+{
+    return a == CODEC_BASE64_URL ? codec::base64::alphabet::url
+                                 : codec::base64::alphabet::standard;
+}
+
+}  // namespace
+
+extern "C" {
+
+int
+codec_version(void)
+{
+    return CODEC_VERSION;
+}
+
+char const*
+codec_isa(void)
+{
+    return codec::cpu::name(codec::cpu::active_isa());
+}
+
+int
+codec_set_isa(char const* name)
+{
+    codec::cpu::isa level;
+    if (!name || !codec::cpu::parse_isa(name, level) ||
+        !codec::cpu::set_isa(level))
+        return -1;
+    return 0;
+}
+
+ptrdiff_t
+codec_hex_encode(
+    unsigned char const* in,
+    size_t len,
+    char* out,
+    size_t out_size)
+{
+    if (out_size / 2 < len)
+        return -1;
+    codec::hex::encode_hex(reinterpret_cast<char const*>(in), len, out);
+    return 2 * len;
+}
+
+ptrdiff_t
+codec_hex_decode(
+    char const* in,
+    size_t len,
+    unsigned char* out,
+    size_t out_size)
+{
+    if (len % 2 || out_size < len / 2)
+        return -1;
+    if (!codec::hex::decode_hex(in, len / 2, reinterpret_cast<char*>(out)))
+        return -1;
+    return len / 2;
+}
+
+size_t
+codec_base58_max_encoded_size(size_t len)
+{
+    // log(256) / log(58) is 1.366
+    return len * 138 / 100 + 1;
+}
+
+ptrdiff_t
+codec_base58_encode(
+    unsigned char const* in,
+    size_t len,
+    char* out,
+    size_t out_size,
+    codec_base58_alphabet alphabet)
+{
+    if (len > INT_MAX / 2)
+        return -1;
+    auto const digits = base58_digits(alphabet);
+    auto const n = static_cast<int>(len);
+    if (out_size >= codec_base58_max_encoded_size(len))
+        return codec::base58::encode_base58(in, n, out, digits);
+    // encode_base58 may write up to max_encoded_size chars, so a smaller out
+    // goes through a buffer on the stack
+    if (len > 256)
+        return -1;
+    char buf[256 * 138 / 100 + 1];
+    auto const written = codec::base58::encode_base58(in, n, buf, digits);
+    if (static_cast<size_t>(written) > out_size)
+        return -1;
+    memcpy(out, buf, written);
+    return written;
+}
+
+ptrdiff_t
+codec_base58_decode(
+    char const* in,
+    size_t len,
+    unsigned char* out,
+    size_t out_size,
+    codec_base58_alphabet alphabet)
+{
+    if (len > INT_MAX)
+        return -1;
+    auto const digits = reinterpret_cast<unsigned char const*>(in);
+    auto const n = static_cast<int>(len);
+    auto const size = static_cast<int>(std::min<size_t>(out_size, INT_MAX));
+    auto const& inv = base58_inverse(alphabet);
+    // the limbs of decode_base58 are on the stack, so long strings go to the
+    // bitcoin decoder
+    return n <= 64
+        ? codec::base58::decode_base58<64>(digits, n, out, size, inv)
+        : codec::base58::decode_base58_bitcoin(digits, n, out, size, inv);
+}
+
+size_t
+codec_base64_encoded_size(size_t len, int pad)
+{
+    return codec::base64::encoded_size(len, pad != 0);
+}
+
+size_t
+codec_base64_max_decoded_size(size_t len)
+{
+    return codec::base64::max_decoded_size(len);
+}
+
+ptrdiff_t
+codec_base64_encode(
+    unsigned char const* in,
+    size_t len,
+    char* out,
+    size_t out_size,
+    codec_base64_alphabet alphabet,
+    int pad)
+{
+    if (out_size < codec::base64::encoded_size(len, pad != 0))
+        return -1;
+    return codec::base64::encode_base64(
+        in, len, out, base64_alphabet(alphabet), pad != 0);
+}
+
+ptrdiff_t
+codec_base64_decode(
+    char const* in,
+    size_t len,
+    unsigned char* out,
+    size_t out_size,
+    codec_base64_alphabet alphabet)
+{
+    if (out_size < codec::base64::max_decoded_size(len))
+        return -1;
+    return codec::base64::decode_base64(
+        in, len, out, base64_alphabet(alphabet));
+}
+
+void
+codec_sha256(unsigned char const* in, size_t len, unsigned char* out)
+{
+    codec::sha256::sha256(in, len, out);
+}
+
+}  // extern "C"
@@ -0,0 +1,295 @@
+/**
+   The C interface of the nasm_codec library: hex, base58, base64 and sha256
+   with the best kernels the cpu supports, picked once at startup (see
+   cpu_features.h). The functions take the output buffer and its size from
+   the caller, and are safe to call from any thread. They don't allocate,
+   except in base58: encoding more than 32 bytes and decoding more than 64
+   chars each allocate a work buffer on the heap.
+
+   Link with -lnasm_codec (the static or the shared library). The interface is
+   stable: functions are only ever added, and codec_version() says which were
+   there when the library was built.
+
+   For C++17 and later, the namespace codec at the end of this header wraps
+   the functions in std::string_view and span arguments.
+*/
+
+#ifndef NASM_CODEC_H
+#define NASM_CODEC_H
+
+#include <stddef.h>
+
+#if defined(__GNUC__)
+#define CODEC_API __attribute__((visibility("default")))
+#else
+#define CODEC_API
+#endif
+
+#define CODEC_VERSION 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum codec_base58_alphabet
+{
+    CODEC_BASE58_RIPPLE = 0,
+    CODEC_BASE58_BITCOIN = 1
+};
+
+enum codec_base64_alphabet
+{
+    CODEC_BASE64_STANDARD = 0,
+    CODEC_BASE64_URL = 1
+};
+
+// CODEC_VERSION of the library, which may be newer than this header
+CODEC_API int
+codec_version(void);
+
+// The name of the instruction set the kernels use: scalar, sse41, avx2,
+// avx512 or avx512vbmi
+CODEC_API char const*
+codec_isa(void);
+
+// Use the named instruction set. Returns 0, or -1 if the name is unknown or
+// the cpu doesn't support it. Not safe while other threads call the codecs.
+CODEC_API int
+codec_set_isa(char const* name);
+
+// Encode len bytes into 2*len uppercase hex chars. Returns the number of
+// chars written, or -1 if out_size is too small.
+CODEC_API ptrdiff_t
+codec_hex_encode(
+    unsigned char const* in,
+    size_t len,
+    char* out,
+    size_t out_size);
+
+// Decode len hex chars of either case into len/2 bytes. Returns the number
+// of bytes written, or -1 if len is odd, a char is not a hex digit, or
+// out_size is too small.
+CODEC_API ptrdiff_t
+codec_hex_decode(
+    char const* in,
+    size_t len,
+    unsigned char* out,
+    size_t out_size);
+
+// The most chars len bytes encode to in base58
+CODEC_API size_t
+codec_base58_max_encoded_size(size_t len);
+
+// Encode len bytes into base58, with a leading zero digit for each leading
+// zero byte. Returns the number of chars written, or -1 if out_size is too
+// small. More than 32 bytes allocate a work buffer of about len bytes.
+CODEC_API ptrdiff_t
+codec_base58_encode(
+    unsigned char const* in,
+    size_t len,
+    char* out,
+    size_t out_size,
+    enum codec_base58_alphabet alphabet);
+
+// Decode len base58 chars. Returns the number of bytes written, or -1 if a
+// char is not a digit or out_size is too small. More than 64 chars go through
+// a decoder that allocates about 3*len/4 bytes.
+CODEC_API ptrdiff_t
+codec_base58_decode(
+    char const* in,
+    size_t len,
+    unsigned char* out,
+    size_t out_size,
+    enum codec_base58_alphabet alphabet);
+
+// The number of chars len bytes encode to in base64, with or without padding
+CODEC_API size_t
+codec_base64_encoded_size(size_t len, int pad);
+
+// The most bytes len base64 chars decode to
+CODEC_API size_t
+codec_base64_max_decoded_size(size_t len);
+
+// Encode len bytes into base64, padded with '=' if pad is nonzero. Returns
+// the number of chars written, or -1 if out_size is too small.
+CODEC_API ptrdiff_t
+codec_base64_encode(
+    unsigned char const* in,
+    size_t len,
+    char* out,
+    size_t out_size,
+    enum codec_base64_alphabet alphabet,
+    int pad);
+
+// Decode len base64 chars, with or without padding. Returns the number of
+// bytes written, or -1 if the input is not base64 or out_size is less than
+// codec_base64_max_decoded_size(len).
+CODEC_API ptrdiff_t
+codec_base64_decode(
+    char const* in,
+    size_t len,
+    unsigned char* out,
+    size_t out_size,
+    enum codec_base64_alphabet alphabet);
+
+// The sha256 of len bytes, into 32 bytes
+CODEC_API void
+codec_sha256(unsigned char const* in, size_t len, unsigned char* out);
+
+#ifdef __cplusplus
+}  // extern "C"
+#endif
+
+#if defined(__cplusplus) && __cplusplus >= 201703L
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+#if __cplusplus >= 202002L && __has_include(<span>)
+#include <span>
+#endif
+
+namespace codec {
+
+#if defined(__cpp_lib_span)
+template <class T>
+using span = std::span<T>;
+#else
+// The part of std::span these wrappers use, for C++17
+template <class T>
+class span
+{
+private:
+    T* data_ = nullptr;
+    std::size_t size_ = 0;
+
+public:
+    constexpr span() = default;
+
+    constexpr span(T* data, std::size_t size) : data_(data), size_(size)
+    {
+    }
+
+    template <std::size_t N>
+    constexpr span(T (&a)[N]) : data_(a), size_(N)
+    {
+    }
+
+    template <
+        class Container,
+        class = decltype(static_cast<T*>(std::declval<Container&>().data()))>
+    constexpr span(Container& c) : data_(c.data()), size_(c.size())
+    {
+    }
+
+    constexpr T*
+    data() const
+    {
+        return data_;
+    }
+
+    constexpr std::size_t
+    size() const
+    {
+        return size_;
+    }
+
+    constexpr T*
+    begin() const
+    {
+        return data_;
+    }
+
+    constexpr T*
+    end() const
+    {
+        return data_ + size_;
+    }
+};
+#endif
+
+/**
+   The functions of the C interface over views. Each writes to the front of
+   out and returns the part it wrote, or nullopt where the C function returns
+   -1. They allocate only where the C functions do: the base58 functions on
+   long inputs.
+*/
+
+inline std::optional<std::string_view>
+hex_encode(span<unsigned char const> in, span<char> out)
+{
+    auto const n = codec_hex_encode(in.data(), in.size(), out.data(), out.size());
+    if (n < 0)
+        return std::nullopt;
+    return std::string_view(out.data(), n);
+}
+
+inline std::optional<span<unsigned char>>
+hex_decode(std::string_view in, span<unsigned char> out)
+{
+    auto const n = codec_hex_decode(in.data(), in.size(), out.data(), out.size());
+    if (n < 0)
+        return std::nullopt;
+    return span<unsigned char>(out.data(), n);
+}
+
+inline std::optional<std::string_view>
+base58_encode(
+    span<unsigned char const> in,
+    span<char> out,
+    codec_base58_alphabet alphabet = CODEC_BASE58_RIPPLE)
+{
+    auto const n = codec_base58_encode(
+        in.data(), in.size(), out.data(), out.size(), alphabet);
+    if (n < 0)
+        return std::nullopt;
+    return std::string_view(out.data(), n);
+}
+
+inline std::optional<span<unsigned char>>
+base58_decode(
+    std::string_view in,
+    span<unsigned char> out,
+    codec_base58_alphabet alphabet = CODEC_BASE58_RIPPLE)
+{
+    auto const n = codec_base58_decode(
+        in.data(), in.size(), out.data(), out.size(), alphabet);
+    if (n < 0)
+        return std::nullopt;
+    return span<unsigned char>(out.data(), n);
+}
+
+inline std::optional<std::string_view>
+base64_encode(
+    span<unsigned char const> in,
+    span<char> out,
+    codec_base64_alphabet alphabet = CODEC_BASE64_STANDARD,
+    bool pad = true)
+{
+    auto const n = codec_base64_encode(
+        in.data(), in.size(), out.data(), out.size(), alphabet, pad);
+    if (n < 0)
+        return std::nullopt;
+    return std::string_view(out.data(), n);
+}
+
+inline std::optional<span<unsigned char>>
+base64_decode(
+    std::string_view in,
+    span<unsigned char> out,
+    codec_base64_alphabet alphabet = CODEC_BASE64_STANDARD)
+{
+    auto const n = codec_base64_decode(
+        in.data(), in.size(), out.data(), out.size(), alphabet);
+    if (n < 0)
+        return std::nullopt;
+    return span<unsigned char>(out.data(), n);
+}
+
+}  // namespace codec
+
+#endif  // C++17
+
+#endif  // NASM_CODEC_H
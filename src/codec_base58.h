@@ -1,18 +1,34 @@
 #pragma once
 
+#include "codec_sha256.h"
+#include "cpu_features.h"
 #include "utils.h"
 
 #include <algorithm>
+#include <cassert>
 #include <chrono>
 #include <cstring>
 #include <iostream>
+#include <memory>
 #include <random>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <boost/multiprecision/cpp_int.hpp>
 #include <boost/container/small_vector.hpp>
 
-extern "C" int base58_8_coeff(unsigned char const* in, std::uint64_t* out, unsigned int const* alphabet);
+// Each variant converts 44 base58 digits into 6 base 58^8 coefficients, and
+// returns 0 if any of the chars is not a digit. rows is the digit_rows table
+// of the alphabet.
+extern "C" int base58_8_coeff_sse41(unsigned char const* in, std::uint64_t* out, unsigned char const* rows);
+extern "C" int base58_8_coeff_avx2(unsigned char const* in, std::uint64_t* out, unsigned char const* rows);
+extern "C" int base58_8_coeff_avx512(unsigned char const* in, std::uint64_t* out, unsigned char const* rows);
+
+// Converts 8 strings of 44 base58 digits into 5 base 58^10 coefficients each,
+// with one string in each lane. Coefficient k of string a is out[8 * k + a].
+// Returns a mask of the strings that have a char that is not a digit.
+extern "C" int base58_10_coeff_x8_avx2(unsigned char const* const* in, std::uint64_t* out, unsigned char const* rows);
 
 namespace codec {
 namespace base58 {
@@ -20,28 +36,101 @@ namespace base58 {
 static char rippleAlphabet[] =
     "rpshnaf39wBUDNEGHJKLM4PQRST7VWXYZ2bcdeCg65jkm8oFqi1tuvAxyz";
 
+/**
+   The digits of an alphabet, arranged so the simd kernels can look them up
+   with a byte shuffle instead of a gather. Row h - 3 holds the digits of the
+   chars 0xh0 to 0xhf, for the high nibbles h from 3 to 7, and 0xff for the
+   chars that are not digits. Chars in none of the rows are not digits.
+
+   Every char of the alphabet must be in 0x30 to 0x7f for the rows to hold
+   all of it; the chars outside are left out. This holds for the ripple and
+   bitcoin alphabets, which are all letters and the digits 1 to 9.
+*/
+struct digit_rows
+{
+    static constexpr int first_high_nibble = 3;
+    static constexpr int num_rows = 5;
+
+    unsigned char rows[num_rows][16];
+
+    constexpr explicit digit_rows(char const* digits) : rows{}
+    {
+        for (int r = 0; r < num_rows; ++r)
+            for (int l = 0; l < 16; ++l)
+                rows[r][l] = 0xff;
+        for (int i = 0; digits[i]; ++i)
+        {
+            int const c = static_cast<unsigned char>(digits[i]);
+            int const r = (c >> 4) - first_high_nibble;
+            if (r >= 0 && r < num_rows)
+                rows[r][c & 0xf] = i;
+        }
+    }
+
+    // True if every char of digits fits in the rows
+    static constexpr bool
+    fits(char const* digits)
+    {
+        for (int i = 0; digits[i]; ++i)
+        {
+            int const h = static_cast<unsigned char>(digits[i]) >> 4;
+            if (h < first_high_nibble || h >= first_high_nibble + num_rows)
+                return false;
+        }
+        return true;
+    }
+
+    unsigned char const*
+    data() const
+    {
+        return &rows[0][0];
+    }
+};
+
+// The digit of c in rows (see digit_rows), or 0xff if it is not a digit
+inline
+unsigned int
+lookup_digit(unsigned char const* rows, unsigned char c)
+{
+    int const r = (c >> 4) - digit_rows::first_high_nibble;
+    if (r < 0 || r >= digit_rows::num_rows)
+        return 0xff;
+    return rows[16 * r + (c & 0xf)];
+}
+
 // Maps characters to their base58 digit
 class InverseAlphabet
 {
 private:
     std::array<unsigned char, 256> map_;
-    // Assembly routines need this as a dword
-    std::array<unsigned int, 256> int_map_;
+    // The assembly routines look up digits in this instead of map_
+    digit_rows rows_;
+
+    static char const*
+    checked(std::string const& digits)
+    {
+        if (!digit_rows::fits(digits.c_str()))
+            throw std::invalid_argument(
+                "base58 alphabet has a char outside 0x30 to 0x7f");
+        return digits.c_str();
+    }
 
 public:
+    // Throws std::invalid_argument if a char of digits is not in 0x30 to 0x7f
+    // (see digit_rows)
     explicit
     InverseAlphabet(std::string const& digits)
+        : rows_(checked(digits))
     {
         map_.fill(-1);
         int i = 0;
         for(auto const c : digits)
             map_[static_cast<
                 unsigned char>(c)] = i++;
-        std::copy(map_.begin(), map_.end(), int_map_.begin());
     }
 
-    unsigned int const* dmap_data() const{
-        return int_map_.data();
+    digit_rows const& rows() const{
+        return rows_;
     };
 
     int
@@ -52,8 +141,293 @@ public:
     }
 };
 
+/**
+   The alphabets known at compile time. Their digit_rows are built by the
+   compiler, so the decoders that take the alphabet as a template parameter
+   don't build or look up any table at run time.
+*/
+enum class alphabet
+{
+    ripple,
+    bitcoin
+};
+
+template <alphabet Alphabet>
+struct alphabet_traits;
+
+template <>
+struct alphabet_traits<alphabet::ripple>
+{
+    static constexpr char const*
+    digits()
+    {
+        return "rpshnaf39wBUDNEGHJKLM4PQRST7VWXYZ2bcdeCg65jkm8oFqi1tuvAxyz";
+    }
+};
+
+template <>
+struct alphabet_traits<alphabet::bitcoin>
+{
+    static constexpr char const*
+    digits()
+    {
+        return "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+    }
+};
+
+template <alphabet Alphabet>
+struct alphabet_rows
+{
+    static_assert(
+        digit_rows::fits(alphabet_traits<Alphabet>::digits()),
+        "the alphabet must be in the chars 0x30 to 0x7f");
+    static constexpr digit_rows rows{alphabet_traits<Alphabet>::digits()};
+};
+
+template <alphabet Alphabet>
+constexpr digit_rows alphabet_rows<Alphabet>::rows;
+
 static InverseAlphabet rippleInverse(rippleAlphabet);
 
+// The scalar variant of base58_8_coeff, for cpus without sse4.1
+inline
+int
+base58_8_coeff_ref(
+    unsigned char const* in,
+    std::uint64_t* out,
+    unsigned char const* rows)
+{
+    int const n = 44;
+
+    // convert from base58 to base 58^8; All values will fit in a 64-bit
+    // uint without overflow
+    std::array<std::uint64_t, 8> b588_powers{0x1,
+                                             0x3A,
+                                             0xD24,
+                                             0x2FA28,
+                                             0xACAD10,
+                                             0x271F35A0,
+                                             0x8DD122640,
+                                             0x202161CAA80};
+    int i = 0;
+    int b588i = 0;
+    unsigned int bad = 0;
+    while (1)
+    {
+        auto const count = std::min(8, n - i);
+        std::uint64_t s = 0;
+        for (int j = 0; j < count; ++j, ++i)
+        {
+            auto const val = lookup_digit(rows, in[n - i - 1]);
+            bad |= val;
+            s += b588_powers[j] * val;  // big endian
+        }
+        out[b588i] = s;
+        if (i >= n)
+        {
+            assert(i == n);
+            // digits are at most 57, so only the bad value 0xff sets the high
+            // bits
+            return (bad & 0xc0) == 0;
+        }
+        ++b588i;
+    }
+}
+
+inline
+auto
+base58_8_coeff_for(cpu::isa level)
+{
+    // indexed by cpu::isa
+    static decltype(&base58_8_coeff_ref) const table[] = {
+        base58_8_coeff_ref,
+        base58_8_coeff_sse41,
+        base58_8_coeff_avx2,
+        base58_8_coeff_avx512,
+        // vbmi adds nothing the coefficient kernel can use
+        base58_8_coeff_avx512,
+    };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) ==
+            static_cast<int>(cpu::isa::num_isa),
+        "one variant per isa");
+    return table[static_cast<int>(level)];
+}
+
+/**
+   Convert 44 base58 digits into 6 base 58^8 coefficients, least significant
+   first, using the best variant the cpu supports. Returns 1, or 0 if any char
+   is not a digit of the alphabet, in which case the coefficients are garbage.
+*/
+inline
+int
+base58_8_coeff(
+    unsigned char const* in,
+    std::uint64_t* out,
+    digit_rows const& rows)
+{
+    return base58_8_coeff_for(cpu::active_isa())(in, out, rows.data());
+}
+
+// The scalar variant of base58_10_coeff_x8, for cpus without avx2
+inline
+int
+base58_10_coeff_x8_ref(
+    unsigned char const* const* in,
+    std::uint64_t* out,
+    unsigned char const* rows)
+{
+    int bad_mask = 0;
+    for (int a = 0; a < 8; ++a)
+    {
+        // The first coefficient is the first four digits, and the others ten
+        // digits each
+        unsigned int bad = 0;
+        int i = 0;
+        for (int k = 4; k >= 0; --k)
+        {
+            int const count = k == 4 ? 4 : 10;
+            std::uint64_t s = 0;
+            for (int j = 0; j < count; ++j, ++i)
+            {
+                auto const val = lookup_digit(rows, in[a][i]);
+                bad |= val;
+                s = 58 * s + val;
+            }
+            out[8 * k + a] = s;
+        }
+        // digits are at most 57, so only the bad value 0xff sets the high
+        // bits
+        if (bad & 0xc0)
+            bad_mask |= 1 << a;
+    }
+    return bad_mask;
+}
+
+inline
+auto
+base58_10_coeff_x8_for(cpu::isa level)
+{
+    // indexed by cpu::isa
+    static decltype(&base58_10_coeff_x8_ref) const table[] = {
+        base58_10_coeff_x8_ref,
+        // without avx2 there is no vpmovzxbd to ymm or 8 lanes of dwords
+        base58_10_coeff_x8_ref,
+        base58_10_coeff_x8_avx2,
+        // 16 strings at a time would need a batch size of 16
+        base58_10_coeff_x8_avx2,
+        base58_10_coeff_x8_avx2,
+    };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) ==
+            static_cast<int>(cpu::isa::num_isa),
+        "one variant per isa");
+    return table[static_cast<int>(level)];
+}
+
+/**
+   Convert 8 strings of 44 base58 digits into 5 base 58^10 coefficients each,
+   least significant first, using the best variant the cpu supports.
+   Coefficient k of string a is out[8 * k + a]. Returns a mask with bit a set
+   if string a has a char that is not a digit of the alphabet.
+*/
+inline
+int
+base58_10_coeff_x8(
+    unsigned char const* const* in,
+    std::uint64_t* out,
+    digit_rows const& rows)
+{
+    return base58_10_coeff_x8_for(cpu::active_isa())(in, out, rows.data());
+}
+
+// 58^(8k) for k = 0 to 5, as little endian 64-bit limbs
+static constexpr std::uint64_t b58_8_powers[6][4] = {
+    {0x1, 0x0, 0x0, 0x0},
+    {0x7479027EA100, 0x0, 0x0, 0x0},
+    {0x1DA26B26E1410000, 0x34FDE376, 0x0, 0x0},
+    {0x1C01D3A7E1000000, 0x17963A5226BD66DC, 0x181C, 0x0},
+    {0xFB7F528100000000, 0xF58B911D87035677, 0xAF820335D9B3D9C, 0x0},
+    {0xB061210000000000, 0xC19C48E628F6AF73, 0xE28ED5357BA4A062, 0x4FD9DF9DBF7}};
+
+// 58^(10k) for k = 0 to 4, as little endian 64-bit limbs
+static constexpr std::uint64_t b58_10_powers[5][4] = {
+    {0x1, 0x0, 0x0, 0x0},
+    {0x5FA8624C7FBA400, 0x0, 0x0, 0x0},
+    {0x9AAF505301100000, 0x23BE67B5F0F288, 0x0, 0x0},
+    {0x1CEAA75E40000000, 0x6D5A3847EC548C47, 0xD5B2B2A25E00, 0x0},
+    {0xB061210000000000, 0xC19C48E628F6AF73, 0xE28ED5357BA4A062, 0x4FD9DF9DBF7}};
+
+/**
+   Sum the products of the coefficients and their powers into a 256-bit
+   result, as little endian 64-bit limbs. Returns the carry out of the top
+   limb, which is not zero if the sum does not fit in 256 bits.
+
+   @note: This replaces the multiprecision reduction. The result is summed a
+   column of limbs at a time: the low halves of the 64x64->128 bit products go
+   in the column, and the high halves in the next one. The products are
+   independent of each other, there are no branches, and the multiplications
+   by the zero limbs of the powers fold away since the tables are constants.
+   Every column sum fits in 128 bits since the coefficients are less than
+   2^60.
+*/
+template <std::size_t Coeffs>
+inline
+std::uint64_t
+reduce_base58_limbs(
+    std::array<std::uint64_t, Coeffs> const& coeffs,
+    std::uint64_t const (&powers)[Coeffs][4],
+    std::array<std::uint64_t, 4>& limbs)
+{
+    unsigned __int128 carry = 0;
+    for (int j = 0; j < 4; ++j)
+    {
+        unsigned __int128 col = carry;
+        unsigned __int128 next = 0;
+        for (std::size_t k = 0; k < Coeffs; ++k)
+        {
+            auto const p = static_cast<unsigned __int128>(coeffs[k]) * powers[k][j];
+            col += static_cast<std::uint64_t>(p);
+            next += static_cast<std::uint64_t>(p >> 64);
+        }
+        limbs[j] = static_cast<std::uint64_t>(col);
+        carry = (col >> 64) + next;
+    }
+    return static_cast<std::uint64_t>(carry);
+}
+
+/**
+   Write 256-bit little endian limbs to 32 bytes of out, big endian.
+
+   @note: Like the export_bits this replaces, the value is written without its
+   leading zero bytes and the rest of out is zero filled, the same layout as
+   decode_base58_bitcoin.
+*/
+inline
+void
+store_limbs_be(std::array<std::uint64_t, 4> const& limbs, unsigned char* out)
+{
+    unsigned char be[32];
+    for (int i = 0; i < 4; ++i)
+    {
+        std::uint64_t const limb = __builtin_bswap64(limbs[3 - i]);
+        memcpy(be + 8 * i, &limb, 8);
+    }
+
+    int zero_bytes = 0;
+    for (int i = 3; i >= 0; --i)
+    {
+        if (limbs[i])
+        {
+            zero_bytes += __builtin_clzll(limbs[i]) / 8;
+            break;
+        }
+        zero_bytes += 8;
+    }
+    memcpy(out, be + zero_bytes, 32 - zero_bytes);
+    memset(out + 32 - zero_bytes, 0, zero_bytes);
+}
+
 /**
    Decode a 256-bit base58 number.
 
@@ -66,13 +440,182 @@ static InverseAlphabet rippleInverse(rippleAlphabet);
    bit number. This base 58^10 is then decoded into a 256-bit result. This
    reduces the number of multiplications and additions that happen in non-native
    bit lengths.
+
+   Returns false if there is a bad digit or the value does not fit in 256 bits.
+   An overflow is the carry out of the reduction, so a hostile input costs the
+   same as any other: there is no exception to unwind. The contents of out are
+   unspecified when this returns false.
 */
+inline
 bool
 decode_base58_ref(
     unsigned char const* in,
     int n,
     unsigned char* out,
     InverseAlphabet const& alphabet)
+{
+    assert(n == 44);
+
+    std::array<std::uint64_t, 5> b5810{};
+    {
+        // convert from base58 to base 58^10; All values will fit in a 64-bit
+        // uint without overflow
+        std::array<std::uint64_t, 10> b5810_powers{0x1,
+                                                   0x3A,
+                                                   0xD24,
+                                                   0x2FA28,
+                                                   0xACAD10,
+                                                   0x271F35A0,
+                                                   0x8DD122640,
+                                                   0x202161CAA80,
+                                                   0x7479027EA100,
+                                                   0x1A636A90B07A00};
+        int i = 0;
+        int b5810i = 0;
+        while (1)
+        {
+            auto const count = std::min(10, n - i);
+            std::uint64_t s = 0;
+            for (int j = 0; j < count; ++j, ++i)
+            {
+                auto const val = alphabet[in[n - i - 1]];
+                if (val  == 0xff)
+                    return false;
+                s += b5810_powers[j] * val;  // big endian
+            }
+            b5810[b5810i] = s;
+            if (i >= n)
+            {
+                assert(i == n);
+                break;
+            }
+            ++b5810i;
+        }
+    };
+
+    std::array<std::uint64_t, 4> limbs;
+    auto const carry = reduce_base58_limbs(b5810, b58_10_powers, limbs);
+    store_limbs_be(limbs, out);
+    return carry == 0;
+}
+
+/**
+   Decode a 256-bit base58 number, computing the base 58^8 coefficients with
+   the simd kernel for the active isa. rows are the digits of the alphabet.
+
+   Returns false if there is a bad digit or the value does not fit in 256
+   bits, the same way as decode_base58_ref, so it is safe on untrusted input.
+*/
+inline
+bool
+decode_base58_asm(
+    unsigned char const* in,
+    int n,
+    unsigned char* out,
+    digit_rows const& rows)
+{
+    assert(n == 44);
+
+    std::array<std::uint64_t, 6> b588{};
+    if (!base58_8_coeff(in, &b588[0], rows))
+        return false;
+
+    std::array<std::uint64_t, 4> limbs;
+    auto const carry = reduce_base58_limbs(b588, b58_8_powers, limbs);
+    store_limbs_be(limbs, out);
+    return carry == 0;
+}
+
+inline
+bool
+decode_base58_asm(
+    unsigned char const* in,
+    int n,
+    unsigned char* out,
+    InverseAlphabet const& alphabet)
+{
+    return decode_base58_asm(in, n, out, alphabet.rows());
+}
+
+// decode_base58_asm for an alphabet known at compile time
+template <alphabet Alphabet>
+bool
+decode_base58_asm(unsigned char const* in, int n, unsigned char* out)
+{
+    return decode_base58_asm(in, n, out, alphabet_rows<Alphabet>::rows);
+}
+
+/**
+   Decode n 256-bit base58 numbers of 44 digits each. The result of in[i] is
+   the 32 bytes at out + 32 * i, and ok[i] is false if it has a bad digit or
+   does not fit in 256 bits, the same as the result of decode_base58_asm.
+   Returns the number of good results.
+
+   @note: The strings are decoded 8 at a time with one string in each lane,
+   so the coefficients are accumulated with vertical simd operations only
+   (see base58_10_coeff_x8). The reduction of each string's coefficients to
+   256 bits is the scalar reduce_base58_limbs: the 64x64->128 bit products it
+   needs have no simd equivalent below avx512 ifma.
+*/
+inline
+std::size_t
+decode_base58_batch(
+    unsigned char const* const* in,
+    std::size_t n,
+    unsigned char* out,
+    bool* ok,
+    digit_rows const& rows)
+{
+    std::size_t num_ok = 0;
+    for (std::size_t first = 0; first < n; first += 8)
+    {
+        std::size_t const count = std::min<std::size_t>(8, n - first);
+        // the lanes past the end of a short batch decode the first string
+        // again, and their results are dropped
+        unsigned char const* batch[8];
+        for (std::size_t a = 0; a < 8; ++a)
+            batch[a] = in[first + (a < count ? a : 0)];
+
+        std::uint64_t coeffs[5 * 8];
+        int const bad_mask = base58_10_coeff_x8(batch, coeffs, rows);
+
+        for (std::size_t a = 0; a < count; ++a)
+        {
+            std::array<std::uint64_t, 5> const b5810{
+                coeffs[a], coeffs[8 + a], coeffs[16 + a], coeffs[24 + a],
+                coeffs[32 + a]};
+            std::array<std::uint64_t, 4> limbs;
+            auto const carry = reduce_base58_limbs(b5810, b58_10_powers, limbs);
+            store_limbs_be(limbs, out + 32 * (first + a));
+            bool const good = carry == 0 && !(bad_mask & (1 << a));
+            ok[first + a] = good;
+            num_ok += good;
+        }
+    }
+    return num_ok;
+}
+
+inline
+std::size_t
+decode_base58_batch(
+    unsigned char const* const* in,
+    std::size_t n,
+    unsigned char* out,
+    bool* ok,
+    InverseAlphabet const& alphabet)
+{
+    return decode_base58_batch(in, n, out, ok, alphabet.rows());
+}
+
+// decode_base58_ref with the multiprecision reduction it used before
+// reduce_base58_limbs, kept to compare against
+inline
+bool
+decode_base58_ref_mp(
+    unsigned char const* in,
+    int n,
+    unsigned char* out,
+    InverseAlphabet const& alphabet)
 {
     using namespace boost::multiprecision;
 
@@ -140,8 +683,11 @@ decode_base58_ref(
     }
 }
 
+// decode_base58_asm with the multiprecision reduction it used before
+// reduce_base58_limbs, kept to compare against
+inline
 bool
-decode_base58_asm(
+decode_base58_asm_mp(
     unsigned char const* in,
     int n,
     unsigned char* out,
@@ -152,7 +698,7 @@ decode_base58_asm(
     assert(n == 44);
 
     std::array<std::uint64_t, 6> b588{};
-    base58_8_coeff(in, &b588[0], alphabet.dmap_data());
+    base58_8_coeff(in, &b588[0], alphabet.rows());
 
     static uint128_t const c58_8{"0x7479027EA100"};
     static uint128_t const c58_16{"0x34FDE3761DA26B26E1410000"};
@@ -170,6 +716,7 @@ decode_base58_asm(
     return true;
 }
 
+inline
 bool check_base58_8_coeff()
 {
     unsigned char const* in = reinterpret_cast<unsigned char const*>(
@@ -179,43 +726,11 @@ bool check_base58_8_coeff()
 
     assert(n==44);
 
-    std::array<std::uint64_t, 6> const c_coeff = [&] {
-        // convert from base58 to base 58^8; All values will fit in a 64-bit
-        // uint without overflow
-        std::array<std::uint64_t, 6> result{};
-        std::array<std::uint64_t, 8> b588_powers{0x1,
-                                                 0x3A,
-                                                 0xD24,
-                                                 0x2FA28,
-                                                 0xACAD10,
-                                                 0x271F35A0,
-                                                 0x8DD122640,
-                                                 0x202161CAA80};
-        int i = 0;
-        int b588i = 0;
-        while (1)
-        {
-            auto const count = std::min(8, n - i);
-            std::uint64_t s = 0;
-            for (int j = 0; j < count; ++j, ++i)
-            {
-                auto const val = alphabet[in[n - i - 1]];
-                // if (val  == 0xff)
-                //     return false;
-                s += b588_powers[j] * val;  // big endian
-            }
-            result[b588i] = s;
-            if (i >= n)
-            {
-                assert(i == n);
-                return result;
-            }
-            ++b588i;
-        }
-    }();
+    std::array<std::uint64_t, 6> c_coeff;
+    base58_8_coeff_ref(in, &c_coeff[0], alphabet.rows().data());
 
     std::array<std::uint64_t, 6> asm_coeff;
-    base58_8_coeff(in, &asm_coeff[0], alphabet.dmap_data());
+    base58_8_coeff(in, &asm_coeff[0], alphabet.rows());
 
     if (c_coeff != asm_coeff)
     {
@@ -246,63 +761,1223 @@ bool check_base58_8_coeff()
     return true;
 }
 
-
-// Code from Bitcoin: https://github.com/bitcoin/bitcoin
-// Copyright (c) 2014 The Bitcoin Core developers
-// Distributed under the MIT software license, see the accompanying
-// file COPYING or http://www.opensource.org/licenses/mit-license.php.
-//
-// Modified from the original
-bool
-decode_base58_bitcoin (unsigned char const* in,
-                       int n,
-                       unsigned char* out,
-                       InverseAlphabet const& inv)
+// Compare base58_8_coeff against the reference on random digits. A quarter
+// of the inputs have a char that is not a digit, at every position in turn.
+inline
+bool random_test_base58_8_coeff(int iterations)
 {
-    auto psz = in;
-    auto remain = n;
-    // Skip and count leading zeroes
-    int zeroes = 0;
-    while (remain > 0 && inv[*psz] == 0)
+    unsigned char val[44];
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_index(0, 57);
+    std::uniform_int_distribution<> rand_char(0, 255);
+
+    for (int i = 0; i < iterations; ++i)
     {
-        ++zeroes;
-        ++psz;
-        --remain;
-    }
-    // Allocate enough space in big-endian base256 representation.
-    // log(58) / log(256), rounded up.
-    boost::container::small_vector<unsigned char, 32> b256;
+        for (int j = 0; j < 44; ++j)
+            val[j] = rippleAlphabet[rand_index(gen)];
+        if (i % 4 == 0)
+        {
+            unsigned char c;
+            do
+            {
+                c = rand_char(gen);
+            } while (rippleInverse[c] != 0xff);
+            val[(i / 4) % 44] = c;
+        }
+
+        std::array<std::uint64_t, 6> c_coeff;
+        auto const c_r =
+            base58_8_coeff_ref(val, &c_coeff[0], rippleInverse.rows().data());
+        std::array<std::uint64_t, 6> asm_coeff;
+        auto const asm_r =
+            base58_8_coeff(val, &asm_coeff[0], rippleInverse.rows());
+        if (c_r != asm_r || c_r != (i % 4 != 0) ||
+            (c_r && c_coeff != asm_coeff))
+        {
+            std::cerr << "Mismatch on coeff after: " << i << " iterations.\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Check the compile-time digit rows of an alphabet against InverseAlphabet,
+// and decode_base58_asm with them against decode_base58_ref on random digits.
+template <alphabet Alphabet>
+bool random_test_alphabet_rows(int iterations)
+{
+    auto const digits = alphabet_traits<Alphabet>::digits();
+    InverseAlphabet const inverse(digits);
+    auto const& rows = alphabet_rows<Alphabet>::rows;
+
+    for (int c = 0; c < 256; ++c)
+    {
+        if (lookup_digit(rows.data(), c) !=
+            static_cast<unsigned int>(inverse[c] & 0xff))
+        {
+            std::cerr << "Mismatch on digit rows for char: " << c << '\n';
+            return false;
+        }
+    }
+
+    unsigned char val[44];
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_index(0, 57);
+    std::uniform_int_distribution<> rand_first(0, 3);
+    std::uniform_int_distribution<> rand_char(0, 255);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = 0; j < 44; ++j)
+            val[j] = digits[rand_index(gen)];
+        if (i % 2)
+            val[0] = digits[rand_first(gen)];
+        if (i % 8 == 1)
+            val[rand_index(gen) % 44] = rand_char(gen);
+
+        unsigned char out[32];
+        unsigned char out_asm[32];
+        auto const r = decode_base58_ref(val, 44, out, inverse);
+        auto const r_asm = decode_base58_asm<Alphabet>(val, 44, out_asm);
+        if (r != r_asm || (r && memcmp(out, out_asm, 32)))
+        {
+            std::cerr << "Mismatch on alphabet rows after: " << i
+                      << " iterations.\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Check that the digit rows leave out the chars outside 0x30 to 0x7f instead
+// of writing past the table, and that InverseAlphabet rejects an alphabet
+// with such a char
+inline
+bool
+check_alphabet_outside_rows()
+{
+    std::string digits(rippleAlphabet);
+    for (int const c : {0x01, 0x21, 0x2f, 0x80, 0xf5, 0xff})
+    {
+        digits.back() = static_cast<char>(c);
+        digit_rows const rows(digits.c_str());
+        if (digit_rows::fits(digits.c_str()) ||
+            lookup_digit(rows.data(), 'r') != 0 ||
+            lookup_digit(rows.data(), c) != 0xff)
+        {
+            std::cerr << "Mismatch on digit rows for char: " << c << '\n';
+            return false;
+        }
+        try
+        {
+            InverseAlphabet const inverse(digits);
+            std::cerr << "Alphabet with char " << c << " accepted\n";
+            return false;
+        }
+        catch (std::invalid_argument const&)
+        {
+        }
+    }
+    return true;
+}
+
+// Compare decode_base58_batch against decode_base58_ref on random batch
+// sizes, with some values that overflow and some bad chars
+inline
+bool random_test_decode_base58_batch(int iterations)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_index(0, 57);
+    std::uniform_int_distribution<> rand_first(0, 3);
+    std::uniform_int_distribution<> rand_char(0, 255);
+    std::uniform_int_distribution<> rand_n(0, 40);
+
+    std::vector<std::array<unsigned char, 44>> vals(40);
+    std::vector<unsigned char const*> in(40);
+    unsigned char out[40 * 32];
+    bool ok[40];
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        int const n = rand_n(gen);
+        for (int s = 0; s < n; ++s)
+        {
+            auto& val = vals[s];
+            for (auto& c : val)
+                c = rippleAlphabet[rand_index(gen)];
+            if (s % 2)
+                val[0] = rippleAlphabet[rand_first(gen)];
+            if (s % 8 == 3)
+                val[rand_index(gen) % 44] = rand_char(gen);
+            in[s] = val.data();
+        }
+
+        auto const num_ok = decode_base58_batch(in.data(), n, out, ok, rippleInverse);
+        std::size_t num_ref_ok = 0;
+        for (int s = 0; s < n; ++s)
+        {
+            unsigned char ref_out[32];
+            auto const r = decode_base58_ref(in[s], 44, ref_out, rippleInverse);
+            num_ref_ok += r;
+            if (r != ok[s] || (r && memcmp(ref_out, out + 32 * s, 32)))
+            {
+                std::cerr << "Mismatch on batch decode after: " << i
+                          << " iterations, string: " << s << '\n';
+                return false;
+            }
+        }
+        if (num_ok != num_ref_ok)
+        {
+            std::cerr << "Mismatch on batch decode count after: " << i
+                      << " iterations.\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Compare the native reductions against the multiprecision one on random
+// digits. Most random 44 digit values don't fit in 256 bits, so half of the
+// values start with a small digit to check the values that do.
+inline
+bool random_test_reduce_base58(int iterations)
+{
+    unsigned char val[44];
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_index(0, 57);
+    std::uniform_int_distribution<> rand_first(0, 3);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = 0; j < 44; ++j)
+            val[j] = rippleAlphabet[rand_index(gen)];
+        if (i % 2)
+            val[0] = rippleAlphabet[rand_first(gen)];
+
+        unsigned char out[32];
+        unsigned char out_mp[32];
+        auto const r = decode_base58_ref(val, 44, out, rippleInverse);
+        auto const r_mp = decode_base58_ref_mp(val, 44, out_mp, rippleInverse);
+        if (r != r_mp || (r && memcmp(out, out_mp, 32)))
+        {
+            std::cerr << "Mismatch on ref reduction after: " << i
+                      << " iterations.\n";
+            return false;
+        }
+
+        // decode_base58_asm_mp truncates part of the sum to 128 bits, so
+        // the asm reduction is checked against the ref one
+        auto const r_asm = decode_base58_asm(val, 44, out_mp, rippleInverse);
+        if (r != r_asm || (r && memcmp(out, out_mp, 32)))
+        {
+            std::cerr << "Mismatch on asm reduction after: " << i
+                      << " iterations.\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Code from Bitcoin: https://github.com/bitcoin/bitcoin
+// Copyright (c) 2014 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Modified from the original
+inline
+bool
+decode_base58_bitcoin (unsigned char const* in,
+                       int n,
+                       unsigned char* out,
+                       InverseAlphabet const& inv)
+{
+    auto psz = in;
+    auto remain = n;
+    // Skip and count leading zeroes
+    int zeroes = 0;
+    while (remain > 0 && inv[*psz] == 0)
+    {
+        ++zeroes;
+        ++psz;
+        --remain;
+    }
+    // Allocate enough space in big-endian base256 representation.
+    // log(58) / log(256), rounded up.
+    boost::container::small_vector<unsigned char, 32> b256;
     b256.resize(remain * 733 / 1000 + 1);
     while (remain > 0)
     {
-        auto carry = inv[*psz];
-        if (carry == 255)
+        auto carry = inv[*psz];
+        if (carry == 255)
+            return false;
+        // Apply "b256 = b256 * 58 + carry".
+        for (auto iter = b256.rbegin();
+            iter != b256.rend(); ++iter)
+        {
+            carry += 58 * *iter;
+            *iter = carry % 256;
+            carry /= 256;
+        }
+        assert(carry == 0);
+        ++psz;
+        --remain;
+    }
+    // Skip leading zeroes in b256.
+    auto iter = std::find_if(
+        b256.begin(), b256.end(),[](unsigned char c)
+            { return c != 0; });
+    // hack: support 256 bit values only
+    memset((void*)out, 0, 32);
+    while (iter != b256.end())
+    {
+        *out++ = *iter++;
+    }
+    return true;
+}
+
+// Code from Bitcoin: https://github.com/bitcoin/bitcoin
+// Copyright (c) 2014 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// Modified from the original so it does not allocate. out must hold
+// n * 138 / 100 + 1 chars. Returns the number of chars written.
+inline
+int
+encode_base58_bitcoin(
+    unsigned char const* in,
+    int n,
+    char* out,
+    char const* alphabet)
+{
+    auto pbegin = in;
+    auto const pend = in + n;
+    // Skip & count leading zeroes.
+    int zeroes = 0;
+    int length = 0;
+    while (pbegin != pend && *pbegin == 0)
+    {
+        pbegin++;
+        zeroes++;
+    }
+    // Allocate enough space in big-endian base58 representation.
+    // log(256) / log(58), rounded up.
+    int const size = (pend - pbegin) * 138 / 100 + 1;
+    boost::container::small_vector<unsigned char, 45> b58(size);
+    // Process the bytes.
+    while (pbegin != pend)
+    {
+        int carry = *pbegin;
+        int i = 0;
+        // Apply "b58 = b58 * 256 + ch".
+        for (auto it = b58.rbegin();
+             (carry != 0 || i < length) && (it != b58.rend());
+             it++, i++)
+        {
+            carry += 256 * (*it);
+            *it = carry % 58;
+            carry /= 58;
+        }
+
+        assert(carry == 0);
+        length = i;
+        pbegin++;
+    }
+    // Skip leading zeroes in base58 result.
+    auto it = b58.begin() + (size - length);
+    while (it != b58.end() && *it == 0)
+        it++;
+    // Translate the result into a string.
+    auto const start = out;
+    out = std::fill_n(out, zeroes, alphabet[0]);
+    while (it != b58.end())
+        *out++ = alphabet[*(it++)];
+    return out - start;
+}
+
+/**
+   Divide a big endian number of count 64-bit limbs, most significant first,
+   in place by 58^10 and return the remainder.
+
+   Each step divides a two limb number by 58^10 with a multiplication by a
+   precomputed reciprocal (Moller and Granlund, "Improved division by
+   invariant integers"), instead of a div instruction or a byte at a time
+   long division. The divisor is shifted left so its top bit is set, and the
+   dividend is shifted along with it.
+*/
+inline
+std::uint64_t
+divmod_58_10(std::uint64_t* limbs, int count)
+{
+    using uint128 = unsigned __int128;
+    // 58^10 << 5
+    constexpr std::uint64_t d = 0xBF50C498FF748000;
+    constexpr int shift = 5;
+    // floor((2^128 - 1) / d) - 2^64
+    constexpr std::uint64_t v = 0x568DF8B76CBF212C;
+
+    std::uint64_t r = limbs[0] >> (64 - shift);
+    for (int i = 0; i < count; ++i)
+    {
+        std::uint64_t const next = i + 1 < count ? limbs[i + 1] : 0;
+        std::uint64_t const u0 = (limbs[i] << shift) | (next >> (64 - shift));
+
+        // r < d, so the quotient fits in one limb
+        uint128 const p = static_cast<uint128>(v) * r +
+            ((static_cast<uint128>(r) << 64) | u0);
+        std::uint64_t q = static_cast<std::uint64_t>(p >> 64) + 1;
+        r = u0 - q * d;
+        if (r > static_cast<std::uint64_t>(p))
+        {
+            --q;
+            r += d;
+        }
+        if (r >= d)
+        {
+            ++q;
+            r -= d;
+        }
+        limbs[i] = q;
+    }
+    return r >> shift;
+}
+
+/**
+   Write the ten base58 digits of a value less than 58^10 to out, most
+   significant first. The value is split into two halves less than 58^5, so
+   the divisions by 58 are 32-bit multiplications.
+*/
+inline
+void
+base58_10_digits(std::uint64_t val, char* out, char const* alphabet)
+{
+    constexpr std::uint32_t b58_5 = 656356768;  // 58^5
+    std::uint32_t hi = static_cast<std::uint32_t>(val / b58_5);
+    std::uint32_t lo = static_cast<std::uint32_t>(val % b58_5);
+    for (int i = 4; i >= 0; --i)
+    {
+        out[5 + i] = alphabet[lo % 58];
+        lo /= 58;
+        out[i] = alphabet[hi % 58];
+        hi /= 58;
+    }
+}
+
+/**
+   Encode n bytes as base58. Returns the number of chars written; out must
+   hold n * 138 / 100 + 1 chars.
+
+   @note: This is the decoder's base 58^10 idea in reverse. The value is
+   loaded into 64-bit limbs and repeatedly divided by 58^10 with reciprocal
+   multiplication, which gives the number in base 58^10, least significant
+   coefficient first. Each coefficient then expands into ten digits. A 256-bit
+   value is five divisions of at most four limbs, instead of one division by
+   58 per byte for every digit already produced.
+*/
+inline
+int
+encode_base58(
+    unsigned char const* in,
+    int n,
+    char* out,
+    char const* alphabet)
+{
+    // Leading zero bytes are encoded as leading zero digits, one each
+    int zeroes = 0;
+    while (zeroes < n && in[zeroes] == 0)
+        ++zeroes;
+    in += zeroes;
+    n -= zeroes;
+    auto const start = out;
+    out = std::fill_n(out, zeroes, alphabet[0]);
+    if (!n)
+        return out - start;
+
+    // big endian limbs, most significant first. The first limb holds the
+    // bytes left over from a multiple of eight.
+    int const num_limbs = (n + 7) / 8;
+    boost::container::small_vector<std::uint64_t, 4> limbs(num_limbs);
+    for (int i = 0, limb = (8 - n % 8) % 8; i < n; ++i, ++limb)
+        limbs[limb / 8] = (limbs[limb / 8] << 8) | in[i];
+
+    // base 58^10 coefficients, least significant first
+    boost::container::small_vector<std::uint64_t, 5> b5810;
+    int first = 0;
+    while (first < num_limbs)
+    {
+        b5810.push_back(divmod_58_10(&limbs[first], num_limbs - first));
+        while (first < num_limbs && !limbs[first])
+            ++first;
+    }
+
+    // The most significant coefficient is not zero, but its leading digits
+    // may be. The others have exactly ten digits.
+    char top[10];
+    base58_10_digits(b5810.back(), top, alphabet);
+    auto const top_begin =
+        std::find_if(top, top + 10, [&](char c) { return c != alphabet[0]; });
+    out = std::copy(top_begin, top + 10, out);
+    for (int i = static_cast<int>(b5810.size()) - 2; i >= 0; --i, out += 10)
+        base58_10_digits(b5810[i], out, alphabet);
+    return out - start;
+}
+
+// Compare encode_base58 against the bitcoin encoder on random lengths, with
+// random runs of leading zero bytes
+inline
+bool
+random_test_encode_base58(int iterations)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_len(0, 80);
+    std::uniform_int_distribution<> rand_zeroes(0, 3);
+    std::uniform_int_distribution<> rand255(0, 255);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        // half of the values are 256-bit
+        int const n = rand255(gen) & 1 ? 32 : rand_len(gen);
+        std::string val(n, 0);
+        int const zeroes = std::min(n, rand_zeroes(gen));
+        for (int j = zeroes; j < n; ++j)
+            val[j] = rand255(gen);
+
+        auto const in = reinterpret_cast<unsigned char const*>(val.data());
+        std::string bitcoin_out(n * 138 / 100 + 1, 0);
+        std::string fast_out(n * 138 / 100 + 1, 0);
+        bitcoin_out.resize(
+            encode_base58_bitcoin(in, n, &bitcoin_out[0], rippleAlphabet));
+        fast_out.resize(encode_base58(in, n, &fast_out[0], rippleAlphabet));
+        if (bitcoin_out != fast_out)
+        {
+            std::cerr << "Mismatch encoding: ";
+            print_it(val.data(), n, true);
+            std::cerr << "\nbitcoin: " << bitcoin_out << "\n   fast: " << fast_out
+                      << "\nFailed after: " << i << " iterations.\n";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Same as decode_base58_bitcoin, but for any length: out gets the leading
+// zero bytes and the bytes of the value, like the original. Returns the
+// number of bytes written, or -1 if there is a bad digit or the result does
+// not fit in out_size bytes.
+inline
+int
+decode_base58_bitcoin(
+    unsigned char const* in,
+    int n,
+    unsigned char* out,
+    int out_size,
+    InverseAlphabet const& inv)
+{
+    auto psz = in;
+    auto remain = n;
+    // Skip and count leading zeroes
+    int zeroes = 0;
+    while (remain > 0 && inv[*psz] == 0)
+    {
+        ++zeroes;
+        ++psz;
+        --remain;
+    }
+    // Allocate enough space in big-endian base256 representation.
+    // log(58) / log(256), rounded up.
+    boost::container::small_vector<unsigned char, 48> b256;
+    b256.resize(remain * 733 / 1000 + 1);
+    while (remain > 0)
+    {
+        auto carry = inv[*psz];
+        if (carry == 255)
+            return -1;
+        // Apply "b256 = b256 * 58 + carry".
+        for (auto iter = b256.rbegin(); iter != b256.rend(); ++iter)
+        {
+            carry += 58 * *iter;
+            *iter = carry % 256;
+            carry /= 256;
+        }
+        assert(carry == 0);
+        ++psz;
+        --remain;
+    }
+    // Skip leading zeroes in b256.
+    auto iter = std::find_if(
+        b256.begin(), b256.end(), [](unsigned char c) { return c != 0; });
+    int const size = zeroes + (b256.end() - iter);
+    if (size > out_size)
+        return -1;
+    out = std::fill_n(out, zeroes, 0);
+    std::copy(iter, b256.end(), out);
+    return size;
+}
+
+// Value of count <= 10 base58 digits, or -1 if one of them is bad. The
+// digits are summed as two independent halves of up to five digits, which
+// halves the chain of dependent multiplies.
+inline
+std::int64_t
+base58_group(
+    unsigned char const* in,
+    int count,
+    InverseAlphabet const& alphabet)
+{
+    constexpr std::int64_t b58_5 = 656356768;  // 58^5
+    int const split = count > 5 ? count - 5 : 0;
+    std::int64_t hi = 0;
+    std::int64_t lo = 0;
+    int bad = 0;
+    for (int i = 0; i < split; ++i)
+    {
+        auto const val = alphabet[in[i]];
+        bad |= val;
+        hi = 58 * hi + val;
+    }
+    for (int i = split; i < count; ++i)
+    {
+        auto const val = alphabet[in[i]];
+        bad |= val;
+        lo = 58 * lo + val;
+    }
+    // digits are at most 57, so only the bad value 0xff sets the high bits
+    if (bad & 0xc0)
+        return -1;
+    return hi * b58_5 + lo;
+}
+
+/**
+   Multiply a little endian number of count 64-bit limbs by m and add c, in
+   place. Returns the limb that carries out of the top.
+*/
+inline
+std::uint64_t
+mul_add_limbs(std::uint64_t* limbs, int count, std::uint64_t m, std::uint64_t c)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        auto const p = static_cast<unsigned __int128>(limbs[i]) * m + c;
+        limbs[i] = static_cast<std::uint64_t>(p);
+        c = static_cast<std::uint64_t>(p >> 64);
+    }
+    return c;
+}
+
+// Number of bytes in the value of the little endian limbs, without leading
+// zeros
+template <std::size_t Limbs>
+int
+significant_bytes(std::array<std::uint64_t, Limbs> const& limbs)
+{
+    for (int i = Limbs - 1; i >= 0; --i)
+    {
+        if (limbs[i])
+            return 8 * i + (64 - __builtin_clzll(limbs[i]) + 7) / 8;
+    }
+    return 0;
+}
+
+// Write the low size bytes of the little endian limbs to out, big endian
+template <std::size_t Limbs>
+void
+limbs_to_bytes(
+    std::array<std::uint64_t, Limbs> const& limbs,
+    unsigned char* out,
+    int size)
+{
+    for (int i = 0; i < size; ++i)
+    {
+        int const k = size - 1 - i;
+        out[i] = limbs[k / 8] >> (8 * (k % 8));
+    }
+}
+
+/**
+   Decode n base58 digits in the bitcoin format: each leading zero digit is a
+   zero byte, and the other digits are the big endian bytes of their value,
+   without leading zeros. Returns the number of bytes written to out, or -1 if
+   there is a bad digit, there are more than MaxDigits digits, or the result
+   does not fit in out_size bytes.
+
+   @note: This is decode_base58_ref for any length. The digits are grouped
+   into base 58^10 coefficients, most significant first, and each one is
+   multiplied into the 64-bit limbs of the result. Only the limbs in use are
+   multiplied, so short values are cheap. MaxDigits sets the size of the
+   limb buffer on the stack.
+*/
+template <int MaxDigits = 64>
+int
+decode_base58(
+    unsigned char const* in,
+    int n,
+    unsigned char* out,
+    int out_size,
+    InverseAlphabet const& alphabet)
+{
+    constexpr std::uint64_t b58_10 = 0x5FA8624C7FBA400;  // 58^10
+    // a base58 digit is less than 5.86 bits. Round up both the bits and the
+    // limbs.
+    constexpr std::size_t num_limbs = (MaxDigits * 586 + 6399) / 6400;
+
+    if (n > MaxDigits)
+        return -1;
+    int zeroes = 0;
+    while (zeroes < n && alphabet[in[zeroes]] == 0)
+        ++zeroes;
+    in += zeroes;
+    n -= zeroes;
+
+    std::array<std::uint64_t, num_limbs> limbs{};
+    int used = 0;
+    // the first group has the digits left over from a multiple of ten
+    for (int i = 0, group = n % 10 ? n % 10 : 10; i < n; i += group, group = 10)
+    {
+        auto const s = base58_group(in + i, group, alphabet);
+        if (s < 0)
+            return -1;
+        auto const carry = mul_add_limbs(&limbs[0], used, b58_10, s);
+        if (carry)
+        {
+            if (used == static_cast<int>(num_limbs))
+                return -1;
+            limbs[used++] = carry;
+        }
+    }
+
+    int const size = zeroes + significant_bytes(limbs);
+    if (size > out_size)
+        return -1;
+    std::fill_n(out, zeroes, 0);
+    limbs_to_bytes(limbs, out + zeroes, size - zeroes);
+    return size;
+}
+
+/**
+   decode_base58 for an output of exactly Bytes bytes. Returns false unless
+   the digits are the bitcoin encoding of a Bytes byte value.
+
+   This is the fast path for the common widths: 20 bytes (account IDs), 32
+   (hashes and private keys) and 33 (public keys). The digits are padded to
+   a whole number of groups, so the number of groups and limbs is known at
+   compile time and the compiler unrolls the loops.
+*/
+template <int Bytes>
+bool
+decode_base58_fixed(
+    unsigned char const* in,
+    int n,
+    unsigned char* out,
+    InverseAlphabet const& alphabet)
+{
+    constexpr std::uint64_t b58_5 = 656356768;          // 58^5
+    constexpr std::uint64_t b58_10 = 0x5FA8624C7FBA400;  // 58^10
+    constexpr std::size_t num_limbs = (Bytes + 7) / 8;
+    // log(256) / log(58), rounded up
+    constexpr int max_digits = Bytes * 138 / 100 + 1;
+    constexpr int num_groups = (max_digits + 9) / 10;
+
+    if (n > max_digits)
+        return false;
+    int zeroes = 0;
+    while (zeroes < n && alphabet[in[zeroes]] == 0)
+        ++zeroes;
+
+    // The digit values, aligned to the end of a buffer of whole groups. The
+    // zero digits in front don't change the value, and every group is ten
+    // digits at a fixed offset.
+    unsigned char vals[10 * num_groups] = {};
+    int bad = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        auto const val = alphabet[in[i]];
+        bad |= val;
+        vals[10 * num_groups - n + i] = val;
+    }
+    // digits are at most 57, so only the bad value 0xff sets the high bits
+    if (bad & 0xc0)
+        return false;
+
+    std::array<std::uint64_t, num_limbs> limbs{};
+    for (int g = 0; g < num_groups; ++g)
+    {
+        std::uint64_t hi = 0;
+        std::uint64_t lo = 0;
+        for (int j = 0; j < 5; ++j)
+        {
+            hi = 58 * hi + vals[10 * g + j];
+            lo = 58 * lo + vals[10 * g + 5 + j];
+        }
+        if (mul_add_limbs(&limbs[0], num_limbs, b58_10, hi * b58_5 + lo))
+            return false;
+    }
+
+    if (zeroes + significant_bytes(limbs) != Bytes)
+        return false;
+    std::fill_n(out, zeroes, 0);
+    limbs_to_bytes(limbs, out + zeroes, Bytes - zeroes);
+    return true;
+}
+
+/**
+   The kinds of Base58Check tokens, by the version byte in front of their
+   payload. These are the ripple token types.
+*/
+enum class token_type : std::uint8_t
+{
+    account_id = 0,
+    node_public = 28,
+    family_seed = 33,
+    account_public = 35,
+};
+
+// Number of payload bytes in a token, without the version byte and checksum
+constexpr int
+payload_size(token_type type)
+{
+    switch (type)
+    {
+        case token_type::account_id:
+            return 20;
+        case token_type::node_public:
+        case token_type::account_public:
+            return 33;
+        case token_type::family_seed:
+            return 16;
+    }
+    return 0;
+}
+
+// The first four bytes of the double sha256 of the n bytes of in
+inline
+void
+base58check_checksum(unsigned char const* in, int n, unsigned char* out)
+{
+    unsigned char digest[32];
+    sha256::sha256d(in, n, digest);
+    memcpy(out, digest, 4);
+}
+
+/**
+   Encode the payload of a token of the given type: its version byte, the
+   payload_size(type) bytes of in and their checksum, in base58. Returns the
+   number of chars written; out must hold
+   (payload_size(type) + 5) * 138 / 100 + 1 chars.
+*/
+inline
+int
+encode_base58check(
+    token_type type,
+    unsigned char const* in,
+    char* out,
+    char const* alphabet = rippleAlphabet)
+{
+    int const size = payload_size(type);
+    // the largest payload is 33 bytes
+    unsigned char buf[1 + 33 + 4];
+    buf[0] = static_cast<unsigned char>(type);
+    memcpy(buf + 1, in, size);
+    base58check_checksum(buf, 1 + size, buf + 1 + size);
+    return encode_base58(buf, size + 5, out, alphabet);
+}
+
+/**
+   Decode n base58 digits as a token of type Type, and write its
+   payload_size(Type) byte payload to out. Returns false if the digits are
+   not the encoding of a token of that size, or the version byte or checksum
+   don't match.
+
+   @note: The digits are decoded with decode_base58_fixed, since the size of
+   the token is known at compile time, and the checksum is sha256d with the
+   sha extensions if the cpu has them.
+*/
+template <token_type Type>
+bool
+decode_base58check(
+    unsigned char const* in,
+    int n,
+    unsigned char* out,
+    InverseAlphabet const& alphabet = rippleInverse)
+{
+    constexpr int size = payload_size(Type);
+    unsigned char buf[size + 5];
+    if (!decode_base58_fixed<size + 5>(in, n, buf, alphabet) ||
+        buf[0] != static_cast<unsigned char>(Type))
+        return false;
+
+    unsigned char checksum[4];
+    base58check_checksum(buf, 1 + size, checksum);
+    if (memcmp(checksum, buf + 1 + size, 4))
+        return false;
+    memcpy(out, buf + 1, size);
+    return true;
+}
+
+// decode_base58check for a type known at run time
+inline
+bool
+decode_base58check(
+    token_type type,
+    unsigned char const* in,
+    int n,
+    unsigned char* out,
+    InverseAlphabet const& alphabet = rippleInverse)
+{
+    switch (type)
+    {
+        case token_type::account_id:
+            return decode_base58check<token_type::account_id>(
+                in, n, out, alphabet);
+        case token_type::node_public:
+            return decode_base58check<token_type::node_public>(
+                in, n, out, alphabet);
+        case token_type::family_seed:
+            return decode_base58check<token_type::family_seed>(
+                in, n, out, alphabet);
+        case token_type::account_public:
+            return decode_base58check<token_type::account_public>(
+                in, n, out, alphabet);
+    }
+    return false;
+}
+
+/**
+   decode_base58check for n tokens of type Type. Token i is the lens[i]
+   digits at in[i], and its payload is written to
+   out + payload_size(Type) * i. ok[i] is set if token i is valid. Returns
+   the number of valid tokens.
+
+   @note: The checksums are computed 8 tokens at a time with sha256d_x8, so
+   without the sha extensions they go through the 8 lane avx2 kernel. The
+   lanes past the end of a short batch hash the first token again.
+*/
+template <token_type Type>
+std::size_t
+decode_base58check_batch(
+    unsigned char const* const* in,
+    int const* lens,
+    std::size_t n,
+    unsigned char* out,
+    bool* ok,
+    InverseAlphabet const& alphabet = rippleInverse)
+{
+    constexpr int size = payload_size(Type);
+    std::size_t num_ok = 0;
+    for (std::size_t first = 0; first < n; first += 8)
+    {
+        std::size_t const count = std::min<std::size_t>(8, n - first);
+        // zeroed so the tokens that don't decode hash defined bytes
+        unsigned char bufs[8][size + 5] = {};
+        bool decoded[8];
+        for (std::size_t a = 0; a < count; ++a)
+        {
+            decoded[a] = decode_base58_fixed<size + 5>(
+                             in[first + a], lens[first + a], bufs[a], alphabet) &&
+                bufs[a][0] == static_cast<unsigned char>(Type);
+        }
+
+        unsigned char const* batch[8];
+        for (std::size_t a = 0; a < 8; ++a)
+            batch[a] = bufs[a < count ? a : 0];
+        unsigned char digests[8 * 32];
+        sha256::sha256d_x8(batch, 1 + size, digests);
+
+        for (std::size_t a = 0; a < count; ++a)
+        {
+            bool const good =
+                decoded[a] && !memcmp(digests + 32 * a, bufs[a] + 1 + size, 4);
+            if (good)
+                memcpy(out + size * (first + a), bufs[a] + 1, size);
+            ok[first + a] = good;
+            num_ok += good;
+        }
+    }
+    return num_ok;
+}
+
+// Compare decode_base58 against the bitcoin decoder on the encodings of
+// random values with leading zero bytes, and on random digits, some with a
+// bad char
+inline
+bool
+random_test_decode_base58(int iterations)
+{
+    constexpr int widths[] = {20, 32, 33};
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_len(0, 40);
+    std::uniform_int_distribution<> rand_zeroes(0, 3);
+    std::uniform_int_distribution<> rand_index(0, 57);
+    std::uniform_int_distribution<> rand255(0, 255);
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        std::string digits;
+        if (i % 2)
+        {
+            // half of them are one of the fixed widths
+            int const n = rand255(gen) & 1 ? widths[rand255(gen) % 3]
+                                           : rand_len(gen);
+            std::string val(n, 0);
+            for (int j = std::min(n, rand_zeroes(gen)); j < n; ++j)
+                val[j] = rand255(gen);
+            digits.resize(n * 138 / 100 + 1);
+            digits.resize(encode_base58_bitcoin(
+                reinterpret_cast<unsigned char const*>(val.data()),
+                n,
+                &digits[0],
+                rippleAlphabet));
+        }
+        else
+        {
+            digits.resize(rand_len(gen) + rand_zeroes(gen));
+            for (auto& c : digits)
+                c = rippleAlphabet[rand_index(gen)];
+            if (!digits.empty() && !rand_zeroes(gen))
+                digits[rand255(gen) % digits.size()] = '0';
+        }
+
+        auto const in = reinterpret_cast<unsigned char const*>(digits.data());
+        int const n = digits.size();
+        // random output sizes, so some results don't fit
+        int const out_size = rand255(gen) % 48;
+        unsigned char bitcoin_out[48];
+        unsigned char fast_out[48];
+        auto const bcr =
+            decode_base58_bitcoin(in, n, bitcoin_out, out_size, rippleInverse);
+        auto const fr = decode_base58(in, n, fast_out, out_size, rippleInverse);
+        if (bcr != fr || (fr > 0 && memcmp(bitcoin_out, fast_out, fr)))
+        {
+            std::cerr << "Mismatch decoding: " << digits << " bitcoin: " << bcr
+                      << " fast: " << fr << '\n';
+            return false;
+        }
+
+        // the fixed width paths agree with the general one
+        auto check_fixed = [&](auto bytes, auto decode_fixed) {
+            unsigned char out[48];
+            int const r = decode_base58(in, n, fast_out, 48, rippleInverse);
+            bool const expected = r == decltype(bytes)::value;
+            bool const fixed_r = decode_fixed(in, n, out, rippleInverse);
+            if (fixed_r != expected ||
+                (fixed_r && memcmp(out, fast_out, decltype(bytes)::value)))
+            {
+                std::cerr << "Mismatch decoding " << decltype(bytes)::value
+                          << " bytes: " << digits << '\n';
+                return false;
+            }
+            return true;
+        };
+        if (!check_fixed(
+                std::integral_constant<int, 20>{}, decode_base58_fixed<20>) ||
+            !check_fixed(
+                std::integral_constant<int, 32>{}, decode_base58_fixed<32>) ||
+            !check_fixed(
+                std::integral_constant<int, 33>{}, decode_base58_fixed<33>))
+            return false;
+
+        // the limb buffers of small MaxDigits, with the largest values of
+        // each length below
+        auto check_max_digits = [&](auto max_digits, unsigned char const* in,
+                                    int n, int bcr) {
+            constexpr int max = decltype(max_digits)::value;
+            int const r = decode_base58<max>(in, n, fast_out, out_size,
+                                             rippleInverse);
+            if (r != (n > max ? -1 : bcr) ||
+                (r > 0 && memcmp(bitcoin_out, fast_out, r)))
+            {
+                std::cerr << "Mismatch decoding at most " << max
+                          << " digits: " << digits << '\n';
+                return false;
+            }
+            return true;
+        };
+        if (!check_max_digits(std::integral_constant<int, 11>{}, in, n, bcr) ||
+            !check_max_digits(std::integral_constant<int, 22>{}, in, n, bcr))
+            return false;
+
+        // all digits 'z', the largest value of their length
+        std::string const top(i % 24, rippleAlphabet[57]);
+        auto const top_in = reinterpret_cast<unsigned char const*>(top.data());
+        int const top_n = top.size();
+        auto const top_bcr = decode_base58_bitcoin(
+            top_in, top_n, bitcoin_out, out_size, rippleInverse);
+        if (!check_max_digits(
+                std::integral_constant<int, 11>{}, top_in, top_n, top_bcr) ||
+            !check_max_digits(
+                std::integral_constant<int, 22>{}, top_in, top_n, top_bcr))
+            return false;
+    }
+
+    return true;
+}
+
+// Check Base58Check against known tokens. Then check encode_base58check
+// against the bitcoin encoder and the portable sha256, and decode it with
+// decode_base58check and decode_base58check_batch, on random payloads. One
+// digit of every third token is changed, which must make it fail.
+inline
+bool
+random_test_base58check(int iterations)
+{
+    // the genesis account and its seed, from the passphrase "masterpassphrase"
+    {
+        unsigned char const account[20] = {
+            0xB5, 0xF7, 0x62, 0x79, 0x8A, 0x53, 0xD5, 0x43, 0xA0, 0x14,
+            0xCA, 0xF8, 0xB2, 0x97, 0xCF, 0xF8, 0xF2, 0xF9, 0x37, 0xE8};
+        unsigned char const seed[16] = {
+            0xDE, 0xDC, 0xE9, 0xCE, 0x67, 0xB4, 0x51, 0xD8,
+            0x52, 0xFD, 0x4E, 0x84, 0x6F, 0xCD, 0xE3, 0x1C};
+        std::string const account_str = "rHb9CJAWyB4rj91VRWn96DkukG4bwdtyTh";
+        std::string const seed_str = "snoPBrXtMeMyMHUVTgbuqAfg1SUTb";
+
+        char chars[64];
+        unsigned char payload[33];
+        auto const account_in =
+            reinterpret_cast<unsigned char const*>(account_str.data());
+        auto const seed_in =
+            reinterpret_cast<unsigned char const*>(seed_str.data());
+        if (std::string(
+                chars,
+                encode_base58check(token_type::account_id, account, chars)) !=
+                account_str ||
+            std::string(
+                chars,
+                encode_base58check(token_type::family_seed, seed, chars)) !=
+                seed_str ||
+            !decode_base58check<token_type::account_id>(
+                account_in, account_str.size(), payload) ||
+            memcmp(payload, account, 20) ||
+            !decode_base58check(
+                token_type::family_seed, seed_in, seed_str.size(), payload) ||
+            memcmp(payload, seed, 16) ||
+            decode_base58check<token_type::family_seed>(
+                account_in, account_str.size(), payload))
+        {
+            std::cerr << "Base58Check mismatch on the genesis account\n";
             return false;
-        // Apply "b256 = b256 * 58 + carry".
-        for (auto iter = b256.rbegin();
-            iter != b256.rend(); ++iter)
+        }
+    }
+
+    token_type const types[] = {
+        token_type::account_id,
+        token_type::node_public,
+        token_type::family_seed,
+        token_type::account_public};
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_type(0, 3);
+    std::uniform_int_distribution<> rand_byte(0, 255);
+    std::uniform_int_distribution<> rand_index(0, 57);
+
+    // the account IDs, to decode again as a batch
+    std::vector<std::string> batch;
+    std::vector<std::array<unsigned char, 20>> batch_payloads;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const type = types[rand_type(gen)];
+        int const size = payload_size(type);
+
+        unsigned char buf[1 + 33 + 4];
+        buf[0] = static_cast<unsigned char>(type);
+        for (int j = 0; j < size; ++j)
+            buf[1 + j] = rand_byte(gen);
+        unsigned char digest[32];
+        sha256::sha256_ref(buf, 1 + size, digest);
+        sha256::sha256_ref(digest, 32, digest);
+        memcpy(buf + 1 + size, digest, 4);
+
+        char expected[64];
+        auto const expected_size =
+            encode_base58_bitcoin(buf, size + 5, expected, rippleAlphabet);
+        char chars[64];
+        auto const chars_size = encode_base58check(type, buf + 1, chars);
+        if (chars_size != expected_size || memcmp(chars, expected, chars_size))
         {
-            carry += 58 * *iter;
-            *iter = carry % 256;
-            carry /= 256;
+            std::cerr << "encode_base58check mismatch, type: "
+                      << static_cast<int>(type) << '\n';
+            return false;
+        }
+
+        bool const changed = i % 3 == 0;
+        if (changed)
+        {
+            auto& c = chars[std::uniform_int_distribution<>(
+                0, chars_size - 1)(gen)];
+            char d;
+            do
+                d = rippleAlphabet[rand_index(gen)];
+            while (d == c);
+            c = d;
+        }
+
+        unsigned char payload[33];
+        auto const in = reinterpret_cast<unsigned char const*>(chars);
+        if (decode_base58check(type, in, chars_size, payload) == changed ||
+            (!changed && memcmp(payload, buf + 1, size)))
+        {
+            std::cerr << "decode_base58check mismatch, type: "
+                      << static_cast<int>(type) << " changed: " << changed
+                      << '\n';
+            return false;
+        }
+
+        if (type == token_type::account_id)
+        {
+            batch.emplace_back(chars, chars_size);
+            batch_payloads.emplace_back();
+            memcpy(batch_payloads.back().data(), buf + 1, 20);
+        }
+        // the same token with the other type of the same size
+        else if (
+            type != token_type::family_seed &&
+            decode_base58check(
+                type == token_type::node_public ? token_type::account_public
+                                                : token_type::node_public,
+                in,
+                chars_size,
+                payload))
+        {
+            std::cerr << "decode_base58check accepted the wrong type\n";
+            return false;
         }
-        assert(carry == 0);
-        ++psz;
-        --remain;
     }
-    // Skip leading zeroes in b256.
-    auto iter = std::find_if(
-        b256.begin(), b256.end(),[](unsigned char c)
-            { return c != 0; });
-    // hack: support 256 bit values only
-    memset((void*)out, 0, 32);
-    while (iter != b256.end())
+
+    std::vector<unsigned char const*> batch_in;
+    std::vector<int> batch_lens;
+    for (auto const& s : batch)
     {
-        *out++ = *iter++;
+        batch_in.push_back(reinterpret_cast<unsigned char const*>(s.data()));
+        batch_lens.push_back(s.size());
+    }
+    std::vector<unsigned char> out(20 * batch.size());
+    std::unique_ptr<bool[]> ok(new bool[batch.size()]);
+    decode_base58check_batch<token_type::account_id>(
+        batch_in.data(), batch_lens.data(), batch.size(), &out[0], ok.get());
+    for (std::size_t i = 0; i < batch.size(); ++i)
+    {
+        unsigned char payload[20];
+        bool const single = decode_base58check<token_type::account_id>(
+            batch_in[i], batch_lens[i], payload);
+        if (ok[i] != single ||
+            (single && memcmp(&out[20 * i], batch_payloads[i].data(), 20)))
+        {
+            std::cerr << "decode_base58check_batch mismatch at: " << i << '\n';
+            return false;
+        }
     }
     return true;
 }
 
+inline
 void test_base58()
 {
     int const iters = 1'000'000;
@@ -343,6 +2018,7 @@ void test_base58()
               << " Overflows: " << iters - num_success << '\n';
 }
 
+inline
 void
 benchmark_decode_base58()
 {
@@ -396,6 +2072,331 @@ benchmark_decode_base58()
         auto end = timer::now();
         std::cout << "    Dec asm: " << time_diff(start, end).count() << '\n';
     }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (!decode_base58_ref_mp(reinterpret_cast<unsigned char const*>(val), 44, out, rippleInverse))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << " Dec ref mp: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            decode_base58_asm_mp(reinterpret_cast<unsigned char const*>(val), 44, out, rippleInverse);
+        }
+        auto end = timer::now();
+        std::cout << " Dec asm mp: " << time_diff(start, end).count() << '\n';
+    }
+
+    // The largest digit everywhere, so every decode overflows
+    std::fill_n(val, 44, rippleAlphabet[57]);
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (decode_base58_ref(reinterpret_cast<unsigned char const*>(val), 44, out, rippleInverse))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "   Overflow ref: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (decode_base58_asm(reinterpret_cast<unsigned char const*>(val), 44, out, rippleInverse))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "   Overflow asm: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (decode_base58_ref_mp(reinterpret_cast<unsigned char const*>(val), 44, out, rippleInverse))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Overflow ref mp: " << time_diff(start, end).count() << '\n';
+    }
+}
+
+inline
+void
+benchmark_encode_base58()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    char out[45];
+    unsigned char val[32];
+    {
+        std::mt19937 gen;
+        std::uniform_int_distribution<> rand255(0, 255);
+        for (int i = 0; i < 32; ++i)
+            val[i] = rand255(gen);
+    }
+
+    int const iters = 1'000'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            // need if or optimizer will skip call
+            if (!encode_base58_bitcoin(val, 32, out, rippleAlphabet))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Enc bitcoin: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (!encode_base58(val, 32, out, rippleAlphabet))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "   Enc fast: " << time_diff(start, end).count() << '\n';
+    }
+}
+
+// Decode the encodings of 20, 32 and 33 byte values, with the bitcoin
+// decoder, decode_base58 and decode_base58_fixed
+inline
+void
+benchmark_decode_base58_widths()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    int const iters = 1'000'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    auto bench = [&](auto bytes, auto decode_fixed) {
+        constexpr int n_bytes = decltype(bytes)::value;
+        unsigned char val[n_bytes];
+        std::mt19937 gen;
+        std::uniform_int_distribution<> rand255(0, 255);
+        for (auto& c : val)
+            c = rand255(gen);
+        char digits[n_bytes * 138 / 100 + 1];
+        int const n = encode_base58(val, n_bytes, digits, rippleAlphabet);
+        auto const in = reinterpret_cast<unsigned char const*>(digits);
+        unsigned char out[n_bytes];
+
+        {
+            auto start = timer::now();
+            for (int i = 0; i < iters; ++i)
+            {
+                // need if or optimizer will skip call
+                if (decode_base58_bitcoin(in, n, out, n_bytes, rippleInverse) !=
+                    n_bytes)
+                    return;
+            }
+            auto end = timer::now();
+            std::cout << "Dec " << n_bytes
+                      << " bitcoin: " << time_diff(start, end).count() << '\n';
+        }
+
+        {
+            auto start = timer::now();
+            for (int i = 0; i < iters; ++i)
+            {
+                if (decode_base58(in, n, out, n_bytes, rippleInverse) !=
+                    n_bytes)
+                    return;
+            }
+            auto end = timer::now();
+            std::cout << "    Dec " << n_bytes
+                      << " var: " << time_diff(start, end).count() << '\n';
+        }
+
+        {
+            auto start = timer::now();
+            for (int i = 0; i < iters; ++i)
+            {
+                if (!decode_fixed(in, n, out, rippleInverse))
+                    return;
+            }
+            auto end = timer::now();
+            std::cout << "  Dec " << n_bytes
+                      << " fixed: " << time_diff(start, end).count() << '\n';
+        }
+    };
+
+    bench(std::integral_constant<int, 20>{}, decode_base58_fixed<20>);
+    bench(std::integral_constant<int, 32>{}, decode_base58_fixed<32>);
+    bench(std::integral_constant<int, 33>{}, decode_base58_fixed<33>);
+}
+
+inline
+void
+benchmark_decode_base58_batch()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    // A ledger's worth of addresses that all decode
+    int const num_strings = 1024;
+    std::vector<std::array<unsigned char, 44>> vals(num_strings);
+    std::vector<unsigned char const*> in(num_strings);
+    {
+        std::mt19937 gen;
+        std::uniform_int_distribution<> rand_index(0, 57);
+        std::uniform_int_distribution<> rand_first(0, 3);
+        for (int s = 0; s < num_strings; ++s)
+        {
+            for (auto& c : vals[s])
+                c = rippleAlphabet[rand_index(gen)];
+            vals[s][0] = rippleAlphabet[rand_first(gen)];
+            in[s] = vals[s].data();
+        }
+    }
+
+    std::vector<unsigned char> out(32 * num_strings);
+    std::unique_ptr<bool[]> ok(new bool[num_strings]);
+    int const iters = 1'000;
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            for (int s = 0; s < num_strings; ++s)
+            {
+                if (!decode_base58_asm(in[s], 44, &out[32 * s], rippleInverse))
+                    return;
+            }
+        }
+        auto end = timer::now();
+        std::cout << " Dec asm loop: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (decode_base58_batch(
+                    in.data(), num_strings, &out[0], ok.get(), rippleInverse) !=
+                num_strings)
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "    Dec batch: " << time_diff(start, end).count() << '\n';
+    }
+}
+
+
+// Decode account IDs with the checksum: the generic decoder with the
+// portable sha256, decode_base58check one at a time, and as a batch
+inline
+void
+benchmark_base58check()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    int const num_tokens = 1024;
+    std::vector<std::string> tokens(num_tokens);
+    std::vector<unsigned char const*> in(num_tokens);
+    std::vector<int> lens(num_tokens);
+    {
+        std::mt19937 gen;
+        std::uniform_int_distribution<> rand_byte(0, 255);
+        for (int t = 0; t < num_tokens; ++t)
+        {
+            unsigned char account[20];
+            for (auto& b : account)
+                b = rand_byte(gen);
+            char chars[64];
+            tokens[t].assign(
+                chars,
+                encode_base58check(token_type::account_id, account, chars));
+            in[t] = reinterpret_cast<unsigned char const*>(tokens[t].data());
+            lens[t] = tokens[t].size();
+        }
+    }
+
+    std::vector<unsigned char> out(20 * num_tokens);
+    std::unique_ptr<bool[]> ok(new bool[num_tokens]);
+    int const iters = 1'000;
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            for (int t = 0; t < num_tokens; ++t)
+            {
+                unsigned char buf[25];
+                unsigned char digest[32];
+                if (decode_base58(in[t], lens[t], buf, 25, rippleInverse) !=
+                    25)
+                    return;
+                sha256::sha256_ref(buf, 21, digest);
+                sha256::sha256_ref(digest, 32, digest);
+                if (memcmp(digest, buf + 21, 4))
+                    return;
+                memcpy(&out[20 * t], buf + 1, 20);
+            }
+        }
+        auto end = timer::now();
+        std::cout << "  Check ref: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            for (int t = 0; t < num_tokens; ++t)
+            {
+                if (!decode_base58check<token_type::account_id>(
+                        in[t], lens[t], &out[20 * t]))
+                    return;
+            }
+        }
+        auto end = timer::now();
+        std::cout << " Check loop: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (decode_base58check_batch<token_type::account_id>(
+                    in.data(), lens.data(), num_tokens, &out[0], ok.get()) !=
+                num_tokens)
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Check batch: " << time_diff(start, end).count() << '\n';
+    }
 }
 
 }
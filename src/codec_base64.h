@@ -0,0 +1,493 @@
+#pragma once
+
+#include "cpu_features.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// The avx2 kernels encode and decode whole blocks, and return how much of the
+// input they did; the rest is left to the portable code (see base64.asm)
+extern "C" std::size_t
+base64_encode_avx2(unsigned char const* in, std::size_t len, char* out);
+
+extern "C" std::size_t
+base64_encode_url_avx2(unsigned char const* in, std::size_t len, char* out);
+
+extern "C" std::size_t
+base64_decode_avx2(char const* in, std::size_t len, unsigned char* out);
+
+extern "C" std::size_t
+base64_decode_url_avx2(char const* in, std::size_t len, unsigned char* out);
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace codec {
+namespace base64 {
+
+/**
+   The two alphabets of RFC 4648: the standard one, and the url and filename
+   safe one, which has '-' and '_' in place of '+' and '/'.
+*/
+enum class alphabet : int
+{
+    standard = 0,
+    url,
+    num_alphabets
+};
+
+inline
+char const*
+digits(alphabet a)
+{
+    return a == alphabet::url
+        ? "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_"
+        : "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+}
+
+// The value of every char in the alphabet, and 0xff for the other chars
+inline
+unsigned char const*
+inverse(alphabet a)
+{
+    using table = std::array<unsigned char, 256>;
+    static std::array<table, 2> const tables = [] {
+        std::array<table, 2> t;
+        for (int i = 0; i < 2; ++i)
+        {
+            t[i].fill(0xff);
+            auto const d = digits(static_cast<alphabet>(i));
+            for (int v = 0; v < 64; ++v)
+                t[i][static_cast<unsigned char>(d[v])] = v;
+        }
+        return t;
+    }();
+    return tables[static_cast<int>(a)].data();
+}
+
+// The number of chars n bytes encode to, with or without the '=' padding
+constexpr std::size_t
+encoded_size(std::size_t n, bool pad = true)
+{
+    return pad ? (n + 2) / 3 * 4 : n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0);
+}
+
+// The most bytes n chars can decode to
+constexpr std::size_t
+max_decoded_size(std::size_t n)
+{
+    return n / 4 * 3 + (n % 4 > 1 ? n % 4 - 1 : 0);
+}
+
+/**
+   Encode n bytes into encoded_size(n, pad) chars. Returns the number of
+   chars written.
+*/
+inline
+std::size_t
+encode_base64_ref(
+    unsigned char const* in,
+    std::size_t n,
+    char* out,
+    alphabet a = alphabet::standard,
+    bool pad = true)
+{
+    auto const d = digits(a);
+    auto const start = out;
+    std::size_t i = 0;
+    for (; i + 3 <= n; i += 3)
+    {
+        std::uint32_t const v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        *out++ = d[v >> 18];
+        *out++ = d[(v >> 12) & 63];
+        *out++ = d[(v >> 6) & 63];
+        *out++ = d[v & 63];
+    }
+    if (auto const left = n - i)
+    {
+        std::uint32_t const v =
+            (in[i] << 16) | (left == 2 ? in[i + 1] << 8 : 0);
+        *out++ = d[v >> 18];
+        *out++ = d[(v >> 12) & 63];
+        if (left == 2)
+            *out++ = d[(v >> 6) & 63];
+        else if (pad)
+            *out++ = '=';
+        if (pad)
+            *out++ = '=';
+    }
+    return out - start;
+}
+
+/**
+   The number of chars before the padding, or -1 if the padding is wrong.
+   Input that is padded must be a whole number of 4 char groups, with one or
+   two '='. Input without padding can be any length but one more than a
+   multiple of 4.
+*/
+inline
+std::ptrdiff_t
+unpadded_size(char const* in, std::size_t n)
+{
+    std::size_t len = n;
+    if (len && in[len - 1] == '=')
+    {
+        if (n % 4)
+            return -1;
+        --len;
+        if (in[len - 1] == '=')
+            --len;
+    }
+    if (len % 4 == 1)
+        return -1;
+    return len;
+}
+
+/**
+   Decode n chars, with or without padding, into out, which must hold
+   max_decoded_size(n) bytes. Returns the number of bytes written, or -1 if
+   a char is not a digit of the alphabet, the padding is wrong, or the bits
+   past the last byte are not zero (so every value has exactly one
+   encoding).
+*/
+inline
+std::ptrdiff_t
+decode_base64_ref(
+    char const* in,
+    std::size_t n,
+    unsigned char* out,
+    alphabet a = alphabet::standard)
+{
+    auto const len = unpadded_size(in, n);
+    if (len < 0)
+        return -1;
+    auto const inv = inverse(a);
+    auto const start = out;
+    std::uint32_t v = 0;
+    unsigned bad = 0;
+    std::ptrdiff_t i = 0;
+    for (; i + 4 <= len; i += 4)
+    {
+        unsigned char const c[4] = {
+            inv[static_cast<unsigned char>(in[i])],
+            inv[static_cast<unsigned char>(in[i + 1])],
+            inv[static_cast<unsigned char>(in[i + 2])],
+            inv[static_cast<unsigned char>(in[i + 3])]};
+        bad |= c[0] | c[1] | c[2] | c[3];
+        v = (c[0] << 18) | (c[1] << 12) | (c[2] << 6) | c[3];
+        *out++ = v >> 16;
+        *out++ = v >> 8;
+        *out++ = v;
+    }
+    if (auto const left = len - i)
+    {
+        v = 0;
+        for (std::ptrdiff_t j = 0; j < left; ++j)
+        {
+            auto const c = inv[static_cast<unsigned char>(in[i + j])];
+            bad |= c;
+            v |= std::uint32_t(c) << (18 - 6 * j);
+        }
+        *out++ = v >> 16;
+        if (left == 3)
+            *out++ = v >> 8;
+        // the bits of the last char that are not part of a byte
+        if (v & (left == 3 ? 0xff : 0xffff))
+            return -1;
+    }
+    // every value is < 64, so a char that isn't a digit sets the top bits
+    if (bad & 0xc0)
+        return -1;
+    return out - start;
+}
+
+// The portable kernels: encode or decode whole 3 byte (4 char) groups, with
+// the same contract as the asm kernels
+template <alphabet A>
+std::size_t
+encode_groups_ref(unsigned char const* in, std::size_t len, char* out)
+{
+    auto const done = len / 3 * 3;
+    encode_base64_ref(in, done, out, A, false);
+    return done;
+}
+
+template <alphabet A>
+std::size_t
+decode_groups_ref(char const*, std::size_t, unsigned char*)
+{
+    // the portable decoder does the whole input, so leave it all to it
+    return 0;
+}
+
+// One variant of the base64 kernels, for one alphabet
+struct kernels
+{
+    std::size_t (*encode)(unsigned char const* in, std::size_t len, char* out);
+    std::size_t (*decode)(char const* in, std::size_t len, unsigned char* out);
+};
+
+inline
+kernels const&
+kernels_for(alphabet a, cpu::isa level)
+{
+    constexpr auto standard = alphabet::standard;
+    constexpr auto url = alphabet::url;
+    // indexed by alphabet, then cpu::isa. There are no sse41 or avx512
+    // kernels: sse41 uses the portable code, and avx512 the avx2 kernels.
+    static kernels const table[][static_cast<int>(cpu::isa::num_isa)] = {
+        {
+            {encode_groups_ref<standard>, decode_groups_ref<standard>},
+            {encode_groups_ref<standard>, decode_groups_ref<standard>},
+            {base64_encode_avx2, base64_decode_avx2},
+            {base64_encode_avx2, base64_decode_avx2},
+            {base64_encode_avx2, base64_decode_avx2},
+        },
+        {
+            {encode_groups_ref<url>, decode_groups_ref<url>},
+            {encode_groups_ref<url>, decode_groups_ref<url>},
+            {base64_encode_url_avx2, base64_decode_url_avx2},
+            {base64_encode_url_avx2, base64_decode_url_avx2},
+            {base64_encode_url_avx2, base64_decode_url_avx2},
+        },
+    };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) ==
+            static_cast<int>(alphabet::num_alphabets),
+        "one set of kernels per alphabet");
+    return table[static_cast<int>(a)][static_cast<int>(level)];
+}
+
+/**
+   Encode n bytes into encoded_size(n, pad) chars with the kernels for the
+   active isa. Returns the number of chars written.
+*/
+inline
+std::size_t
+encode_base64(
+    unsigned char const* in,
+    std::size_t n,
+    char* out,
+    alphabet a = alphabet::standard,
+    bool pad = true)
+{
+    auto const done = kernels_for(a, cpu::active_isa()).encode(in, n, out);
+    auto const chars = done / 3 * 4;
+    return chars +
+        encode_base64_ref(in + done, n - done, out + chars, a, pad);
+}
+
+/**
+   Decode n chars, with or without padding, into out, which must hold
+   max_decoded_size(n) bytes, with the kernels for the active isa. Returns
+   the number of bytes written, or -1 for input decode_base64_ref rejects.
+*/
+inline
+std::ptrdiff_t
+decode_base64(
+    char const* in,
+    std::size_t n,
+    unsigned char* out,
+    alphabet a = alphabet::standard)
+{
+    auto const len = unpadded_size(in, n);
+    if (len < 0)
+        return -1;
+    // the kernel stops at a block with a bad char, and the portable decoder
+    // then finds it
+    auto const done = kernels_for(a, cpu::active_isa()).decode(in, len, out);
+    auto const bytes = done / 4 * 3;
+    auto const rest =
+        decode_base64_ref(in + done, len - done, out + bytes, a);
+    return rest < 0 ? -1 : bytes + rest;
+}
+
+// The test vectors of RFC 4648, and the two chars that differ in the url
+// alphabet
+inline
+bool
+check_base64()
+{
+    struct vector
+    {
+        char const* bytes;
+        char const* chars;
+        alphabet a;
+        bool pad;
+    };
+    vector const vectors[] = {
+        {"", "", alphabet::standard, true},
+        {"f", "Zg==", alphabet::standard, true},
+        {"fo", "Zm8=", alphabet::standard, true},
+        {"foo", "Zm9v", alphabet::standard, true},
+        {"foob", "Zm9vYg==", alphabet::standard, true},
+        {"fooba", "Zm9vYmE=", alphabet::standard, true},
+        {"foobar", "Zm9vYmFy", alphabet::standard, true},
+        {"\xfb\xff", "+/8=", alphabet::standard, true},
+        {"\xfb\xff", "-_8", alphabet::url, false},
+    };
+    for (auto const& v : vectors)
+    {
+        auto const n = strlen(v.bytes);
+        auto const bytes = reinterpret_cast<unsigned char const*>(v.bytes);
+        std::string chars(encoded_size(n, v.pad), 0);
+        unsigned char out[8];
+        if (encode_base64(bytes, n, &chars[0], v.a, v.pad) != chars.size() ||
+            chars != v.chars ||
+            decode_base64(chars.data(), chars.size(), out, v.a) !=
+                static_cast<std::ptrdiff_t>(n) ||
+            memcmp(out, bytes, n))
+        {
+            std::cerr << "base64 mismatch on \"" << v.chars << "\"\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+   Encode and decode random bytes of random length with the active kernels
+   and the portable code, in both alphabets, with and without padding, and
+   compare. Then corrupt one char, and check both decoders reject it.
+*/
+inline
+bool
+random_test_base64(int iterations, int max_len)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_len(0, max_len);
+    std::uniform_int_distribution<> rand255(0, 255);
+    std::uniform_int_distribution<> rand_bit(0, 1);
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const a = static_cast<alphabet>(rand_bit(gen));
+        bool const pad = rand_bit(gen);
+        std::size_t const len = rand_len(gen);
+        std::string input(len, 0);
+        for (auto& c : input)
+            c = rand255(gen);
+        auto const bytes = reinterpret_cast<unsigned char const*>(input.data());
+
+        std::string asm_out(encoded_size(len, pad), 0);
+        std::string c_out(encoded_size(len, pad), 0);
+        if (encode_base64(bytes, len, &asm_out[0], a, pad) != asm_out.size() ||
+            encode_base64_ref(bytes, len, &c_out[0], a, pad) != c_out.size() ||
+            asm_out != c_out)
+        {
+            std::cerr << "Mismatch encoding " << len << " bytes to base64\n";
+            return false;
+        }
+
+        std::string decoded(max_decoded_size(c_out.size()), 0);
+        auto const out = reinterpret_cast<unsigned char*>(&decoded[0]);
+        if (decode_base64(c_out.data(), c_out.size(), out, a) !=
+                static_cast<std::ptrdiff_t>(len) ||
+            decoded.compare(0, len, input))
+        {
+            std::cerr << "Mismatch decoding " << c_out.size()
+                      << " base64 chars\n";
+            return false;
+        }
+
+        if (c_out.empty())
+            continue;
+        // a char of the other alphabet, or one that is in neither
+        std::uniform_int_distribution<std::size_t> rand_pos(
+            0, c_out.size() - 1);
+        auto bad = c_out;
+        auto const pos = rand_pos(gen);
+        if (bad[pos] == '=')
+            continue;
+        bad[pos] = "+/-_ .\x80\xff"[rand255(gen) % 8];
+        if (bad[pos] == digits(a)[62] || bad[pos] == digits(a)[63])
+            continue;
+        if (decode_base64(bad.data(), bad.size(), out, a) != -1 ||
+            decode_base64_ref(bad.data(), bad.size(), out, a) != -1)
+        {
+            std::cerr << "Accepted a bad base64 char at " << pos << " of "
+                      << bad.size() << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+inline
+void
+benchmark_base64()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    std::size_t const len = 1 << 20;
+    std::string bin(len, 0);
+    {
+        std::mt19937 gen;
+        for (auto& c : bin)
+            c = static_cast<char>(gen());
+    }
+    auto const bytes = reinterpret_cast<unsigned char*>(&bin[0]);
+    std::string chars(encoded_size(len), 0);
+
+    int const iters = 1'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            encode_base64(bytes, len, &chars[0]);
+        }
+        auto end = timer::now();
+        std::cout << "Base64 Enc Asm: " << time_diff(start, end).count()
+                  << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            encode_base64_ref(bytes, len, &chars[0]);
+        }
+        auto end = timer::now();
+        std::cout << "  Base64 Enc C: " << time_diff(start, end).count()
+                  << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            // need if or optimizer will skip call
+            if (decode_base64(chars.data(), chars.size(), bytes) !=
+                static_cast<std::ptrdiff_t>(len))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Base64 Dec Asm: " << time_diff(start, end).count()
+                  << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (decode_base64_ref(chars.data(), chars.size(), bytes) !=
+                static_cast<std::ptrdiff_t>(len))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "  Base64 Dec C: " << time_diff(start, end).count()
+                  << '\n';
+    }
+}
+
+}  // namespace base64
+}  // namespace codec
@@ -0,0 +1,524 @@
+// codec_bench: time the codec kernels on realistic mixes of input.
+//
+//   codec_bench [--isa NAME|all] [--filter TEXT] [--samples N]
+//               [--json FILE] [--baseline FILE] [--threshold PERCENT]
+//               [--mode throughput|latency|both] [--no-counters]
+//
+// Every case runs one codec path over a set of 1024 inputs of one kind, so
+// the branch predictors see the mix a server sees rather than one input
+// repeated. It reports ns per op, time stamp counter cycles per byte, and the
+// p50 and p99 time per op over the timed batches (see codec_bench.h). When
+// the hardware performance counters can be read, it also reports cycles,
+// instructions, IPC, branch misses, L1D misses and uops per op (see
+// codec_perf.h); otherwise it says why not and carries on without them.
+//
+// By default each case is timed twice: with independent ops, for the
+// throughput, and with each op waiting for the result of the one before,
+// for the latency of a call whose result is used straight away.
+//
+// --json writes the results, and --baseline compares them with a file an
+// earlier run wrote. The exit code is 1 if the median of a case is slower
+// than its baseline by more than --threshold percent.
+
+#include "codec_base58.h"
+#include "codec_base64.h"
+#include "codec_bench.h"
+#include "codec_hex.h"
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+namespace po = boost::program_options;
+using codec::bench::result;
+
+// The number of inputs of each kind; op i uses input i % num_inputs
+constexpr std::size_t num_inputs = 1024;
+
+// Runs the cases that match the filter in each mode, throughput or latency,
+// and collects their results
+class suite
+{
+private:
+    codec::bench::config cfg_;
+    std::string filter_;
+    std::vector<bool> latency_;
+    std::vector<result> results_;
+
+public:
+    suite(
+        codec::bench::config const& cfg,
+        std::string filter,
+        std::vector<bool> latency)
+        : cfg_(cfg), filter_(std::move(filter)), latency_(std::move(latency))
+    {
+    }
+
+    template <class Op>
+    void
+    run(std::string const& name,
+        std::string const& input,
+        std::size_t bytes_per_op,
+        Op const& op)
+    {
+        if ((name + '/' + input).find(filter_) == std::string::npos)
+            return;
+        for (bool const latency : latency_)
+        {
+            auto cfg = cfg_;
+            cfg.latency = latency;
+            results_.push_back(
+                codec::bench::measure(name, input, bytes_per_op, op, cfg));
+            codec::bench::print(std::cout, results_.back());
+        }
+    }
+
+    std::vector<result> const&
+    results() const
+    {
+        return results_;
+    }
+};
+
+std::mt19937&
+rng()
+{
+    static std::mt19937 gen;
+    return gen;
+}
+
+std::array<unsigned char, 32>
+random_value()
+{
+    std::uniform_int_distribution<> rand255(0, 255);
+    std::array<unsigned char, 32> v;
+    for (auto& b : v)
+        b = rand255(rng());
+    return v;
+}
+
+/**
+   64 char hex keys of one kind:
+
+   valid:          random values, in random case
+   invalid_first,
+   invalid_middle,
+   invalid_last:   valid keys with a bad char at 0, 32 or 63
+   mixed:          half valid, half bad at a random position, shuffled
+*/
+std::vector<std::array<char, 64>>
+hex_inputs(std::string const& kind)
+{
+    static char const digits[] = "0123456789abcdefABCDEF";
+    std::uniform_int_distribution<> rand_digit(0, 21);
+    std::uniform_int_distribution<> rand_pos(0, 63);
+    std::vector<std::array<char, 64>> keys(num_inputs);
+    for (std::size_t k = 0; k < num_inputs; ++k)
+    {
+        for (auto& c : keys[k])
+            c = digits[rand_digit(rng())];
+        int bad = -1;
+        if (kind == "invalid_first")
+            bad = 0;
+        else if (kind == "invalid_middle")
+            bad = 32;
+        else if (kind == "invalid_last")
+            bad = 63;
+        else if (kind == "mixed" && k % 2)
+            bad = rand_pos(rng());
+        if (bad >= 0)
+            keys[k][bad] = 'g';
+    }
+    if (kind == "mixed")
+        std::shuffle(keys.begin(), keys.end(), rng());
+    return keys;
+}
+
+/**
+   44 digit base58 strings of one kind, in the ripple alphabet:
+
+   valid:          the encodings of random 256-bit values
+   random:         random digits; about two thirds of them overflow 256 bits
+   overflow:       random digits that all overflow 256 bits
+   invalid_first,
+   invalid_middle,
+   invalid_last:   valid strings with a bad char at 0, 22 or 43
+*/
+std::vector<std::array<unsigned char, 44>>
+base58_inputs(std::string const& kind)
+{
+    using namespace codec::base58;
+    std::uniform_int_distribution<> rand_digit(0, 57);
+    std::vector<std::array<unsigned char, 44>> strings(num_inputs);
+    for (auto& s : strings)
+    {
+        if (kind == "random" || kind == "overflow")
+        {
+            unsigned char out[32];
+            do
+            {
+                for (auto& c : s)
+                    c = rippleAlphabet[rand_digit(rng())];
+            } while (kind == "overflow" &&
+                     decode_base58_ref(s.data(), 44, out, rippleInverse));
+            continue;
+        }
+
+        // leading zero bytes make shorter strings, so draw until it is 44
+        char chars[45];
+        while (encode_base58(
+                   random_value().data(), 32, chars, rippleAlphabet) != 44)
+            ;
+        memcpy(s.data(), chars, 44);
+        if (kind == "invalid_first")
+            s[0] = '0';
+        else if (kind == "invalid_middle")
+            s[22] = '0';
+        else if (kind == "invalid_last")
+            s[43] = '0';
+    }
+    return strings;
+}
+
+void
+bench_hex(suite& s)
+{
+    using namespace codec::hex;
+
+    std::vector<std::array<unsigned char, 32>> values(num_inputs);
+    for (auto& v : values)
+        v = random_value();
+    // The ops return something that depends on their output, so that in the
+    // latency mode the next op waits for all of it
+    char out[64]{};
+    s.run("encode_hex256", "random", 32, [&](std::size_t i) {
+        encode_hex256(
+            reinterpret_cast<char const*>(values[i % num_inputs].data()), out);
+        return out[63];
+    });
+
+    for (auto const kind :
+         {"valid", "invalid_first", "invalid_middle", "invalid_last", "mixed"})
+    {
+        auto const keys = hex_inputs(kind);
+        s.run("decode_hex256", kind, 64, [&](std::size_t i) {
+            return decode_hex256(keys[i % num_inputs].data(), out) + out[31];
+        });
+    }
+
+    // encode a value and decode it back; the next value is the one decoded
+    char value[32]{};
+    s.run("hex256_round_trip", "random", 32, [&](std::size_t i) {
+        encode_hex256(
+            reinterpret_cast<char const*>(values[i % num_inputs].data()), out);
+        return decode_hex256(out, value) + value[31];
+    });
+
+    // 64 keys a call, so the batch kernels run as they do on a block
+    constexpr std::size_t batch = 64;
+    std::vector<char> bytes(32 * num_inputs);
+    for (auto& b : bytes)
+        b = static_cast<char>(rng()());
+    std::vector<char> chars(64 * num_inputs);
+    s.run("encode_hex256_batch", "random", 32 * batch, [&](std::size_t i) {
+        auto const first = (i * batch) % num_inputs;
+        encode_hex256_batch(&bytes[32 * first], batch, &chars[64 * first]);
+        return chars[64 * (first + batch) - 1];
+    });
+
+    for (auto const kind : {"valid", "mixed"})
+    {
+        auto const keys = hex_inputs(kind);
+        std::uint8_t ok[batch / 8];
+        s.run("decode_hex256_batch", kind, 64 * batch, [&](std::size_t i) {
+            auto const first = (i * batch) % num_inputs;
+            decode_hex256_batch(
+                keys[first].data(), batch, &bytes[32 * first], ok);
+            return ok[batch / 8 - 1] + bytes[32 * (first + batch) - 1];
+        });
+    }
+
+    // a 4 KB blob, to see the cost per byte of the bulk loops. There is one
+    // blob, so the chain of the latency mode goes through a hidden zero.
+    constexpr std::size_t blob = 4096;
+    std::vector<char> blob_chars(2 * blob);
+    encode_hex(bytes.data(), blob, blob_chars.data());
+    auto const zero = codec::bench::hidden_zero();
+    s.run("encode_hex", "random_4k", blob, [&, zero](std::size_t i) {
+        encode_hex(bytes.data() + (i & zero), blob, blob_chars.data());
+        return blob_chars[2 * blob - 1];
+    });
+    s.run("decode_hex", "valid_4k", 2 * blob, [&, zero](std::size_t i) {
+        return decode_hex(blob_chars.data() + (i & zero), blob, bytes.data()) +
+            bytes[blob - 1];
+    });
+}
+
+void
+bench_base58(suite& s)
+{
+    using namespace codec::base58;
+
+    std::vector<std::array<unsigned char, 32>> values(num_inputs);
+    for (auto& v : values)
+        v = random_value();
+    char chars[45];
+    s.run("encode_base58", "random", 32, [&](std::size_t i) {
+        auto const n = encode_base58(
+            values[i % num_inputs].data(), 32, chars, rippleAlphabet);
+        return n + chars[n - 1];
+    });
+    s.run("encode_base58_bitcoin", "random", 32, [&](std::size_t i) {
+        auto const n = encode_base58_bitcoin(
+            values[i % num_inputs].data(), 32, chars, rippleAlphabet);
+        return n + chars[n - 1];
+    });
+
+    unsigned char out[32]{};
+    for (auto const kind :
+         {"valid",
+          "random",
+          "overflow",
+          "invalid_first",
+          "invalid_middle",
+          "invalid_last"})
+    {
+        auto const strings = base58_inputs(kind);
+        auto in = [&](std::size_t i) { return strings[i % num_inputs].data(); };
+        s.run("decode_base58_ref", kind, 44, [&](std::size_t i) {
+            return decode_base58_ref(in(i), 44, out, rippleInverse) + out[31];
+        });
+        s.run("decode_base58_ref_mp", kind, 44, [&](std::size_t i) {
+            return decode_base58_ref_mp(in(i), 44, out, rippleInverse) +
+                out[31];
+        });
+        s.run("decode_base58_asm_mp", kind, 44, [&](std::size_t i) {
+            return decode_base58_asm_mp(in(i), 44, out, rippleInverse) +
+                out[31];
+        });
+        // the simd kernel alone, without the reduction
+        s.run("base58_8_coeff", kind, 44, [&](std::size_t i) {
+            std::uint64_t coeffs[6];
+            auto const good = base58_8_coeff(
+                in(i), coeffs, alphabet_rows<alphabet::ripple>::rows);
+            codec::bench::do_not_optimize(coeffs);
+            return good + coeffs[0];
+        });
+        s.run("decode_base58_asm", kind, 44, [&](std::size_t i) {
+            return decode_base58_asm<alphabet::ripple>(in(i), 44, out) +
+                out[31];
+        });
+        s.run("decode_base58", kind, 44, [&](std::size_t i) {
+            return decode_base58(in(i), 44, out, 32, rippleInverse) + out[31];
+        });
+        s.run("decode_base58_fixed", kind, 44, [&](std::size_t i) {
+            return decode_base58_fixed<32>(in(i), 44, out, rippleInverse) +
+                out[31];
+        });
+        s.run("decode_base58_bitcoin", kind, 44, [&](std::size_t i) {
+            return decode_base58_bitcoin(in(i), 44, out, 32, rippleInverse) +
+                out[31];
+        });
+
+        // 64 strings a call, as in a block of transactions
+        constexpr std::size_t batch = 64;
+        std::vector<unsigned char const*> ptrs(num_inputs);
+        for (std::size_t i = 0; i < num_inputs; ++i)
+            ptrs[i] = strings[i].data();
+        std::vector<unsigned char> batch_out(32 * batch);
+        bool ok[batch];
+        s.run("decode_base58_batch", kind, 44 * batch, [&](std::size_t i) {
+            return decode_base58_batch(
+                       &ptrs[(i * batch) % num_inputs],
+                       batch,
+                       batch_out.data(),
+                       ok,
+                       alphabet_rows<alphabet::ripple>::rows) +
+                batch_out.back();
+        });
+    }
+}
+
+void
+bench_base64(suite& s)
+{
+    using namespace codec::base64;
+
+    // a 4 KB blob, like the hex one, in both alphabets, chained through a
+    // hidden zero in the latency mode
+    constexpr std::size_t blob = 4096;
+    std::vector<unsigned char> bytes(blob);
+    for (std::size_t i = 0; i < blob; i += 32)
+    {
+        auto const v = random_value();
+        std::copy(v.begin(), v.end(), &bytes[i]);
+    }
+    std::vector<char> chars(encoded_size(blob));
+    auto const zero = codec::bench::hidden_zero();
+    for (auto const a : {alphabet::standard, alphabet::url})
+    {
+        auto const kind = a == alphabet::url ? "url_4k" : "random_4k";
+        s.run("encode_base64", kind, blob, [&, a, zero](std::size_t i) {
+            return encode_base64(
+                       bytes.data() + (i & zero), blob, chars.data(), a) +
+                chars.back();
+        });
+        encode_base64(bytes.data(), blob, chars.data(), a);
+        s.run("decode_base64", kind, chars.size(), [&, a, zero](std::size_t i) {
+            return decode_base64(
+                       chars.data() + (i & zero),
+                       chars.size(),
+                       bytes.data(),
+                       a) +
+                bytes.back();
+        });
+    }
+}
+
+}  // namespace
+
+int
+main(int argc, char** argv)
+{
+    codec::bench::config cfg;
+    std::string isa_name;
+    std::string filter;
+    std::string json;
+    std::string baseline;
+    double threshold = 5;
+    bool no_counters = false;
+    std::string mode = "both";
+
+    po::options_description desc(
+        "Usage: codec_bench [options]\n\n"
+        "Time the codec kernels on mixes of valid, invalid and overflowing "
+        "input");
+    // clang-format off
+    desc.add_options()
+        ("help,h", "print this message")
+        ("isa", po::value(&isa_name),
+            "the isa to run: scalar, sse41, avx2, avx512, avx512vbmi or all; "
+            "the default is the active one")
+        ("filter", po::value(&filter),
+            "only the cases whose name/input contains this")
+        ("samples", po::value(&cfg.samples)->default_value(cfg.samples),
+            "timed batches per case")
+        ("json", po::value(&json), "write the results to this json file")
+        ("baseline", po::value(&baseline),
+            "compare with the results in this json file")
+        ("threshold", po::value(&threshold)->default_value(threshold),
+            "the percent slower than the baseline that is a regression")
+        ("mode", po::value(&mode)->default_value(mode),
+            "throughput, latency (each op waits for the result of the one "
+            "before) or both")
+        ("no-counters", po::bool_switch(&no_counters),
+            "don't read the hardware performance counters");
+    // clang-format on
+
+    try
+    {
+        po::variables_map vm;
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+        if (vm.count("help"))
+        {
+            std::cout << desc << '\n';
+            return 0;
+        }
+        if (!cfg.samples)
+            throw po::error("--samples must be at least 1");
+        std::vector<bool> latency;
+        if (mode == "throughput" || mode == "both")
+            latency.push_back(false);
+        if (mode == "latency" || mode == "both")
+            latency.push_back(true);
+        if (latency.empty())
+            throw po::error("--mode must be throughput, latency or both");
+
+        std::vector<codec::cpu::isa> levels{codec::cpu::active_isa()};
+        if (isa_name == "all")
+        {
+            levels = codec::cpu::supported_isas();
+        }
+        else if (!isa_name.empty())
+        {
+            if (!codec::cpu::parse_isa(isa_name.c_str(), levels[0]))
+                throw po::error("unknown isa '" + isa_name + "'");
+            if (levels[0] > codec::cpu::best_isa())
+                throw po::error(isa_name + " is not supported on this cpu");
+        }
+
+        std::cout << "tsc: " << std::setprecision(3)
+                  << codec::bench::tsc_per_ns() << " GHz\n";
+        std::unique_ptr<codec::perf::counters> counters;
+        if (!no_counters)
+        {
+            counters.reset(new codec::perf::counters);
+            if (counters->available())
+                cfg.counters = counters.get();
+            else
+                std::cout << "counters: unavailable (" << counters->error()
+                          << ")\n";
+        }
+        codec::bench::print_header(std::cout, cfg.counters);
+        std::vector<result> results;
+        for (auto const level : levels)
+        {
+            codec::cpu::set_isa(level);
+            suite s(cfg, filter, latency);
+            bench_hex(s);
+            bench_base58(s);
+            bench_base64(s);
+            results.insert(
+                results.end(), s.results().begin(), s.results().end());
+        }
+
+        if (!json.empty())
+        {
+            std::ofstream os(json);
+            codec::bench::write_json(os, results);
+            if (!os)
+                throw std::runtime_error("could not write " + json);
+        }
+        if (!baseline.empty())
+        {
+            std::cout << "\nAgainst " << baseline << ":\n";
+            auto const slower = codec::bench::compare(
+                std::cout,
+                results,
+                codec::bench::read_baseline(baseline),
+                threshold / 100);
+            if (slower)
+            {
+                std::cout << slower << " case"
+                          << (slower == 1 ? " is" : "s are")
+                          << " slower than the baseline\n";
+                return 1;
+            }
+        }
+        return 0;
+    }
+    catch (po::error const& e)
+    {
+        std::cerr << "codec_bench: " << e.what() << "\n\n" << desc << '\n';
+        return 2;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "codec_bench: " << e.what() << '\n';
+        return 2;
+    }
+}
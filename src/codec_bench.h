@@ -0,0 +1,457 @@
+#pragma once
+
+#include "codec_perf.h"
+#include "cpu_features.h"
+
+// the json parser includes boost/bind.hpp, which warns unless this is set
+#ifndef BOOST_BIND_GLOBAL_PLACEHOLDERS
+#define BOOST_BIND_GLOBAL_PLACEHOLDERS
+#endif
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <x86intrin.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace codec {
+namespace bench {
+
+// Make the compiler assume value, and the memory it points to, is read
+template <class T>
+inline
+void
+do_not_optimize(T const& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Make the compiler assume all memory is read and written
+inline
+void
+clobber_memory()
+{
+    asm volatile("" : : : "memory");
+}
+
+// A 0 the compiler can't see through. i & hidden_zero() adds nothing to an
+// address, but makes it depend on i.
+inline
+std::size_t
+hidden_zero()
+{
+    std::size_t zero = 0;
+    asm volatile("" : "+r"(zero));
+    return zero;
+}
+
+// Read the time stamp counter after the instructions before it have finished
+inline
+std::uint64_t
+tsc_start()
+{
+    _mm_lfence();
+    auto const t = __rdtsc();
+    _mm_lfence();
+    return t;
+}
+
+// Read the time stamp counter once the instructions before it have finished,
+// and before any after it start
+inline
+std::uint64_t
+tsc_stop()
+{
+    unsigned aux;
+    auto const t = __rdtscp(&aux);
+    _mm_lfence();
+    return t;
+}
+
+/**
+   Time stamp counter ticks per nanosecond, measured once against
+   steady_clock.
+
+   @note: The counter runs at a constant rate, not at the core clock, so the
+   "cycles" here are reference cycles. They match the core cycles only when
+   the core runs at its base frequency.
+*/
+inline
+double
+tsc_per_ns()
+{
+    static double const rate = [] {
+        using clock = std::chrono::steady_clock;
+        auto const start = clock::now();
+        auto const tsc = tsc_start();
+        while (clock::now() - start < std::chrono::milliseconds(100))
+            ;
+        auto const ticks = tsc_stop() - tsc;
+        auto const ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            clock::now() - start)
+                            .count();
+        return static_cast<double>(ticks) / ns;
+    }();
+    return rate;
+}
+
+// The ticks tsc_start and tsc_stop add to an empty batch
+inline
+std::uint64_t
+tsc_overhead()
+{
+    static std::uint64_t const overhead = [] {
+        std::vector<std::uint64_t> samples(1000);
+        for (auto& s : samples)
+        {
+            auto const start = tsc_start();
+            s = tsc_stop() - start;
+        }
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }();
+    return overhead;
+}
+
+// How long to measure each case
+struct config
+{
+    // time spent running the case before it is measured, to warm the caches
+    // and branch predictors and let the core reach its avx frequency
+    double warmup_ms = 20;
+    // the number of batches that are timed
+    std::size_t samples = 2000;
+    // a batch is doubled until it takes at least this many ticks, so the
+    // cost of reading the counter stays small
+    std::uint64_t min_batch_ticks = 5000;
+    // hardware counters to read around the timed batches, or null
+    perf::counters* counters = nullptr;
+    // chain each op on the result of the one before, to measure latency
+    // instead of throughput
+    bool latency = false;
+};
+
+// The measurements of one case
+struct result
+{
+    std::string name;
+    std::string input;
+    std::string isa;
+    // "throughput" or "latency"
+    std::string mode;
+    std::size_t bytes_per_op = 0;
+    std::size_t ops = 0;
+    double ns_per_op = 0;
+    double cycles_per_op = 0;
+    double cycles_per_byte = 0;
+    // percentiles of the time per op, over the batches
+    double p50_ns = 0;
+    double p99_ns = 0;
+    // the hardware counts over all the timed batches, if they were counted
+    perf::counts counts;
+
+    // The count of e per op
+    double
+    per_op(perf::event e) const
+    {
+        return ops ? static_cast<double>(counts[e]) / ops : 0;
+    }
+};
+
+/**
+   Measure op, a callable that runs one operation on input i of a set and
+   returns its result. i counts up from 0, so a case can cycle through a set
+   of inputs instead of hitting one the branch predictor learns. Each result
+   is passed to do_not_optimize, so the calls can't be dropped.
+
+   The ops run in batches. The mean is over all the timed batches, and the
+   percentiles are of the mean op of each batch.
+
+   By default the ops are independent, so the core overlaps as many as it
+   can and the time is the throughput. With cfg.latency, op i+1 gets input
+   i + (r & zero), where r is the result of op i and zero is a 0 the
+   compiler can't see through. Its input address then depends on r, so the
+   ops run one after another and the time is the latency of a call whose
+   result is used at once. An op measures its whole latency only if its
+   input address depends on i, and its result on its output, not just on the
+   checks of its input. An op on one fixed input can offset its address by
+   i & hidden_zero().
+*/
+template <class Op>
+result
+measure(
+    std::string name,
+    std::string input,
+    std::size_t bytes_per_op,
+    Op&& op,
+    config const& cfg = {})
+{
+    std::size_t i = 0;
+    auto const zero = hidden_zero();
+    auto run_batch = [&](std::size_t batch) {
+        auto const start = tsc_start();
+        if (cfg.latency)
+        {
+            std::size_t next = 0;
+            for (std::size_t n = 0; n < batch; ++n, ++i)
+            {
+                auto const r = op(i + next);
+                do_not_optimize(r);
+                clobber_memory();
+                next = static_cast<std::size_t>(r) & zero;
+            }
+        }
+        else
+        {
+            for (std::size_t n = 0; n < batch; ++n, ++i)
+            {
+                do_not_optimize(op(i));
+                clobber_memory();
+            }
+        }
+        auto const ticks = tsc_stop() - start;
+        auto const overhead = tsc_overhead();
+        return ticks > overhead ? ticks - overhead : 0;
+    };
+
+    std::size_t batch = 1;
+    while (batch < (std::size_t(1) << 20) &&
+           run_batch(batch) < cfg.min_batch_ticks)
+        batch *= 2;
+    auto const warmup_ticks =
+        static_cast<std::uint64_t>(cfg.warmup_ms * 1e6 * tsc_per_ns());
+    for (std::uint64_t spent = 0; spent < warmup_ticks;)
+        spent += run_batch(batch);
+
+    std::vector<double> per_op(cfg.samples);
+    std::uint64_t total = 0;
+    if (cfg.counters)
+        cfg.counters->start();
+    for (auto& s : per_op)
+    {
+        auto const ticks = run_batch(batch);
+        total += ticks;
+        s = static_cast<double>(ticks) / batch;
+    }
+    perf::counts counts;
+    if (cfg.counters)
+        counts = cfg.counters->stop();
+    std::sort(per_op.begin(), per_op.end());
+
+    auto const rate = tsc_per_ns();
+    result r;
+    r.name = std::move(name);
+    r.input = std::move(input);
+    r.isa = cpu::name(cpu::active_isa());
+    r.mode = cfg.latency ? "latency" : "throughput";
+    r.bytes_per_op = bytes_per_op;
+    r.ops = batch * cfg.samples;
+    r.cycles_per_op = static_cast<double>(total) / r.ops;
+    r.ns_per_op = r.cycles_per_op / rate;
+    r.cycles_per_byte = bytes_per_op ? r.cycles_per_op / bytes_per_op : 0;
+    r.p50_ns = per_op[per_op.size() / 2] / rate;
+    r.p99_ns = per_op[per_op.size() * 99 / 100] / rate;
+    r.counts = counts;
+    return r;
+}
+
+// The key that matches a result with the same case in a baseline
+inline
+std::string
+key(result const& r)
+{
+    return r.name + '/' + r.input + '/' + r.isa + '/' + r.mode;
+}
+
+// The header of print. With counters, it has the columns of the counts too.
+inline
+void
+print_header(std::ostream& os, bool counters)
+{
+    os << std::left << std::setw(24) << "case" << std::setw(16) << "input"
+       << std::setw(11) << "isa" << std::setw(11) << "mode" << std::right
+       << std::setw(10) << "ns/op" << std::setw(10) << "cyc/B"
+       << std::setw(10) << "p50 ns" << std::setw(10) << "p99 ns";
+    if (counters)
+    {
+        os << std::setw(10) << "cyc/op" << std::setw(10) << "ins/op"
+           << std::setw(6) << "IPC" << std::setw(10) << "brmiss/op"
+           << std::setw(10) << "l1dmis/op" << std::setw(10) << "uops/op"
+           << std::setw(6) << "run%";
+    }
+    os << '\n';
+}
+
+// Print one line of results, with the counts per op if there are any. A
+// count that is missing is a "-". run% is the share of the time the counters
+// were on the PMU; below 100 the counts are scaled estimates.
+inline
+void
+print(std::ostream& os, result const& r)
+{
+    auto const flags = os.flags();
+    os << std::left << std::setw(24) << r.name << std::setw(16) << r.input
+       << std::setw(11) << r.isa << std::setw(11) << r.mode << std::right
+       << std::fixed
+       << std::setprecision(1) << std::setw(10) << r.ns_per_op
+       << std::setprecision(2) << std::setw(10) << r.cycles_per_byte
+       << std::setprecision(1) << std::setw(10) << r.p50_ns << std::setw(10)
+       << r.p99_ns;
+
+    using perf::event;
+    auto const& c = r.counts;
+    if (std::find(c.valid.begin(), c.valid.end(), true) != c.valid.end())
+    {
+        auto column = [&](event e, int width, int precision) {
+            if (c.has(e))
+                os << std::setprecision(precision) << std::setw(width)
+                   << r.per_op(e);
+            else
+                os << std::setw(width) << '-';
+        };
+        column(event::cycles, 10, 1);
+        column(event::instructions, 10, 1);
+        if (c.has(event::cycles) && c.has(event::instructions) &&
+            c[event::cycles])
+        {
+            os << std::setprecision(2) << std::setw(6)
+               << static_cast<double>(c[event::instructions]) /
+                    c[event::cycles];
+        }
+        else
+        {
+            os << std::setw(6) << '-';
+        }
+        column(event::branch_misses, 10, 3);
+        column(event::l1d_misses, 10, 3);
+        column(event::uops, 10, 1);
+        os << std::setprecision(0) << std::setw(6) << 100 * c.running;
+    }
+    os << '\n';
+    os.flags(flags);
+}
+
+/**
+   Write the results as json: the host's counter rate, and one object per
+   case. A case with hardware counts has a "counters" object with the count
+   per op of each event that was counted, and the ipc. If the counters were
+   multiplexed, it also has "running", the share of the time they were on the
+   PMU, and the counts are scaled estimates. read_baseline reads this back.
+*/
+inline
+void
+write_json(std::ostream& os, std::vector<result> const& results)
+{
+    auto const flags = os.flags();
+    os << std::setprecision(6) << "{\n  \"tsc_ghz\": " << tsc_per_ns()
+       << ",\n  \"results\": [";
+    for (std::size_t i = 0; i < results.size(); ++i)
+    {
+        auto const& r = results[i];
+        os << (i ? ",\n" : "\n") << "    {\"name\": \"" << r.name
+           << "\", \"input\": \"" << r.input << "\", \"isa\": \"" << r.isa
+           << "\", \"mode\": \"" << r.mode
+           << "\", \"bytes_per_op\": " << r.bytes_per_op
+           << ", \"ops\": " << r.ops << ", \"ns_per_op\": " << r.ns_per_op
+           << ", \"cycles_per_op\": " << r.cycles_per_op
+           << ", \"cycles_per_byte\": " << r.cycles_per_byte
+           << ", \"p50_ns\": " << r.p50_ns << ", \"p99_ns\": " << r.p99_ns;
+
+        using perf::event;
+        auto const& c = r.counts;
+        bool first = true;
+        auto field = [&](char const* name, double value) {
+            os << (first ? ", \"counters\": {\"" : ", \"") << name
+               << "\": " << value;
+            first = false;
+        };
+        for (std::size_t e = 0; e < perf::num_events; ++e)
+        {
+            if (c.valid[e])
+            {
+                auto const ev = static_cast<event>(e);
+                field(perf::name(ev), r.per_op(ev));
+            }
+        }
+        if (c.has(event::cycles) && c.has(event::instructions) &&
+            c[event::cycles])
+        {
+            field(
+                "ipc",
+                static_cast<double>(c[event::instructions]) / c[event::cycles]);
+        }
+        if (!first && c.multiplexed())
+            field("running", c.running);
+        if (!first)
+            os << '}';
+        os << '}';
+    }
+    os << "\n  ]\n}\n";
+    os.flags(flags);
+}
+
+// The p50_ns of each case in a file written by write_json, by key(). A file
+// from before the latency mode has throughput results only.
+inline
+std::map<std::string, double>
+read_baseline(std::string const& path)
+{
+    boost::property_tree::ptree tree;
+    boost::property_tree::read_json(path, tree);
+    std::map<std::string, double> baseline;
+    for (auto const& entry : tree.get_child("results"))
+    {
+        auto const& r = entry.second;
+        baseline[r.get<std::string>("name") + '/' +
+                 r.get<std::string>("input") + '/' +
+                 r.get<std::string>("isa") + '/' +
+                 r.get<std::string>("mode", "throughput")] =
+            r.get<double>("p50_ns");
+    }
+    return baseline;
+}
+
+/**
+   Print the change in the median time per op of every case that is in the
+   baseline. The median, unlike the mean, doesn't move when an interrupt or
+   a migration lands in a few batches. Returns the number of cases that are
+   slower by more than threshold, a fraction.
+*/
+inline
+std::size_t
+compare(
+    std::ostream& os,
+    std::vector<result> const& results,
+    std::map<std::string, double> const& baseline,
+    double threshold)
+{
+    auto const flags = os.flags();
+    std::size_t regressions = 0;
+    for (auto const& r : results)
+    {
+        auto const it = baseline.find(key(r));
+        if (it == baseline.end() || it->second <= 0)
+            continue;
+        auto const change = r.p50_ns / it->second - 1;
+        bool const slower = change > threshold;
+        regressions += slower;
+        os << std::left << std::setw(62) << key(r) << std::right << std::fixed
+           << std::setprecision(1) << std::setw(10) << it->second
+           << std::setw(10) << r.p50_ns << std::showpos << std::setw(9)
+           << 100 * change << '%' << std::noshowpos
+           << (slower ? "  slower" : "") << '\n';
+    }
+    os.flags(flags);
+    return regressions;
+}
+
+}  // namespace bench
+}  // namespace codec
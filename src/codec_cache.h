@@ -0,0 +1,579 @@
+#pragma once
+
+#include "codec_base58.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace codec {
+namespace base58 {
+
+/**
+   A 64-bit hash of n chars, eight at a time. The strings are short and come
+   from a hash already (they are encoded keys), so one multiply and shift per
+   word and a final mix are enough to spread them over the stripes and slots.
+*/
+inline
+std::uint64_t
+hash_digits(unsigned char const* in, int n)
+{
+    std::uint64_t h = 0x9e3779b97f4a7c15 ^ static_cast<std::uint64_t>(n);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        std::uint64_t w;
+        memcpy(&w, in + i, 8);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9;
+        h ^= h >> 31;
+    }
+    if (i < n)
+    {
+        std::uint64_t w = 0;
+        memcpy(&w, in + i, n - i);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9;
+        h ^= h >> 31;
+    }
+    h ^= h >> 29;
+    h *= 0x94d049bb133111eb;
+    return h ^ (h >> 32);
+}
+
+/**
+   A bounded cache of decoded base58 strings, for the hot accounts that show
+   up in most transactions. It keeps the result of the decoder for each
+   string, valid or not, so a hit is a hash, a compare and a copy instead of
+   a decode.
+
+   The cache is split into stripes, each with its own mutex, chosen by the
+   top bits of the hash, so threads decoding different strings rarely wait
+   on each other. A stripe holds a fixed number of entries and a linear
+   probing index of them, and evicts with CLOCK: a hit sets the reference
+   bit of its entry, and the hand clears bits until it finds an entry that
+   wasn't used since its last pass. The memory is allocated up front and
+   doesn't grow.
+
+   Strings of more than max_digits chars aren't cached and go straight to
+   the decoder. A cache holds the results of one decoder and alphabet; use
+   another cache for another one.
+*/
+class decode_cache
+{
+public:
+    static constexpr int max_digits = 48;
+    // a digit is less than a byte, so max_digits digits fit in max_digits
+    // bytes, leading zeros included
+    static constexpr int max_bytes = max_digits;
+
+    struct stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        // strings too long to cache
+        std::uint64_t bypassed = 0;
+        std::size_t size = 0;
+    };
+
+private:
+    struct entry
+    {
+        std::uint64_t hash;
+        unsigned char digits[max_digits];
+        unsigned char bytes[max_bytes];
+        std::uint8_t num_digits;
+        // the result of the decoder: the number of bytes, or -1
+        std::int8_t result;
+        bool referenced;
+    };
+
+    struct stripe
+    {
+        std::mutex mutex;
+        std::vector<entry> entries;
+        // indices into entries, or -1 for an empty slot
+        std::vector<std::int32_t> index;
+        std::size_t hand = 0;
+        stats counts;
+    };
+
+    std::vector<std::unique_ptr<stripe>> stripes_;
+    std::size_t per_stripe_;
+    std::size_t index_mask_;
+    int stripe_shift_;
+
+    std::size_t
+    home(std::uint64_t hash) const
+    {
+        return static_cast<std::size_t>(hash) & index_mask_;
+    }
+
+    stripe&
+    stripe_for(std::uint64_t hash) const
+    {
+        return *stripes_[stripe_shift_ < 64 ? hash >> stripe_shift_ : 0];
+    }
+
+    // The entry for the digits, or -1
+    std::int32_t
+    find(stripe const& s, std::uint64_t hash, unsigned char const* in, int n)
+        const
+    {
+        for (auto i = home(hash);; i = (i + 1) & index_mask_)
+        {
+            auto const e = s.index[i];
+            if (e < 0)
+                return -1;
+            auto const& ent = s.entries[e];
+            if (ent.hash == hash && ent.num_digits == n &&
+                !memcmp(ent.digits, in, n))
+                return e;
+        }
+    }
+
+    // Remove entry e from the index, moving the entries after it back so
+    // every entry stays reachable from its home slot
+    void
+    unlink(stripe& s, std::int32_t e)
+    {
+        auto i = home(s.entries[e].hash);
+        while (s.index[i] != e)
+            i = (i + 1) & index_mask_;
+        for (auto j = (i + 1) & index_mask_; s.index[j] >= 0;
+             j = (j + 1) & index_mask_)
+        {
+            auto const k = home(s.entries[s.index[j]].hash);
+            // the entry at j stays if its home is cyclically in (i, j]
+            if (((j - k) & index_mask_) < ((j - i) & index_mask_))
+                continue;
+            s.index[i] = s.index[j];
+            i = j;
+        }
+        s.index[i] = -1;
+    }
+
+    // An entry for a new string: a free one, or the CLOCK victim
+    std::int32_t
+    allocate(stripe& s)
+    {
+        if (s.counts.size < per_stripe_)
+            return static_cast<std::int32_t>(s.counts.size++);
+        for (;;)
+        {
+            auto& ent = s.entries[s.hand];
+            auto const e = static_cast<std::int32_t>(s.hand);
+            s.hand = s.hand + 1 == per_stripe_ ? 0 : s.hand + 1;
+            if (ent.referenced)
+            {
+                ent.referenced = false;
+                continue;
+            }
+            unlink(s, e);
+            ++s.counts.evictions;
+            return e;
+        }
+    }
+
+    static int
+    copy_result(entry const& ent, unsigned char* out, int out_size)
+    {
+        if (ent.result < 0 || ent.result > out_size)
+            return -1;
+        memcpy(out, ent.bytes, ent.result);
+        return ent.result;
+    }
+
+public:
+    /**
+       A cache of about capacity strings in num_stripes stripes. The number
+       of stripes is rounded up to a power of two, and the capacity up to a
+       multiple of it.
+    */
+    explicit
+    decode_cache(std::size_t capacity = 1 << 16, unsigned num_stripes = 64)
+    {
+        std::size_t n = 1;
+        int bits = 0;
+        while (n < std::max(num_stripes, 1u))
+        {
+            n *= 2;
+            ++bits;
+        }
+        stripe_shift_ = 64 - bits;
+        per_stripe_ = std::max<std::size_t>((capacity + n - 1) / n, 1);
+        // at most half full, so the probes stay short
+        std::size_t slots = 2;
+        while (slots < 2 * per_stripe_)
+            slots *= 2;
+        index_mask_ = slots - 1;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            stripes_.emplace_back(new stripe);
+            stripes_.back()->entries.resize(per_stripe_);
+            stripes_.back()->index.assign(slots, -1);
+        }
+    }
+
+    decode_cache(decode_cache const&) = delete;
+    decode_cache&
+    operator=(decode_cache const&) = delete;
+
+    // The most strings the cache holds
+    std::size_t
+    capacity() const
+    {
+        return per_stripe_ * stripes_.size();
+    }
+
+    /**
+       Decode n digits into out with decode, or copy the result of an earlier
+       call for the same digits. decode is called as decode(in, n, buf,
+       max_bytes) and returns the number of bytes, or -1 for a bad string,
+       like decode_base58. Returns what decode would return for out and
+       out_size.
+
+       The decoder runs outside the lock of the stripe, so two threads that
+       miss on the same string may both decode it; the second insert finds
+       the first and keeps it.
+    */
+    template <class Decode>
+    int
+    decode(
+        unsigned char const* in,
+        int n,
+        unsigned char* out,
+        int out_size,
+        Decode const& decode)
+    {
+        if (n < 0 || n > max_digits)
+        {
+            {
+                auto& s = *stripes_[0];
+                std::lock_guard<std::mutex> lock(s.mutex);
+                ++s.counts.bypassed;
+            }
+            return decode(in, n, out, out_size);
+        }
+
+        auto const hash = hash_digits(in, n);
+        auto& s = stripe_for(hash);
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto const e = find(s, hash, in, n);
+            if (e >= 0)
+            {
+                auto& ent = s.entries[e];
+                ent.referenced = true;
+                ++s.counts.hits;
+                return copy_result(ent, out, out_size);
+            }
+            ++s.counts.misses;
+        }
+
+        entry fresh;
+        fresh.hash = hash;
+        memcpy(fresh.digits, in, n);
+        fresh.num_digits = static_cast<std::uint8_t>(n);
+        fresh.result =
+            static_cast<std::int8_t>(decode(in, n, fresh.bytes, max_bytes));
+        // a new entry has to wait one pass of the hand before it can go
+        fresh.referenced = true;
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (find(s, hash, in, n) < 0)
+            {
+                auto const e = allocate(s);
+                s.entries[e] = fresh;
+                auto i = home(hash);
+                while (s.index[i] >= 0)
+                    i = (i + 1) & index_mask_;
+                s.index[i] = e;
+            }
+        }
+        return copy_result(fresh, out, out_size);
+    }
+
+    // decode with decode_base58, the general decoder, in the alphabet inv
+    int
+    decode(
+        unsigned char const* in,
+        int n,
+        unsigned char* out,
+        int out_size,
+        InverseAlphabet const& inv)
+    {
+        return decode(
+            in,
+            n,
+            out,
+            out_size,
+            [&inv](unsigned char const* in, int n, unsigned char* out, int size) {
+                return decode_base58<>(in, n, out, size, inv);
+            });
+    }
+
+    // The counters and size, summed over the stripes
+    stats
+    counts() const
+    {
+        stats result;
+        for (auto const& s : stripes_)
+        {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            result.hits += s->counts.hits;
+            result.misses += s->counts.misses;
+            result.evictions += s->counts.evictions;
+            result.bypassed += s->counts.bypassed;
+            result.size += s->counts.size;
+        }
+        return result;
+    }
+
+    // Forget every string and zero the counters
+    void
+    clear()
+    {
+        for (auto const& s : stripes_)
+        {
+            std::lock_guard<std::mutex> lock(s->mutex);
+            std::fill(s->index.begin(), s->index.end(), -1);
+            s->hand = 0;
+            s->counts = stats{};
+        }
+    }
+};
+
+/**
+   Draws 0 to n-1 with a Zipf distribution: i has a weight of 1/(i+1)^s. With
+   s near 1 a few values take most of the draws, like the hot accounts of
+   real traffic.
+*/
+class zipf_distribution
+{
+private:
+    std::vector<double> cdf_;
+
+public:
+    zipf_distribution(std::size_t n, double s)
+        : cdf_(n)
+    {
+        double sum = 0;
+        for (std::size_t i = 0; i < n; ++i)
+            cdf_[i] = sum += 1 / std::pow(i + 1.0, s);
+        for (auto& c : cdf_)
+            c /= sum;
+    }
+
+    template <class Gen>
+    std::size_t
+    operator()(Gen& gen) const
+    {
+        std::uniform_real_distribution<> u(0, 1);
+        auto const i =
+            std::lower_bound(cdf_.begin(), cdf_.end(), u(gen)) - cdf_.begin();
+        return std::min<std::size_t>(i, cdf_.size() - 1);
+    }
+};
+
+/**
+   Decode strings drawn from a small pool, some of them bad or too long to
+   cache, through a cache too small to hold them all, and check every result
+   against the decoder. Then do the same from several threads at once, and
+   check the counters add up and the cache stays within its capacity.
+*/
+inline
+bool
+random_test_decode_cache(int iterations)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_byte(0, 255);
+    std::uniform_int_distribution<> rand_len(0, 40);
+    std::uniform_int_distribution<> rand_zeroes(0, 3);
+
+    // values of 0 to 40 bytes, a few with leading zeros, and a few strings
+    // with a bad digit or more digits than the cache takes
+    std::vector<std::string> pool(500);
+    for (auto& s : pool)
+    {
+        std::vector<unsigned char> value(rand_len(gen));
+        for (auto& b : value)
+            b = rand_byte(gen);
+        for (int i = 0, z = rand_zeroes(gen); i < z && i < int(value.size());
+             ++i)
+            value[i] = 0;
+        s.resize(value.size() * 138 / 100 + 1);
+        s.resize(encode_base58(
+            value.data(), value.size(), &s[0], rippleAlphabet));
+        if (rand_byte(gen) < 16 && !s.empty())
+            s[rand_byte(gen) % s.size()] = '0';
+        if (rand_byte(gen) < 8)
+            s.append(decode_cache::max_digits, 'r');
+    }
+
+    auto check = [&pool](decode_cache& cache, std::mt19937& g, int n) {
+        zipf_distribution zipf(pool.size(), 1.0);
+        for (int i = 0; i < n; ++i)
+        {
+            auto const& s = pool[zipf(g)];
+            auto const in = reinterpret_cast<unsigned char const*>(s.data());
+            int const size = s.size();
+            // a short out_size sometimes, so a cached value can be too big
+            int const out_size = g() % 8 ? 64 : g() % 40;
+            unsigned char out[64], ref[64];
+            auto const r = cache.decode(in, size, out, out_size, rippleInverse);
+            auto const rr =
+                decode_base58<64>(in, size, ref, out_size, rippleInverse);
+            if (r != rr || (r > 0 && memcmp(out, ref, r)))
+            {
+                std::cerr << "decode_cache mismatch on " << s << ": " << r
+                          << " expected " << rr << '\n';
+                return false;
+            }
+        }
+        return true;
+    };
+
+    {
+        decode_cache cache(64, 4);
+        if (!check(cache, gen, iterations))
+            return false;
+        auto const c = cache.counts();
+        if (c.hits + c.misses + c.bypassed !=
+                static_cast<std::uint64_t>(iterations) ||
+            c.size > cache.capacity() || !c.hits || !c.evictions)
+        {
+            std::cerr << "decode_cache counters don't add up\n";
+            return false;
+        }
+    }
+
+    {
+        decode_cache cache(128, 8);
+        std::atomic<bool> ok{true};
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < 4; ++t)
+        {
+            threads.emplace_back([&, t] {
+                std::mt19937 g(t);
+                if (!check(cache, g, iterations))
+                    ok = false;
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        auto const c = cache.counts();
+        if (!ok ||
+            c.hits + c.misses + c.bypassed !=
+                4 * static_cast<std::uint64_t>(iterations) ||
+            c.size > cache.capacity())
+        {
+            std::cerr << "decode_cache failed with 4 threads\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Decode 4 million account IDs drawn with a Zipf distribution from a million
+// addresses, straight and through caches of 1% and 10% of the addresses,
+// with 1 and 4 threads
+inline
+void
+benchmark_decode_cache()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    std::size_t const num_addresses = 1'000'000;
+    std::size_t const num_lookups = 4'000'000;
+    std::mt19937 gen;
+    std::vector<std::string> addresses(num_addresses);
+    for (auto& a : addresses)
+    {
+        unsigned char value[20];
+        for (auto& b : value)
+            b = static_cast<unsigned char>(gen());
+        char digits[32];
+        a.assign(
+            digits,
+            encode_base58_bitcoin(value, 20, digits, rippleAlphabet));
+    }
+    zipf_distribution const zipf(num_addresses, 1.0);
+    std::vector<std::string const*> lookups(num_lookups);
+    for (auto& l : lookups)
+        l = &addresses[zipf(gen)];
+
+    auto bitcoin = [](unsigned char const* in,
+                      int n,
+                      unsigned char* out,
+                      int out_size) {
+        return decode_base58_bitcoin(in, n, out, out_size, rippleInverse);
+    };
+
+    auto run = [&](unsigned num_threads, auto&& decode) {
+        std::atomic<std::size_t> bad{0};
+        std::vector<std::thread> threads;
+        auto start = timer::now();
+        for (unsigned t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([&, t] {
+                unsigned char out[32];
+                for (std::size_t i = t; i < num_lookups; i += num_threads)
+                {
+                    auto const& s = *lookups[i];
+                    if (decode(
+                            reinterpret_cast<unsigned char const*>(s.data()),
+                            s.size(),
+                            out,
+                            sizeof(out)) != 20)
+                        ++bad;
+                }
+            });
+        }
+        for (auto& t : threads)
+            t.join();
+        auto end = timer::now();
+        return bad ? -1 : time_diff(start, end).count();
+    };
+
+    for (unsigned const num_threads : {1u, 4u})
+    {
+        std::cout << "Threads: " << num_threads
+                  << " Dec bitcoin: " << run(num_threads, bitcoin);
+        for (std::size_t const capacity :
+             {num_addresses / 100, num_addresses / 10})
+        {
+            decode_cache cache(capacity);
+            auto const ms = run(
+                num_threads,
+                [&](unsigned char const* in,
+                    int n,
+                    unsigned char* out,
+                    int out_size) {
+                    return cache.decode(in, n, out, out_size, bitcoin);
+                });
+            auto const c = cache.counts();
+            std::cout << " Cached " << capacity << ": " << ms << " (hits "
+                      << 100 * c.hits / (c.hits + c.misses) << "%)";
+        }
+        std::cout << '\n';
+    }
+}
+
+}  // namespace base58
+}  // namespace codec
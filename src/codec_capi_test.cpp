@@ -0,0 +1,288 @@
+// codec_capi_test: check every function of the C interface of codec.h, and
+// the C++17 wrappers over it, against the C++ reference implementations. It
+// runs once for each instruction set the cpu supports, selected through
+// codec_set_isa. Exits with 1 on the first mismatch.
+//
+// This is built as C++17, like a caller of the wrappers would be; the
+// library itself is C++14.
+
+#include "codec.h"
+
+#include "codec_base58.h"
+#include "codec_base64.h"
+#include "codec_hex.h"
+#include "codec_sha256.h"
+
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+using bytes = std::vector<unsigned char>;
+
+bool
+fail(char const* what, std::size_t len)
+{
+    std::cerr << "Mismatch in " << what << " on " << len << " bytes\n";
+    return false;
+}
+
+bytes
+random_bytes(std::mt19937& gen, std::size_t len)
+{
+    std::uniform_int_distribution<> rand255(0, 255);
+    bytes b(len);
+    for (auto& c : b)
+        c = rand255(gen);
+    // some leading zeros, which base58 encodes on their own
+    for (std::size_t i = 0; i < len && rand255(gen) < 64; ++i)
+        b[i] = 0;
+    return b;
+}
+
+bool
+check_isa()
+{
+    if (codec_version() != CODEC_VERSION || !codec_isa() ||
+        codec_set_isa("no such isa") != -1 || codec_set_isa(nullptr) != -1)
+        return fail("version and isa", 0);
+    return true;
+}
+
+bool
+random_test_hex(std::mt19937& gen, int iterations)
+{
+    std::uniform_int_distribution<> rand_len(0, 100);
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const len = rand_len(gen);
+        auto const in = random_bytes(gen, len);
+        std::string ref(2 * len, 0);
+        codec::hex::encode_hex_ref(
+            reinterpret_cast<char const*>(in.data()), len, &ref[0]);
+
+        std::string chars(2 * len, 0);
+        if (codec_hex_encode(in.data(), len, &chars[0], chars.size()) !=
+                2 * len ||
+            chars != ref)
+            return fail("codec_hex_encode", len);
+        if (len && codec_hex_encode(in.data(), len, &chars[0], 2 * len - 1) !=
+                -1)
+            return fail("codec_hex_encode with a short output", len);
+
+        bytes out(len);
+        if (codec_hex_decode(ref.data(), ref.size(), out.data(), len) != len ||
+            out != in)
+            return fail("codec_hex_decode", len);
+        if (len &&
+            (codec_hex_decode(ref.data(), ref.size(), out.data(), len - 1) !=
+                 -1 ||
+             codec_hex_decode(ref.data(), ref.size() - 1, out.data(), len) !=
+                 -1))
+            return fail("codec_hex_decode with a short output or odd len", len);
+        if (len)
+        {
+            auto bad = ref;
+            bad[gen() % bad.size()] = 'g';
+            if (codec_hex_decode(bad.data(), bad.size(), out.data(), len) != -1)
+                return fail("codec_hex_decode with a bad char", len);
+        }
+
+        char chars_buf[200];
+        unsigned char out_buf[100];
+        auto const enc = codec::hex_encode(
+            codec::span<unsigned char const>(in.data(), in.size()), chars_buf);
+        if (!enc || *enc != ref)
+            return fail("codec::hex_encode", len);
+        auto const dec = codec::hex_decode(*enc, out_buf);
+        if (!dec || dec->size() != in.size() ||
+            !std::equal(dec->begin(), dec->end(), in.begin()))
+            return fail("codec::hex_decode", len);
+        codec::span<unsigned char> const short_buf(out_buf, len ? len - 1 : 0);
+        if (len && codec::hex_decode(*enc, short_buf))
+            return fail("codec::hex_decode with a short output", len);
+    }
+    return true;
+}
+
+bool
+random_test_base58(std::mt19937& gen, int iterations)
+{
+    using namespace codec::base58;
+    // past 64 chars the decoder changes, and past 256 bytes a short output
+    // can't go through the stack buffer of the encoder
+    std::uniform_int_distribution<> rand_len(0, 80);
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const len = i % 50 ? rand_len(gen) : 250 + i % 10;
+        auto const in = random_bytes(gen, len);
+        auto const a = i % 2 ? CODEC_BASE58_BITCOIN : CODEC_BASE58_RIPPLE;
+        auto const digits = a == CODEC_BASE58_BITCOIN
+            ? alphabet_traits<alphabet::bitcoin>::digits()
+            : alphabet_traits<alphabet::ripple>::digits();
+        InverseAlphabet const inverse(digits);
+
+        std::string ref(codec_base58_max_encoded_size(len), 0);
+        ref.resize(encode_base58_bitcoin(in.data(), len, &ref[0], digits));
+
+        std::string chars(codec_base58_max_encoded_size(len), 0);
+        auto const n =
+            codec_base58_encode(in.data(), len, &chars[0], chars.size(), a);
+        if (n < 0 || chars.substr(0, n) != ref)
+            return fail("codec_base58_encode", len);
+        // an output of exactly the encoded size goes through the stack buffer
+        std::string exact(ref.size(), 0);
+        if (codec_base58_encode(in.data(), len, &exact[0], exact.size(), a) !=
+                static_cast<ptrdiff_t>(ref.size()) ||
+            exact != ref)
+            return fail("codec_base58_encode with an exact output", len);
+        if (!ref.empty() &&
+            codec_base58_encode(in.data(), len, &exact[0], ref.size() - 1, a) !=
+                -1)
+            return fail("codec_base58_encode with a short output", len);
+
+        bytes out(len);
+        if (codec_base58_decode(ref.data(), ref.size(), out.data(), len, a) !=
+                static_cast<ptrdiff_t>(len) ||
+            out != in)
+            return fail("codec_base58_decode", len);
+        if (len &&
+            codec_base58_decode(
+                ref.data(), ref.size(), out.data(), len - 1, a) != -1)
+            return fail("codec_base58_decode with a short output", len);
+        if (!ref.empty())
+        {
+            auto bad = ref;
+            bad[gen() % bad.size()] = '0';
+            if (codec_base58_decode(
+                    bad.data(), bad.size(), out.data(), len, a) != -1)
+                return fail("codec_base58_decode with a bad char", len);
+        }
+
+        std::vector<char> chars_buf(codec_base58_max_encoded_size(len));
+        std::vector<unsigned char> out_buf(len);
+        auto const enc = codec::base58_encode(
+            codec::span<unsigned char const>(in.data(), in.size()),
+            chars_buf,
+            a);
+        if (!enc || *enc != ref)
+            return fail("codec::base58_encode", len);
+        auto const dec = codec::base58_decode(*enc, out_buf, a);
+        if (!dec || dec->size() != in.size() ||
+            !std::equal(dec->begin(), dec->end(), in.begin()))
+            return fail("codec::base58_decode", len);
+    }
+    return true;
+}
+
+bool
+random_test_base64(std::mt19937& gen, int iterations)
+{
+    using namespace codec::base64;
+    std::uniform_int_distribution<> rand_len(0, 200);
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const len = rand_len(gen);
+        auto const in = random_bytes(gen, len);
+        auto const a = i % 2 ? CODEC_BASE64_URL : CODEC_BASE64_STANDARD;
+        auto const ref_a = i % 2 ? alphabet::url : alphabet::standard;
+        int const pad = i % 3 != 0;
+        auto const size = codec_base64_encoded_size(len, pad);
+
+        std::string ref(encoded_size(len, pad), 0);
+        encode_base64_ref(in.data(), len, &ref[0], ref_a, pad);
+
+        std::string chars(size, 0);
+        if (size != ref.size() ||
+            codec_base64_encode(in.data(), len, &chars[0], size, a, pad) !=
+                static_cast<ptrdiff_t>(size) ||
+            chars != ref)
+            return fail("codec_base64_encode", len);
+        if (size &&
+            codec_base64_encode(in.data(), len, &chars[0], size - 1, a, pad) !=
+                -1)
+            return fail("codec_base64_encode with a short output", len);
+
+        bytes out(codec_base64_max_decoded_size(size));
+        if (codec_base64_decode(ref.data(), size, out.data(), out.size(), a) !=
+                static_cast<ptrdiff_t>(len) ||
+            !std::equal(in.begin(), in.end(), out.begin()))
+            return fail("codec_base64_decode", len);
+        if (out.size() &&
+            codec_base64_decode(
+                ref.data(), size, out.data(), out.size() - 1, a) != -1)
+            return fail("codec_base64_decode with a short output", len);
+        if (size)
+        {
+            auto bad = ref;
+            bad[gen() % bad.size()] = '*';
+            if (codec_base64_decode(
+                    bad.data(), size, out.data(), out.size(), a) != -1)
+                return fail("codec_base64_decode with a bad char", len);
+        }
+
+        std::vector<char> chars_buf(size);
+        std::vector<unsigned char> out_buf(out.size());
+        auto const enc = codec::base64_encode(
+            codec::span<unsigned char const>(in.data(), in.size()),
+            chars_buf,
+            a,
+            pad != 0);
+        if (!enc || *enc != ref)
+            return fail("codec::base64_encode", len);
+        auto const dec = codec::base64_decode(*enc, out_buf, a);
+        if (!dec || dec->size() != in.size() ||
+            !std::equal(dec->begin(), dec->end(), in.begin()))
+            return fail("codec::base64_decode", len);
+    }
+    return true;
+}
+
+bool
+random_test_sha256(std::mt19937& gen, int iterations)
+{
+    std::uniform_int_distribution<> rand_len(0, 300);
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const len = rand_len(gen);
+        auto const in = random_bytes(gen, len);
+        unsigned char out[32];
+        unsigned char ref[32];
+        codec_sha256(in.data(), len, out);
+        codec::sha256::sha256_ref(in.data(), len, ref);
+        if (memcmp(out, ref, 32))
+            return fail("codec_sha256", len);
+    }
+    return true;
+}
+
+}  // namespace
+
+int
+main()
+{
+    if (!check_isa())
+        return 1;
+    for (auto const level : codec::cpu::supported_isas())
+    {
+        auto const name = codec::cpu::name(level);
+        std::cout << "Testing the C interface with " << name << '\n';
+        if (codec_set_isa(name) || strcmp(codec_isa(), name))
+        {
+            std::cerr << "codec_set_isa failed for " << name << '\n';
+            return 1;
+        }
+
+        std::mt19937 gen;
+        if (!random_test_hex(gen, 10'000) ||
+            !random_test_base58(gen, 10'000) ||
+            !random_test_base64(gen, 10'000) ||
+            !random_test_sha256(gen, 1'000))
+            return 1;
+    }
+    std::cout << "Passed\n";
+    return 0;
+}
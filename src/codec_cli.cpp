@@ -0,0 +1,714 @@
+// codec: convert bulk data between binary and hex or base58.
+//
+//   codec encode|decode [--format hex|base58] [--width N] [--lines]
+//         [--alphabet ripple|bitcoin] [--threads N] [-i in] [-o out]
+//
+// The binary side is always fixed width records of --width bytes, one after
+// another. The text side is either the same records encoded one after
+// another (hex, or 44 digit base58 for 32 byte records), or one record per
+// line with --lines. Base58 is variable length, so encoding to base58 always
+// writes lines.
+//
+// A regular input file is mmapped, and a regular output file is created at
+// its final size and mmapped, so the codecs read from and write to the page
+// cache directly. The records are converted in chunks on all the cores (see
+// codec_parallel.h). Any other input, such as a pipe, is streamed: blocks of
+// records go through the worker threads as they arrive, and are written in
+// order as soon as they are converted (see codec_stream.h).
+//
+// Exits with 0 on success, 1 if some records failed to decode (the output is
+// still written, with zeros for those records), and 2 on any other error.
+
+#include "codec_parallel.h"
+#include "codec_stream.h"
+
+#include <boost/program_options.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+namespace po = boost::program_options;
+
+using codec::chunk_summary;
+using codec::for_each_line;
+using codec::work_pool;
+
+// Ends the program with exit status 2 and the message
+struct cli_error : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+[[noreturn]] void
+throw_errno(std::string const& what)
+{
+    throw cli_error(what + ": " + strerror(errno));
+}
+
+// True if path is a regular file, which can be mmapped
+bool
+is_regular_file(std::string const& path)
+{
+    struct stat st;
+    if (path == "-" ? fstat(0, &st) : stat(path.c_str(), &st))
+        throw_errno(path);
+    return S_ISREG(st.st_mode);
+}
+
+/**
+   The whole of a regular input file, mmapped read only with a sequential
+   access hint.
+*/
+class input_file
+{
+private:
+    char const* data_ = nullptr;
+    std::size_t size_ = 0;
+    void* map_ = nullptr;
+
+public:
+    explicit
+    input_file(std::string const& path)
+    {
+        int const fd = path == "-" ? 0 : open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw_errno(path);
+
+        struct stat st;
+        if (fstat(fd, &st))
+            throw_errno(path);
+
+        size_ = st.st_size;
+        if (size_)
+        {
+            map_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map_ == MAP_FAILED)
+                throw_errno(path);
+            madvise(map_, size_, MADV_SEQUENTIAL);
+            data_ = static_cast<char const*>(map_);
+        }
+
+        if (fd)
+            close(fd);
+    }
+
+    input_file(input_file const&) = delete;
+    input_file&
+    operator=(input_file const&) = delete;
+
+    ~input_file()
+    {
+        if (map_)
+            munmap(map_, size_);
+    }
+
+    char const*
+    data() const
+    {
+        return data_;
+    }
+
+    std::size_t
+    size() const
+    {
+        return size_;
+    }
+};
+
+/**
+   The output, written in place. A regular file is created at its final
+   size and mmapped shared, so the codecs write straight into the page cache
+   and there is no copy through write(). For "-" the output is an anonymous
+   mapping, page aligned and zero filled, that commit() writes to stdout.
+*/
+class output_file
+{
+private:
+    int fd_ = -1;
+    std::size_t size_ = 0;
+    char* data_ = nullptr;
+
+public:
+    output_file(std::string const& path, std::size_t size) : size_(size)
+    {
+        if (path == "-")
+            fd_ = 1;
+        else
+            fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0)
+            throw_errno(path);
+        if (fd_ != 1 && ftruncate(fd_, size))
+            throw_errno(path);
+        if (!size)
+            return;
+
+        auto const map = fd_ == 1
+            ? mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+            : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (map == MAP_FAILED)
+            throw_errno(path);
+        madvise(map, size, MADV_SEQUENTIAL);
+        data_ = static_cast<char*>(map);
+    }
+
+    output_file(output_file const&) = delete;
+    output_file&
+    operator=(output_file const&) = delete;
+
+    ~output_file()
+    {
+        if (data_)
+            munmap(data_, size_);
+        if (fd_ > 1)
+            close(fd_);
+    }
+
+    char*
+    data()
+    {
+        return data_;
+    }
+
+    unsigned char*
+    bytes()
+    {
+        return reinterpret_cast<unsigned char*>(data_);
+    }
+
+    // Finish the output: a file is already written, stdout gets the buffer
+    void
+    commit()
+    {
+        if (fd_ != 1)
+            return;
+        for (std::size_t done = 0; done < size_;)
+        {
+            auto const n = write(fd_, data_ + done, size_ - done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                throw_errno("stdout");
+            done += n;
+        }
+    }
+};
+
+struct options
+{
+    bool encode = false;
+    bool base58 = false;
+    bool lines = false;
+    std::size_t width = 32;
+    unsigned threads = 0;
+    std::string alphabet = "ripple";
+    std::string input = "-";
+    std::string output = "-";
+};
+
+codec::base58::InverseAlphabet const&
+inverse_alphabet(std::string const& name)
+{
+    using namespace codec::base58;
+    static InverseAlphabet const ripple(
+        alphabet_traits<alphabet::ripple>::digits());
+    static InverseAlphabet const bitcoin(
+        alphabet_traits<alphabet::bitcoin>::digits());
+    return name == "bitcoin" ? bitcoin : ripple;
+}
+
+char const*
+alphabet_digits(std::string const& name)
+{
+    using namespace codec::base58;
+    return name == "bitcoin" ? alphabet_traits<alphabet::bitcoin>::digits()
+                             : alphabet_traits<alphabet::ripple>::digits();
+}
+
+/**
+   Split the input into pieces of about default_chunk_bytes that each end
+   just after a newline, or at the end of the input, so no line is split
+   between two chunks. Returns the end of each piece.
+*/
+std::vector<std::size_t>
+line_chunk_ends(char const* data, std::size_t size)
+{
+    std::vector<std::size_t> ends;
+    for (std::size_t pos = 0; pos < size;)
+    {
+        std::size_t end = std::min(pos + codec::default_chunk_bytes, size);
+        if (end < size)
+        {
+            auto const nl = static_cast<char const*>(
+                memchr(data + end - 1, '\n', size - end + 1));
+            end = nl ? nl - data + 1 : size;
+        }
+        ends.push_back(end);
+        pos = end;
+    }
+    return ends;
+}
+
+/**
+   Decode one record per line into width bytes each. decode(line, len, out)
+   returns false if the line is bad. The chunks are counted on the pool
+   first, so each one knows where its records go in the output.
+*/
+template <class Decode>
+std::vector<chunk_summary>
+decode_lines(
+    work_pool& pool,
+    input_file const& in,
+    options const& opts,
+    Decode const& decode)
+{
+    auto const data = in.data();
+    auto const ends = line_chunk_ends(data, in.size());
+    auto const begin = [&](std::size_t c) { return c ? ends[c - 1] : 0; };
+
+    std::vector<chunk_summary> summaries(ends.size());
+    pool.run(ends.size(), [&](std::size_t c) {
+        for_each_line(
+            data + begin(c), data + ends[c], [&](char const*, std::size_t) {
+                ++summaries[c].count;
+            });
+    });
+    std::size_t total = 0;
+    for (auto& s : summaries)
+    {
+        s.first = total;
+        total += s.count;
+    }
+
+    output_file out(opts.output, opts.width * total);
+    pool.run(ends.size(), [&](std::size_t c) {
+        auto& s = summaries[c];
+        auto record = s.first;
+        for_each_line(
+            data + begin(c),
+            data + ends[c],
+            [&](char const* line, std::size_t len) {
+                auto const value = out.bytes() + opts.width * record;
+                if (!decode(line, len, value))
+                {
+                    memset(value, 0, opts.width);
+                    if (!s.num_bad++)
+                        s.first_bad = record;
+                }
+                ++record;
+            });
+    });
+    out.commit();
+    return summaries;
+}
+
+// The number of whole records of record_bytes in the input
+std::size_t
+fixed_records(input_file const& in, std::size_t record_bytes)
+{
+    if (in.size() % record_bytes)
+        throw cli_error(
+            "the input is not a whole number of " +
+            std::to_string(record_bytes) + " byte records");
+    return in.size() / record_bytes;
+}
+
+/**
+   The bulk decoders leave whatever they wrote for a bad record. Go over the
+   chunks that had any one record at a time, zero the records i for which
+   good(i) is false, and count the summaries of those chunks again. good(i)
+   must decide with the same rules as the bulk decoder, so that a file and a
+   pipe give the same output.
+*/
+template <class Good>
+void
+zero_bad_records(
+    work_pool& pool,
+    std::vector<chunk_summary>& summaries,
+    unsigned char* out,
+    std::size_t width,
+    Good const& good)
+{
+    pool.run(summaries.size(), [&](std::size_t c) {
+        auto& s = summaries[c];
+        if (!s.num_bad)
+            return;
+        s.num_bad = 0;
+        for (auto i = s.first; i < s.first + s.count; ++i)
+        {
+            if (good(i))
+                continue;
+            memset(out + width * i, 0, width);
+            if (!s.num_bad++)
+                s.first_bad = i;
+        }
+    });
+}
+
+std::vector<chunk_summary>
+decode_hex(work_pool& pool, input_file const& in, options const& opts)
+{
+    auto const width = opts.width;
+    if (opts.lines)
+    {
+        return decode_lines(
+            pool,
+            in,
+            opts,
+            [width](char const* line, std::size_t len, unsigned char* out) {
+                return len == 2 * width &&
+                    codec::hex::decode_hex(
+                        line, width, reinterpret_cast<char*>(out));
+            });
+    }
+
+    auto const count = fixed_records(in, 2 * width);
+    output_file out(opts.output, width * count);
+    std::vector<chunk_summary> summaries;
+    if (width == 32)
+    {
+        summaries =
+            codec::hex::parallel_decode(in.data(), count, out.data(), pool);
+        zero_bad_records(
+            pool, summaries, out.bytes(), width, [&](std::size_t i) {
+                return codec::hex::decode_hex(
+                    in.data() + 64 * i, 32, out.data() + 32 * i);
+            });
+    }
+    else
+    {
+        summaries = codec::run_chunks(
+            pool,
+            count,
+            codec::records_per_chunk(2 * width, codec::default_chunk_bytes),
+            [&](std::size_t first, std::size_t n, chunk_summary& s) {
+                for (auto i = first; i < first + n; ++i)
+                {
+                    auto const value = out.data() + width * i;
+                    if (!codec::hex::decode_hex(
+                            in.data() + 2 * width * i, width, value))
+                    {
+                        memset(value, 0, width);
+                        if (!s.num_bad++)
+                            s.first_bad = i;
+                    }
+                }
+            });
+    }
+    out.commit();
+    return summaries;
+}
+
+void
+encode_hex(work_pool& pool, input_file const& in, options const& opts)
+{
+    auto const width = opts.width;
+    auto const count = fixed_records(in, width);
+    // two chars a byte, and a newline
+    auto const record_chars = 2 * width + opts.lines;
+    output_file out(opts.output, record_chars * count);
+    if (width == 32 && !opts.lines)
+    {
+        codec::hex::parallel_encode(in.data(), count, out.data(), pool);
+    }
+    else
+    {
+        codec::run_chunks(
+            pool,
+            count,
+            codec::records_per_chunk(width, codec::default_chunk_bytes),
+            [&](std::size_t first, std::size_t n, chunk_summary&) {
+                for (auto i = first; i < first + n; ++i)
+                {
+                    auto const chars = out.data() + record_chars * i;
+                    codec::hex::encode_hex(in.data() + width * i, width, chars);
+                    if (opts.lines)
+                        chars[2 * width] = '\n';
+                }
+            });
+    }
+    out.commit();
+}
+
+std::vector<chunk_summary>
+decode_base58(work_pool& pool, input_file const& in, options const& opts)
+{
+    auto const& alphabet = inverse_alphabet(opts.alphabet);
+    auto const width = opts.width;
+    if (opts.lines)
+    {
+        return decode_lines(
+            pool,
+            in,
+            opts,
+            [&](char const* line, std::size_t len, unsigned char* out) {
+                return codec::base58::decode_base58<128>(
+                        reinterpret_cast<unsigned char const*>(line),
+                        len,
+                        out,
+                        width,
+                        alphabet) == static_cast<int>(width);
+            });
+    }
+
+    if (width != 32)
+        throw cli_error(
+            "base58 records without --lines must be 32 bytes (44 digits)");
+    auto const count = fixed_records(in, 44);
+    output_file out(opts.output, 32 * count);
+    auto const digits = reinterpret_cast<unsigned char const*>(in.data());
+    // the batch decodes the 44 digits as one 256 bit number, as the stream
+    // decoder does; its ok bits are the verdicts, with no second decode
+    std::unique_ptr<bool[]> ok(new bool[count]);
+    auto summaries = codec::base58::parallel_decode(
+        digits, count, out.bytes(), ok.get(), alphabet.rows(), pool);
+    zero_bad_records(pool, summaries, out.bytes(), 32, [&](std::size_t i) {
+        return ok[i];
+    });
+    out.commit();
+    return summaries;
+}
+
+/**
+   Encode to base58, one record per line. The lengths vary, so each chunk is
+   encoded into a buffer of its own, and the buffers are copied to the
+   output once their sizes, and so their offsets, are known.
+*/
+void
+encode_base58(work_pool& pool, input_file const& in, options const& opts)
+{
+    auto const width = opts.width;
+    auto const count = fixed_records(in, width);
+    auto const digits = alphabet_digits(opts.alphabet);
+    auto const per_chunk =
+        codec::records_per_chunk(width, codec::default_chunk_bytes);
+    std::size_t const max_chars = width * 138 / 100 + 2;
+
+    std::size_t const num_chunks = (count + per_chunk - 1) / per_chunk;
+    std::vector<std::string> chunks(num_chunks);
+    pool.run(num_chunks, [&](std::size_t c) {
+        auto const first = c * per_chunk;
+        auto const n = std::min(per_chunk, count - first);
+        auto& text = chunks[c];
+        text.resize(max_chars * n);
+        std::size_t size = 0;
+        for (auto i = first; i < first + n; ++i)
+        {
+            size += codec::base58::encode_base58(
+                reinterpret_cast<unsigned char const*>(in.data()) + width * i,
+                width,
+                &text[size],
+                digits);
+            text[size++] = '\n';
+        }
+        text.resize(size);
+    });
+
+    std::vector<std::size_t> offsets(num_chunks + 1);
+    for (std::size_t c = 0; c < num_chunks; ++c)
+        offsets[c + 1] = offsets[c] + chunks[c].size();
+
+    output_file out(opts.output, offsets.back());
+    pool.run(num_chunks, [&](std::size_t c) {
+        memcpy(out.data() + offsets[c], chunks[c].data(), chunks[c].size());
+    });
+    out.commit();
+}
+
+// Print the bad records, if any. Returns true if there were none.
+bool
+report(std::vector<chunk_summary> const& summaries, bool lines)
+{
+    std::size_t num_bad = 0;
+    std::size_t first_bad = 0;
+    for (auto const& s : summaries)
+    {
+        if (s.num_bad && !num_bad)
+            first_bad = s.first_bad;
+        num_bad += s.num_bad;
+    }
+    if (!num_bad)
+        return true;
+    std::cerr << "codec: " << num_bad << " bad record"
+              << (num_bad == 1 ? "" : "s") << ", the first is "
+              << (lines ? "line " : "record ") << first_bad + 1 << '\n';
+    return false;
+}
+
+/**
+   Convert an input that can't be mmapped as it arrives, with
+   codec::transcode_stream. The output is written with write(), to a file
+   or stdout.
+*/
+int
+stream(options const& opts)
+{
+    auto const transcode = [&](int in_fd, int out_fd) {
+        codec::stream_options stream_opts;
+        stream_opts.workers = opts.threads;
+        auto const run = [&](auto const& convert) {
+            return codec::transcode_stream(
+                in_fd, out_fd, convert.format(), convert, stream_opts);
+        };
+        if (opts.encode && opts.base58)
+            return run(codec::base58::stream_encoder{
+                opts.width, alphabet_digits(opts.alphabet)});
+        if (opts.encode)
+            return run(codec::hex::stream_encoder{opts.width, opts.lines});
+        if (opts.base58)
+            return run(codec::base58::stream_decoder{
+                opts.width, opts.lines, &inverse_alphabet(opts.alphabet)});
+        return run(codec::hex::stream_decoder{opts.width, opts.lines});
+    };
+
+    if (opts.base58 && !opts.encode && !opts.lines && opts.width != 32)
+        throw cli_error(
+            "base58 records without --lines must be 32 bytes (44 digits)");
+
+    int const in_fd = opts.input == "-" ? 0 : open(opts.input.c_str(), O_RDONLY);
+    if (in_fd < 0)
+        throw_errno(opts.input);
+    int const out_fd = opts.output == "-"
+        ? 1
+        : open(opts.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0)
+        throw_errno(opts.output);
+
+    auto const result = transcode(in_fd, out_fd);
+    if (in_fd)
+        close(in_fd);
+    if (out_fd > 1 && close(out_fd))
+        throw_errno(opts.output);
+
+    if (result.trailing)
+    {
+        auto const record_bytes =
+            opts.encode ? opts.width : opts.base58 ? 44 : 2 * opts.width;
+        throw cli_error(
+            "the input is not a whole number of " +
+            std::to_string(record_bytes) + " byte records");
+    }
+    return report({result.records}, opts.lines) ? 0 : 1;
+}
+
+int
+run(options const& opts)
+{
+    if (!opts.width)
+        throw cli_error("--width must be at least 1");
+    if (opts.base58 && opts.width * 138 / 100 + 1 > 128)
+        throw cli_error("base58 records are at most 92 bytes");
+    if (!is_regular_file(opts.input))
+        return stream(opts);
+
+    work_pool pool(
+        opts.threads ? opts.threads : std::thread::hardware_concurrency());
+    input_file const in(opts.input);
+
+    if (opts.encode)
+    {
+        if (opts.base58)
+            encode_base58(pool, in, opts);
+        else
+            encode_hex(pool, in, opts);
+        return 0;
+    }
+
+    auto const summaries =
+        opts.base58 ? decode_base58(pool, in, opts) : decode_hex(pool, in, opts);
+    return report(summaries, opts.lines) ? 0 : 1;
+}
+
+}  // namespace
+
+int
+main(int argc, char** argv)
+{
+    options opts;
+    std::string command;
+    std::string format = "hex";
+
+    po::options_description desc(
+        "Usage: codec encode|decode [options]\n\n"
+        "Convert fixed width binary records to hex or base58 and back");
+    // clang-format off
+    desc.add_options()
+        ("help,h", "print this message")
+        ("format,f", po::value(&format)->default_value(format),
+            "hex or base58")
+        ("width,w", po::value(&opts.width)->default_value(opts.width),
+            "bytes in a binary record")
+        ("lines,l", po::bool_switch(&opts.lines),
+            "one encoded record per line, instead of one after another")
+        ("alphabet,a", po::value(&opts.alphabet)->default_value(opts.alphabet),
+            "base58 alphabet: ripple or bitcoin")
+        ("threads,t", po::value(&opts.threads)->default_value(opts.threads),
+            "worker threads; 0 is one per core")
+        ("input,i", po::value(&opts.input)->default_value(opts.input),
+            "input file, or - for stdin")
+        ("output,o", po::value(&opts.output)->default_value(opts.output),
+            "output file, or - for stdout");
+    // clang-format on
+    po::options_description hidden;
+    hidden.add_options()("command", po::value(&command));
+    po::options_description all;
+    all.add(desc).add(hidden);
+    po::positional_options_description positional;
+    positional.add("command", 1);
+
+    try
+    {
+        po::variables_map vm;
+        po::store(
+            po::command_line_parser(argc, argv)
+                .options(all)
+                .positional(positional)
+                .run(),
+            vm);
+        po::notify(vm);
+
+        if (vm.count("help"))
+        {
+            std::cout << desc << '\n';
+            return 0;
+        }
+        if (command != "encode" && command != "decode")
+            throw cli_error("the command must be encode or decode");
+        if (format != "hex" && format != "base58")
+            throw cli_error("--format must be hex or base58");
+        if (opts.alphabet != "ripple" && opts.alphabet != "bitcoin")
+            throw cli_error("--alphabet must be ripple or bitcoin");
+
+        opts.encode = command == "encode";
+        opts.base58 = format == "base58";
+        // base58 is variable length, so the encoder always writes lines
+        if (opts.encode && opts.base58)
+            opts.lines = true;
+        return run(opts);
+    }
+    catch (po::error const& e)
+    {
+        std::cerr << "codec: " << e.what() << "\n\n" << desc << '\n';
+        return 2;
+    }
+    catch (std::exception const& e)
+    {
+        std::cerr << "codec: " << e.what() << '\n';
+        return 2;
+    }
+}
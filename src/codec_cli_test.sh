@@ -0,0 +1,43 @@
+#!/bin/sh
+# codec_cli_test.sh CODEC: decode the same base58 records from a regular
+# file, which the codec tool mmaps and decodes in bulk, and from a pipe,
+# which it decodes with the stream decoder. Both must give the same values
+# and the same bad count. The records share one chunk: a valid record after
+# two zero digits (the ripple 'r'), a bad one, and a valid one after one
+# zero digit. Exits with 1 on a mismatch.
+
+codec=${1:?usage: codec_cli_test.sh CODEC}
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+good1=rrshnaf39wBUDNEGHJKLM4PQRST7VWXYZ2bcdeCg65jk
+bad=00000000000000000000000000000000000000000000
+good2=rpshnaf39wBUDNEGHJKLM4PQRST7VWXYZ2bcdeCg65jk
+printf '%s%s%s' "$good1" "$bad" "$good2" > "$dir/in"
+
+expected="02523E7C17A8D8E7A6E2156E11B96FF1B7712601582B05462C7A0676085A2300\
+0000000000000000000000000000000000000000000000000000000000000000\
+43E6EE63662E36049094E22D5D4B281B6561984AF1B73F02821E0676085A2300"
+message="codec: 1 bad record, the first is record 2"
+
+fail()
+{
+    echo "codec_cli_test: $1" >&2
+    exit 1
+}
+
+"$codec" decode -f base58 -i "$dir/in" -o "$dir/file" 2> "$dir/file.err"
+[ $? -eq 1 ] || fail "decoding a file should exit with 1"
+cat "$dir/in" | "$codec" decode -f base58 -o "$dir/pipe" 2> "$dir/pipe.err"
+[ $? -eq 1 ] || fail "decoding a pipe should exit with 1"
+
+for path in file pipe
+do
+    [ "$(cat "$dir/$path.err")" = "$message" ] ||
+        fail "wrong bad records from a $path: $(cat "$dir/$path.err")"
+    "$codec" encode -w 96 -i "$dir/$path" -o "$dir/$path.hex" ||
+        fail "can't encode the values from a $path"
+    [ "$(cat "$dir/$path.hex")" = "$expected" ] ||
+        fail "wrong values from a $path: $(cat "$dir/$path.hex")"
+done
+echo "Passed"
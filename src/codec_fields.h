@@ -0,0 +1,457 @@
+#pragma once
+
+#include "codec_hex.h"
+#include "cpu_features.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Bit i of masks[k] is set if char 64*k + i is part of a field, and clear if
+// it is one of the separators in tables (see fields.asm)
+extern "C" void
+field_masks_avx2(
+    char const* in,
+    std::size_t num_blocks,
+    std::uint64_t* masks,
+    unsigned char const* tables);
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace codec {
+namespace hex {
+
+/**
+   The chars that separate the fields of a text, as the two nibble tables the
+   field_masks kernels look up. Each distinct high nibble of the separators
+   gets one bit, set in the high nibble's entry and in the entries of the
+   low nibbles of its separators, so a char is a separator if its two
+   entries have a bit in common. That allows separators with up to eight
+   different high nibbles, which covers any set of ASCII chars.
+*/
+class field_separators
+{
+private:
+    // the low nibble table, then the high nibble table
+    std::array<unsigned char, 32> tables_{};
+
+public:
+    // Throws std::invalid_argument if the separators have more than eight
+    // different high nibbles
+    explicit
+    field_separators(char const* chars)
+    {
+        int bits = 0;
+        for (; *chars; ++chars)
+        {
+            auto const c = static_cast<unsigned char>(*chars);
+            auto& high = tables_[16 + (c >> 4)];
+            if (!high)
+            {
+                if (bits == 8)
+                    throw std::invalid_argument(
+                        "field separators with more than eight high nibbles");
+                high = 1 << bits++;
+            }
+            tables_[c & 0x0f] |= high;
+        }
+    }
+
+    bool
+    contains(char c) const
+    {
+        auto const u = static_cast<unsigned char>(c);
+        return tables_[u & 0x0f] & tables_[16 + (u >> 4)];
+    }
+
+    unsigned char const*
+    tables() const
+    {
+        return tables_.data();
+    }
+};
+
+// Commas, double quotes and whitespace
+inline
+field_separators const&
+default_separators()
+{
+    static field_separators const separators(",\" \t\r\n");
+    return separators;
+}
+
+// The portable field_masks, for cpus without avx2
+inline
+void
+field_masks_scalar(
+    char const* in,
+    std::size_t num_blocks,
+    std::uint64_t* masks,
+    unsigned char const* tables)
+{
+    for (std::size_t k = 0; k < num_blocks; ++k, in += 64)
+    {
+        std::uint64_t m = 0;
+        for (int i = 0; i < 64; ++i)
+        {
+            auto const u = static_cast<unsigned char>(in[i]);
+            if (!(tables[u & 0x0f] & tables[16 + (u >> 4)]))
+                m |= std::uint64_t(1) << i;
+        }
+        masks[k] = m;
+    }
+}
+
+struct field_kernels
+{
+    void (*field_masks)(
+        char const* in,
+        std::size_t num_blocks,
+        std::uint64_t* masks,
+        unsigned char const* tables);
+};
+
+inline
+field_kernels const&
+field_kernels_for(cpu::isa level)
+{
+    // indexed by cpu::isa. There are no sse41 or avx512 kernels: sse41 uses
+    // the portable code, and avx512 the avx2 kernel.
+    static field_kernels const table[] = {
+        {field_masks_scalar},
+        {field_masks_scalar},
+        {field_masks_avx2},
+        {field_masks_avx2},
+        {field_masks_avx2},
+    };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) ==
+            static_cast<int>(cpu::isa::num_isa),
+        "one set of kernels per isa");
+    return table[static_cast<int>(level)];
+}
+
+/**
+   Call f(offset, size) for every field of the size chars at in, in order. A
+   field is a run of chars that are not separators, so separators next to
+   each other don't make empty fields.
+
+   @note: This is the structural indexing of simdjson. The kernel turns
+   each block of 64 chars into a 64-bit mask of the chars that are in
+   fields, and a field starts or ends at every bit that differs from the bit
+   before it. Those edges are walked with a count of trailing zeros each, so
+   the chars are compared 32 at a time and never one by one. The masks are
+   made for a window of 4 KB at a time, which is still in L1 when f reads
+   its fields.
+*/
+template <class F>
+void
+for_each_field(
+    char const* in,
+    std::size_t size,
+    F&& f,
+    field_separators const& separators = default_separators())
+{
+    auto const field_masks = field_kernels_for(cpu::active_isa()).field_masks;
+    constexpr std::size_t window = 64;
+    std::uint64_t masks[window];
+
+    std::size_t start = 0;
+    bool in_field = false;
+    // bit 63 is set if the char before the block is in a field
+    std::uint64_t prev = 0;
+    auto const walk = [&](std::uint64_t mask, std::size_t base) {
+        auto edges = mask ^ ((mask << 1) | (prev >> 63));
+        prev = mask;
+        while (edges)
+        {
+            auto const pos = base + __builtin_ctzll(edges);
+            edges &= edges - 1;
+            if (in_field)
+                f(start, pos - start);
+            else
+                start = pos;
+            in_field = !in_field;
+        }
+    };
+
+    std::size_t const num_blocks = size / 64;
+    for (std::size_t first = 0; first < num_blocks; first += window)
+    {
+        auto const n = std::min(window, num_blocks - first);
+        field_masks(in + 64 * first, n, masks, separators.tables());
+        for (std::size_t k = 0; k < n; ++k)
+            walk(masks[k], 64 * (first + k));
+    }
+
+    // The chars past the end count as separators, so this ends the last
+    // field even if size is a multiple of 64
+    std::uint64_t tail = 0;
+    for (std::size_t i = 64 * num_blocks; i < size; ++i)
+    {
+        if (!separators.contains(in[i]))
+            tail |= std::uint64_t(1) << (i % 64);
+    }
+    walk(tail, 64 * num_blocks);
+}
+
+// A field that is not a 32 byte hex key: the number of the field, counting
+// every field from 0, and where it is in the text
+struct bad_field
+{
+    std::size_t index;
+    std::size_t offset;
+    std::size_t size;
+};
+
+namespace detail {
+
+// Decode one field into the next 32 bytes of values: 64 hex chars, after
+// an optional "0x" or "0X"
+template <class Decode>
+void
+decode_hex256_field(
+    char const* in,
+    std::size_t offset,
+    std::size_t size,
+    std::vector<char>& values,
+    std::vector<bad_field>& bad,
+    std::size_t index,
+    Decode const& decode)
+{
+    auto chars = in + offset;
+    auto len = size;
+    if (len == 66 && chars[0] == '0' && (chars[1] | 0x20) == 'x')
+    {
+        chars += 2;
+        len = 64;
+    }
+    auto const value = values.size();
+    values.resize(value + 32);
+    if (len != 64 || !decode(chars, &values[value]))
+    {
+        memset(&values[value], 0, 32);
+        bad.push_back({index, offset, size});
+    }
+}
+
+}  // namespace detail
+
+/**
+   Decode every field of the size chars at in as a 32 byte key: 64 hex chars
+   of either case, after an optional "0x" or "0X". Appends one value for each
+   field to values, and zeros for a field that is not a key, which is also
+   appended to bad. Returns the number of fields.
+
+   The fields are found by for_each_field, and each one goes straight into
+   decode_hex256 while its chars are in L1, so the text is read from memory
+   once.
+*/
+inline
+std::size_t
+decode_hex256_fields(
+    char const* in,
+    std::size_t size,
+    std::vector<char>& values,
+    std::vector<bad_field>& bad,
+    field_separators const& separators = default_separators())
+{
+    std::size_t index = 0;
+    for_each_field(
+        in,
+        size,
+        [&](std::size_t offset, std::size_t len) {
+            detail::decode_hex256_field(
+                in, offset, len, values, bad, index++, decode_hex256);
+        },
+        separators);
+    return index;
+}
+
+// decode_hex256_fields with a scan for the separators one char at a time,
+// to compare against
+inline
+std::size_t
+decode_hex256_fields_ref(
+    char const* in,
+    std::size_t size,
+    std::vector<char>& values,
+    std::vector<bad_field>& bad,
+    field_separators const& separators = default_separators())
+{
+    std::size_t index = 0;
+    for (std::size_t i = 0; i < size;)
+    {
+        if (separators.contains(in[i]))
+        {
+            ++i;
+            continue;
+        }
+        auto const start = i;
+        while (i < size && !separators.contains(in[i]))
+            ++i;
+        detail::decode_hex256_field(
+            in, start, i - start, values, bad, index++, set_hex_exact);
+    }
+    return index;
+}
+
+// Compare decode_hex256_fields against decode_hex256_fields_ref on texts of
+// keys, keys with a 0x, bad keys and other fields, with runs of separators
+// between them
+inline
+bool
+random_test_fields(int iterations)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_count(0, 40);
+    std::uniform_int_distribution<> rand_kind(0, 7);
+    std::uniform_int_distribution<> rand_byte(0, 255);
+    std::uniform_int_distribution<> rand_hex(0, 21);
+    std::uniform_int_distribution<> rand_run(1, 3);
+
+    field_separators const custom(";|\x01\xff");
+    char const* const default_chars = ",\" \t\r\n";
+    char const* const custom_chars = ";|\x01\xff";
+    char const* const digits = "0123456789ABCDEFabcdef";
+
+    for (int it = 0; it < iterations; ++it)
+    {
+        bool const use_custom = rand_byte(gen) & 1;
+        auto const& separators = use_custom ? custom : default_separators();
+        auto const separator_chars = use_custom ? custom_chars : default_chars;
+        auto const num_separators = strlen(separator_chars);
+
+        std::string text;
+        int const count = rand_count(gen);
+        for (int f = 0; f < count; ++f)
+        {
+            if (f || rand_byte(gen) & 1)
+            {
+                for (int r = rand_run(gen); r; --r)
+                    text += separator_chars[rand_byte(gen) % num_separators];
+            }
+            auto const kind = rand_kind(gen);
+            if (kind == 1)
+                text += rand_byte(gen) & 1 ? "0x" : "0X";
+            std::size_t len = 64;
+            if (kind == 3)
+                len = 63 + 2 * (rand_byte(gen) & 1);
+            else if (kind == 4)
+                len = rand_byte(gen) % 80 + 1;
+            auto const first = text.size();
+            for (std::size_t i = 0; i < len; ++i)
+                text += digits[rand_hex(gen)];
+            if (kind == 2)
+                text[first + rand_byte(gen) % len] = 'g';
+            else if (kind == 5)
+                text[first + rand_byte(gen) % len] = '\x80';
+            else if (kind == 6)
+                text.insert(first, "0x0x");
+        }
+        if (rand_byte(gen) & 1)
+            text += separator_chars[0];
+
+        std::vector<char> values;
+        std::vector<char> values_ref;
+        std::vector<bad_field> bad;
+        std::vector<bad_field> bad_ref;
+        auto const n = decode_hex256_fields(
+            text.data(), text.size(), values, bad, separators);
+        auto const n_ref = decode_hex256_fields_ref(
+            text.data(), text.size(), values_ref, bad_ref, separators);
+        bool same_bad = bad.size() == bad_ref.size();
+        for (std::size_t i = 0; same_bad && i < bad.size(); ++i)
+        {
+            same_bad = bad[i].index == bad_ref[i].index &&
+                bad[i].offset == bad_ref[i].offset &&
+                bad[i].size == bad_ref[i].size;
+        }
+        if (n != n_ref || n != static_cast<std::size_t>(count) ||
+            values != values_ref || !same_bad)
+        {
+            std::cerr << "decode_hex256_fields mismatch, fields: " << count
+                      << " size: " << text.size() << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+// Decode a CSV of a million lines of two keys, one with a 0x, with the
+// structural index and with a scan one char at a time
+inline
+void
+benchmark_fields()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    std::size_t const num_lines = 1'000'000;
+    std::string text;
+    text.reserve(num_lines * 133);
+    {
+        std::mt19937 gen;
+        char value[32];
+        char key[64];
+        for (std::size_t i = 0; i < num_lines; ++i)
+        {
+            for (auto& v : value)
+                v = static_cast<char>(gen());
+            encode_hex256(value, key);
+            text += "0x";
+            text.append(key, 64);
+            text += ',';
+            encode_hex256(value, key);
+            text.append(key, 64);
+            text += '\n';
+        }
+    }
+
+    std::vector<char> values;
+    values.reserve(64 * num_lines);
+    std::vector<bad_field> bad;
+
+    auto start = timer::now();
+    decode_hex256_fields(text.data(), text.size(), values, bad);
+    auto end = timer::now();
+    std::cout << "Fields indexed: " << time_diff(start, end).count();
+    if (!bad.empty())
+        return;
+
+    values.clear();
+    auto const& separators = default_separators();
+    start = timer::now();
+    std::size_t index = 0;
+    // the same scan as decode_hex256_fields_ref, with the same kernel
+    for (std::size_t i = 0; i < text.size();)
+    {
+        if (separators.contains(text[i]))
+        {
+            ++i;
+            continue;
+        }
+        auto const first = i;
+        while (i < text.size() && !separators.contains(text[i]))
+            ++i;
+        detail::decode_hex256_field(
+            text.data(), first, i - first, values, bad, index++, decode_hex256);
+    }
+    end = timer::now();
+    std::cout << " Fields char scan: " << time_diff(start, end).count()
+              << '\n';
+}
+
+}  // namespace hex
+}  // namespace codec
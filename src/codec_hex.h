@@ -1,21 +1,196 @@
 #pragma once
 
+#include "cpu_features.h"
+#include "utils.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// Each kernel comes in one variant per instruction set. Callers should use
+// the functions in codec::hex, which dispatch to the best variant the cpu
+// supports.
+
+// AVX2: decode.asm, encode.asm
+extern "C" int
+decode_hex256_avx2(char const* in, char* out);
+
+extern "C" void
+encode_hex256_avx2(char const* in, char* out);
+
+// Decode 2*len hex chars into len bytes. The input and output must not overlap.
+extern "C" int
+decode_hex_avx2(char const* in, std::size_t len, char* out);
+
+// Encode len bytes into 2*len hex chars. The input and output must not overlap.
+extern "C" void
+encode_hex_avx2(char const* in, std::size_t len, char* out);
+
+// Decode count 64 char keys into count 32 byte values. Bit i%8 of ok[i/8] is
+// set if key i is valid. ok must hold (count+7)/8 bytes.
+extern "C" void
+decode_hex256_batch_avx2(
+    char const* in,
+    std::size_t count,
+    char* out,
+    std::uint8_t* ok);
+
+// Encode count 32 byte values into count 64 char keys.
+extern "C" void
+encode_hex256_batch_avx2(char const* in, std::size_t count, char* out);
+
+// The _upper and _lower decoders only accept the letters of one case, and the
+// _lower encoders write lowercase letters.
+extern "C" int
+decode_hex256_upper_avx2(char const* in, char* out);
+
+extern "C" int
+decode_hex256_lower_avx2(char const* in, char* out);
+
+extern "C" int
+decode_hex_upper_avx2(char const* in, std::size_t len, char* out);
+
+extern "C" int
+decode_hex_lower_avx2(char const* in, std::size_t len, char* out);
+
+extern "C" void
+encode_hex256_lower_avx2(char const* in, char* out);
+
+// Decode or encode 20, 33 or 64 bytes: account IDs, compressed public keys
+// and signatures
+extern "C" int
+decode_hex160_avx2(char const* in, char* out);
+
+extern "C" int
+decode_hex264_avx2(char const* in, char* out);
+
+extern "C" int
+decode_hex512_avx2(char const* in, char* out);
+
+extern "C" void
+encode_hex160_avx2(char const* in, char* out);
+
+extern "C" void
+encode_hex264_avx2(char const* in, char* out);
+
+extern "C" void
+encode_hex512_avx2(char const* in, char* out);
+
+// Decode hex digits with ' ', ':' or '-' between them, 64 digits at a time.
+// Returns the bytes written, from the digits of the first *consumed chars;
+// the caller decodes the rest (see decode.asm).
+extern "C" std::size_t
+decode_hex_lenient_avx2(
+    char const* in,
+    std::size_t len,
+    char* out,
+    std::size_t out_size,
+    std::size_t* consumed,
+    std::uint8_t const* left_pack);
+
+extern "C" void
+encode_hex_lower_avx2(char const* in, std::size_t len, char* out);
+
+// SSE4.1: decode_sse41.asm, encode_sse41.asm
+extern "C" int
+decode_hex256_sse41(char const* in, char* out);
+
+extern "C" void
+encode_hex256_sse41(char const* in, char* out);
+
+extern "C" int
+decode_hex256_upper_sse41(char const* in, char* out);
+
+extern "C" int
+decode_hex256_lower_sse41(char const* in, char* out);
+
+extern "C" void
+encode_hex256_lower_sse41(char const* in, char* out);
+
+// AVX-512BW: decode_avx512.asm, encode_avx512.asm
+extern "C" int
+decode_hex256_avx512(char const* in, char* out);
+
+extern "C" void
+encode_hex256_avx512(char const* in, char* out);
+
+extern "C" int
+decode_hex256_upper_avx512(char const* in, char* out);
+
+extern "C" int
+decode_hex256_lower_avx512(char const* in, char* out);
+
+extern "C" void
+encode_hex256_lower_avx512(char const* in, char* out);
+
+// AVX-512 VBMI: decode_avx512vbmi.asm, encode_avx512vbmi.asm
+extern "C" int
+decode_hex256_avx512vbmi(char const* in, char* out);
+
+extern "C" void
+encode_hex256_avx512vbmi(char const* in, char* out);
+
 extern "C" int
-decode_hex256(char const* in, char* out);
+decode_hex_avx512vbmi(char const* in, std::size_t len, char* out);
 
 extern "C" void
-encode_hex256(char const* in, char* out);
+encode_hex_avx512vbmi(char const* in, std::size_t len, char* out);
+
+extern "C" int
+decode_hex256_upper_avx512vbmi(char const* in, char* out);
+
+extern "C" int
+decode_hex256_lower_avx512vbmi(char const* in, char* out);
+
+extern "C" int
+decode_hex_upper_avx512vbmi(char const* in, std::size_t len, char* out);
+
+extern "C" int
+decode_hex_lower_avx512vbmi(char const* in, std::size_t len, char* out);
+
+extern "C" void
+encode_hex256_lower_avx512vbmi(char const* in, char* out);
+
+extern "C" void
+encode_hex_lower_avx512vbmi(char const* in, std::size_t len, char* out);
 
 #include <algorithm>
+#include <cctype>
 #include <chrono>
 #include <cstring>
 #include <iostream>
 #include <random>
 #include <string>
+#include <vector>
 
 namespace codec {
 namespace hex {
 
+// Letter case the encoders write
+enum class letter_case : int
+{
+    upper = 0,
+    lower
+};
+
+// Letter case the decoders accept. A letter of the other case is a bad hex
+// char.
+enum class input_case : int
+{
+    any = 0,
+    upper,
+    lower
+};
+
+// The "0x" prefix. The encoders write it unless it is none. The decoders
+// reject it (none), skip it if it is there (optional), or reject input
+// without it (required). "0X" is never accepted.
+enum class prefix_mode : int
+{
+    none = 0,
+    optional,
+    required
+};
+
 inline
 int
 char_unhex(char xc)
@@ -74,58 +249,62 @@ set_hex_exact(const char* psz, char* out_)
     return true;
 }
 
+// Same as set_hex_exact, but decodes len bytes instead of exactly 32
 inline
 bool
-random_test_decode(int iterations, int bad_digits)
+set_hex(const char* psz, std::size_t len, char* out_)
 {
-    constexpr char const alphabet[23] = "0123456789abcdefABCDEF";
-    constexpr int max_bad = 4;
-    int num_bad = 0;
+    unsigned char* out = reinterpret_cast<unsigned char*>(out_);
 
-    std::mt19937 gen;
-    // random index into the alphabet
-    std::uniform_int_distribution<> rand_index21(0, 21);
-    // random index into the input (for inserting bad chars)
-    std::uniform_int_distribution<> rand_index63(0, 63);
-    // random char
-    std::uniform_int_distribution<> rand255(0, 255);
-    char input[64];
-    char asm_out[32];
-    char c_out[32];
-    for (int i = 0; i < iterations; ++i)
+    for (std::size_t i = 0; i < len; ++i)
     {
-        for (int j = 0; j < 64; ++j)
-        {
-            input[j] = alphabet[rand_index21(gen)];
-        }
+        auto hi = char_unhex(*psz++);
+        if (hi == -1)
+            return false;
 
-        for (int b = 0; b < bad_digits; ++b)
-        {
-            while (1)
-            {
-                auto const r255 = rand255(gen);
-                if ((r255 >= '0' && r255 <= '9') ||
-                    (r255 >= 'A' && r255 <= 'F') ||
-                    (r255 >= 'a' && r255 <= 'f'))
-                    continue;
-                // we may repeat indexes, but that's OK for the test
-                auto const bad_index = rand_index63(gen);
-                input[bad_index] = r255;
-                break;
-            };
-        }
+        auto lo = char_unhex(*psz++);
+        if (lo == -1)
+            return false;
 
-        auto const asm_r = decode_hex256(input, asm_out);
-        auto const c_r = set_hex_exact(input, c_out);
-        if (asm_r != c_r || (asm_r && memcmp(c_out, asm_out, 32)))
-        {
-            print_diff(input, asm_r, c_r, asm_out, c_out);
-            if (++num_bad == max_bad)
-                return false;
-        }
+        *out++ = (hi << 4) | lo;
     }
 
-    return !num_bad;
+    return true;
+}
+
+// char_unhex, but a letter of the wrong case is a bad hex char
+template <input_case Case>
+int
+char_unhex_case(char xc)
+{
+    int const v = char_unhex(xc);
+    if (Case == input_case::any || v < 10)
+        return v;
+    bool const lower = xc >= 'a';
+    return lower == (Case == input_case::lower) ? v : -1;
+}
+
+// set_hex, but a letter of the wrong case is a bad hex char
+template <input_case Case>
+bool
+set_hex_case(const char* psz, std::size_t len, char* out_)
+{
+    unsigned char* out = reinterpret_cast<unsigned char*>(out_);
+
+    for (std::size_t i = 0; i < len; ++i)
+    {
+        auto hi = char_unhex_case<Case>(*psz++);
+        if (hi == -1)
+            return false;
+
+        auto lo = char_unhex_case<Case>(*psz++);
+        if (lo == -1)
+            return false;
+
+        *out++ = (hi << 4) | lo;
+    }
+
+    return true;
 }
 
 inline
@@ -140,90 +319,1367 @@ encode_hex256_ref(char const* in, char* out)
 }
 
 inline
-bool
-random_test_encode(int iterations)
+void
+encode_hex_ref(char const* in, std::size_t len, char* out)
 {
-    constexpr int max_bad = 1;
-    int num_bad = 0;
+    for (std::size_t i = 0; i < len; ++i)
+    {
+        out[2 * i] = "0123456789ABCDEF"[((in[i] & 0xf0) >> 4)];
+        out[2 * i + 1] = "0123456789ABCDEF"[((in[i] & 0x0f) >> 0)];
+    }
+}
 
-    std::mt19937 gen;
-    // random char
-    std::uniform_int_distribution<> rand255(0, 255);
-    char input[32];
-    char asm_out[64];
-    char c_out[64];
-    for (int i = 0; i < iterations; ++i)
+template <letter_case Case>
+void
+encode_hex_case_ref(char const* in, std::size_t len, char* out)
+{
+    char const* const digits = Case == letter_case::upper ? "0123456789ABCDEF"
+                                                          : "0123456789abcdef";
+    for (std::size_t i = 0; i < len; ++i)
     {
-        for (int j = 0; j < 32; ++j)
-        {
-            input[j] = rand255(gen);
-        }
-        encode_hex256(input, asm_out);
-        encode_hex256_ref(input, c_out);
-        if (memcmp(c_out, asm_out, 64))
-        {
-            print_diff_encode(input, asm_out, c_out);
-            if (++num_bad == max_bad)
-                return false;
-        }
+        out[2 * i] = digits[((in[i] & 0xf0) >> 4)];
+        out[2 * i + 1] = digits[((in[i] & 0x0f) >> 0)];
     }
+}
 
-    return !num_bad;
+// The scalar variants of the kernels, for cpus without sse4.1
+inline
+int
+decode_hex256_scalar(char const* in, char* out)
+{
+    return set_hex_exact(in, out);
+}
+
+inline
+int
+decode_hex_scalar(char const* in, std::size_t len, char* out)
+{
+    return set_hex(in, len, out);
 }
 
 inline
 void
-benchmark_encode()
+decode_hex256_batch_scalar(
+    char const* in,
+    std::size_t count,
+    char* out,
+    std::uint8_t* ok)
 {
-    using timer = std::chrono::high_resolution_clock;
+    std::fill(ok, ok + (count + 7) / 8, 0);
+    for (std::size_t i = 0; i < count; ++i)
+        ok[i / 8] |= set_hex_exact(in + 64 * i, out + 32 * i) << (i % 8);
+}
 
-    char out[64];
-    char val[32];
-    memset(val, 0xf0, 32);
+inline
+void
+encode_hex256_batch_scalar(char const* in, std::size_t count, char* out)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        encode_hex256_ref(in + 32 * i, out + 64 * i);
+}
 
-    int const iters = 100'000'000;
+template <input_case Case>
+int
+decode_hex256_case_scalar(char const* in, char* out)
+{
+    return set_hex_case<Case>(in, 32, out);
+}
 
-    auto time_diff = [](auto start, auto end) {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(
-            end - start);
-    };
+template <input_case Case>
+int
+decode_hex_case_scalar(char const* in, std::size_t len, char* out)
+{
+    return set_hex_case<Case>(in, len, out);
+}
 
-    {
-        auto start = timer::now();
-        for (int i = 0; i < iters; ++i)
-        {
-            encode_hex256(val, out);
-        }
-        auto end = timer::now();
-        std::cout << "Enc Asm: " << time_diff(start, end).count() << '\n';
-    }
+template <letter_case Case>
+void
+encode_hex256_case_ref(char const* in, char* out)
+{
+    encode_hex_case_ref<Case>(in, 32, out);
+}
 
+/**
+   Build the variable length and batch functions from a 32 byte kernel, for
+   the instruction sets that only have the 32 byte kernels in assembly. The
+   whole blocks go through the kernel and the tail through the reference
+   implementation, which must accept and write the same case as the kernel.
+*/
+template <
+    int (*Kernel)(char const*, char*),
+    bool (*Tail)(char const*, std::size_t, char*) = set_hex>
+int
+decode_hex_blocks(char const* in, std::size_t len, char* out)
+{
+    for (; len >= 32; len -= 32, in += 64, out += 32)
     {
-        auto start = timer::now();
-        for (int i = 0; i < iters; ++i)
-        {
-            encode_hex256_ref(val, out);
-        }
-        auto end = timer::now();
-        std::cout << "  Enc C: " << time_diff(start, end).count() << '\n';
+        if (!Kernel(in, out))
+            return 0;
     }
+    return Tail(in, len, out);
 }
 
-inline
+template <
+    void (*Kernel)(char const*, char*),
+    void (*Tail)(char const*, std::size_t, char*) = encode_hex_ref>
 void
-benchmark_decode()
+encode_hex_blocks(char const* in, std::size_t len, char* out)
 {
-    using timer = std::chrono::high_resolution_clock;
+    for (; len >= 32; len -= 32, in += 32, out += 64)
+        Kernel(in, out);
+    Tail(in, len, out);
+}
 
-    char out[32];
-    char const* val =
-        "0123456789abcdef0000111122223333444455556666777788889999aaaabbbb";
+template <int (*Kernel)(char const*, char*)>
+void
+decode_hex256_batch_blocks(
+    char const* in,
+    std::size_t count,
+    char* out,
+    std::uint8_t* ok)
+{
+    std::fill(ok, ok + (count + 7) / 8, 0);
+    for (std::size_t i = 0; i < count; ++i)
+        ok[i / 8] |= Kernel(in + 64 * i, out + 32 * i) << (i % 8);
+}
 
-    int const iters = 100'000'000;
+template <void (*Kernel)(char const*, char*)>
+void
+encode_hex256_batch_blocks(char const* in, std::size_t count, char* out)
+{
+    for (std::size_t i = 0; i < count; ++i)
+        Kernel(in + 32 * i, out + 64 * i);
+}
 
-    auto time_diff = [](auto start, auto end) {
-        return std::chrono::duration_cast<std::chrono::milliseconds>(
-            end - start);
+// One variant of every hex kernel
+struct kernels
+{
+    int (*decode_hex256)(char const* in, char* out);
+    void (*encode_hex256)(char const* in, char* out);
+    int (*decode_hex)(char const* in, std::size_t len, char* out);
+    void (*encode_hex)(char const* in, std::size_t len, char* out);
+    void (*decode_hex256_batch)(
+        char const* in,
+        std::size_t count,
+        char* out,
+        std::uint8_t* ok);
+    void (*encode_hex256_batch)(char const* in, std::size_t count, char* out);
+};
+
+inline
+kernels const&
+kernels_for(cpu::isa level)
+{
+    // indexed by cpu::isa
+    static kernels const table[] = {
+        {decode_hex256_scalar,
+         encode_hex256_ref,
+         decode_hex_scalar,
+         encode_hex_ref,
+         decode_hex256_batch_scalar,
+         encode_hex256_batch_scalar},
+        {decode_hex256_sse41,
+         encode_hex256_sse41,
+         decode_hex_blocks<decode_hex256_sse41>,
+         encode_hex_blocks<encode_hex256_sse41>,
+         decode_hex256_batch_blocks<decode_hex256_sse41>,
+         encode_hex256_batch_blocks<encode_hex256_sse41>},
+        {decode_hex256_avx2,
+         encode_hex256_avx2,
+         decode_hex_avx2,
+         encode_hex_avx2,
+         decode_hex256_batch_avx2,
+         encode_hex256_batch_avx2},
+        // there are no avx512 variable length or batch kernels; every cpu
+        // with avx512 has avx2. The avx2 batch decoder is slower than a
+        // loop over the avx512 kernel, while its encoder is faster.
+        {decode_hex256_avx512,
+         encode_hex256_avx512,
+         decode_hex_avx2,
+         encode_hex_avx2,
+         decode_hex256_batch_blocks<decode_hex256_avx512>,
+         encode_hex256_batch_avx2},
+        {decode_hex256_avx512vbmi,
+         encode_hex256_avx512vbmi,
+         decode_hex_avx512vbmi,
+         encode_hex_avx512vbmi,
+         decode_hex256_batch_blocks<decode_hex256_avx512vbmi>,
+         encode_hex256_batch_avx2},
+    };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) ==
+            static_cast<int>(cpu::isa::num_isa),
+        "one set of kernels per isa");
+    return table[static_cast<int>(level)];
+}
+
+inline
+kernels const&
+active_kernels()
+{
+    return kernels_for(cpu::active_isa());
+}
+
+// Decode 64 hex chars into 32 bytes. Returns 0 if there is a bad hex char.
+inline
+int
+decode_hex256(char const* in, char* out)
+{
+    return active_kernels().decode_hex256(in, out);
+}
+
+// Encode 32 bytes into 64 hex chars.
+inline
+void
+encode_hex256(char const* in, char* out)
+{
+    active_kernels().encode_hex256(in, out);
+}
+
+// Decode 2*len hex chars into len bytes. The input and output must not overlap.
+inline
+int
+decode_hex(char const* in, std::size_t len, char* out)
+{
+    return active_kernels().decode_hex(in, len, out);
+}
+
+// Encode len bytes into 2*len hex chars. The input and output must not overlap.
+inline
+void
+encode_hex(char const* in, std::size_t len, char* out)
+{
+    active_kernels().encode_hex(in, len, out);
+}
+
+// Decode count 64 char keys into count 32 byte values. Bit i%8 of ok[i/8] is
+// set if key i is valid. ok must hold (count+7)/8 bytes.
+inline
+void
+decode_hex256_batch(
+    char const* in,
+    std::size_t count,
+    char* out,
+    std::uint8_t* ok)
+{
+    active_kernels().decode_hex256_batch(in, count, out, ok);
+}
+
+// Encode count 32 byte values into count 64 char keys.
+inline
+void
+encode_hex256_batch(char const* in, std::size_t count, char* out)
+{
+    active_kernels().encode_hex256_batch(in, count, out);
+}
+
+template <std::size_t N>
+int
+decode_hex_fixed_scalar(char const* in, char* out)
+{
+    return set_hex(in, N, out);
+}
+
+template <std::size_t N>
+void
+encode_hex_fixed_ref(char const* in, char* out)
+{
+    encode_hex_ref(in, N, out);
+}
+
+/**
+   Build an N byte kernel from a 32 byte kernel, for N of at least 32. The
+   last block is aligned to the end, and overlaps the one before it when N is
+   not a multiple of 32, so nothing past the N bytes is read.
+*/
+template <std::size_t N, int (*Kernel)(char const*, char*)>
+int
+decode_hex_fixed_blocks(char const* in, char* out)
+{
+    static_assert(N >= 32, "at least one block");
+    for (std::size_t i = 0; i + 32 < N; i += 32)
+    {
+        if (!Kernel(in + 2 * i, out + i))
+            return 0;
+    }
+    return Kernel(in + 2 * (N - 32), out + N - 32);
+}
+
+template <std::size_t N, void (*Kernel)(char const*, char*)>
+void
+encode_hex_fixed_blocks(char const* in, char* out)
+{
+    static_assert(N >= 32, "at least one block");
+    for (std::size_t i = 0; i + 32 < N; i += 32)
+        Kernel(in + i, out + 2 * i);
+    Kernel(in + N - 32, out + 2 * (N - 32));
+}
+
+// An N byte kernel from a variable length kernel that masks its loads and
+// stores to len, as the avx512vbmi kernels do
+template <std::size_t N, int (*Kernel)(char const*, std::size_t, char*)>
+int
+decode_hex_fixed_len(char const* in, char* out)
+{
+    return Kernel(in, N, out);
+}
+
+// The kernels for the sizes of the XRPL objects other than 32 bytes: 20
+// byte account IDs, 33 byte compressed public keys and 64 byte signatures
+struct fixed_kernels
+{
+    int (*decode_hex160)(char const* in, char* out);
+    void (*encode_hex160)(char const* in, char* out);
+    int (*decode_hex264)(char const* in, char* out);
+    void (*encode_hex264)(char const* in, char* out);
+    int (*decode_hex512)(char const* in, char* out);
+    void (*encode_hex512)(char const* in, char* out);
+};
+
+inline
+fixed_kernels const&
+fixed_kernels_for(cpu::isa level)
+{
+    // indexed by cpu::isa. sse41 has no kernel for less than 32 bytes. The
+    // avx512 levels use their 32 byte kernels where there is at least one
+    // block, and avx512vbmi its masked variable length decoder; both beat
+    // the avx2 kernels there. For less than a block, avx2 encodes faster.
+    static fixed_kernels const table[] = {
+        {decode_hex_fixed_scalar<20>,
+         encode_hex_fixed_ref<20>,
+         decode_hex_fixed_scalar<33>,
+         encode_hex_fixed_ref<33>,
+         decode_hex_fixed_scalar<64>,
+         encode_hex_fixed_ref<64>},
+        {decode_hex_fixed_scalar<20>,
+         encode_hex_fixed_ref<20>,
+         decode_hex_fixed_blocks<33, decode_hex256_sse41>,
+         encode_hex_fixed_blocks<33, encode_hex256_sse41>,
+         decode_hex_fixed_blocks<64, decode_hex256_sse41>,
+         encode_hex_fixed_blocks<64, encode_hex256_sse41>},
+        {decode_hex160_avx2,
+         encode_hex160_avx2,
+         decode_hex264_avx2,
+         encode_hex264_avx2,
+         decode_hex512_avx2,
+         encode_hex512_avx2},
+        {decode_hex160_avx2,
+         encode_hex160_avx2,
+         decode_hex_fixed_blocks<33, decode_hex256_avx512>,
+         encode_hex_fixed_blocks<33, encode_hex256_avx512>,
+         decode_hex_fixed_blocks<64, decode_hex256_avx512>,
+         encode_hex_fixed_blocks<64, encode_hex256_avx512>},
+        {decode_hex_fixed_len<20, decode_hex_avx512vbmi>,
+         encode_hex160_avx2,
+         decode_hex_fixed_len<33, decode_hex_avx512vbmi>,
+         encode_hex_fixed_blocks<33, encode_hex256_avx512vbmi>,
+         decode_hex_fixed_len<64, decode_hex_avx512vbmi>,
+         encode_hex_fixed_blocks<64, encode_hex256_avx512vbmi>},
+    };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) ==
+            static_cast<int>(cpu::isa::num_isa),
+        "one set of kernels per isa");
+    return table[static_cast<int>(level)];
+}
+
+/**
+   Decode 2*N hex chars into N bytes. Returns 0 if there is a bad hex char.
+   The sizes with their own kernels are 20, 32, 33 and 64; the others go
+   through decode_hex. Nothing past the 2*N chars is read, so a key at the
+   end of a page is safe.
+*/
+template <std::size_t N>
+int
+decode_hex(char const* in, char* out)
+{
+    return decode_hex(in, N, out);
+}
+
+template <>
+inline
+int
+decode_hex<20>(char const* in, char* out)
+{
+    return fixed_kernels_for(cpu::active_isa()).decode_hex160(in, out);
+}
+
+template <>
+inline
+int
+decode_hex<32>(char const* in, char* out)
+{
+    return decode_hex256(in, out);
+}
+
+template <>
+inline
+int
+decode_hex<33>(char const* in, char* out)
+{
+    return fixed_kernels_for(cpu::active_isa()).decode_hex264(in, out);
+}
+
+template <>
+inline
+int
+decode_hex<64>(char const* in, char* out)
+{
+    return fixed_kernels_for(cpu::active_isa()).decode_hex512(in, out);
+}
+
+// Encode N bytes into 2*N hex chars. The sizes with kernels are those of
+// decode_hex<N>.
+template <std::size_t N>
+void
+encode_hex(char const* in, char* out)
+{
+    encode_hex(in, N, out);
+}
+
+template <>
+inline
+void
+encode_hex<20>(char const* in, char* out)
+{
+    fixed_kernels_for(cpu::active_isa()).encode_hex160(in, out);
+}
+
+template <>
+inline
+void
+encode_hex<32>(char const* in, char* out)
+{
+    encode_hex256(in, out);
+}
+
+template <>
+inline
+void
+encode_hex<33>(char const* in, char* out)
+{
+    fixed_kernels_for(cpu::active_isa()).encode_hex264(in, out);
+}
+
+template <>
+inline
+void
+encode_hex<64>(char const* in, char* out)
+{
+    fixed_kernels_for(cpu::active_isa()).encode_hex512(in, out);
+}
+
+// The decode kernels for one input_case
+struct decode_kernels
+{
+    int (*decode_hex256)(char const* in, char* out);
+    int (*decode_hex)(char const* in, std::size_t len, char* out);
+};
+
+// The encode kernels for one letter_case
+struct encode_kernels
+{
+    void (*encode_hex256)(char const* in, char* out);
+    void (*encode_hex)(char const* in, std::size_t len, char* out);
+};
+
+inline
+decode_kernels const&
+decode_kernels_for(input_case c, cpu::isa level)
+{
+    constexpr auto upper = input_case::upper;
+    constexpr auto lower = input_case::lower;
+    // indexed by input_case, then cpu::isa
+    static decode_kernels const
+        table[][static_cast<int>(cpu::isa::num_isa)] = {
+            {
+                {decode_hex256_scalar, decode_hex_scalar},
+                {decode_hex256_sse41, decode_hex_blocks<decode_hex256_sse41>},
+                {decode_hex256_avx2, decode_hex_avx2},
+                {decode_hex256_avx512, decode_hex_avx2},
+                {decode_hex256_avx512vbmi, decode_hex_avx512vbmi},
+            },
+            {
+                {decode_hex256_case_scalar<upper>, decode_hex_case_scalar<upper>},
+                {decode_hex256_upper_sse41,
+                 decode_hex_blocks<decode_hex256_upper_sse41, set_hex_case<upper>>},
+                {decode_hex256_upper_avx2, decode_hex_upper_avx2},
+                {decode_hex256_upper_avx512, decode_hex_upper_avx2},
+                {decode_hex256_upper_avx512vbmi, decode_hex_upper_avx512vbmi},
+            },
+            {
+                {decode_hex256_case_scalar<lower>, decode_hex_case_scalar<lower>},
+                {decode_hex256_lower_sse41,
+                 decode_hex_blocks<decode_hex256_lower_sse41, set_hex_case<lower>>},
+                {decode_hex256_lower_avx2, decode_hex_lower_avx2},
+                {decode_hex256_lower_avx512, decode_hex_lower_avx2},
+                {decode_hex256_lower_avx512vbmi, decode_hex_lower_avx512vbmi},
+            },
+        };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) == 3, "one set of kernels per case");
+    return table[static_cast<int>(c)][static_cast<int>(level)];
+}
+
+inline
+encode_kernels const&
+encode_kernels_for(letter_case c, cpu::isa level)
+{
+    constexpr auto lower = letter_case::lower;
+    // indexed by letter_case, then cpu::isa
+    static encode_kernels const
+        table[][static_cast<int>(cpu::isa::num_isa)] = {
+            {
+                {encode_hex256_ref, encode_hex_ref},
+                {encode_hex256_sse41, encode_hex_blocks<encode_hex256_sse41>},
+                {encode_hex256_avx2, encode_hex_avx2},
+                {encode_hex256_avx512, encode_hex_avx2},
+                {encode_hex256_avx512vbmi, encode_hex_avx512vbmi},
+            },
+            {
+                {encode_hex256_case_ref<lower>, encode_hex_case_ref<lower>},
+                {encode_hex256_lower_sse41,
+                 encode_hex_blocks<
+                     encode_hex256_lower_sse41,
+                     encode_hex_case_ref<lower>>},
+                {encode_hex256_lower_avx2, encode_hex_lower_avx2},
+                {encode_hex256_lower_avx512, encode_hex_lower_avx2},
+                {encode_hex256_lower_avx512vbmi, encode_hex_lower_avx512vbmi},
+            },
+        };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) == 2, "one set of kernels per case");
+    return table[static_cast<int>(c)][static_cast<int>(level)];
+}
+
+/**
+   The format of a hex string as compile time options. Every combination of
+   cases has its own assembly kernels, so a strict or lowercase codec costs
+   the same as the default one, without a separate validation or tolower pass
+   over the output.
+*/
+template <
+    letter_case Output = letter_case::upper,
+    input_case Input = input_case::any,
+    prefix_mode Prefix = prefix_mode::none>
+struct policy
+{
+    static constexpr letter_case output = Output;
+    static constexpr input_case input = Input;
+    static constexpr prefix_mode prefix = Prefix;
+};
+
+// The rippled format: uppercase output, either case input and no prefix. This
+// is the format of the decode_hex and encode_hex functions above.
+using default_policy = policy<>;
+
+/**
+   A hex codec for the format given by Policy. The kernels are bound to the
+   active isa on every call, like the functions above.
+*/
+template <class Policy>
+struct basic_codec
+{
+    // Number of chars of prefix the encoder writes
+    static constexpr std::size_t prefix_size =
+        Policy::prefix == prefix_mode::none ? 0 : 2;
+
+    // Number of chars the encoder writes for len bytes
+    static constexpr std::size_t
+    encoded_size(std::size_t len)
+    {
+        return prefix_size + 2 * len;
+    }
+
+    // Encode len bytes into encoded_size(len) chars. The input and output
+    // must not overlap.
+    static void
+    encode(char const* in, std::size_t len, char* out)
+    {
+        if (prefix_size)
+        {
+            out[0] = '0';
+            out[1] = 'x';
+            out += 2;
+        }
+        auto const& k = encode_kernels_for(Policy::output, cpu::active_isa());
+        if (len == 32)
+            k.encode_hex256(in, out);
+        else
+            k.encode_hex(in, len, out);
+    }
+
+    // Decode the in_len chars of in into exactly len bytes. Returns 0 unless
+    // in is the prefix the policy allows followed by 2*len hex digits of the
+    // case it accepts. The input and output must not overlap.
+    static int
+    decode(char const* in, std::size_t in_len, char* out, std::size_t len)
+    {
+        bool const has_prefix = Policy::prefix != prefix_mode::none &&
+            in_len >= 2 && in[0] == '0' && in[1] == 'x';
+        if (Policy::prefix == prefix_mode::required && !has_prefix)
+            return 0;
+        if (has_prefix)
+        {
+            in += 2;
+            in_len -= 2;
+        }
+        if (in_len != 2 * len)
+            return 0;
+
+        auto const& k = decode_kernels_for(Policy::input, cpu::active_isa());
+        if (len == 32)
+            return k.decode_hex256(in, out);
+        return k.decode_hex(in, len, out);
+    }
+};
+
+// The chars decode_hex_lenient skips between the digits
+inline
+bool
+is_hex_separator(char c)
+{
+    return c == ' ' || c == ':' || c == '-';
+}
+
+/**
+   The vpshufb patterns that left pack 8 chars: row m has the positions of
+   the set bits of m, lowest first, and then 0x80s, which shuffle in zeros.
+*/
+struct left_pack_table
+{
+    std::uint8_t rows[256][8];
+
+    left_pack_table()
+    {
+        for (int m = 0; m < 256; ++m)
+        {
+            int n = 0;
+            for (int b = 0; b < 8; ++b)
+            {
+                if (m & (1 << b))
+                    rows[m][n++] = b;
+            }
+            std::fill(rows[m] + n, rows[m] + 8, 0x80);
+        }
+    }
+};
+
+inline
+left_pack_table const&
+left_pack()
+{
+    static left_pack_table const table;
+    return table;
+}
+
+// The lenient kernel of the isas without avx2: it consumes nothing, and the
+// scalar loop of decode_hex_lenient does it all
+inline
+std::size_t
+decode_hex_lenient_scalar(
+    char const*,
+    std::size_t,
+    char*,
+    std::size_t,
+    std::size_t* consumed,
+    std::uint8_t const*)
+{
+    *consumed = 0;
+    return 0;
+}
+
+inline
+auto
+lenient_kernel_for(cpu::isa level)
+{
+    // indexed by cpu::isa. sse41 uses the scalar code, and avx512 the avx2
+    // kernel.
+    static decltype(&decode_hex_lenient_avx2) const table[] = {
+        decode_hex_lenient_scalar,
+        decode_hex_lenient_scalar,
+        decode_hex_lenient_avx2,
+        decode_hex_lenient_avx2,
+        decode_hex_lenient_avx2,
+    };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) ==
+            static_cast<int>(cpu::isa::num_isa),
+        "one kernel per isa");
+    return table[static_cast<int>(level)];
+}
+
+/**
+   Decode hex the way people paste it: digits of either case with any number
+   of ' ', ':' or '-' around and between them, after an optional "0x" or
+   "0X". "0x0A:1b-FF " decodes to three bytes. The separators may fall
+   anywhere, even inside a byte. Returns the number of bytes written to out,
+   or -1 if a char is neither a digit nor a separator, the number of digits
+   is odd, or the bytes would not fit in out_size.
+
+   @note: The avx2 kernel compares 16 chars at a time against the
+   separators, and left packs the digits with a vpshufb pattern from
+   left_pack(), looked up by each 8 bits of the mask. Every 64 digits go
+   through the nibble combine of decode_hex256, so the input is never
+   copied to a normalized string first. The digits of an unfinished block,
+   and everything from a bad char on, are left to the scalar loop here.
+*/
+inline
+std::ptrdiff_t
+decode_hex_lenient(
+    char const* in,
+    std::size_t len,
+    char* out,
+    std::size_t out_size)
+{
+    auto const end = in + len;
+    while (in < end && is_hex_separator(*in))
+        ++in;
+    if (end - in >= 2 && in[0] == '0' && (in[1] | 0x20) == 'x')
+        in += 2;
+
+    std::size_t consumed;
+    std::size_t written = lenient_kernel_for(cpu::active_isa())(
+        in, end - in, out, out_size, &consumed, left_pack().rows[0]);
+    in += consumed;
+
+    int high = -1;
+    for (; in < end; ++in)
+    {
+        if (is_hex_separator(*in))
+            continue;
+        auto const v = char_unhex(*in);
+        if (v == -1)
+            return -1;
+        if (high == -1)
+        {
+            high = v;
+            continue;
+        }
+        if (written == out_size)
+            return -1;
+        out[written++] = static_cast<char>((high << 4) | v);
+        high = -1;
+    }
+    return high == -1 ? static_cast<std::ptrdiff_t>(written) : -1;
+}
+
+// decode_hex_lenient by copying the digits to a string first, to compare
+// against
+inline
+std::ptrdiff_t
+decode_hex_lenient_ref(
+    char const* in,
+    std::size_t len,
+    char* out,
+    std::size_t out_size)
+{
+    std::string digits(in, len);
+    auto const first = digits.find_first_not_of(" :-");
+    digits.erase(0, first == std::string::npos ? len : first);
+    if (digits.size() >= 2 && digits[0] == '0' && (digits[1] | 0x20) == 'x')
+        digits.erase(0, 2);
+    digits.erase(
+        std::remove_if(digits.begin(), digits.end(), is_hex_separator),
+        digits.end());
+    if (digits.size() % 2 || digits.size() / 2 > out_size ||
+        !set_hex(digits.data(), digits.size() / 2, out))
+        return -1;
+    return digits.size() / 2;
+}
+
+inline
+bool
+random_test_decode(int iterations, int bad_digits)
+{
+    constexpr char const alphabet[23] = "0123456789abcdefABCDEF";
+    constexpr int max_bad = 4;
+    int num_bad = 0;
+
+    std::mt19937 gen;
+    // random index into the alphabet
+    std::uniform_int_distribution<> rand_index21(0, 21);
+    // random index into the input (for inserting bad chars)
+    std::uniform_int_distribution<> rand_index63(0, 63);
+    // random char
+    std::uniform_int_distribution<> rand255(0, 255);
+    char input[64];
+    char asm_out[32];
+    char c_out[32];
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = 0; j < 64; ++j)
+        {
+            input[j] = alphabet[rand_index21(gen)];
+        }
+
+        for (int b = 0; b < bad_digits; ++b)
+        {
+            while (1)
+            {
+                auto const r255 = rand255(gen);
+                if ((r255 >= '0' && r255 <= '9') ||
+                    (r255 >= 'A' && r255 <= 'F') ||
+                    (r255 >= 'a' && r255 <= 'f'))
+                    continue;
+                // we may repeat indexes, but that's OK for the test
+                auto const bad_index = rand_index63(gen);
+                input[bad_index] = r255;
+                break;
+            };
+        }
+
+        auto const asm_r = decode_hex256(input, asm_out);
+        auto const c_r = set_hex_exact(input, c_out);
+        if (asm_r != c_r || (asm_r && memcmp(c_out, asm_out, 32)))
+        {
+            print_diff(input, asm_r, c_r, asm_out, c_out);
+            if (++num_bad == max_bad)
+                return false;
+        }
+    }
+
+    return !num_bad;
+}
+
+inline
+bool
+random_test_encode(int iterations)
+{
+    constexpr int max_bad = 1;
+    int num_bad = 0;
+
+    std::mt19937 gen;
+    // random char
+    std::uniform_int_distribution<> rand255(0, 255);
+    char input[32];
+    char asm_out[64];
+    char c_out[64];
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (int j = 0; j < 32; ++j)
+        {
+            input[j] = rand255(gen);
+        }
+        encode_hex256(input, asm_out);
+        encode_hex256_ref(input, c_out);
+        if (memcmp(c_out, asm_out, 64))
+        {
+            print_diff_encode(input, asm_out, c_out);
+            if (++num_bad == max_bad)
+                return false;
+        }
+    }
+
+    return !num_bad;
+}
+
+// Decode random lengths from 0 to max_len bytes with decode_hex and compare
+// against set_hex. The buffers are sized exactly, so a kernel that reads or
+// writes past the end of them will show up under a memory checker.
+inline
+bool
+random_test_decode_bulk(int iterations, int max_len, int bad_digits)
+{
+    constexpr char const alphabet[23] = "0123456789abcdefABCDEF";
+    constexpr int max_bad = 4;
+    int num_bad = 0;
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_len(0, max_len);
+    std::uniform_int_distribution<> rand_index21(0, 21);
+    std::uniform_int_distribution<> rand255(0, 255);
+    for (int i = 0; i < iterations; ++i)
+    {
+        std::size_t const len = rand_len(gen);
+        std::string input(2 * len, '0');
+        std::string asm_out(len, 0);
+        std::string c_out(len, 0);
+        for (auto& c : input)
+            c = alphabet[rand_index21(gen)];
+
+        for (int b = 0; b < bad_digits && len; ++b)
+        {
+            while (1)
+            {
+                auto const r255 = rand255(gen);
+                if (char_unhex(r255) != -1)
+                    continue;
+                std::uniform_int_distribution<std::size_t> rand_index(
+                    0, input.size() - 1);
+                input[rand_index(gen)] = r255;
+                break;
+            };
+        }
+
+        auto const asm_r = decode_hex(&input[0], len, &asm_out[0]);
+        auto const c_r = set_hex(input.data(), len, &c_out[0]);
+        if (asm_r != c_r || (asm_r && asm_out != c_out))
+        {
+            std::cerr << "Mismatch decoding " << len << " bytes. asm_r: "
+                      << asm_r << " c_r: " << c_r << '\n';
+            if (++num_bad == max_bad)
+                return false;
+        }
+    }
+
+    return !num_bad;
+}
+
+inline
+bool
+random_test_encode_bulk(int iterations, int max_len)
+{
+    constexpr int max_bad = 1;
+    int num_bad = 0;
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_len(0, max_len);
+    std::uniform_int_distribution<> rand255(0, 255);
+    for (int i = 0; i < iterations; ++i)
+    {
+        std::size_t const len = rand_len(gen);
+        std::string input(len, 0);
+        std::string asm_out(2 * len, 0);
+        std::string c_out(2 * len, 0);
+        for (auto& c : input)
+            c = rand255(gen);
+
+        encode_hex(input.data(), len, &asm_out[0]);
+        encode_hex_ref(input.data(), len, &c_out[0]);
+        if (asm_out != c_out)
+        {
+            std::cerr << "Mismatch encoding " << len << " bytes\n";
+            for (std::size_t j = 0; j < c_out.size(); ++j)
+                if (c_out[j] != asm_out[j])
+                {
+                    std::cerr << "First mismatch index: " << j << '\n';
+                    break;
+                }
+            if (++num_bad == max_bad)
+                return false;
+        }
+    }
+
+    return !num_bad;
+}
+
+inline
+bool
+random_test_decode_batch(int iterations, int bad_digits)
+{
+    constexpr char const alphabet[23] = "0123456789abcdefABCDEF";
+    constexpr int max_bad = 4;
+    int num_bad = 0;
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_count(0, 67);
+    std::uniform_int_distribution<> rand_index21(0, 21);
+    std::uniform_int_distribution<> rand255(0, 255);
+    for (int i = 0; i < iterations; ++i)
+    {
+        std::size_t const count = rand_count(gen);
+        std::string input(64 * count, '0');
+        std::string asm_out(32 * count, 0);
+        std::string c_out(32 * count, 0);
+        std::vector<std::uint8_t> ok((count + 7) / 8, 0xaa);
+        for (auto& c : input)
+            c = alphabet[rand_index21(gen)];
+
+        for (int b = 0; b < bad_digits && count; ++b)
+        {
+            while (1)
+            {
+                auto const r255 = rand255(gen);
+                if (char_unhex(r255) != -1)
+                    continue;
+                std::uniform_int_distribution<std::size_t> rand_index(
+                    0, input.size() - 1);
+                input[rand_index(gen)] = r255;
+                break;
+            };
+        }
+
+        decode_hex256_batch(input.data(), count, &asm_out[0], ok.data());
+        for (std::size_t k = 0; k < count; ++k)
+        {
+            bool const asm_r = (ok[k / 8] >> (k % 8)) & 1;
+            auto const c_r = set_hex_exact(&input[64 * k], &c_out[32 * k]);
+            if (asm_r != c_r ||
+                (asm_r && memcmp(&c_out[32 * k], &asm_out[32 * k], 32)))
+            {
+                print_diff(
+                    &input[64 * k], asm_r, c_r, &asm_out[32 * k], &c_out[32 * k]);
+                std::cerr << "Batch index: " << k << " of " << count << '\n';
+                if (++num_bad == max_bad)
+                    return false;
+            }
+        }
+    }
+
+    return !num_bad;
+}
+
+inline
+bool
+random_test_encode_batch(int iterations)
+{
+    constexpr int max_bad = 1;
+    int num_bad = 0;
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_count(0, 67);
+    std::uniform_int_distribution<> rand255(0, 255);
+    for (int i = 0; i < iterations; ++i)
+    {
+        std::size_t const count = rand_count(gen);
+        std::string input(32 * count, 0);
+        std::string asm_out(64 * count, 0);
+        std::string c_out(64 * count, 0);
+        for (auto& c : input)
+            c = rand255(gen);
+
+        encode_hex256_batch(input.data(), count, &asm_out[0]);
+        for (std::size_t k = 0; k < count; ++k)
+            encode_hex256_ref(&input[32 * k], &c_out[64 * k]);
+        if (asm_out != c_out)
+        {
+            for (std::size_t k = 0; k < count; ++k)
+                if (memcmp(&c_out[64 * k], &asm_out[64 * k], 64))
+                {
+                    print_diff_encode(
+                        &input[32 * k], &asm_out[64 * k], &c_out[64 * k]);
+                    std::cerr << "Batch index: " << k << " of " << count
+                              << '\n';
+                    break;
+                }
+            if (++num_bad == max_bad)
+                return false;
+        }
+    }
+
+    return !num_bad;
+}
+
+// Encode and decode random lengths with basic_codec<Policy> and compare
+// against the case aware reference implementations. The decoder input mixes
+// the digits of either case, one case, bad chars, and each kind of prefix, so
+// both the accepted and the rejected formats are checked.
+template <class Policy>
+bool
+random_test_policy(int iterations)
+{
+    using hex_codec = basic_codec<Policy>;
+    constexpr char const* alphabets[] = {
+        "0123456789abcdefABCDEF", "0123456789ABCDEF", "0123456789abcdef"};
+    constexpr int max_bad = 4;
+    int num_bad = 0;
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_len(0, 80);
+    std::uniform_int_distribution<> rand3(0, 2);
+    std::uniform_int_distribution<> rand4(0, 3);
+    std::uniform_int_distribution<> rand255(0, 255);
+    for (int i = 0; i < iterations; ++i)
+    {
+        // a quarter of the lengths are 32, for the hex256 kernels
+        std::size_t const len = rand4(gen) ? rand_len(gen) : 32;
+        std::string bin(len, 0);
+        for (auto& c : bin)
+            c = rand255(gen);
+
+        std::string asm_enc(hex_codec::encoded_size(len), 0);
+        std::string c_enc(hex_codec::prefix_size ? "0x" : "");
+        c_enc.resize(asm_enc.size());
+        hex_codec::encode(bin.data(), len, &asm_enc[0]);
+        encode_hex_case_ref<Policy::output>(
+            bin.data(), len, &c_enc[hex_codec::prefix_size]);
+        if (asm_enc != c_enc)
+        {
+            std::cerr << "Mismatch encoding " << len << " bytes: " << asm_enc
+                      << '\n';
+            if (++num_bad == max_bad)
+                return false;
+        }
+
+        int const prefix = rand3(gen);
+        std::string input(prefix == 0 ? "0x" : prefix == 1 ? "0X" : "");
+        auto const alphabet = alphabets[rand3(gen)];
+        std::uniform_int_distribution<std::size_t> rand_digit(
+            0, strlen(alphabet) - 1);
+        for (std::size_t j = 0; j < 2 * len; ++j)
+            input += alphabet[rand_digit(gen)];
+        if (len && !rand4(gen))
+        {
+            while (1)
+            {
+                auto const r255 = rand255(gen);
+                if (char_unhex(r255) != -1)
+                    continue;
+                std::uniform_int_distribution<std::size_t> rand_index(
+                    0, 2 * len - 1);
+                input[input.size() - 2 * len + rand_index(gen)] = r255;
+                break;
+            }
+        }
+
+        std::string asm_out(len, 0);
+        std::string c_out(len, 0);
+        auto const asm_r =
+            hex_codec::decode(input.data(), input.size(), &asm_out[0], len);
+        bool c_r;
+        if (prefix == 2)
+            c_r = Policy::prefix != prefix_mode::required &&
+                set_hex_case<Policy::input>(input.data(), len, &c_out[0]);
+        else
+            c_r = Policy::prefix != prefix_mode::none && prefix == 0 &&
+                set_hex_case<Policy::input>(input.data() + 2, len, &c_out[0]);
+        if (asm_r != c_r || (asm_r && asm_out != c_out))
+        {
+            std::cerr << "Mismatch decoding " << input << " asm_r: " << asm_r
+                      << " c_r: " << c_r << '\n';
+            if (++num_bad == max_bad)
+                return false;
+        }
+    }
+
+    return !num_bad;
+}
+
+// random_test_policy for every input case and prefix, with both output cases
+inline
+bool
+random_test_policies(int iterations)
+{
+    constexpr auto upper = letter_case::upper;
+    constexpr auto lower = letter_case::lower;
+    constexpr auto none = prefix_mode::none;
+    constexpr auto optional = prefix_mode::optional;
+    constexpr auto required = prefix_mode::required;
+    return random_test_policy<policy<upper, input_case::any, none>>(
+               iterations) &&
+        random_test_policy<policy<lower, input_case::any, optional>>(
+               iterations) &&
+        random_test_policy<policy<upper, input_case::any, required>>(
+               iterations) &&
+        random_test_policy<policy<lower, input_case::upper, none>>(
+               iterations) &&
+        random_test_policy<policy<upper, input_case::upper, optional>>(
+               iterations) &&
+        random_test_policy<policy<lower, input_case::upper, required>>(
+               iterations) &&
+        random_test_policy<policy<lower, input_case::lower, none>>(
+               iterations) &&
+        random_test_policy<policy<upper, input_case::lower, optional>>(
+               iterations) &&
+        random_test_policy<policy<lower, input_case::lower, required>>(
+               iterations);
+}
+
+// Round trip N random bytes through encode_hex<N> and decode_hex<N>, and
+// decode random digits with bad chars, against the reference. The buffers
+// are sized exactly, so a kernel that reads or writes past the end of them
+// will show up under a memory checker.
+template <std::size_t N>
+bool
+random_test_fixed_width(int iterations, int bad_digits)
+{
+    constexpr char const alphabet[23] = "0123456789abcdefABCDEF";
+    constexpr int max_bad = 4;
+    int num_bad = 0;
+
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_index21(0, 21);
+    std::uniform_int_distribution<> rand_index(0, 2 * N - 1);
+    std::uniform_int_distribution<> rand255(0, 255);
+    std::vector<char> bin(N);
+    std::vector<char> hex(2 * N);
+    std::vector<char> hex_ref(2 * N);
+    std::vector<char> out(N);
+    std::vector<char> out_ref(N);
+    for (int i = 0; i < iterations; ++i)
+    {
+        for (auto& c : bin)
+            c = rand255(gen);
+        encode_hex<N>(bin.data(), hex.data());
+        encode_hex_ref(bin.data(), N, hex_ref.data());
+        if (hex != hex_ref ||
+            !decode_hex<N>(hex.data(), out.data()) || out != bin)
+        {
+            std::cerr << "Mismatch encoding " << N << " bytes\n";
+            if (++num_bad == max_bad)
+                return false;
+            continue;
+        }
+
+        for (auto& c : hex)
+            c = alphabet[rand_index21(gen)];
+        for (int b = 0; b < bad_digits; ++b)
+        {
+            auto const r255 = rand255(gen);
+            if (char_unhex(r255) == -1)
+                hex[rand_index(gen)] = r255;
+        }
+        auto const r = decode_hex<N>(hex.data(), out.data());
+        auto const r_ref = set_hex(hex.data(), N, out_ref.data());
+        if (!r != !r_ref || (r && out != out_ref))
+        {
+            std::cerr << "Mismatch decoding " << N << " bytes. asm_r: " << r
+                      << " c_r: " << r_ref << '\n';
+            if (++num_bad == max_bad)
+                return false;
+        }
+    }
+
+    return !num_bad;
+}
+
+inline
+bool
+random_test_fixed_widths(int iterations)
+{
+    return random_test_fixed_width<20>(iterations, 0) &&
+        random_test_fixed_width<20>(iterations, 1) &&
+        random_test_fixed_width<33>(iterations, 0) &&
+        random_test_fixed_width<33>(iterations, 1) &&
+        random_test_fixed_width<64>(iterations, 0) &&
+        random_test_fixed_width<64>(iterations, 1) &&
+        random_test_fixed_width<21>(iterations, 1);
+}
+
+// Compare decode_hex_lenient against decode_hex_lenient_ref on digits with
+// runs of separators, prefixes, bad chars, odd counts and outputs too small
+inline
+bool
+random_test_lenient(int iterations)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_len(0, 200);
+    std::uniform_int_distribution<> rand_char(0, 255);
+    std::uniform_int_distribution<> rand_kind(0, 9);
+    char const* const digits = "0123456789ABCDEFabcdef";
+    char const* const separators = " :-";
+
+    for (int it = 0; it < iterations; ++it)
+    {
+        auto const kind = rand_kind(gen);
+        std::string in;
+        if (kind == 0)
+            in += rand_char(gen) & 1 ? "0x" : " 0X";
+        // the chance of a separator after each digit
+        int const spacing = rand_char(gen);
+        std::size_t const num_digits = rand_len(gen) * (kind == 1 ? 1 : 2);
+        for (std::size_t i = 0; i < num_digits; ++i)
+        {
+            in += digits[rand_char(gen) % 22];
+            while (rand_char(gen) < spacing)
+                in += separators[rand_char(gen) % 3];
+        }
+        if (kind == 2 && !in.empty())
+            in[rand_char(gen) % in.size()] = "gx0 "[rand_char(gen) % 4];
+
+        std::size_t out_size = num_digits / 2;
+        if (kind == 3 && out_size)
+            out_size -= 1 + rand_char(gen) % out_size;
+        std::string out(out_size + 1, 0);
+        std::string out_ref(out_size + 1, 0);
+        auto const n = decode_hex_lenient(in.data(), in.size(), &out[0], out_size);
+        auto const n_ref =
+            decode_hex_lenient_ref(in.data(), in.size(), &out_ref[0], out_size);
+        if (n != n_ref || (n >= 0 && out.compare(0, n, out_ref, 0, n)) ||
+            out[out_size] != 0)
+        {
+            std::cerr << "decode_hex_lenient mismatch: " << in << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+inline
+void
+benchmark_encode()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    char out[64];
+    char val[32];
+    memset(val, 0xf0, 32);
+
+    int const iters = 100'000'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            encode_hex256(val, out);
+        }
+        auto end = timer::now();
+        std::cout << "Enc Asm: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            encode_hex256_ref(val, out);
+        }
+        auto end = timer::now();
+        std::cout << "  Enc C: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        // same number of keys as above, encoded batch_size at a time
+        int const batch_size = 1024;
+        std::string vals(32 * batch_size, '\xf0');
+        std::string outs(64 * batch_size, 0);
+
+        auto start = timer::now();
+        for (int i = 0; i < iters / batch_size; ++i)
+        {
+            encode_hex256_batch(vals.data(), batch_size, &outs[0]);
+        }
+        auto end = timer::now();
+        std::cout << "Enc Asm Batch: " << time_diff(start, end).count() << '\n';
+    }
+
+    // every vector variant the cpu supports, regardless of the active one
+    for (auto const level : cpu::supported_isas())
+    {
+        if (level == cpu::isa::scalar)
+            continue;
+        auto const encode = kernels_for(level).encode_hex256;
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            encode(val, out);
+        }
+        auto end = timer::now();
+        std::cout << "Enc " << cpu::name(level) << ": "
+                  << time_diff(start, end).count() << '\n';
+    }
+}
+
+inline
+void
+benchmark_decode()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    char out[32];
+    char const* val =
+        "0123456789abcdef0000111122223333444455556666777788889999aaaabbbb";
+
+    int const iters = 100'000'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
     };
 
     {
@@ -245,6 +1701,323 @@ benchmark_decode()
         auto end = timer::now();
         std::cout << "  Dec C: " << time_diff(start, end).count() << '\n';
     }
+
+    {
+        // same number of keys as above, decoded batch_size at a time
+        int const batch_size = 1024;
+        std::string vals;
+        for (int i = 0; i < batch_size; ++i)
+            vals += val;
+        std::string outs(32 * batch_size, 0);
+        std::vector<std::uint8_t> ok(batch_size / 8);
+
+        auto start = timer::now();
+        for (int i = 0; i < iters / batch_size; ++i)
+        {
+            decode_hex256_batch(vals.data(), batch_size, &outs[0], ok.data());
+            // need if or optimizer will skip call
+            if (ok[0] != 0xff)
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Dec Asm Batch: " << time_diff(start, end).count() << '\n';
+    }
+
+    // every vector variant the cpu supports, regardless of the active one
+    for (auto const level : cpu::supported_isas())
+    {
+        if (level == cpu::isa::scalar)
+            continue;
+        auto const decode = kernels_for(level).decode_hex256;
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            // need if or optimizer will skip call
+            if (!decode(val, out))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Dec " << cpu::name(level) << ": "
+                  << time_diff(start, end).count() << '\n';
+    }
+}
+
+// Encode and decode a 1 MB buffer. Reports the time for 1 GB of binary data.
+inline
+void
+benchmark_bulk()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    std::size_t const len = 1 << 20;
+    std::string bin(len, '\xf0');
+    std::string hex(2 * len, 0);
+
+    int const iters = 1'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            encode_hex(bin.data(), len, &hex[0]);
+        }
+        auto end = timer::now();
+        std::cout << "Bulk Enc Asm: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            encode_hex_ref(bin.data(), len, &hex[0]);
+        }
+        auto end = timer::now();
+        std::cout << "  Bulk Enc C: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            // need if or optimizer will skip call
+            if (!decode_hex(hex.data(), len, &bin[0]))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Bulk Dec Asm: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (!set_hex(hex.data(), len, &bin[0]))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "  Bulk Dec C: " << time_diff(start, end).count() << '\n';
+    }
+}
+
+// Lowercase output and uppercase only input with the policy kernels, against
+// the default kernels alone and followed by a separate tolower or validation
+// pass.
+inline
+void
+benchmark_policy()
+{
+    using timer = std::chrono::high_resolution_clock;
+    using default_codec = basic_codec<policy<>>;
+    using lower_codec = basic_codec<policy<letter_case::lower>>;
+    using strict_codec =
+        basic_codec<policy<letter_case::upper, input_case::upper>>;
+
+    char out[64];
+    char val[32];
+    memset(val, 0xf0, 32);
+    char const* hex =
+        "0123456789ABCDEF0000111122223333444455556666777788889999AAAABBBB";
+
+    int const iters = 100'000'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            default_codec::encode(val, 32, out);
+        }
+        auto end = timer::now();
+        std::cout << "        Enc Default: " << time_diff(start, end).count()
+                  << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            encode_hex256(val, out);
+            for (auto& c : out)
+                c = std::tolower(static_cast<unsigned char>(c));
+        }
+        auto end = timer::now();
+        std::cout << "Enc Lower Post-pass: " << time_diff(start, end).count()
+                  << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            lower_codec::encode(val, 32, out);
+        }
+        auto end = timer::now();
+        std::cout << "   Enc Lower Policy: " << time_diff(start, end).count()
+                  << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            // need if or optimizer will skip call
+            if (!default_codec::decode(hex, 64, out, 32))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "        Dec Default: " << time_diff(start, end).count()
+                  << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (std::any_of(hex, hex + 64, [](char c) {
+                    return c >= 'a' && c <= 'f';
+                }) ||
+                !decode_hex256(hex, out))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Dec Upper Post-pass: " << time_diff(start, end).count()
+                  << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            if (!strict_codec::decode(hex, 64, out, 32))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "   Dec Upper Policy: " << time_diff(start, end).count()
+                  << '\n';
+    }
+}
+
+
+// Decode and encode an N byte value with decode_hex<N>/encode_hex<N>, with
+// the variable length kernels, and with the reference
+template <std::size_t N>
+void
+benchmark_fixed_width()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    std::string hex(2 * N, 'f');
+    std::string bin(N, 0);
+    int const iters = 10'000'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    auto report = [&](char const* name, auto f) {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            // need if or optimizer will skip call
+            if (!f())
+                return;
+        }
+        auto end = timer::now();
+        std::cout << name << ' ' << N << ": "
+                  << time_diff(start, end).count() << '\n';
+    };
+
+    report("Dec Fixed", [&] { return decode_hex<N>(hex.data(), &bin[0]); });
+    report("  Dec Var", [&] { return decode_hex(hex.data(), N, &bin[0]); });
+    report("    Dec C", [&] { return set_hex(hex.data(), N, &bin[0]); });
+    report("Enc Fixed", [&] {
+        encode_hex<N>(bin.data(), &hex[0]);
+        return hex[0] == 'F';
+    });
+    report("  Enc Var", [&] {
+        encode_hex(bin.data(), N, &hex[0]);
+        return hex[0] == 'F';
+    });
+    report("    Enc C", [&] {
+        encode_hex_ref(bin.data(), N, &hex[0]);
+        return hex[0] == 'F';
+    });
+}
+
+inline
+void
+benchmark_fixed_widths()
+{
+    benchmark_fixed_width<20>();
+    benchmark_fixed_width<33>();
+    benchmark_fixed_width<64>();
+}
+
+// Decode keys pasted as byte pairs between colons, with the lenient decoder
+// and with a copy of the digits to a buffer followed by decode_hex256
+inline
+void
+benchmark_lenient()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    // "01:23:45:...", 95 chars
+    std::string key;
+    char const* const pairs =
+        "0123456789ABCDEF0000111122223333444455556666777788889999AAAABBBB";
+    for (int i = 0; i < 32; ++i)
+    {
+        if (i)
+            key += ':';
+        key.append(pairs + 2 * i, 2);
+    }
+    char out[32];
+    int const iters = 10'000'000;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            // need if or optimizer will skip call
+            if (decode_hex_lenient(key.data(), key.size(), out, 32) != 32)
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "Dec Lenient: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        for (int i = 0; i < iters; ++i)
+        {
+            char digits[64];
+            std::size_t n = 0;
+            for (auto c : key)
+            {
+                if (!is_hex_separator(c) && n < 64)
+                    digits[n++] = c;
+            }
+            if (n != 64 || !decode_hex256(digits, out))
+                return;
+        }
+        auto end = timer::now();
+        std::cout << "   Dec Copy: " << time_diff(start, end).count() << '\n';
+    }
 }
 
 }  // namespace hex
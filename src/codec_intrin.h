@@ -0,0 +1,663 @@
+#pragma once
+
+#include "codec_base58.h"
+#include "codec_base64.h"
+#include "codec_hex.h"
+
+#include <immintrin.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+   AVX2 intrinsics versions of the small kernels, for callers that decode or
+   encode one key at a time in a loop of their own.
+
+   The asm kernels are opaque calls: each one reloads its constants, can't be
+   unrolled into the caller's loop, and ends with vzeroupper, which is most
+   of the cost for 32 bytes. These are inline, so the compiler hoists the
+   constants out of the caller's loop and keeps everything in registers. They
+   don't dispatch: the caller checks the cpu has avx2 (cpu::best_isa()), and
+   is itself compiled with -mavx2 or marked CODEC_TARGET_AVX2, or they won't
+   be inlined.
+
+   The asm kernels stay the reference, and random_test_intrinsics checks
+   these against them. They compute the same results, but not always with
+   the same instructions: the hex decoder packs the nibbles with pmaddubsw
+   and packuswb, and the base58 one merges the digits with pmaddubsw and
+   pmaddwd, which are shorter written as intrinsics.
+
+   The kernels whose calls run long (the batch, bulk and sha256 kernels)
+   have no intrinsics version, since the call is a small part of their cost.
+*/
+
+#define CODEC_TARGET_AVX2 __attribute__((target("avx2")))
+
+namespace codec {
+namespace intrin {
+
+namespace detail {
+
+// 16 bytes into 32 hex chars. First is the first letter: 'A' or 'a'.
+template <char First>
+CODEC_TARGET_AVX2 inline __m256i
+encode_hex_16(__m128i bytes)
+{
+    auto const w = _mm256_cvtepu8_epi16(bytes);
+    // the high nibble in the first byte of each word, the low in the second
+    auto const v = _mm256_add_epi8(
+        _mm256_srli_epi16(w, 4),
+        _mm256_slli_epi16(_mm256_and_si256(w, _mm256_set1_epi16(0x0f)), 8));
+    auto const digit = _mm256_cmpgt_epi8(_mm256_set1_epi8(10), v);
+    auto const offset = _mm256_blendv_epi8(
+        _mm256_set1_epi8(First - 10), _mm256_set1_epi8('0'), digit);
+    return _mm256_add_epi8(v, offset);
+}
+
+// 32 hex chars of either case into their values. Ors a nonzero byte into bad
+// for a char that is not a hex digit.
+CODEC_TARGET_AVX2 inline __m256i
+decode_hex_32(__m256i c, __m256i& bad)
+{
+    auto const nine = _mm256_set1_epi8('9');
+    // upcase the letters by clearing bit six
+    auto gt9 = _mm256_cmpgt_epi8(c, nine);
+    c = _mm256_andnot_si256(
+        _mm256_and_si256(gt9, _mm256_set1_epi8(0x20)), c);
+    gt9 = _mm256_cmpgt_epi8(c, nine);
+    // between '9' and 'A' is bad, and so is a value above 15 (which includes
+    // every char below '0' or above 'F', and the bytes >= 0x80)
+    bad = _mm256_or_si256(
+        bad,
+        _mm256_and_si256(gt9, _mm256_cmpgt_epi8(_mm256_set1_epi8('A'), c)));
+    auto const v = _mm256_sub_epi8(
+        c,
+        _mm256_blendv_epi8(
+            _mm256_set1_epi8('0'), _mm256_set1_epi8('A' - 10), gt9));
+    bad = _mm256_or_si256(
+        bad, _mm256_and_si256(v, _mm256_set1_epi8(static_cast<char>(0xf0))));
+    return v;
+}
+
+// 64 nibble values into 32 bytes
+CODEC_TARGET_AVX2 inline __m256i
+pack_nibbles(__m256i lo, __m256i hi)
+{
+    // the first nibble of each pair is the high one
+    auto const pair = _mm256_set1_epi16(0x0110);
+    auto const packed = _mm256_packus_epi16(
+        _mm256_maddubs_epi16(lo, pair), _mm256_maddubs_epi16(hi, pair));
+    // packus interleaves the lanes of its inputs
+    return _mm256_permute4x64_epi64(packed, 0xd8);
+}
+
+}  // namespace detail
+
+// Encode 32 bytes into 64 hex chars, like encode_hex256_avx2. Lower writes
+// lowercase letters.
+template <bool Lower = false>
+CODEC_TARGET_AVX2 inline void
+encode_hex256(char const* in, char* out)
+{
+    constexpr char first = Lower ? 'a' : 'A';
+    auto const bytes =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out),
+        detail::encode_hex_16<first>(_mm256_castsi256_si128(bytes)));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out + 32),
+        detail::encode_hex_16<first>(_mm256_extracti128_si256(bytes, 1)));
+}
+
+// Decode 64 hex chars of either case into 32 bytes, like decode_hex256_avx2.
+// Returns 0 if there is a bad hex char, and the output is then garbage.
+CODEC_TARGET_AVX2 inline int
+decode_hex256(char const* in, char* out)
+{
+    auto bad = _mm256_setzero_si256();
+    auto const lo = detail::decode_hex_32(
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in)), bad);
+    auto const hi = detail::decode_hex_32(
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in + 32)), bad);
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out), detail::pack_nibbles(lo, hi));
+    return _mm256_testz_si256(bad, bad);
+}
+
+// Encode len bytes into 2*len hex chars. The input and output must not
+// overlap.
+template <bool Lower = false>
+CODEC_TARGET_AVX2 inline void
+encode_hex(char const* in, std::size_t len, char* out)
+{
+    if (len < 32)
+    {
+        if (Lower)
+            hex::encode_hex_case_ref<hex::letter_case::lower>(in, len, out);
+        else
+            hex::encode_hex_ref(in, len, out);
+        return;
+    }
+    // the last block is aligned to the end, and may overlap the one before
+    for (std::size_t i = 0;; i += 32)
+    {
+        i = std::min(i, len - 32);
+        encode_hex256<Lower>(in + i, out + 2 * i);
+        if (i == len - 32)
+            return;
+    }
+}
+
+// Decode 2*len hex chars of either case into len bytes. Returns 0 if there is
+// a bad hex char. The input and output must not overlap.
+CODEC_TARGET_AVX2 inline int
+decode_hex(char const* in, std::size_t len, char* out)
+{
+    if (len < 32)
+        return hex::decode_hex_scalar(in, len, out);
+    int ok = 1;
+    for (std::size_t i = 0;; i += 32)
+    {
+        i = std::min(i, len - 32);
+        ok &= decode_hex256(in + 2 * i, out + i);
+        if (i == len - 32)
+            return ok;
+    }
+}
+
+namespace detail {
+
+// 32 chars into their values through the digit rows (see digit_rows), and
+// 0xff for the chars that are not digits
+CODEC_TARGET_AVX2 inline __m256i
+lookup_digits_32(__m256i c, __m256i const (&rows)[base58::digit_rows::num_rows])
+{
+    auto const low_nibble = _mm256_set1_epi8(0x0f);
+    auto const hi = _mm256_and_si256(_mm256_srli_epi16(c, 4), low_nibble);
+    auto const lo = _mm256_and_si256(c, low_nibble);
+    auto v = _mm256_set1_epi8(static_cast<char>(0xff));
+    for (int r = 0; r < base58::digit_rows::num_rows; ++r)
+    {
+        auto const in_row = _mm256_cmpeq_epi8(
+            hi, _mm256_set1_epi8(base58::digit_rows::first_high_nibble + r));
+        v = _mm256_blendv_epi8(v, _mm256_shuffle_epi8(rows[r], lo), in_row);
+    }
+    return v;
+}
+
+// 32 digit values, most significant first, into 8 base 58^4 dwords
+CODEC_TARGET_AVX2 inline __m256i
+merge_digits_4(__m256i v)
+{
+    // 58 and 1, then 58^2 and 1
+    auto const pairs = _mm256_maddubs_epi16(v, _mm256_set1_epi16(0x013a));
+    return _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00010d24));
+}
+
+}  // namespace detail
+
+/**
+   Convert 44 base58 digits into 6 base 58^8 coefficients, least significant
+   first, like base58_8_coeff_avx2. Returns 1, or 0 if any char is not a
+   digit of the alphabet, in which case the coefficients are garbage.
+*/
+CODEC_TARGET_AVX2 inline int
+base58_8_coeff(
+    unsigned char const* in,
+    std::uint64_t* out,
+    base58::digit_rows const& rows)
+{
+    __m256i table[base58::digit_rows::num_rows];
+    for (int r = 0; r < base58::digit_rows::num_rows; ++r)
+        table[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128(
+            reinterpret_cast<__m128i const*>(rows.rows[r])));
+
+    // chars 0-31 and 12-43: the groups of four digits at 0, 4, ... 28, and
+    // at 12, 16, ... 40
+    auto const a = detail::lookup_digits_32(
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in)), table);
+    auto const b = detail::lookup_digits_32(
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in + 12)), table);
+    // digits are at most 57, so only a bad char (0xff) sets the high bit
+    int const bad = _mm256_movemask_epi8(_mm256_or_si256(a, b));
+
+    auto const ga = detail::merge_digits_4(a);
+    auto const gb = detail::merge_digits_4(b);
+
+    // each qword of gb holds a pair of groups: the coefficients 3 to 0
+    std::uint64_t const b58_4 = 0xACAD10;
+    auto const coeff = _mm256_add_epi64(
+        _mm256_mul_epu32(gb, _mm256_set1_epi64x(b58_4)),
+        _mm256_srli_epi64(gb, 32));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i*>(out),
+        _mm256_permute4x64_epi64(coeff, 0x1b));
+
+    // coefficient 4 is groups 1 and 2, and 5 is the four digits of group 0
+    auto const low = _mm256_castsi256_si128(ga);
+    out[4] = b58_4 * static_cast<std::uint32_t>(_mm_extract_epi32(low, 1)) +
+        static_cast<std::uint32_t>(_mm_extract_epi32(low, 2));
+    out[5] = static_cast<std::uint32_t>(_mm_cvtsi128_si32(low));
+    return bad == 0;
+}
+
+namespace detail {
+
+// The tables of each base64 alphabet, as in base64.asm: the offsets of the
+// encoder, the classes each low nibble is invalid in, the offsets of the
+// decoder, and the digit with an offset of its own
+template <base64::alphabet A>
+struct base64_tables;
+
+template <>
+struct base64_tables<base64::alphabet::standard>
+{
+    CODEC_TARGET_AVX2 static __m256i
+    encode_offsets()
+    {
+        return _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 65, 0, 0));
+    }
+
+    CODEC_TARGET_AVX2 static __m256i
+    decode_lo()
+    {
+        return _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            0x0b, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+            0x03, 0x03, 0x07, 0x35, 0x37, 0x37, 0x37, 0x35));
+    }
+
+    CODEC_TARGET_AVX2 static __m256i
+    decode_offsets()
+    {
+        return _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 16, 0, 0, 0, 0, 0));
+    }
+
+    static constexpr char odd_digit = '/';
+};
+
+template <>
+struct base64_tables<base64::alphabet::url>
+{
+    CODEC_TARGET_AVX2 static __m256i
+    encode_offsets()
+    {
+        return _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -17, 32, 65, 0, 0));
+    }
+
+    CODEC_TARGET_AVX2 static __m256i
+    decode_lo()
+    {
+        return _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            0x0b, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03, 0x03,
+            0x03, 0x03, 0x07, 0x37, 0x37, 0x35, 0x37, 0x27));
+    }
+
+    CODEC_TARGET_AVX2 static __m256i
+    decode_offsets()
+    {
+        return _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            0, 0, 17, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, -32, 0, 0));
+    }
+
+    static constexpr char odd_digit = '_';
+};
+
+}  // namespace detail
+
+/**
+   Encode 24 bytes into 32 base64 chars. Reads 28 bytes, so the caller must
+   have 4 bytes past the 24.
+*/
+template <base64::alphabet A = base64::alphabet::standard>
+CODEC_TARGET_AVX2 inline void
+encode_base64_block(unsigned char const* in, char* out)
+{
+    // 12 bytes in each lane, then bytes b1 b0 b2 b1 in each dword
+    auto v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(in))),
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + 12)),
+        1);
+    v = _mm256_shuffle_epi8(
+        v,
+        _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10)));
+    // the first and third 6-bit values down, the second and fourth up
+    auto const ac = _mm256_mulhi_epu16(
+        _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)),
+        _mm256_set1_epi32(0x04000040));
+    auto const bd = _mm256_mullo_epi16(
+        _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)),
+        _mm256_set1_epi32(0x01000010));
+    v = _mm256_or_si256(ac, bd);
+
+    // 0-25 -> 13, 26-51 -> 0, 52-63 -> 1-12, then the offset of the range
+    auto index = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+    index = _mm256_or_si256(
+        index,
+        _mm256_and_si256(
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(26), v),
+            _mm256_set1_epi8(13)));
+    v = _mm256_add_epi8(
+        v,
+        _mm256_shuffle_epi8(
+            detail::base64_tables<A>::encode_offsets(), index));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+}
+
+/**
+   Decode 32 base64 chars into 24 bytes. Writes 32 bytes. Returns false if a
+   char is not a digit, and writes nothing then.
+*/
+template <base64::alphabet A = base64::alphabet::standard>
+CODEC_TARGET_AVX2 inline bool
+decode_base64_block(char const* in, unsigned char* out)
+{
+    auto const low_nibble = _mm256_set1_epi8(0x0f);
+    auto const c = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(in));
+    auto const hi = _mm256_and_si256(_mm256_srli_epi32(c, 4), low_nibble);
+    auto const lo = _mm256_and_si256(c, low_nibble);
+
+    // a digit has no class in common between its low and high nibbles
+    auto const hi_class = _mm256_broadcastsi128_si256(_mm_setr_epi8(
+        0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x08, 0x20,
+        0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01));
+    if (!_mm256_testz_si256(
+            _mm256_shuffle_epi8(detail::base64_tables<A>::decode_lo(), lo),
+            _mm256_shuffle_epi8(hi_class, hi)))
+        return false;
+
+    // the offset by high nibble, or 8 + it for the odd digit
+    auto const odd = _mm256_and_si256(
+        _mm256_cmpeq_epi8(
+            c, _mm256_set1_epi8(detail::base64_tables<A>::odd_digit)),
+        _mm256_set1_epi8(8));
+    auto v = _mm256_add_epi8(
+        c,
+        _mm256_shuffle_epi8(
+            detail::base64_tables<A>::decode_offsets(),
+            _mm256_or_si256(hi, odd)));
+
+    // four 6-bit values into 24 bits, then 12 big endian bytes to the front
+    // of each lane, then 24 to the front
+    v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+    v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+    v = _mm256_shuffle_epi8(
+        v,
+        _mm256_broadcastsi128_si256(_mm_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)));
+    v = _mm256_permutevar8x32_epi32(
+        v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+    return true;
+}
+
+// The block loops, with the contract of base64_encode_avx2: returns the number
+// of bytes encoded, a multiple of 24, and leaves the rest to the caller
+template <base64::alphabet A = base64::alphabet::standard>
+CODEC_TARGET_AVX2 inline std::size_t
+encode_base64_blocks(unsigned char const* in, std::size_t len, char* out)
+{
+    std::size_t i = 0;
+    for (; i + 28 <= len; i += 24, out += 32)
+        encode_base64_block<A>(in + i, out);
+    return i;
+}
+
+// and of base64_decode_avx2: returns the number of chars decoded, a multiple
+// of 32, stopping at the last 12 chars or the first block with a bad char
+template <base64::alphabet A = base64::alphabet::standard>
+CODEC_TARGET_AVX2 inline std::size_t
+decode_base64_blocks(char const* in, std::size_t len, unsigned char* out)
+{
+    std::size_t i = 0;
+    for (; i + 44 <= len; i += 32, out += 24)
+    {
+        if (!decode_base64_block<A>(in + i, out))
+            break;
+    }
+    return i;
+}
+
+// The body of random_test_intrinsics, for cpus with avx2
+CODEC_TARGET_AVX2 inline bool
+random_test_intrinsics_avx2(int iterations)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_byte(0, 255);
+    std::uniform_int_distribution<> rand_len(0, 200);
+    std::uniform_int_distribution<> rand_digit(0, 57);
+    char const* const hex_digits = "0123456789abcdefABCDEF";
+
+    for (int it = 0; it < iterations; ++it)
+    {
+        // hex, every length up to 200 bytes, sometimes with a bad char
+        std::size_t const len = rand_len(gen);
+        std::vector<char> bytes(len + 32), chars(2 * len + 64);
+        std::vector<char> out(len + 32), ref(len + 32);
+        for (auto& b : bytes)
+            b = rand_byte(gen);
+        std::string expected(2 * len, 0);
+        encode_hex(bytes.data(), len, chars.data());
+        hex::encode_hex_ref(bytes.data(), len, &expected[0]);
+        bool same = !expected.compare(0, 2 * len, chars.data(), 2 * len);
+        encode_hex<true>(bytes.data(), len, chars.data());
+        hex::encode_hex_case_ref<hex::letter_case::lower>(
+            bytes.data(), len, &expected[0]);
+        same &= !expected.compare(0, 2 * len, chars.data(), 2 * len);
+        if (!same)
+        {
+            std::cerr << "intrin::encode_hex mismatch, len: " << len << '\n';
+            return false;
+        }
+        for (std::size_t i = 0; i < 2 * len; ++i)
+            chars[i] = hex_digits[rand_byte(gen) % 22];
+        if (len && rand_byte(gen) < 64)
+            chars[rand_byte(gen) % (2 * len)] = rand_byte(gen);
+        auto const r = decode_hex(chars.data(), len, out.data());
+        auto const rr = hex::decode_hex_scalar(chars.data(), len, ref.data());
+        if (!r != !rr || (r && memcmp(out.data(), ref.data(), len)))
+        {
+            std::cerr << "intrin::decode_hex mismatch, len: " << len << '\n';
+            return false;
+        }
+        if (len >= 32)
+        {
+            auto const r256 = decode_hex256(chars.data(), out.data());
+            auto const rr256 = decode_hex256_avx2(chars.data(), ref.data());
+            if (!r256 != !rr256 || (r256 && memcmp(out.data(), ref.data(), 32)))
+            {
+                std::cerr << "intrin::decode_hex256 mismatch\n";
+                return false;
+            }
+        }
+
+        // base58 coefficients, sometimes with a bad char
+        unsigned char digits[44];
+        for (auto& d : digits)
+            d = base58::rippleAlphabet[rand_digit(gen)];
+        if (rand_byte(gen) < 64)
+            digits[rand_byte(gen) % 44] = rand_byte(gen);
+        std::uint64_t coeff[6], coeff_ref[6];
+        auto const& rows = base58::rippleInverse.rows();
+        auto const c = intrin::base58_8_coeff(digits, coeff, rows);
+        auto const cr = base58_8_coeff_avx2(digits, coeff_ref, rows.data());
+        if (c != cr || (c && memcmp(coeff, coeff_ref, sizeof(coeff))))
+        {
+            std::cerr << "intrin::base58_8_coeff mismatch\n";
+            return false;
+        }
+
+        // base64 blocks in both alphabets, sometimes with a bad char
+        std::vector<unsigned char> bin(len + 32);
+        for (auto& b : bin)
+            b = rand_byte(gen);
+        std::string b64(base64::encoded_size(len) + 32, 0);
+        std::string b64_ref(b64.size(), 0);
+        auto const url = rand_byte(gen) & 1;
+        auto const e = url
+            ? encode_base64_blocks<base64::alphabet::url>(
+                  bin.data(), len, &b64[0])
+            : encode_base64_blocks(bin.data(), len, &b64[0]);
+        auto const er = url
+            ? base64_encode_url_avx2(bin.data(), len, &b64_ref[0])
+            : base64_encode_avx2(bin.data(), len, &b64_ref[0]);
+        if (e != er || b64 != b64_ref)
+        {
+            std::cerr << "intrin::encode_base64_blocks mismatch, len: " << len
+                      << '\n';
+            return false;
+        }
+        auto const n = base64::encode_base64_ref(
+            bin.data(),
+            len,
+            &b64[0],
+            url ? base64::alphabet::url : base64::alphabet::standard,
+            false);
+        if (n && rand_byte(gen) < 64)
+            b64[rand_byte(gen) % n] = rand_byte(gen);
+        std::vector<unsigned char> dec(len + 32), dec_ref(len + 32);
+        auto const d = url
+            ? decode_base64_blocks<base64::alphabet::url>(
+                  b64.data(), n, dec.data())
+            : decode_base64_blocks(b64.data(), n, dec.data());
+        auto const dr = url
+            ? base64_decode_url_avx2(b64.data(), n, dec_ref.data())
+            : base64_decode_avx2(b64.data(), n, dec_ref.data());
+        if (d != dr || memcmp(dec.data(), dec_ref.data(), d / 4 * 3))
+        {
+            std::cerr << "intrin::decode_base64_blocks mismatch, len: " << len
+                      << '\n';
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+   Check the intrinsics kernels against the asm ones (and the portable code
+   for the short hex inputs), on random input with bad chars. Returns true
+   without checking anything if the cpu doesn't have avx2.
+
+   This is not compiled for avx2 itself, so nothing runs before the check
+   that a cpu without avx2 can't execute. The kernels ignore cpu::set_isa,
+   so it only needs to run once.
+*/
+inline
+bool
+random_test_intrinsics(int iterations)
+{
+    if (cpu::best_isa() < cpu::isa::avx2)
+        return true;
+    return random_test_intrinsics_avx2(iterations);
+}
+
+// The body of benchmark_intrinsics, for cpus with avx2
+CODEC_TARGET_AVX2 inline void
+benchmark_intrinsics_avx2()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    std::size_t const num_keys = 1'000'000;
+    std::vector<char> values(32 * num_keys, '\x5a');
+    std::vector<char> keys(64 * num_keys);
+    for (std::size_t i = 0; i < num_keys; ++i)
+        encode_hex256_avx2(&values[32 * i], &keys[64 * i]);
+
+    std::vector<unsigned char> strings(44 * num_keys);
+    for (std::size_t i = 0; i < strings.size(); ++i)
+        strings[i] = base58::rippleAlphabet[i % 44 ? i % 58 : 1];
+    std::vector<std::uint64_t> coeff(6 * num_keys);
+    auto const& rows = base58::rippleInverse.rows();
+
+    int const iters = 10;
+    {
+        auto start = timer::now();
+        int ok = 1;
+        for (int it = 0; it < iters; ++it)
+            for (std::size_t i = 0; i < num_keys; ++i)
+                ok &= decode_hex256_avx2(&keys[64 * i], &values[32 * i]);
+        auto end = timer::now();
+        std::cout << "  Dec hex Asm: " << time_diff(start, end).count();
+        if (!ok)
+            return;
+
+        start = timer::now();
+        for (int it = 0; it < iters; ++it)
+            for (std::size_t i = 0; i < num_keys; ++i)
+                ok &= decode_hex256(&keys[64 * i], &values[32 * i]);
+        end = timer::now();
+        std::cout << " Intrin: " << time_diff(start, end).count() << '\n';
+        if (!ok)
+            return;
+    }
+
+    {
+        auto start = timer::now();
+        for (int it = 0; it < iters; ++it)
+            for (std::size_t i = 0; i < num_keys; ++i)
+                encode_hex256_avx2(&values[32 * i], &keys[64 * i]);
+        auto end = timer::now();
+        std::cout << "  Enc hex Asm: " << time_diff(start, end).count();
+
+        start = timer::now();
+        for (int it = 0; it < iters; ++it)
+            for (std::size_t i = 0; i < num_keys; ++i)
+                encode_hex256(&values[32 * i], &keys[64 * i]);
+        end = timer::now();
+        std::cout << " Intrin: " << time_diff(start, end).count() << '\n';
+    }
+
+    {
+        auto start = timer::now();
+        int ok = 1;
+        for (int it = 0; it < iters; ++it)
+            for (std::size_t i = 0; i < num_keys; ++i)
+                ok &= base58_8_coeff_avx2(
+                    &strings[44 * i], &coeff[6 * i], rows.data());
+        auto end = timer::now();
+        std::cout << "Base58 8 Asm: " << time_diff(start, end).count();
+        if (!ok)
+            return;
+
+        start = timer::now();
+        for (int it = 0; it < iters; ++it)
+            for (std::size_t i = 0; i < num_keys; ++i)
+                ok &= intrin::base58_8_coeff(&strings[44 * i], &coeff[6 * i], rows);
+        end = timer::now();
+        std::cout << " Intrin: " << time_diff(start, end).count() << '\n';
+    }
+}
+
+/**
+   Decode and encode a million 32 byte hex keys and base58 coefficients one
+   at a time in a loop, with the asm kernels and with the intrinsics. This is
+   the cost of the call and its constants that inlining removes. Does nothing
+   if the cpu doesn't have avx2.
+*/
+inline
+void
+benchmark_intrinsics()
+{
+    if (cpu::best_isa() < cpu::isa::avx2)
+        return;
+    benchmark_intrinsics_avx2();
+}
+
+}  // namespace intrin
+}  // namespace codec
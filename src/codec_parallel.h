@@ -0,0 +1,618 @@
+#pragma once
+
+#include "codec_base58.h"
+#include "codec_hex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace codec {
+
+/**
+   A fixed set of threads that run the tasks of one job at a time, with work
+   stealing.
+
+   run() deals the tasks out to the workers in contiguous ranges, so each
+   worker streams through neighbouring chunks of the input. A worker takes
+   tasks from the front of its own queue, and when that is empty it steals
+   from the back of the others, so a worker that falls behind (a slow core,
+   or a chunk with many bad records) doesn't hold up the job. The thread
+   that calls run() is one of the workers.
+*/
+class work_pool
+{
+private:
+    struct queue
+    {
+        std::mutex mutex;
+        std::deque<std::size_t> tasks;
+    };
+
+    // one queue per worker; queue 0 belongs to the thread that calls run()
+    std::vector<std::unique_ptr<queue>> queues_;
+    std::vector<std::thread> threads_;
+
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    // the job of the current run, or null between runs
+    std::function<void(std::size_t)> const* job_ = nullptr;
+    std::size_t generation_ = 0;
+    // pool threads inside work()
+    unsigned busy_ = 0;
+    bool stop_ = false;
+    std::atomic<std::size_t> remaining_{0};
+
+public:
+    // A pool of num_threads workers, including the one that calls run()
+    explicit
+    work_pool(unsigned num_threads = std::thread::hardware_concurrency())
+    {
+        num_threads = std::max(num_threads, 1u);
+        for (unsigned i = 0; i < num_threads; ++i)
+            queues_.emplace_back(new queue);
+        for (unsigned i = 1; i < num_threads; ++i)
+            threads_.emplace_back([this, i] { thread_main(i); });
+    }
+
+    work_pool(work_pool const&) = delete;
+    work_pool&
+    operator=(work_pool const&) = delete;
+
+    ~work_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        start_.notify_all();
+        for (auto& t : threads_)
+            t.join();
+    }
+
+    unsigned
+    size() const
+    {
+        return queues_.size();
+    }
+
+    /**
+       Call job(i) for every i from 0 to num_tasks - 1, and return when they
+       have all finished. job must not throw.
+
+       @note: One run at a time; it is not safe to call run() from two
+       threads, or from inside a job.
+    */
+    void
+    run(std::size_t num_tasks, std::function<void(std::size_t)> const& job)
+    {
+        if (!num_tasks)
+            return;
+
+        auto const num_workers = queues_.size();
+        for (std::size_t w = 0; w < num_workers; ++w)
+        {
+            std::lock_guard<std::mutex> lock(queues_[w]->mutex);
+            for (auto i = num_tasks * w / num_workers;
+                 i < num_tasks * (w + 1) / num_workers;
+                 ++i)
+                queues_[w]->tasks.push_back(i);
+        }
+
+        remaining_ = num_tasks;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            ++generation_;
+        }
+        start_.notify_all();
+
+        work(0, job);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return !remaining_ && !busy_; });
+        job_ = nullptr;
+    }
+
+private:
+    // Take a task from the front of worker self's queue, or steal one from
+    // the back of another's. Returns false if every queue is empty.
+    bool
+    pop(std::size_t self, std::size_t& task)
+    {
+        auto const num_workers = queues_.size();
+        for (std::size_t i = 0; i < num_workers; ++i)
+        {
+            auto& q = *queues_[(self + i) % num_workers];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tasks.empty())
+                continue;
+            if (i == 0)
+            {
+                task = q.tasks.front();
+                q.tasks.pop_front();
+            }
+            else
+            {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void
+    work(std::size_t self, std::function<void(std::size_t)> const& job)
+    {
+        std::size_t task;
+        while (pop(self, task))
+        {
+            job(task);
+            --remaining_;
+        }
+    }
+
+    void
+    thread_main(std::size_t self)
+    {
+        std::size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;)
+        {
+            start_.wait(
+                lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+            // a thread that wakes after its run has finished has nothing to do
+            auto const job = job_;
+            if (!job)
+                continue;
+
+            ++busy_;
+            lock.unlock();
+            work(self, *job);
+            lock.lock();
+            if (!--busy_ && !remaining_)
+                done_.notify_all();
+        }
+    }
+};
+
+// The pool the parallel codecs use by default, one worker per core
+inline
+work_pool&
+default_pool()
+{
+    static work_pool pool;
+    return pool;
+}
+
+/**
+   What happened to one chunk of a parallel decode. Records are counted from
+   the start of the whole input.
+*/
+struct chunk_summary
+{
+    // the first record of the chunk, and the number of records in it
+    std::size_t first = 0;
+    std::size_t count = 0;
+    // the number of records that failed to decode, and the first of them
+    // (only meaningful if num_bad is not 0)
+    std::size_t num_bad = 0;
+    std::size_t first_bad = 0;
+};
+
+// The number of records in a chunk: enough to fill chunk_bytes of input,
+// which is about the size of an L2 cache by default
+inline
+std::size_t
+records_per_chunk(std::size_t record_bytes, std::size_t chunk_bytes)
+{
+    return std::max<std::size_t>(chunk_bytes / record_bytes, 1);
+}
+
+constexpr std::size_t default_chunk_bytes = 256 * 1024;
+
+/**
+   Split count records into chunks, run chunk(first, n, summary) for each of
+   them on the pool, and return the summaries in input order.
+*/
+template <class Chunk>
+std::vector<chunk_summary>
+run_chunks(
+    work_pool& pool,
+    std::size_t count,
+    std::size_t per_chunk,
+    Chunk const& chunk)
+{
+    std::vector<chunk_summary> summaries((count + per_chunk - 1) / per_chunk);
+    pool.run(summaries.size(), [&](std::size_t c) {
+        auto& s = summaries[c];
+        s.first = c * per_chunk;
+        s.count = std::min(per_chunk, count - s.first);
+        chunk(s.first, s.count, s);
+    });
+    return summaries;
+}
+
+namespace hex {
+
+/**
+   decode_hex256_batch on all the cores of pool: decode count 64 char keys
+   into count 32 byte values. Returns a summary of the bad keys in every
+   chunk. The values of bad keys are undefined.
+*/
+inline
+std::vector<chunk_summary>
+parallel_decode(
+    char const* in,
+    std::size_t count,
+    char* out,
+    work_pool& pool = default_pool(),
+    std::size_t chunk_bytes = default_chunk_bytes)
+{
+    return run_chunks(
+        pool,
+        count,
+        records_per_chunk(64, chunk_bytes),
+        [&](std::size_t first, std::size_t n, chunk_summary& s) {
+            std::vector<std::uint8_t> ok((n + 7) / 8);
+            decode_hex256_batch(in + 64 * first, n, out + 32 * first, &ok[0]);
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                if (ok[i / 8] & (1 << (i % 8)))
+                    continue;
+                if (!s.num_bad++)
+                    s.first_bad = first + i;
+            }
+        });
+}
+
+// encode_hex256_batch on all the cores of pool: encode count 32 byte values
+// into count 64 char keys
+inline
+void
+parallel_encode(
+    char const* in,
+    std::size_t count,
+    char* out,
+    work_pool& pool = default_pool(),
+    std::size_t chunk_bytes = default_chunk_bytes)
+{
+    run_chunks(
+        pool,
+        count,
+        records_per_chunk(32, chunk_bytes),
+        [&](std::size_t first, std::size_t n, chunk_summary&) {
+            encode_hex256_batch(in + 32 * first, n, out + 64 * first);
+        });
+}
+
+}  // namespace hex
+
+namespace base58 {
+
+/**
+   decode_base58_batch on all the cores of pool: decode count strings of 44
+   digits, stored one after another, into count 32 byte values, and set
+   ok[i] to whether string i decoded. Returns a summary of the strings that
+   failed in every chunk.
+*/
+inline
+std::vector<chunk_summary>
+parallel_decode(
+    unsigned char const* in,
+    std::size_t count,
+    unsigned char* out,
+    bool* ok,
+    digit_rows const& rows,
+    work_pool& pool = default_pool(),
+    std::size_t chunk_bytes = default_chunk_bytes)
+{
+    return run_chunks(
+        pool,
+        count,
+        records_per_chunk(44, chunk_bytes),
+        [&](std::size_t first, std::size_t n, chunk_summary& s) {
+            std::vector<unsigned char const*> strings(n);
+            for (std::size_t i = 0; i < n; ++i)
+                strings[i] = in + 44 * (first + i);
+            if (decode_base58_batch(
+                    strings.data(), n, out + 32 * first, ok + first, rows) ==
+                n)
+                return;
+            for (auto i = first; i < first + n; ++i)
+            {
+                if (ok[i])
+                    continue;
+                if (!s.num_bad++)
+                    s.first_bad = i;
+            }
+        });
+}
+
+// As above, for a caller that only needs the summaries
+inline
+std::vector<chunk_summary>
+parallel_decode(
+    unsigned char const* in,
+    std::size_t count,
+    unsigned char* out,
+    digit_rows const& rows,
+    work_pool& pool = default_pool(),
+    std::size_t chunk_bytes = default_chunk_bytes)
+{
+    std::unique_ptr<bool[]> ok(new bool[count]);
+    return parallel_decode(in, count, out, ok.get(), rows, pool, chunk_bytes);
+}
+
+/**
+   encode_base58 on all the cores of pool: encode count values of
+   value_bytes bytes each. Value i is written to out + slot * i, and its
+   length to lens[i]. slot must be at least value_bytes * 138 / 100 + 1.
+*/
+inline
+void
+parallel_encode(
+    unsigned char const* in,
+    std::size_t count,
+    std::size_t value_bytes,
+    char* out,
+    std::size_t slot,
+    int* lens,
+    char const* alphabet,
+    work_pool& pool = default_pool(),
+    std::size_t chunk_bytes = default_chunk_bytes)
+{
+    run_chunks(
+        pool,
+        count,
+        records_per_chunk(value_bytes, chunk_bytes),
+        [&](std::size_t first, std::size_t n, chunk_summary&) {
+            for (auto i = first; i < first + n; ++i)
+                lens[i] = encode_base58(
+                    in + value_bytes * i, value_bytes, out + slot * i, alphabet);
+        });
+}
+
+}  // namespace base58
+
+// Compare the parallel codecs against the single threaded ones, on a pool
+// with more threads than most test hosts have cores, with small chunks so
+// there are many more chunks than workers and they get stolen
+inline
+bool
+random_test_parallel(int iterations)
+{
+    work_pool pool(4);
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_count(0, 2000);
+    std::uniform_int_distribution<> rand_byte(0, 255);
+    std::uniform_int_distribution<> rand_hex(0, 15);
+    std::uniform_int_distribution<> rand_index(0, 57);
+    std::uniform_int_distribution<> rand_first(0, 3);
+    std::uniform_int_distribution<> rand_chunk(1, 4096);
+
+    for (int it = 0; it < iterations; ++it)
+    {
+        std::size_t const count = rand_count(gen);
+        std::size_t const chunk_bytes = rand_chunk(gen);
+
+        // hex: a few keys with a bad char
+        std::vector<char> values(32 * count);
+        for (auto& v : values)
+            v = rand_byte(gen);
+        std::vector<char> keys(64 * count);
+        std::vector<char> keys_ref(64 * count);
+        hex::parallel_encode(values.data(), count, keys.data(), pool, chunk_bytes);
+        hex::encode_hex256_batch(values.data(), count, keys_ref.data());
+        if (keys != keys_ref)
+        {
+            std::cerr << "hex::parallel_encode mismatch, count: " << count
+                      << '\n';
+            return false;
+        }
+        for (std::size_t i = 0; i < count; i += 1 + rand_byte(gen))
+            keys[64 * i + rand_byte(gen) % 64] = 'g';
+
+        std::vector<char> out(32 * count);
+        std::vector<char> out_ref(32 * count);
+        std::vector<std::uint8_t> ok((count + 7) / 8);
+        auto const summaries =
+            hex::parallel_decode(keys.data(), count, out.data(), pool, chunk_bytes);
+        if (count)
+            hex::decode_hex256_batch(keys.data(), count, out_ref.data(), &ok[0]);
+
+        std::size_t next = 0;
+        for (auto const& s : summaries)
+        {
+            std::size_t num_bad = 0;
+            std::size_t first_bad = 0;
+            for (auto i = s.first; i < s.first + s.count; ++i)
+            {
+                if (ok[i / 8] & (1 << (i % 8)))
+                {
+                    if (memcmp(&out[32 * i], &out_ref[32 * i], 32))
+                    {
+                        std::cerr << "hex::parallel_decode mismatch at: " << i
+                                  << '\n';
+                        return false;
+                    }
+                }
+                else if (!num_bad++)
+                    first_bad = i;
+            }
+            if (s.first != next || !s.count || s.num_bad != num_bad ||
+                (num_bad && s.first_bad != first_bad))
+            {
+                std::cerr << "hex::parallel_decode bad summary, first: "
+                          << s.first << '\n';
+                return false;
+            }
+            next += s.count;
+        }
+        if (next != count)
+        {
+            std::cerr << "hex::parallel_decode summaries don't cover the input\n";
+            return false;
+        }
+
+        // base58: some strings that overflow and some with a bad char
+        std::vector<unsigned char> strings(44 * count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            for (int j = 0; j < 44; ++j)
+                strings[44 * i + j] = base58::rippleAlphabet[rand_index(gen)];
+            if (i % 3)
+                strings[44 * i] = base58::rippleAlphabet[rand_first(gen)];
+            if (i % 7 == 0)
+                strings[44 * i + rand_byte(gen) % 44] = '0';
+        }
+        std::vector<unsigned char> out58(32 * count);
+        auto const summaries58 = base58::parallel_decode(
+            strings.data(),
+            count,
+            out58.data(),
+            base58::rippleInverse.rows(),
+            pool,
+            chunk_bytes);
+        next = 0;
+        for (auto const& s : summaries58)
+        {
+            std::size_t num_bad = 0;
+            std::size_t first_bad = 0;
+            for (auto i = s.first; i < s.first + s.count; ++i)
+            {
+                unsigned char ref[32];
+                if (!base58::decode_base58_ref(
+                        &strings[44 * i], 44, ref, base58::rippleInverse))
+                {
+                    if (!num_bad++)
+                        first_bad = i;
+                }
+                else if (memcmp(&out58[32 * i], ref, 32))
+                {
+                    std::cerr << "base58::parallel_decode mismatch at: " << i
+                              << '\n';
+                    return false;
+                }
+            }
+            if (s.first != next || !s.count || s.num_bad != num_bad ||
+                (num_bad && s.first_bad != first_bad))
+            {
+                std::cerr << "base58::parallel_decode bad summary, first: "
+                          << s.first << '\n';
+                return false;
+            }
+            next += s.count;
+        }
+
+        std::size_t const slot = 32 * 138 / 100 + 1;
+        std::vector<char> chars(slot * count);
+        std::vector<int> lens(count);
+        base58::parallel_encode(
+            reinterpret_cast<unsigned char const*>(values.data()),
+            count,
+            32,
+            chars.data(),
+            slot,
+            lens.data(),
+            base58::rippleAlphabet,
+            pool,
+            chunk_bytes);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            char ref[slot];
+            auto const n = base58::encode_base58(
+                reinterpret_cast<unsigned char const*>(&values[32 * i]),
+                32,
+                ref,
+                base58::rippleAlphabet);
+            if (lens[i] != n || memcmp(&chars[slot * i], ref, n))
+            {
+                std::cerr << "base58::parallel_encode mismatch at: " << i
+                          << '\n';
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Decode and encode 16 million hex keys and 4 million base58 strings on
+// pools of 1, 2, 4, ... workers, up to the number of cores
+inline
+void
+benchmark_parallel()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    std::size_t const num_keys = 16 * 1024 * 1024;
+    std::vector<char> values(32 * num_keys, '\x5a');
+    std::vector<char> keys(64 * num_keys);
+    hex::encode_hex256_batch(values.data(), num_keys, keys.data());
+
+    std::size_t const num_strings = 4 * 1024 * 1024;
+    std::vector<unsigned char> strings(44 * num_strings);
+    for (std::size_t i = 0; i < strings.size(); ++i)
+        strings[i] = base58::rippleAlphabet[i % 44 ? i % 58 : 1];
+    std::vector<unsigned char> out58(32 * num_strings);
+
+    unsigned const cores = std::max(std::thread::hardware_concurrency(), 1u);
+    for (unsigned n = 1;; n = std::min(2 * n, cores))
+    {
+        work_pool pool(n);
+
+        auto start = timer::now();
+        hex::parallel_encode(values.data(), num_keys, keys.data(), pool);
+        auto end = timer::now();
+        std::cout << "Threads: " << n
+                  << " Enc hex: " << time_diff(start, end).count();
+
+        start = timer::now();
+        auto const summaries =
+            hex::parallel_decode(keys.data(), num_keys, values.data(), pool);
+        end = timer::now();
+        std::cout << " Dec hex: " << time_diff(start, end).count();
+        for (auto const& s : summaries)
+            if (s.num_bad)
+                return;
+
+        start = timer::now();
+        auto const summaries58 = base58::parallel_decode(
+            strings.data(),
+            num_strings,
+            out58.data(),
+            base58::rippleInverse.rows(),
+            pool);
+        end = timer::now();
+        std::cout << " Dec base58: " << time_diff(start, end).count() << '\n';
+        for (auto const& s : summaries58)
+            if (s.num_bad)
+                return;
+
+        if (n == cores)
+            break;
+    }
+}
+
+}  // namespace codec
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cpuid.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace codec {
+namespace perf {
+
+// The hardware events counted around a benchmark
+enum class event : int
+{
+    cycles = 0,
+    instructions,
+    branch_misses,
+    l1d_misses,
+    uops,
+    num_events
+};
+
+constexpr std::size_t num_events = static_cast<std::size_t>(event::num_events);
+
+inline
+char const*
+name(event e)
+{
+    switch (e)
+    {
+        case event::cycles:
+            return "cycles";
+        case event::instructions:
+            return "instructions";
+        case event::branch_misses:
+            return "branch_misses";
+        case event::l1d_misses:
+            return "l1d_misses";
+        case event::uops:
+            return "uops";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+   The perf_event_attr type and config of an event on this cpu. Returns false
+   if there is no way to count it.
+
+   The uops have no generic perf event, so they are a raw event of the
+   vendor: uops issued (UOPS_ISSUED.ANY) on Intel, and retired ops on AMD.
+*/
+inline
+bool
+event_config(event e, std::uint32_t& type, std::uint64_t& config)
+{
+    type = PERF_TYPE_HARDWARE;
+    switch (e)
+    {
+        case event::cycles:
+            config = PERF_COUNT_HW_CPU_CYCLES;
+            return true;
+        case event::instructions:
+            config = PERF_COUNT_HW_INSTRUCTIONS;
+            return true;
+        case event::branch_misses:
+            config = PERF_COUNT_HW_BRANCH_MISSES;
+            return true;
+        case event::l1d_misses:
+            type = PERF_TYPE_HW_CACHE;
+            config = PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            return true;
+        case event::uops:
+        {
+            unsigned max, vendor[3];
+            if (!__get_cpuid(0, &max, &vendor[0], &vendor[2], &vendor[1]))
+                return false;
+            type = PERF_TYPE_RAW;
+            if (!memcmp(vendor, "GenuineIntel", 12))
+            {
+                config = 0x010e;  // event 0x0e, umask 0x01
+                return true;
+            }
+            if (!memcmp(vendor, "AuthenticAMD", 12))
+            {
+                config = 0x00c1;
+                return true;
+            }
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+// The counts of one measurement. valid[e] is false for an event that could
+// not be counted. running is the fraction of the time the group was enabled
+// that it was on the PMU; below 1 the kernel multiplexed it with other
+// groups, and the values are scaled up to estimates for the whole time.
+struct counts
+{
+    std::array<std::uint64_t, num_events> values{};
+    std::array<bool, num_events> valid{};
+    double running = 1;
+
+    bool
+    multiplexed() const
+    {
+        return running < 1;
+    }
+
+    bool
+    has(event e) const
+    {
+        return valid[static_cast<std::size_t>(e)];
+    }
+
+    std::uint64_t
+    operator[](event e) const
+    {
+        return values[static_cast<std::size_t>(e)];
+    }
+};
+
+/**
+   Hardware counters for the calling thread, counting user mode only.
+
+   The events are opened as one group, so they are scheduled onto the PMU
+   together and count over exactly the same instructions. An event the cpu
+   or the kernel refuses is left out, and available() is false if none could
+   be opened: a VM without a virtual PMU, a container without
+   perf_event_open, or a perf_event_paranoid above 2. The benchmarks then
+   run without counters, and error() says why.
+*/
+class counters
+{
+private:
+    std::array<int, num_events> fds_;
+    // the id the kernel gave each open event, to match it in a group read
+    std::array<std::uint64_t, num_events> ids_{};
+    int leader_ = -1;
+    std::string error_;
+
+    static int
+    open_event(event e, int group)
+    {
+        std::uint32_t type;
+        std::uint64_t config;
+        if (!event_config(e, type, config))
+        {
+            errno = EOPNOTSUPP;
+            return -1;
+        }
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = group < 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID |
+            PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(
+            syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+    }
+
+public:
+    counters()
+    {
+        fds_.fill(-1);
+        for (std::size_t i = 0; i < num_events; ++i)
+        {
+            auto const e = static_cast<event>(i);
+            fds_[i] = open_event(e, leader_);
+            if (fds_[i] >= 0 && ioctl(fds_[i], PERF_EVENT_IOC_ID, &ids_[i]))
+            {
+                close(fds_[i]);
+                fds_[i] = -1;
+            }
+            if (fds_[i] < 0)
+            {
+                if (error_.empty())
+                    error_ = std::string(name(e)) + ": " + strerror(errno);
+                continue;
+            }
+            if (leader_ < 0)
+                leader_ = fds_[i];
+        }
+        if (leader_ >= 0)
+            error_.clear();
+        else if (error_.empty())
+            error_ = "no events";
+    }
+
+    counters(counters const&) = delete;
+    counters&
+    operator=(counters const&) = delete;
+
+    ~counters()
+    {
+        for (auto fd : fds_)
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+
+    // true if at least one event is counted
+    bool
+    available() const
+    {
+        return leader_ >= 0;
+    }
+
+    // Why no event is counted, when none is
+    std::string const&
+    error() const
+    {
+        return error_;
+    }
+
+    // Zero the counts and start counting
+    void
+    start()
+    {
+        if (leader_ < 0)
+            return;
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+
+    // Stop counting, and return the counts since start()
+    counts
+    stop()
+    {
+        counts result;
+        if (leader_ < 0)
+            return result;
+        ioctl(leader_, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+        // nr, the time enabled and running, then a value and an id for each
+        // event in the group
+        std::uint64_t buf[3 + 2 * num_events];
+        if (read(leader_, buf, sizeof(buf)) < 0)
+            return result;
+        // a group the PMU had no room for never ran, and its counts are 0
+        if (!buf[2])
+            return result;
+        // a group that shared the PMU ran for part of the time; scale its
+        // counts by enabled / running, as perf stat does
+        auto const enabled = buf[1];
+        auto const running = buf[2];
+        if (running < enabled)
+            result.running = static_cast<double>(running) / enabled;
+        for (std::uint64_t n = 0; n < buf[0]; ++n)
+        {
+            auto value = buf[3 + 2 * n];
+            if (running < enabled)
+                value = static_cast<std::uint64_t>(
+                    static_cast<long double>(value) * enabled / running);
+            auto const id = buf[4 + 2 * n];
+            for (std::size_t i = 0; i < num_events; ++i)
+            {
+                if (fds_[i] >= 0 && ids_[i] == id)
+                {
+                    result.values[i] = value;
+                    result.valid[i] = true;
+                }
+            }
+        }
+        return result;
+    }
+};
+
+}  // namespace perf
+}  // namespace codec
@@ -0,0 +1,492 @@
+#pragma once
+
+#include "cpu_features.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// SHA extensions: sha256_shani.asm
+// Compress num_blocks 64 byte blocks into the state (8 dwords, a-h).
+// num_blocks must not be 0.
+extern "C" void
+sha256_blocks_shani(
+    unsigned char const* in,
+    std::size_t num_blocks,
+    std::uint32_t* state);
+
+// AVX2: sha256_x8.asm
+// Compress the 64 byte block at in[a] into state a, for a from 0 to 7. Word i
+// of state a is state[8 * i + a].
+extern "C" void
+sha256_block_x8_avx2(unsigned char const* const* in, std::uint32_t* state);
+
+namespace codec {
+namespace sha256 {
+
+static constexpr std::uint32_t round_constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static constexpr std::uint32_t initial_state[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+inline
+std::uint32_t
+rotr(std::uint32_t x, int n)
+{
+    return (x >> n) | (x << (32 - n));
+}
+
+inline
+std::uint32_t
+load_be32(unsigned char const* in)
+{
+    std::uint32_t x;
+    memcpy(&x, in, 4);
+    return __builtin_bswap32(x);
+}
+
+inline
+void
+store_be32(std::uint32_t x, unsigned char* out)
+{
+    x = __builtin_bswap32(x);
+    memcpy(out, &x, 4);
+}
+
+// The portable compression function, for cpus without the sha extensions
+inline
+void
+sha256_blocks_ref(
+    unsigned char const* in,
+    std::size_t num_blocks,
+    std::uint32_t* state)
+{
+    for (; num_blocks; --num_blocks, in += 64)
+    {
+        std::uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+            w[i] = load_be32(in + 4 * i);
+        for (int i = 16; i < 64; ++i)
+        {
+            auto const s0 =
+                rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            auto const s1 =
+                rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        std::uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        std::uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            auto const s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            auto const ch = (e & f) ^ (~e & g);
+            auto const t1 = h + s1 + ch + round_constants[i] + w[i];
+            auto const s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            auto const maj = (a & b) ^ (a & c) ^ (b & c);
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + s0 + maj;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+// sha256_block_x8 with the portable compression function, one state at a
+// time
+inline
+void
+sha256_block_x8_ref(unsigned char const* const* in, std::uint32_t* state)
+{
+    for (int a = 0; a < 8; ++a)
+    {
+        std::uint32_t s[8];
+        for (int i = 0; i < 8; ++i)
+            s[i] = state[8 * i + a];
+        sha256_blocks_ref(in[a], 1, s);
+        for (int i = 0; i < 8; ++i)
+            state[8 * i + a] = s[i];
+    }
+}
+
+/**
+   The compression function to use at the given level. The sha extensions
+   are a cpuid bit of their own rather than an isa level, so this checks for
+   them directly. The kernel also needs sse4.1, and forcing the scalar level
+   runs the portable one.
+*/
+inline
+auto
+sha256_blocks_for(cpu::isa level) -> decltype(&sha256_blocks_ref)
+{
+    if (level >= cpu::isa::sse41 && cpu::detected_features().sha)
+        return sha256_blocks_shani;
+    return sha256_blocks_ref;
+}
+
+inline
+auto
+sha256_block_x8_for(cpu::isa level)
+{
+    // indexed by cpu::isa
+    static decltype(&sha256_block_x8_ref) const table[] = {
+        sha256_block_x8_ref,
+        // without avx2 there are only 4 dword lanes
+        sha256_block_x8_ref,
+        sha256_block_x8_avx2,
+        // 16 lanes would need a batch size of 16
+        sha256_block_x8_avx2,
+        sha256_block_x8_avx2,
+    };
+    static_assert(
+        sizeof(table) / sizeof(table[0]) ==
+            static_cast<int>(cpu::isa::num_isa),
+        "one variant per isa");
+    return table[static_cast<int>(level)];
+}
+
+/**
+   Pad the last n % 64 bytes of a message of n bytes into one or two blocks
+   of out, which must hold 128 bytes. tail is the address of those bytes.
+   Returns the number of blocks.
+*/
+inline
+int
+pad_tail(unsigned char const* tail, std::size_t n, unsigned char* out)
+{
+    std::size_t const rest = n % 64;
+    int const num_blocks = rest < 56 ? 1 : 2;
+    memcpy(out, tail, rest);
+    out[rest] = 0x80;
+    memset(out + rest + 1, 0, 64 * num_blocks - 8 - rest - 1);
+    std::uint64_t const bits = __builtin_bswap64(8 * std::uint64_t(n));
+    memcpy(out + 64 * num_blocks - 8, &bits, 8);
+    return num_blocks;
+}
+
+// Hash n bytes of in into the 32 byte digest out with the compression
+// function blocks
+template <class Blocks>
+void
+hash_with(
+    Blocks blocks,
+    unsigned char const* in,
+    std::size_t n,
+    unsigned char* out)
+{
+    std::uint32_t state[8];
+    memcpy(state, initial_state, sizeof(state));
+    if (std::size_t const full = n / 64)
+        blocks(in, full, state);
+
+    unsigned char tail[128];
+    blocks(tail, pad_tail(in + n / 64 * 64, n, tail), state);
+
+    for (int i = 0; i < 8; ++i)
+        store_be32(state[i], out + 4 * i);
+}
+
+// Hash 8 messages of n bytes each with the 8 lane compression function
+// block_x8. The digest of in[a] is written to out + 32 * a.
+template <class BlockX8>
+void
+hash_x8_with(
+    BlockX8 block_x8,
+    unsigned char const* const* in,
+    std::size_t n,
+    unsigned char* out)
+{
+    std::uint32_t state[64];
+    for (int i = 0; i < 8; ++i)
+        std::fill_n(state + 8 * i, 8, initial_state[i]);
+
+    unsigned char const* blocks[8];
+    for (std::size_t b = 0; b < n / 64; ++b)
+    {
+        for (int a = 0; a < 8; ++a)
+            blocks[a] = in[a] + 64 * b;
+        block_x8(blocks, state);
+    }
+
+    // every message is the same length, so they all have the same number of
+    // tail blocks
+    unsigned char tails[8][128];
+    int num_tail = 0;
+    for (int a = 0; a < 8; ++a)
+        num_tail = pad_tail(in[a] + n / 64 * 64, n, tails[a]);
+    for (int b = 0; b < num_tail; ++b)
+    {
+        for (int a = 0; a < 8; ++a)
+            blocks[a] = tails[a] + 64 * b;
+        block_x8(blocks, state);
+    }
+
+    for (int a = 0; a < 8; ++a)
+        for (int i = 0; i < 8; ++i)
+            store_be32(state[8 * i + a], out + 32 * a + 4 * i);
+}
+
+// The portable sha256, for the tests
+inline
+void
+sha256_ref(unsigned char const* in, std::size_t n, unsigned char* out)
+{
+    hash_with(sha256_blocks_ref, in, n, out);
+}
+
+// Hash n bytes of in into the 32 byte digest out, with the sha extensions if
+// the cpu has them
+inline
+void
+sha256(unsigned char const* in, std::size_t n, unsigned char* out)
+{
+    hash_with(sha256_blocks_for(cpu::active_isa()), in, n, out);
+}
+
+// sha256 of the sha256 of n bytes of in, the Base58Check checksum hash
+inline
+void
+sha256d(unsigned char const* in, std::size_t n, unsigned char* out)
+{
+    auto const blocks = sha256_blocks_for(cpu::active_isa());
+    unsigned char first[32];
+    hash_with(blocks, in, n, first);
+    hash_with(blocks, first, 32, out);
+}
+
+/**
+   sha256d of 8 messages of n bytes each. The digest of in[a] is written to
+   out + 32 * a.
+
+   @note: With the sha extensions the messages are hashed one after another,
+   which is faster than the 8 lane kernel (see the readme). Without them the
+   8 messages go through the multi-buffer kernel for the active isa together,
+   one block of each at a time, which is why they must be the same length.
+*/
+inline
+void
+sha256d_x8(unsigned char const* const* in, std::size_t n, unsigned char* out)
+{
+    auto const level = cpu::active_isa();
+    if (sha256_blocks_for(level) != sha256_blocks_ref)
+    {
+        for (int a = 0; a < 8; ++a)
+            sha256d(in[a], n, out + 32 * a);
+        return;
+    }
+
+    auto const block_x8 = sha256_block_x8_for(level);
+    unsigned char first[8 * 32];
+    hash_x8_with(block_x8, in, n, first);
+    unsigned char const* first_in[8];
+    for (int a = 0; a < 8; ++a)
+        first_in[a] = first + 32 * a;
+    hash_x8_with(block_x8, first_in, 32, out);
+}
+
+// Check sha256 and sha256d_x8 against known digests
+inline
+bool
+check_sha256()
+{
+    struct known
+    {
+        char const* msg;
+        unsigned char digest[32];
+    };
+    static known const vectors[] = {
+        {"",
+         {0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4,
+          0xc8, 0x99, 0x6f, 0xb9, 0x24, 0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b,
+          0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55}},
+        {"abc",
+         {0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40,
+          0xde, 0x5d, 0xae, 0x22, 0x23, 0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17,
+          0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad}},
+        // 56 chars, so the padding takes a second block
+        {"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+         {0x24, 0x8d, 0x6a, 0x61, 0xd2, 0x06, 0x38, 0xb8, 0xe5, 0xc0, 0x26,
+          0x93, 0x0c, 0x3e, 0x60, 0x39, 0xa3, 0x3c, 0xe4, 0x59, 0x64, 0xff,
+          0x21, 0x67, 0xf6, 0xec, 0xed, 0xd4, 0x19, 0xdb, 0x06, 0xc1}},
+    };
+
+    for (auto const& v : vectors)
+    {
+        auto const in = reinterpret_cast<unsigned char const*>(v.msg);
+        auto const n = strlen(v.msg);
+        unsigned char out[32];
+        sha256(in, n, out);
+        if (memcmp(out, v.digest, 32))
+        {
+            std::cerr << "sha256 mismatch on \"" << v.msg << "\"\n";
+            return false;
+        }
+
+        // the x8 kernel on the same message in every lane, once
+        unsigned char const* ins[8];
+        std::fill_n(ins, 8, in);
+        unsigned char outs[8 * 32];
+        hash_x8_with(sha256_block_x8_for(cpu::active_isa()), ins, n, outs);
+        for (int a = 0; a < 8; ++a)
+        {
+            if (memcmp(outs + 32 * a, v.digest, 32))
+            {
+                std::cerr << "sha256 x8 mismatch on \"" << v.msg
+                          << "\" lane: " << a << '\n';
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Compare sha256d, sha256d_x8 and the 8 lane kernel against the portable
+// sha256 on random messages of random lengths, across the block boundaries
+inline
+bool
+random_test_sha256(int iterations)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_len(0, 200);
+    std::uniform_int_distribution<> rand_byte(0, 255);
+
+    auto const block_x8 = sha256_block_x8_for(cpu::active_isa());
+    std::vector<unsigned char> msgs[8];
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto const n = rand_len(gen);
+        unsigned char const* ins[8];
+        for (int a = 0; a < 8; ++a)
+        {
+            msgs[a].resize(n);
+            for (auto& c : msgs[a])
+                c = rand_byte(gen);
+            ins[a] = msgs[a].data();
+        }
+
+        unsigned char outs[8 * 32];
+        unsigned char outs_d[8 * 32];
+        hash_x8_with(block_x8, ins, n, outs);
+        sha256d_x8(ins, n, outs_d);
+        for (int a = 0; a < 8; ++a)
+        {
+            unsigned char ref[32];
+            unsigned char ref_d[32];
+            sha256_ref(ins[a], n, ref);
+            sha256_ref(ref, 32, ref_d);
+
+            unsigned char out_d[32];
+            sha256d(ins[a], n, out_d);
+            if (memcmp(outs + 32 * a, ref, 32) ||
+                memcmp(outs_d + 32 * a, ref_d, 32) || memcmp(out_d, ref_d, 32))
+            {
+                std::cerr << "sha256 mismatch, len: " << n << " lane: " << a
+                          << '\n';
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The double hash of the 21 and 34 byte messages Base58Check hashes for
+// account IDs and public keys, with each compression function
+inline
+void
+benchmark_sha256()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    auto time_diff = [](auto start, auto end) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            end - start);
+    };
+
+    int const iters = 1'000'000;
+    for (std::size_t const n : {21, 34})
+    {
+        std::vector<unsigned char> msgs(8 * n, 0xa5);
+        unsigned char const* ins[8];
+        for (int a = 0; a < 8; ++a)
+            ins[a] = &msgs[n * a];
+        unsigned char first[8 * 32];
+        unsigned char const* first_in[8];
+        for (int a = 0; a < 8; ++a)
+            first_in[a] = first + 32 * a;
+        unsigned char out[8 * 32];
+
+        std::cout << "SHA256d of " << n << " bytes, 8 at a time\n";
+        {
+            auto start = timer::now();
+            for (int i = 0; i < iters / 8; ++i)
+            {
+                for (int a = 0; a < 8; ++a)
+                {
+                    hash_with(sha256_blocks_ref, ins[a], n, first + 32 * a);
+                    hash_with(sha256_blocks_ref, first + 32 * a, 32, out);
+                }
+            }
+            auto end = timer::now();
+            std::cout << "     ref: " << time_diff(start, end).count() << '\n';
+        }
+
+        if (cpu::detected_features().sha)
+        {
+            auto start = timer::now();
+            for (int i = 0; i < iters / 8; ++i)
+            {
+                for (int a = 0; a < 8; ++a)
+                {
+                    hash_with(sha256_blocks_shani, ins[a], n, first + 32 * a);
+                    hash_with(sha256_blocks_shani, first + 32 * a, 32, out);
+                }
+            }
+            auto end = timer::now();
+            std::cout << "   shani: " << time_diff(start, end).count() << '\n';
+        }
+
+        if (cpu::detected_features().avx2)
+        {
+            auto start = timer::now();
+            for (int i = 0; i < iters / 8; ++i)
+            {
+                hash_x8_with(sha256_block_x8_avx2, ins, n, first);
+                hash_x8_with(sha256_block_x8_avx2, first_in, 32, out);
+            }
+            auto end = timer::now();
+            std::cout << " x8 avx2: " << time_diff(start, end).count() << '\n';
+        }
+    }
+}
+
+}  // namespace sha256
+}  // namespace codec
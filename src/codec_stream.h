@@ -0,0 +1,1071 @@
+#pragma once
+
+#include "codec_base58.h"
+#include "codec_hex.h"
+#include "codec_parallel.h"
+
+#include <fcntl.h>
+#include <immintrin.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace codec {
+
+/**
+   A bounded queue from one producer thread to one consumer thread.
+
+   push() and pop() are lock free. The head and the tail are on cache lines of
+   their own, and each side keeps a copy of the other side's index, so it only
+   reads the shared one when the ring looks full or empty. A consumer that
+   waits on an empty ring spins for a few microseconds (unless there is one
+   core) and then sleeps on a condition variable. The producer only takes the
+   mutex to wake it when it said it was asleep, so a busy pipeline makes no
+   system calls here.
+*/
+template <class T>
+class spsc_ring
+{
+private:
+    static constexpr std::size_t cache_line = 64;
+
+    std::vector<T> slots_;
+    std::size_t mask_;
+    // pauses before a consumer sleeps; on one core, spinning only keeps the
+    // producer off it
+    int spins_ = std::thread::hardware_concurrency() > 1 ? 2048 : 0;
+
+    char pad0_[cache_line];
+    // the next slot to pop, and the consumer's copy of tail_
+    std::atomic<std::size_t> head_{0};
+    std::size_t cached_tail_ = 0;
+
+    char pad1_[cache_line];
+    // the next slot to push, and the producer's copy of head_
+    std::atomic<std::size_t> tail_{0};
+    std::size_t cached_head_ = 0;
+
+    char pad2_[cache_line];
+    std::atomic<bool> sleeping_{false};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+
+public:
+    // A ring that holds at least capacity items
+    explicit
+    spsc_ring(std::size_t capacity)
+    {
+        std::size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        slots_.resize(size);
+        mask_ = size - 1;
+    }
+
+    spsc_ring(spsc_ring const&) = delete;
+    spsc_ring&
+    operator=(spsc_ring const&) = delete;
+
+    // Producer: add v. Returns false if the ring is full.
+    bool
+    push(T const& v)
+    {
+        auto const tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ == slots_.size())
+        {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ == slots_.size())
+                return false;
+        }
+        slots_[tail & mask_] = v;
+        tail_.store(tail + 1, std::memory_order_release);
+
+        // pairs with the fence in wait_pop(): either the consumer sees the
+        // new tail, or this sees that it is asleep
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            wake_.notify_one();
+        }
+        return true;
+    }
+
+    // Consumer: take the oldest item. Returns false if the ring is empty.
+    bool
+    pop(T& v)
+    {
+        auto const head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_)
+        {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_)
+                return false;
+        }
+        v = slots_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: take the oldest item, waiting for one if the ring is empty.
+    // Returns false, without an item, once stop is set and wake() is called.
+    bool
+    wait_pop(T& v, std::atomic<bool> const& stop)
+    {
+        for (int spin = 0;; ++spin)
+        {
+            if (pop(v))
+                return true;
+            if (stop.load(std::memory_order_relaxed))
+                return false;
+            if (spin < spins_)
+            {
+                _mm_pause();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            sleeping_.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            wake_.wait(lock, [&] {
+                return tail_.load(std::memory_order_acquire) !=
+                    head_.load(std::memory_order_relaxed) ||
+                    stop.load();
+            });
+            sleeping_.store(false, std::memory_order_relaxed);
+            spin = 0;
+        }
+    }
+
+    // Wake a sleeping consumer, to see that stop is set
+    void
+    wake()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        wake_.notify_all();
+    }
+};
+
+/**
+   The records of a stream. The input is cut into blocks of whole records
+   only, so a block converts on its own.
+*/
+struct record_format
+{
+    // the input bytes of a record, with its newline for lines. For lines this
+    // is the length of a good record, and only sizes the buffers.
+    std::size_t in_bytes = 0;
+    // the most output bytes one record converts to
+    std::size_t out_bytes = 0;
+    // one record per line, instead of records of in_bytes one after another
+    bool lines = false;
+};
+
+struct stream_options
+{
+    // threads that convert blocks; 0 is one per core, less the reader and
+    // the writer
+    unsigned workers = 0;
+    // the most input bytes in a block
+    std::size_t block_bytes = default_chunk_bytes;
+    // the blocks of each worker, in flight or free. This bounds the memory.
+    std::size_t blocks_per_worker = 4;
+};
+
+struct stream_result
+{
+    // all the records of the stream, with first 0
+    chunk_summary records;
+    // the bytes at the end of a fixed width input that are not a whole
+    // record. They are not converted.
+    std::size_t trailing = 0;
+};
+
+// Call f(line, len) for every line in [begin, end), without the newline or
+// a '\r' before it
+template <class F>
+void
+for_each_line(char const* begin, char const* end, F&& f)
+{
+    while (begin < end)
+    {
+        auto const nl =
+            static_cast<char const*>(memchr(begin, '\n', end - begin));
+        auto const line_end = nl ? nl : end;
+        std::size_t len = line_end - begin;
+        if (len && begin[len - 1] == '\r')
+            --len;
+        f(begin, len);
+        begin = nl ? nl + 1 : end;
+    }
+}
+
+namespace detail {
+
+struct free_deleter
+{
+    void
+    operator()(char* p) const
+    {
+        free(p);
+    }
+};
+
+using aligned_buffer = std::unique_ptr<char, free_deleter>;
+
+inline
+aligned_buffer
+alloc_aligned(std::size_t size)
+{
+    void* p = nullptr;
+    if (posix_memalign(&p, 4096, std::max<std::size_t>(size, 1)))
+        throw std::bad_alloc();
+    return aligned_buffer(static_cast<char*>(p));
+}
+
+struct stream_block
+{
+    char* in = nullptr;
+    char* out = nullptr;
+    // the whole records in in, and how many there are
+    std::size_t in_size = 0;
+    std::size_t count = 0;
+    std::size_t out_size = 0;
+    chunk_summary summary;
+};
+
+/**
+   The records at the front of the size bytes at p, up to max_records of
+   them: returns their bytes and sets count. At the end of the input, a last
+   line without a newline is a record too.
+*/
+inline
+std::size_t
+whole_records(
+    char const* p,
+    std::size_t size,
+    record_format const& format,
+    std::size_t max_records,
+    bool eof,
+    std::size_t& count)
+{
+    if (!format.lines)
+    {
+        count = std::min(size / format.in_bytes, max_records);
+        return count * format.in_bytes;
+    }
+
+    auto const end = p + size;
+    count = std::count(p, end, '\n');
+    char const* cut = p;
+    if (count <= max_records)
+    {
+        if (count)
+            cut = std::find(
+                      std::reverse_iterator<char const*>(end),
+                      std::reverse_iterator<char const*>(p),
+                      '\n').base();
+    }
+    else
+    {
+        count = max_records;
+        for (std::size_t i = 0; i < count; ++i)
+            cut = static_cast<char const*>(memchr(cut, '\n', end - cut)) + 1;
+    }
+    if (eof && cut < end && count < max_records)
+    {
+        ++count;
+        cut = end;
+    }
+    return cut - p;
+}
+
+inline
+void
+write_all(int fd, char const* p, std::size_t size)
+{
+    while (size)
+    {
+        auto const n = write(fd, p, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            throw std::system_error(errno, std::generic_category(), "write");
+        p += n;
+        size -= n;
+    }
+}
+
+}  // namespace detail
+
+/**
+   Convert the records read from in_fd, and write them to out_fd in order.
+
+   convert(in, size, count, out, summary) converts the count records in the
+   size bytes at in, writes them to out and returns the number of bytes it
+   wrote. It sets summary.num_bad and summary.first_bad, counting from the
+   first record of the block. It is called from several threads at once, and
+   must not throw.
+
+   The reader, on the calling thread, cuts the input into blocks of whole
+   records and deals them out to the workers in turn. The writer takes them
+   back in the same turn, so the output is in input order. The stages are
+   connected by spsc_rings of block numbers: the reader to each worker, each
+   worker to the writer, and the writer back to the reader with the blocks
+   it has written. All the blocks are allocated up front, so the memory is
+   bounded, and nothing is allocated per block or per record.
+
+   The reader hands on a block as soon as a read returns less than it asked
+   for, which on a pipe means there is nothing more to read for now. A busy
+   stream fills each block, and a sparse one sends each record through as
+   it arrives.
+
+   Throws std::system_error if a read or a write fails, and
+   std::length_error if a line is longer than a block.
+*/
+template <class Convert>
+stream_result
+transcode_stream(
+    int in_fd,
+    int out_fd,
+    record_format const& format,
+    Convert const& convert,
+    stream_options const& options = {})
+{
+    auto num_workers = options.workers;
+    if (!num_workers)
+    {
+        auto const cores = std::thread::hardware_concurrency();
+        num_workers = cores > 2 ? cores - 2 : 1;
+    }
+    auto const in_bytes = std::max<std::size_t>(format.in_bytes, 1);
+    auto const block_bytes = std::max(options.block_bytes, in_bytes);
+    auto const max_records =
+        std::max<std::size_t>(block_bytes / in_bytes, 1);
+    auto const out_bytes = max_records * format.out_bytes;
+    auto const num_blocks =
+        num_workers * std::max<std::size_t>(options.blocks_per_worker, 2);
+    constexpr std::size_t end_of_stream = ~std::size_t(0);
+
+#ifdef F_SETPIPE_SZ
+    // bigger pipes take fewer reads and writes. This fails on anything that
+    // is not a pipe, which is fine.
+    fcntl(in_fd, F_SETPIPE_SZ, static_cast<int>(block_bytes));
+    fcntl(out_fd, F_SETPIPE_SZ, static_cast<int>(block_bytes));
+#endif
+
+    // the in and out buffers of every block, each on a page of its own
+    auto const in_stride = (block_bytes + 4095) & ~std::size_t(4095);
+    auto const out_stride = (out_bytes + 4095) & ~std::size_t(4095);
+    auto const memory =
+        detail::alloc_aligned(num_blocks * (in_stride + out_stride));
+    std::vector<detail::stream_block> blocks(num_blocks);
+    for (std::size_t b = 0; b < num_blocks; ++b)
+    {
+        blocks[b].in = memory.get() + b * in_stride;
+        blocks[b].out = memory.get() + num_blocks * in_stride + b * out_stride;
+    }
+
+    using ring = spsc_ring<std::size_t>;
+    ring free_blocks(num_blocks);
+    std::vector<std::unique_ptr<ring>> to_worker;
+    std::vector<std::unique_ptr<ring>> to_writer;
+    for (unsigned w = 0; w < num_workers; ++w)
+    {
+        to_worker.emplace_back(new ring(num_blocks + 1));
+        to_writer.emplace_back(new ring(num_blocks + 1));
+    }
+    for (std::size_t b = 0; b < num_blocks; ++b)
+        free_blocks.push(b);
+
+    std::atomic<bool> stop{false};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    // Record the first error and stop every stage
+    auto const fail = [&](std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error)
+                error = e;
+        }
+        stop = true;
+        free_blocks.wake();
+        for (unsigned w = 0; w < num_workers; ++w)
+        {
+            to_worker[w]->wake();
+            to_writer[w]->wake();
+        }
+    };
+
+    stream_result result;
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w < num_workers; ++w)
+    {
+        threads.emplace_back([&, w] {
+            std::size_t b;
+            while (to_worker[w]->wait_pop(b, stop))
+            {
+                if (b != end_of_stream)
+                {
+                    auto& block = blocks[b];
+                    block.summary = chunk_summary();
+                    block.summary.count = block.count;
+                    block.out_size = convert(
+                        block.in,
+                        block.in_size,
+                        block.count,
+                        block.out,
+                        block.summary);
+                }
+                to_writer[w]->push(b);
+                if (b == end_of_stream)
+                    return;
+            }
+        });
+    }
+    threads.emplace_back([&] {
+        try
+        {
+            auto& records = result.records;
+            for (std::size_t seq = 0;; ++seq)
+            {
+                std::size_t b;
+                if (!to_writer[seq % num_workers]->wait_pop(b, stop) ||
+                    b == end_of_stream)
+                    return;
+                auto const& block = blocks[b];
+                detail::write_all(out_fd, block.out, block.out_size);
+                auto const& s = block.summary;
+                if (s.num_bad && !records.num_bad)
+                    records.first_bad = records.count + s.first_bad;
+                records.num_bad += s.num_bad;
+                records.count += s.count;
+                free_blocks.push(b);
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+    });
+
+    // The reader. size is the bytes in the current block, of which the
+    // first were left over from the block before.
+    try
+    {
+        std::size_t cur;
+        std::size_t size = 0;
+        std::size_t seq = 0;
+        bool eof = false;
+        free_blocks.wait_pop(cur, stop);
+        while (!stop)
+        {
+            auto& block = blocks[cur];
+            if (!eof)
+            {
+                auto const n = read(in_fd, block.in + size, block_bytes - size);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n < 0)
+                    throw std::system_error(
+                        errno, std::generic_category(), "read");
+                eof = n == 0;
+                size += n;
+            }
+
+            std::size_t count;
+            auto const whole = detail::whole_records(
+                block.in, size, format, max_records, eof, count);
+            if (!count)
+            {
+                if (eof)
+                    break;
+                if (size == block_bytes)
+                    throw std::length_error(
+                        "a line is longer than a stream block");
+                continue;
+            }
+
+            std::size_t next;
+            if (!free_blocks.wait_pop(next, stop))
+                break;
+            memcpy(blocks[next].in, block.in + whole, size - whole);
+            size -= whole;
+            block.in_size = whole;
+            block.count = count;
+            to_worker[seq++ % num_workers]->push(cur);
+            cur = next;
+        }
+        // the bytes of a fixed width record that never finished
+        result.trailing = size;
+        for (unsigned w = 0; w < num_workers; ++w)
+            to_worker[(seq + w) % num_workers]->push(end_of_stream);
+    }
+    catch (...)
+    {
+        fail(std::current_exception());
+    }
+
+    for (auto& t : threads)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+    return result;
+}
+
+namespace hex {
+
+/**
+   The convert function of transcode_stream for hex keys of width bytes, one
+   per line or one after another. A bad key decodes to zeros. Keys of 32
+   bytes one after another go through decode_hex256_batch.
+*/
+struct stream_decoder
+{
+    std::size_t width;
+    bool lines;
+
+    record_format
+    format() const
+    {
+        return {2 * width + lines, width, lines};
+    }
+
+    std::size_t
+    operator()(
+        char const* in,
+        std::size_t size,
+        std::size_t count,
+        char* out,
+        chunk_summary& s) const
+    {
+        std::size_t i = 0;
+        auto const record = [&](bool good) {
+            if (!good)
+            {
+                memset(out + width * i, 0, width);
+                if (!s.num_bad++)
+                    s.first_bad = i;
+            }
+            ++i;
+        };
+
+        if (lines)
+        {
+            for_each_line(
+                in, in + size, [&](char const* line, std::size_t len) {
+                    record(
+                        len == 2 * width &&
+                        decode_hex(line, width, out + width * i));
+                });
+        }
+        else if (width == 32)
+        {
+            // batches small enough for the valid bits to be on the stack
+            constexpr std::size_t batch = 256;
+            std::uint8_t ok[batch / 8];
+            for (std::size_t first = 0; first < count; first += batch)
+            {
+                auto const n = std::min(batch, count - first);
+                decode_hex256_batch(in + 64 * first, n, out + 32 * first, ok);
+                for (std::size_t j = 0; j < n; ++j)
+                    record(ok[j / 8] & (1 << (j % 8)));
+            }
+        }
+        else
+        {
+            while (i < count)
+                record(decode_hex(in + 2 * width * i, width, out + width * i));
+        }
+        return width * count;
+    }
+};
+
+/**
+   The convert function of transcode_stream that encodes records of width
+   bytes into hex keys, one per line or one after another.
+*/
+struct stream_encoder
+{
+    std::size_t width;
+    bool lines;
+
+    record_format
+    format() const
+    {
+        return {width, 2 * width + lines, false};
+    }
+
+    std::size_t
+    operator()(
+        char const* in,
+        std::size_t,
+        std::size_t count,
+        char* out,
+        chunk_summary&) const
+    {
+        auto const record_chars = 2 * width + lines;
+        if (width == 32 && !lines)
+        {
+            encode_hex256_batch(in, count, out);
+            return 64 * count;
+        }
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto const chars = out + record_chars * i;
+            encode_hex(in + width * i, width, chars);
+            if (lines)
+                chars[2 * width] = '\n';
+        }
+        return record_chars * count;
+    }
+};
+
+}  // namespace hex
+
+namespace base58 {
+
+/**
+   The convert function of transcode_stream for base58 values of width
+   bytes, one per line, or 44 digits each one after another for 32 byte
+   values. A record is good if decode_base58 gives exactly width bytes, and
+   a bad one decodes to zeros. The 44 digit records go through
+   decode_base58_batch first.
+*/
+struct stream_decoder
+{
+    std::size_t width;
+    bool lines;
+    InverseAlphabet const* alphabet;
+
+    record_format
+    format() const
+    {
+        // a good line of width bytes has about 1.37 digits a byte
+        return {lines ? width * 137 / 100 + 2 : 44, width, lines};
+    }
+
+    bool
+    decode(unsigned char const* in, std::size_t len, unsigned char* out) const
+    {
+        return decode_base58<128>(in, len, out, width, *alphabet) ==
+            static_cast<int>(width);
+    }
+
+    std::size_t
+    operator()(
+        char const* in,
+        std::size_t size,
+        std::size_t count,
+        char* out,
+        chunk_summary& s) const
+    {
+        auto const digits = reinterpret_cast<unsigned char const*>(in);
+        auto const values = reinterpret_cast<unsigned char*>(out);
+        std::size_t i = 0;
+        auto const record = [&](bool good) {
+            if (!good)
+            {
+                memset(values + width * i, 0, width);
+                if (!s.num_bad++)
+                    s.first_bad = i;
+            }
+            ++i;
+        };
+
+        if (lines)
+        {
+            for_each_line(
+                in, in + size, [&](char const* line, std::size_t len) {
+                    record(decode(
+                        reinterpret_cast<unsigned char const*>(line),
+                        len,
+                        values + width * i));
+                });
+            return width * count;
+        }
+
+        constexpr std::size_t batch = 256;
+        unsigned char const* strings[batch];
+        bool ok[batch];
+        for (std::size_t first = 0; first < count; first += batch)
+        {
+            auto const n = std::min(batch, count - first);
+            for (std::size_t j = 0; j < n; ++j)
+                strings[j] = digits + 44 * (first + j);
+            decode_base58_batch(
+                strings, n, values + 32 * first, ok, alphabet->rows());
+            // the batch rejects some strings decode_base58 takes
+            for (std::size_t j = 0; j < n; ++j)
+                record(ok[j] || decode(strings[j], 44, values + 32 * i));
+        }
+        return 32 * count;
+    }
+};
+
+/**
+   The convert function of transcode_stream that encodes records of width
+   bytes into base58, one per line.
+*/
+struct stream_encoder
+{
+    std::size_t width;
+    char const* digits;
+
+    record_format
+    format() const
+    {
+        return {width, width * 138 / 100 + 2, false};
+    }
+
+    std::size_t
+    operator()(
+        char const* in,
+        std::size_t,
+        std::size_t count,
+        char* out,
+        chunk_summary&) const
+    {
+        auto const start = out;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            out += encode_base58(
+                reinterpret_cast<unsigned char const*>(in) + width * i,
+                width,
+                out,
+                digits);
+            *out++ = '\n';
+        }
+        return out - start;
+    }
+};
+
+}  // namespace base58
+
+namespace detail {
+
+// Run transcode_stream on a pipe that a thread feeds with input, in pieces of
+// random sizes, and collect what it writes to another pipe
+template <class Convert>
+stream_result
+transcode_pipes(
+    std::string const& input,
+    Convert const& convert,
+    stream_options const& options,
+    std::mt19937& gen,
+    std::string& output)
+{
+    int in[2];
+    int out[2];
+    if (pipe(in) || pipe(out))
+        throw std::system_error(errno, std::generic_category(), "pipe");
+
+    std::uniform_int_distribution<std::size_t> rand_piece(1, 3000);
+    std::vector<std::size_t> pieces;
+    for (std::size_t done = 0; done < input.size();)
+    {
+        pieces.push_back(std::min(rand_piece(gen), input.size() - done));
+        done += pieces.back();
+    }
+    std::thread feed([&] {
+        std::size_t done = 0;
+        for (auto const n : pieces)
+        {
+            write_all(in[1], input.data() + done, n);
+            done += n;
+        }
+        close(in[1]);
+    });
+    output.clear();
+    std::thread drain([&] {
+        char buf[4096];
+        for (;;)
+        {
+            auto const n = read(out[0], buf, sizeof(buf));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            output.append(buf, n);
+        }
+    });
+
+    auto const result =
+        transcode_stream(in[0], out[1], convert.format(), convert, options);
+    close(out[1]);
+    feed.join();
+    drain.join();
+    close(in[0]);
+    close(out[0]);
+    return result;
+}
+
+}  // namespace detail
+
+/**
+   Compare the streams of every codec against the same convert function
+   called once on the whole input, with small blocks and several workers so
+   the input is cut into many blocks, and random pieces on the pipe so
+   records are split between reads. Some records are bad, and some lines
+   short enough to fill a block with records before its bytes.
+*/
+inline
+bool
+random_test_stream(int iterations)
+{
+    std::mt19937 gen;
+    std::uniform_int_distribution<> rand_byte(0, 255);
+    std::uniform_int_distribution<> rand_count(0, 600);
+    std::uniform_int_distribution<> rand_kind(0, 5);
+    std::uniform_int_distribution<> rand_workers(1, 4);
+    std::uniform_int_distribution<std::size_t> rand_block(128, 8192);
+    std::uniform_int_distribution<std::size_t> rand_width(1, 40);
+
+    for (int it = 0; it < iterations; ++it)
+    {
+        auto const kind = rand_kind(gen);
+        bool const lines = rand_byte(gen) & 1;
+        std::size_t const count = rand_count(gen);
+        std::size_t width = rand_byte(gen) & 2 ? 32 : rand_width(gen);
+        // every other line short enough to fill blocks with records first
+        bool const short_lines = rand_kind(gen) == 0;
+
+        std::vector<unsigned char> values(width * count);
+        for (auto& v : values)
+            v = rand_byte(gen);
+
+        // the hex or base58 of the values, with some bad records
+        auto const text = [&](bool base58, bool in_lines) {
+            std::string s;
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                char buf[256];
+                auto const v =
+                    reinterpret_cast<char const*>(&values[width * i]);
+                std::size_t n;
+                if (base58)
+                    n = base58::encode_base58(
+                        &values[width * i], width, buf, base58::rippleAlphabet);
+                else
+                {
+                    hex::encode_hex(v, width, buf);
+                    n = 2 * width;
+                }
+                if (i % 11 == 3)
+                    buf[rand_byte(gen) % n] = base58 ? '0' : 'g';
+                if (in_lines && (i % 13 == 5 || (short_lines && i % 2)))
+                    n = rand_byte(gen) % 3;
+                s.append(buf, n);
+                if (in_lines)
+                    s += i % 17 == 7 ? "\r\n" : "\n";
+            }
+            // the last line without its newline
+            if (in_lines && count && rand_byte(gen) & 1)
+                s.pop_back();
+            return s;
+        };
+
+        stream_options options;
+        options.workers = rand_workers(gen);
+        options.block_bytes = rand_block(gen);
+        options.blocks_per_worker = 2 + rand_byte(gen) % 3;
+
+        auto const check = [&](auto const& convert, std::string const& input) {
+            std::string output;
+            auto const result =
+                detail::transcode_pipes(input, convert, options, gen, output);
+
+            // the whole input as one block
+            auto const format = convert.format();
+            std::size_t records = 0;
+            auto const whole = detail::whole_records(
+                input.data(), input.size(), format, ~std::size_t(0), true,
+                records);
+            std::string expected(records * format.out_bytes + 1, 0);
+            chunk_summary s;
+            s.count = records;
+            expected.resize(
+                convert(input.data(), whole, records, &expected[0], s));
+
+            if (output != expected || result.records.count != records ||
+                result.records.num_bad != s.num_bad ||
+                (s.num_bad && result.records.first_bad != s.first_bad) ||
+                result.trailing != input.size() - whole)
+            {
+                std::cerr << "transcode_stream mismatch, kind: " << kind
+                          << " width: " << width << " count: " << count
+                          << " lines: " << lines << '\n';
+                return false;
+            }
+            return true;
+        };
+
+        bool good = true;
+        switch (kind)
+        {
+            case 0:
+                good = check(
+                    hex::stream_decoder{width, lines}, text(false, lines));
+                break;
+            case 1:
+            {
+                // and a few bytes of a record that never finishes
+                auto input = text(false, false);
+                input.append(rand_byte(gen) % 5 ? 0 : 7, 'a');
+                good = check(hex::stream_decoder{width, false}, input);
+                break;
+            }
+            case 2:
+            case 3:
+                good = check(
+                    hex::stream_encoder{width, lines},
+                    std::string(values.begin(), values.end()));
+                break;
+            case 4:
+                if (!lines)
+                {
+                    // 44 digits a record, as the fixed width decoder takes
+                    width = 32;
+                    values.resize(32 * count);
+                    for (std::size_t i = 0; i < count; ++i)
+                        values[32 * i] |= 0x80;
+                }
+                good = check(
+                    base58::stream_decoder{
+                        width, lines, &base58::rippleInverse},
+                    text(true, lines));
+                break;
+            default:
+                good = check(
+                    base58::stream_encoder{width, base58::rippleAlphabet},
+                    std::string(values.begin(), values.end()));
+                break;
+        }
+        if (!good)
+            return false;
+    }
+    return true;
+}
+
+/**
+   Stream 256 MB of hex keys through pipes: the throughput of decoding and
+   encoding them, and the latency of a sparse stream, one key at a time.
+*/
+inline
+void
+benchmark_stream()
+{
+    using timer = std::chrono::high_resolution_clock;
+
+    std::size_t const num_keys = 4 * 1024 * 1024;
+    std::string values(32 * num_keys, '\x5a');
+    std::string keys(64 * num_keys, 0);
+    hex::encode_hex256_batch(values.data(), num_keys, &keys[0]);
+
+    // Feed input into a pipe on a thread, and read what the stream writes
+    // to another pipe, without keeping it
+    auto const run = [&](std::string const& input, auto const& convert) {
+        int in[2];
+        int out[2];
+        if (pipe(in) || pipe(out))
+            return;
+        std::thread feed([&] {
+            for (std::size_t done = 0; done < input.size(); done += 1 << 20)
+                detail::write_all(
+                    in[1],
+                    input.data() + done,
+                    std::min<std::size_t>(1 << 20, input.size() - done));
+            close(in[1]);
+        });
+        std::thread drain([&] {
+            std::vector<char> buf(1 << 20);
+            while (read(out[0], buf.data(), buf.size()) > 0)
+                ;
+        });
+        auto const start = timer::now();
+        transcode_stream(in[0], out[1], convert.format(), convert);
+        close(out[1]);
+        drain.join();
+        auto const end = timer::now();
+        feed.join();
+        close(in[0]);
+        close(out[0]);
+        auto const ms =
+            std::chrono::duration_cast<std::chrono::milliseconds>(end - start)
+                .count();
+        std::cout << ms << " ms, "
+                  << input.size() / 1000 / std::max<long long>(ms, 1)
+                  << " MB/s\n";
+    };
+
+    std::cout << "Stream dec hex: ";
+    run(keys, hex::stream_decoder{32, false});
+    std::cout << "Stream enc hex: ";
+    run(values, hex::stream_encoder{32, false});
+
+    // One key at a time, waiting for its value before sending the next
+    {
+        int in[2];
+        int out[2];
+        if (pipe(in) || pipe(out))
+            return;
+        std::thread stream([&] {
+            transcode_stream(
+                in[0], out[1], hex::stream_decoder{32, true}.format(),
+                hex::stream_decoder{32, true});
+            close(out[1]);
+        });
+        int const n = 1000;
+        std::vector<double> us;
+        char line[65];
+        memcpy(line, keys.data(), 64);
+        line[64] = '\n';
+        char value[32];
+        for (int i = 0; i < n; ++i)
+        {
+            auto const start = timer::now();
+            detail::write_all(in[1], line, sizeof(line));
+            for (std::size_t got = 0; got < sizeof(value);)
+            {
+                auto const r = read(out[0], value + got, sizeof(value) - got);
+                if (r <= 0)
+                    break;
+                got += r;
+            }
+            auto const end = timer::now();
+            us.push_back(
+                std::chrono::duration<double, std::micro>(end - start).count());
+            // a pause long enough for the workers to go to sleep
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        close(in[1]);
+        stream.join();
+        close(in[0]);
+        close(out[0]);
+        std::sort(us.begin(), us.end());
+        std::cout << "Stream latency, one key at a time: median "
+                  << us[n / 2] << " us, p99 " << us[n * 99 / 100] << " us\n";
+    }
+}
+
+}  // namespace codec
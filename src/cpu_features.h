@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cpuid.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace codec {
+namespace cpu {
+
+/**
+   Instruction set levels the codec kernels are built for, ordered from the
+   least to the most capable. Every level includes the ones below it.
+*/
+enum class isa : int
+{
+    scalar = 0,
+    sse41,
+    avx2,
+    avx512,
+    avx512vbmi,
+    num_isa
+};
+
+inline
+char const*
+name(isa level)
+{
+    switch (level)
+    {
+        case isa::scalar:
+            return "scalar";
+        case isa::sse41:
+            return "sse41";
+        case isa::avx2:
+            return "avx2";
+        case isa::avx512:
+            return "avx512";
+        case isa::avx512vbmi:
+            return "avx512vbmi";
+        default:
+            return "unknown";
+    }
+}
+
+inline
+bool
+parse_isa(char const* s, isa& level)
+{
+    for (int i = 0; i < static_cast<int>(isa::num_isa); ++i)
+    {
+        if (!strcmp(s, name(static_cast<isa>(i))))
+        {
+            level = static_cast<isa>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+struct features
+{
+    bool sse41 = false;
+    bool avx2 = false;
+    bool avx512bw = false;
+    bool avx512vbmi = false;
+    // The sha256 instructions. They are not part of any isa level: some
+    // avx512 cpus don't have them, and some cpus without avx do.
+    bool sha = false;
+};
+
+// Query cpuid, and xgetbv for the register state the OS saves. A cpu that
+// supports avx but runs under an OS that doesn't save the ymm/zmm state must
+// not use those instructions.
+inline
+features
+query_features()
+{
+    features result;
+
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return result;
+
+    bool const ssse3 = ecx & (1u << 9);
+    bool const sse41 = ecx & (1u << 19);
+    bool const osxsave = ecx & (1u << 27);
+    bool const avx = ecx & (1u << 28);
+
+    result.sse41 = ssse3 && sse41;
+
+    if (result.sse41 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        result.sha = ebx & (1u << 29);
+
+    if (!osxsave || !avx)
+        return result;
+
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    // xmm and ymm state
+    bool const os_avx = (xcr0_lo & 0x6) == 0x6;
+    // opmask and zmm state
+    bool const os_avx512 = (xcr0_lo & 0xe6) == 0xe6;
+
+    if (!os_avx || !__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+        return result;
+
+    result.avx2 = ebx & (1u << 5);
+
+    bool const avx512f = ebx & (1u << 16);
+    bool const avx512bw = ebx & (1u << 30);
+    bool const avx512vl = ebx & (1u << 31);
+    result.avx512bw = os_avx512 && avx512f && avx512bw && avx512vl;
+    result.avx512vbmi = result.avx512bw && (ecx & (1u << 1));
+
+    return result;
+}
+
+inline
+features const&
+detected_features()
+{
+    static features const f = query_features();
+    return f;
+}
+
+// The most capable level this cpu supports
+inline
+isa
+best_isa()
+{
+    auto const& f = detected_features();
+    if (f.avx512vbmi && f.avx2)
+        return isa::avx512vbmi;
+    if (f.avx512bw && f.avx2)
+        return isa::avx512;
+    if (f.avx2)
+        return isa::avx2;
+    if (f.sse41)
+        return isa::sse41;
+    return isa::scalar;
+}
+
+// All the levels this cpu supports, from the least to the most capable
+inline
+std::vector<isa>
+supported_isas()
+{
+    std::vector<isa> result;
+    for (int i = 0; i <= static_cast<int>(best_isa()); ++i)
+        result.push_back(static_cast<isa>(i));
+    return result;
+}
+
+/**
+   The level to use at startup: the best one the cpu supports, unless the
+   environment variable CODEC_ISA names another one (scalar, sse41, avx2,
+   avx512 or avx512vbmi). This is used to force and benchmark each variant on
+   one host. A level the cpu does not support is ignored, since it would fault.
+*/
+inline
+isa
+initial_isa()
+{
+    auto const best = best_isa();
+    char const* const env = std::getenv("CODEC_ISA");
+    if (!env || !*env)
+        return best;
+
+    isa requested;
+    if (!parse_isa(env, requested))
+    {
+        std::cerr << "CODEC_ISA: unknown isa '" << env << "', using "
+                  << name(best) << '\n';
+        return best;
+    }
+    if (requested > best)
+    {
+        std::cerr << "CODEC_ISA: " << name(requested)
+                  << " is not supported on this cpu, using " << name(best)
+                  << '\n';
+        return best;
+    }
+    return requested;
+}
+
+inline
+isa&
+active_isa_ref()
+{
+    static isa level = initial_isa();
+    return level;
+}
+
+// The level the codec kernels are currently bound to
+inline
+isa
+active_isa()
+{
+    return active_isa_ref();
+}
+
+/**
+   Rebind the codec kernels to the given level. Returns false, and leaves the
+   binding alone, if the cpu does not support it.
+
+   @note: This is meant for tests and benchmarks. It is not safe to call while
+   other threads are calling the codecs.
+*/
+inline
+bool
+set_isa(isa level)
+{
+    if (level > best_isa())
+        return false;
+    active_isa_ref() = level;
+    return true;
+}
+
+}  // namespace cpu
+}  // namespace codec
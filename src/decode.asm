@@ -1,70 +1,143 @@
-;; extern int decode_hex256(char* in, char* out);
-
+;; extern int decode_hex256_avx2(char* in, char* out);
+;; extern int decode_hex_avx2(char const* in, size_t len, char* out);
+;; extern void decode_hex256_batch_avx2(char const* in, size_t count, char* out, uint8_t* ok);
+;; extern int decode_hex256_upper_avx2(char const* in, char* out);
+;; extern int decode_hex_upper_avx2(char const* in, size_t len, char* out);
+;; extern int decode_hex256_lower_avx2(char const* in, char* out);
+;; extern int decode_hex_lower_avx2(char const* in, size_t len, char* out);
+;; extern int decode_hex160_avx2(char const* in, char* out);
+;; extern int decode_hex264_avx2(char const* in, char* out);
+;; extern int decode_hex512_avx2(char const* in, char* out);
+;; extern size_t decode_hex_lenient_avx2(char const* in, size_t len, char* out, size_t out_size, size_t* consumed, uint8_t const* left_pack);
+
+;; decode_hex256_avx2:
 ;; RDI is address of buf to decode (hex string). Must be 64 bytes.
 ;; RSI is the address of the output (must be 32 bytes)
+;;
+;; decode_hex_avx2:
+;; RDI is address of buf to decode (hex string). Must be 2*len bytes.
+;; RSI is the number of bytes to decode (len)
+;; RDX is the address of the output (must be len bytes, and must not overlap the input)
+;;
+;; decode_hex256_batch_avx2:
+;; RDI is address of the keys to decode (hex strings). Must be 64*count bytes.
+;; RSI is the number of keys to decode (count)
+;; RDX is the address of the output (must be 32*count bytes)
+;; RCX is the address of the validity bitmap (must be (count+7)/8 bytes). Bit
+;;     i%8 of byte i/8 is set if key i decoded, and cleared if it had a bad
+;;     hex char. The output for a bad key is garbage.
+;;
+;; The _upper and _lower variants take the same parameters as decode_hex256_avx2
+;; and decode_hex_avx2, but only accept the letters 'A'-'F' or 'a'-'f'; a
+;; letter of the other case is a bad hex char. The plain variants accept both.
+;;
+;; decode_hex160_avx2, decode_hex264_avx2 and decode_hex512_avx2 decode the
+;; 40, 66 and 128 hex digits of 20, 33 and 64 bytes, and take the same
+;; parameters as decode_hex256_avx2. Where the digits are not a whole number of
+;; blocks, the loads overlap rather than read past the end of the input.
+;;
+;; decode_hex_lenient_avx2:
+;; RDI is address of the chars to decode: hex digits with any number of ' ',
+;;     ':' or '-' between them. Must be len chars.
+;; RSI is the number of chars (len)
+;; RDX is the address of the output
+;; RCX is the size of the output (out_size)
+;; R8 is the address where the number of chars consumed is stored
+;; R9 is the address of the left pack table (codec::hex::left_pack, 2 KB)
+;; Returns the number of bytes written, a multiple of 32, from the digits in
+;; the first *consumed chars. The chars after those are left to the caller:
+;; the digits of an unfinished block, inputs of less than 16 chars, the rest of
+;; the input after a char that is neither a digit nor a separator, and the
+;; rest of the input once another 32 bytes would not fit in the output.
+;;
 ;; If this is ported to windows, the calling convention is RCX, RDX for the first two params
 
-section   .text
-
-global decode_hex256
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Load the constants used by DECODE_HEX_BLOCK. They are kept in the high
+;;; registers so a loop can reuse them for every block.
+;;;
+;;; %1 the first letter: ascii_A, or ascii_a for the lowercase only variants
+;;; %2 the value to subtract from a letter: fiftyfive for 'A', eightyseven for 'a'
+;;;
+;;; ymm8 shuffle pattern
+;;; ymm9 all bytes 0xf0 (high nibble)
+;;; ymm10 all bytes 55 or 87
+;;; ymm11 all bytes 48
+;;; ymm12 all bytes 'A' or 'a'
+;;; ymm13 all bytes '9'
+;;; ymm14 all bytes 0x20 (the bit cleared to upcase a letter)
+
+%macro DECODE_HEX_CONSTANTS 2
+  vmovdqa ymm8, [shuffle]
+  vpbroadcastb ymm9, [highnibble]
+  vpbroadcastb ymm10, [%2]
+  vpbroadcastb ymm11, [fourtyeight]
+  vpbroadcastb ymm12, [%1]
+  vpbroadcastb ymm13, [ascii_9]
+  vpbroadcastb ymm14, [lowercase_bit]
+%endmacro
 
-decode_hex256:
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode 64 hex digits into 32 bytes. Uses ymm0-ymm5 as scratch.
 ;;;
-;;; ymm{0,1}: input of hex digits
+;;; %1 address of the 64 hex digits
+;;; %2 address of the 32 byte output
+;;; %3 label to jump to if any of the digits are not hex digits
+;;; %4 1 to upcase the letters first, so both cases are accepted. 0 to accept
+;;;    only letters of the case in ymm12.
+
+%macro DECODE_HEX_BLOCK 4
+  vmovdqu ymm0, [%1]
+  vmovdqu ymm1, [%1+32]
+  DECODE_HEX_DIGITS %3, %4
+  vmovdqu [%2], ymm0
+%endmacro
 
-  vmovdqu ymm0, [rdi]
-  vmovdqu ymm1, [rdi+32]
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode the 64 hex digits in ymm0 and ymm1 into 32 bytes in ymm0: the
+;;; digits of ymm0 into the low lane and those of ymm1 into the high lane.
+;;; Uses ymm1-ymm5 as scratch. The parameters are %3 and %4 of
+;;; DECODE_HEX_BLOCK.
 
+%macro DECODE_HEX_DIGITS 2
+%if %2
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;;; upcase by clearing bit six
 ;;;
 ;;; ymm{0,1} from above
-;;; ymm2 all bits set
-;;; ymm3 upcase mask
-;;; ymm4 all bytes '9'
-;;; ymm{5,6} mask of all values > '9'
-;;; ymm{7,8} mask of all values <= '9'
-;;; ymm{9,10} mask to clear bit 6 for values > '9', leave other values alone
-
-  vpcmpeqd ymm2, ymm2
-  vpbroadcastb ymm3, [upcase_mask]
-  vpbroadcastb ymm4, [ascii_9]
-
-  vpcmpgtb ymm5, ymm0, ymm4     ; mask of all values > '9'
-  vpcmpgtb ymm6, ymm1, ymm4
-  vpxor ymm7, ymm5, ymm2       ; mask of all value <= '9'
-  vpxor ymm8, ymm6, ymm2
+;;; ymm{2,3} mask of all values > '9'
+;;; ymm{4,5} bit six for values > '9', zero for other values
 
-  vpor ymm9, ymm7, ymm3       ; set the letter mask to one that will clear bit 6, upcasing it
-  vpor ymm10, ymm8, ymm3
-  vpand ymm0, ymm0, ymm9       ; apply the mask
-  vpand ymm1, ymm1, ymm10
+  vpcmpgtb ymm2, ymm0, ymm13    ; mask of all values > '9'
+  vpcmpgtb ymm3, ymm1, ymm13
+  vpand ymm4, ymm2, ymm14
+  vpand ymm5, ymm3, ymm14
+  vpandn ymm0, ymm4, ymm0       ; clear bit six of the letters, upcasing them
+  vpandn ymm1, ymm5, ymm1
 
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endif
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
-;;; any resulting hex digit greater than '9' and less than 'A' is an error
+;;; any resulting hex digit greater than '9' and less than the first letter
+;;; ('A' or 'a') is an error. Without the upcase, this also rejects the
+;;; uppercase letters when the first letter is 'a', and the check for values
+;;; greater than 15 below rejects the lowercase letters when it is 'A'.
 ;;; ymm{0,1} from above
-;;; ymm2 from above
-;;; ymm3 all bytes 'A'
-;;; ymm4 from above (all bytes '9')
-;;; ymm{5,6} recomputed mask of values > '9'
-;;; ymm{7,8} mask of values < 'A'
-;;; ymm{9,10} mask of value > '9' and < 'A'
-;;; ymm11 bit or of first 32 bytes and second 32 bytes of mask from ymm{9,10}
-
-  vpbroadcastb ymm3, [ascii_A]
-  vpcmpgtb ymm5, ymm0, ymm4
-  vpcmpgtb ymm6, ymm1, ymm4
-  vpcmpgtb ymm7, ymm3, ymm0
-  vpcmpgtb ymm8, ymm3, ymm1
-  vpand ymm9, ymm5, ymm7
-  vpand ymm10, ymm6, ymm8
-  vpor ymm11, ymm9, ymm10
-  vptest ymm11, ymm2
-  jnz .bad_hex_char
+;;; ymm{2,3} recomputed mask of values > '9'
+;;; ymm{4,5} mask of values < the first letter, then mask of value > '9' and < the first letter
+;;; ymm4 bit or of first 32 bytes and second 32 bytes of the error mask
+
+  vpcmpgtb ymm2, ymm0, ymm13
+  vpcmpgtb ymm3, ymm1, ymm13
+  vpcmpgtb ymm4, ymm12, ymm0
+  vpcmpgtb ymm5, ymm12, ymm1
+  vpand ymm4, ymm4, ymm2
+  vpand ymm5, ymm5, ymm3
+  vpor ymm4, ymm4, ymm5
+  vptest ymm4, ymm4
+  jnz %1
 
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -72,19 +145,14 @@ decode_hex256:
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;;; convert the bytes to numeric values
 ;;; ymm{0,1} from above
-;;; ymm2 from above
-;;; ymm3 all bytes 48
-;;; ymm4 all bytes 55
-;;; ymm{5,6} from above
-;;; ymm{7,8} values to subtract from input (either 48 or 55, depending if hex digit is '0'-'9' or 'A'-'F')
+;;; ymm{2,3} from above
+;;; ymm{4,5} values to subtract from input (either 48 or 55 (87), depending if hex digit is '0'-'9' or a letter)
 
-  vpbroadcastb ymm3, [fourtyeight]
-  vpbroadcastb ymm4, [fiftyfive]
-  vpblendvb ymm7, ymm3, ymm4, ymm5 ; select either the constants 48 or 55 depending on the mask in ymm4
-  vpblendvb ymm8, ymm3, ymm4, ymm6
+  vpblendvb ymm4, ymm11, ymm10, ymm2 ; select either the constants 48 or 55 (87) depending on the mask in ymm{2,3}
+  vpblendvb ymm5, ymm11, ymm10, ymm3
 
-  vpsubb ymm0, ymm0, ymm7
-  vpsubb ymm1, ymm1, ymm8
+  vpsubb ymm0, ymm0, ymm4
+  vpsubb ymm1, ymm1, ymm5
 
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -92,17 +160,11 @@ decode_hex256:
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;;; Error checking: if any of the bytes are greater than 15 (high nibble bits set)
 ;;; ymm{0,1} from above (numeric value of hex digit)
-;;; ymm2 from above (all bits set)
-;;; ymm3 all bytes 0xf0 (high nibble)
-;;; ymm{4,5} masked high nibble of values
-;;; ymm6 bit or of ymm{4,5}
+;;; ymm4 bit or of ymm{0,1}
 
-  vpbroadcastb ymm3, [highnibble]
-  vpand ymm4, ymm0, ymm3
-  vpand ymm5, ymm1, ymm3
-  vpor ymm6, ymm5, ymm4      ; ymm6 will be non-zero if any byte in ymm{0,1} is > 15
-  vptest ymm6, ymm2
-  jnz .bad_hex_char
+  vpor ymm4, ymm0, ymm1
+  vptest ymm4, ymm9           ; ZF is clear if any byte in ymm{0,1} is > 15
+  jnz %1
 
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
@@ -111,35 +173,169 @@ decode_hex256:
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;;; shift the even byte bits into the correct position
 ;;; ymm{0,1} from above
-;;; ymm{3,4} shifted low 4 bits of even bytes into high 4 bits of odd bytes
-;;; ymm5 shuffle pattern to shuffle the result into the bytes 8-15 in the high lane and bytes 0-7 in the low lane
+;;; ymm{2,3} shifted low 4 bits of even bytes into high 4 bits of odd bytes
+;;; ymm8 shuffle pattern to shuffle the result into the bytes 8-15 in the high lane and bytes 0-7 in the low lane
 ;;;      Set bytes 0-8 to zero in the high lane and bytes 8-15 in the low lane
-;;; ymm6 extracted high lane of ymm0 put into low lane of ymm6; extrated low lane of xmm1 put into high lane of ymm6
-
-  vmovdqa ymm5, [shuffle]
+;;; ymm4 extracted high lane of ymm0 put into low lane of ymm4; extrated low lane of xmm1 put into high lane of ymm4
 
-  vpsllw ymm3, ymm0, 12
-  vpsllw ymm4, ymm1, 12
-  vpaddb ymm0, ymm0, ymm3       ; the odd bytes contain the correct bitpattern. The even bytes are junk
-  vpaddb ymm1, ymm1, ymm4
+  vpsllw ymm2, ymm0, 12
+  vpsllw ymm3, ymm1, 12
+  vpaddb ymm0, ymm0, ymm2       ; the odd bytes contain the correct bitpattern. The even bytes are junk
+  vpaddb ymm1, ymm1, ymm3
 
-  vpshufb ymm0, ymm0, ymm5
-  vpshufb ymm1, ymm1, ymm5
+  vpshufb ymm0, ymm0, ymm8
+  vpshufb ymm1, ymm1, ymm8
 
-  vextracti128 xmm6, ymm0, 1      ; Extract the high lane of ymm0 and put it into the low lane of ymm11
-  vinserti128 ymm6, ymm6, xmm1, 1 ; Insert from the low lane of xmm1 into the high lane of ymm11
+  vextracti128 xmm4, ymm0, 1      ; Extract the high lane of ymm0 and put it into the low lane of ymm4
+  vinserti128 ymm4, ymm4, xmm1, 1 ; Insert from the low lane of xmm1 into the high lane of ymm4
   vinserti128 ymm1, ymm1, xmm0, 0 ; Insert from the low lane from ymm0 and put it into the low land of xmm1
 
   ;; At this point:
   ;; ymm1 upper lane ==  upper lane of ymm1_original
   ;; ymm1 lower lane ==  lower lane of ymm0_original
-  ;; ymm6 upper lane == lower lane of ymm1_original
-  ;; ymm6 lower lane == upper lane of ymm0_original
+  ;; ymm4 upper lane == lower lane of ymm1_original
+  ;; ymm4 lower lane == upper lane of ymm0_original
+
+  vpaddb ymm0, ymm1, ymm4      ; add them all together to get the 256 bit result
 
-  vpaddb ymm0, ymm1, ymm6      ; add them all together to get the 256 bit result
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endmacro
 
-  ;; save the result
-  vmovdqu [rsi], ymm0
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Load the constants used by DECODE_HEX_BLOCK_NB. Only four of the constants
+;;; are kept in registers, so two blocks with six scratch registers each fit
+;;; in the remaining twelve. The others are read from memory.
+;;;
+;;; ymm12 all bytes 'A'
+;;; ymm13 all bytes '9'
+;;; ymm14 all bytes 48
+;;; ymm15 all bytes 55
+
+%macro DECODE_HEX_NB_CONSTANTS 0
+  vpbroadcastb ymm12, [ascii_A]
+  vpbroadcastb ymm13, [ascii_9]
+  vpbroadcastb ymm14, [fourtyeight]
+  vpbroadcastb ymm15, [fiftyfive]
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode 64 hex digits into 32 bytes without branching. This is the same
+;;; algorithm as DECODE_HEX_BLOCK, but instead of jumping on a bad hex char,
+;;; the error mask is left in %7 so the caller can record it. The scratch
+;;; registers are parameters so independent keys can use disjoint registers
+;;; and overlap in the pipeline.
+;;;
+;;; %1 address of the 64 hex digits
+;;; %2 address of the 32 byte output
+;;; %3, %4 scratch: the input, then the numeric values
+;;; %5, %6 scratch: mask of values > '9', then temporaries
+;;; %7 on exit non-zero if any of the digits are not hex digits
+;;; %8 scratch
+
+%macro DECODE_HEX_BLOCK_NB 8
+  vmovdqu %3, [%1]
+  vmovdqu %4, [%1+32]
+
+  ;; upcase by clearing bit six of values > '9'
+  vpcmpgtb %5, %3, ymm13
+  vpcmpgtb %6, %4, ymm13
+  vpand %7, %5, [lowercase_bits]
+  vpand %8, %6, [lowercase_bits]
+  vpandn %3, %7, %3
+  vpandn %4, %8, %4
+
+  ;; any resulting hex digit greater than '9' and less than 'A' is an error
+  vpcmpgtb %5, %3, ymm13
+  vpcmpgtb %6, %4, ymm13
+  vpcmpgtb %7, ymm12, %3
+  vpcmpgtb %8, ymm12, %4
+  vpand %7, %7, %5
+  vpand %8, %8, %6
+  vpor %7, %7, %8
+
+  ;; convert the bytes to numeric values
+  vpblendvb %8, ymm14, ymm15, %5
+  vpsubb %3, %3, %8
+  vpblendvb %8, ymm14, ymm15, %6
+  vpsubb %4, %4, %8
+
+  ;; any value greater than 15 is an error
+  vpor %5, %3, %4
+  vpand %5, %5, [highnibbles]
+  vpor %7, %7, %5
+
+  ;; shift the even byte bits into the correct position; the odd bytes
+  ;; contain the result
+  vpsllw %5, %3, 12
+  vpsllw %6, %4, 12
+  vpaddb %3, %3, %5
+  vpaddb %4, %4, %6
+
+  ;; Pack the odd bytes into the low qword of each lane, interleave the low
+  ;; qwords of the two registers, and put the qwords in order
+  vpshufb %3, %3, [shuffle_packed]
+  vpshufb %4, %4, [shuffle_packed]
+  vpunpcklqdq %3, %3, %4
+  vpermq %3, %3, 0xd8
+
+  vmovdqu [%2], %3
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a 64 digit decoder. The case variants share this body and only
+;;; differ in the constants and the upcase step.
+;;;
+;;; %1 name of the function
+;;; %2 %1 of DECODE_HEX_CONSTANTS
+;;; %3 %2 of DECODE_HEX_CONSTANTS
+;;; %4 %4 of DECODE_HEX_BLOCK (1 to accept both cases)
+
+%macro DECODE_HEX256_FUNCTION 4
+%1:
+  DECODE_HEX_CONSTANTS %2, %3
+  DECODE_HEX_BLOCK rdi, rsi, .bad_hex_char, %4
+  mov eax, 1
+  vzeroupper
+  ret
+
+.bad_hex_char:
+  xor eax,eax
+  vzeroupper
+  ret
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a variable length decoder. The parameters are the same as
+;;; DECODE_HEX256_FUNCTION.
+
+%macro DECODE_HEX_FUNCTION 4
+%1:
+  DECODE_HEX_CONSTANTS %2, %3
+  cmp rsi, 32
+  jb .short
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode 32 bytes at a time. The final block is aligned to the end of the
+;;; buffer, so it overlaps the previous block when len is not a multiple of 32.
+;;; The overlapped bytes decode to the same values, so rewriting them is harmless.
+;;;
+;;; r8 address of the final output block
+;;; r9 address of the final input block
+
+  lea r8, [rdx + rsi - 32]
+  lea r9, [rdi + 2*rsi - 64]
+
+.loop:
+  cmp rdx, r8
+  jae .last_block
+  DECODE_HEX_BLOCK rdi, rdx, .bad_hex_char, %4
+  add rdi, 64
+  add rdx, 32
+  jmp .loop
+
+.last_block:
+  DECODE_HEX_BLOCK r9, r8, .bad_hex_char, %4
   mov eax, 1
   vzeroupper
   ret
@@ -147,19 +343,359 @@ decode_hex256:
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Less than a full block: copy the input into a stack buffer padded with '0'
+;;; so the block never reads past the end of the input, decode it, and copy the
+;;; decoded bytes out.
+;;;
+;;; [rsp] 64 byte padded input
+;;; [rsp+64] 32 byte output
+;;; r10 address of the output
+;;; r11 number of bytes to decode
+
+.short:
+  test rsi, rsi
+  jz .empty
+  sub rsp, 96
+  vpbroadcastb ymm0, [ascii_0]
+  vmovdqu [rsp], ymm0
+  vmovdqu [rsp+32], ymm0
+
+  mov r10, rdx
+  mov r11, rsi
+  lea rcx, [rsi + rsi]
+  mov rsi, rdi
+  mov rdi, rsp
+  rep movsb
+
+  DECODE_HEX_BLOCK rsp, rsp+64, .bad_hex_char_short, %4
+
+  lea rsi, [rsp + 64]
+  mov rdi, r10
+  mov rcx, r11
+  rep movsb
+  add rsp, 96
+
+.empty:
+  mov eax, 1
+  vzeroupper
+  ret
+
+.bad_hex_char_short:
+  add rsp, 96
 .bad_hex_char:
   xor eax,eax
   vzeroupper
   ret
 
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endmacro
+
+default rel
+
+section   .text
+
+global decode_hex256_avx2
+global decode_hex_avx2
+global decode_hex256_batch_avx2
+global decode_hex256_upper_avx2
+global decode_hex_upper_avx2
+global decode_hex256_lower_avx2
+global decode_hex_lower_avx2
+global decode_hex_lenient_avx2
+global decode_hex160_avx2
+global decode_hex264_avx2
+global decode_hex512_avx2
+
+DECODE_HEX256_FUNCTION decode_hex256_avx2, ascii_A, fiftyfive, 1
+DECODE_HEX_FUNCTION decode_hex_avx2, ascii_A, fiftyfive, 1
+DECODE_HEX256_FUNCTION decode_hex256_upper_avx2, ascii_A, fiftyfive, 0
+DECODE_HEX_FUNCTION decode_hex_upper_avx2, ascii_A, fiftyfive, 0
+DECODE_HEX256_FUNCTION decode_hex256_lower_avx2, ascii_a, eightyseven, 0
+DECODE_HEX_FUNCTION decode_hex_lower_avx2, ascii_a, eightyseven, 0
+
+
+decode_hex256_batch_avx2:
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Clear the validity bitmap; the loop only sets bits
+;;;
+;;; r8 address of the input
+;;; r9 address of the validity bitmap
+
+  mov r8, rdi
+  mov r9, rcx
+  lea rcx, [rsi + 7]
+  shr rcx, 3
+  mov rdi, r9
+  xor eax, eax
+  rep stosb
+  mov rdi, r8
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode two keys per iteration. The keys use disjoint registers (ymm0-ymm5
+;;; and ymm6-ymm11), so the out of order core overlaps their latency.
+;;;
+;;; r10 index of the current key
+;;; r11 number of keys decoded in pairs
+;;; eax, r8d validity of the first and second key of the pair
+
+  DECODE_HEX_NB_CONSTANTS
+  xor r10, r10
+  mov r11, rsi
+  and r11, -2
+
+.pair_loop:
+  cmp r10, r11
+  jae .last_key
+  DECODE_HEX_BLOCK_NB rdi, rdx, ymm0, ymm1, ymm2, ymm3, ymm4, ymm5
+  DECODE_HEX_BLOCK_NB rdi+64, rdx+32, ymm6, ymm7, ymm8, ymm9, ymm10, ymm11
+  xor eax, eax
+  xor r8d, r8d
+  vptest ymm4, ymm4
+  setz al
+  vptest ymm10, ymm10
+  setz r8b
+  lea eax, [rax + 2*r8]
+  mov ecx, r10d                 ; r10 is even, so both bits land in the same byte
+  and ecx, 7
+  shl eax, cl
+  mov rcx, r10
+  shr rcx, 3
+  or [r9 + rcx], al
+  add rdi, 128
+  add rdx, 64
+  add r10, 2
+  jmp .pair_loop
+
+.last_key:
+  cmp r10, rsi
+  jae .done
+  DECODE_HEX_BLOCK_NB rdi, rdx, ymm0, ymm1, ymm2, ymm3, ymm4, ymm5
+  xor eax, eax
+  vptest ymm4, ymm4
+  setz al
+  mov ecx, r10d
+  and ecx, 7
+  shl eax, cl
+  mov rcx, r10
+  shr rcx, 3
+  or [r9 + rcx], al
+
+.done:
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Lenient decode. Each 16 chars are compared against the separators, and
+;;; the digits are left packed into a staging buffer on the stack with two
+;;; vpshufb of 8 chars, each shuffle looked up in the left pack table by its
+;;; 8 bits of the mask. Once the buffer has 64 digits, DECODE_HEX_BLOCK
+;;; decodes them straight to the output.
+;;;
+;;; [rsp] staging buffer, 64 digits and the up to 15 after them
+;;; r9 position in the input of the next 16 chars
+;;; r10 chars consumed: just after the last digit of the last block
+;;; r11 digits in the staging buffer
+;;; r8 the left pack table
+;;; r13 start of the output
+;;; r14 the address to store the chars consumed
+;;; rcx the output left
+;;; ebx the chars of the 16 to keep, one bit each
+;;; xmm6, xmm7, xmm15 all bytes ' ', ':' and '-'
+
+decode_hex_lenient_avx2:
+  push rbx
+  push r12
+  push r13
+  push r14
+  push rbp
+  mov rbp, rsp
+  sub rsp, 128
+  and rsp, -32
+
+  DECODE_HEX_CONSTANTS ascii_A, fiftyfive
+  vpbroadcastb xmm6, [ascii_space]
+  vpbroadcastb xmm7, [ascii_colon]
+  vpbroadcastb xmm15, [ascii_dash]
+
+  mov r13, rdx
+  mov r14, r8
+  mov r8, r9
+  xor r9, r9
+  xor r10, r10
+  xor r11, r11
+
+.lenient_loop:
+  mov r12d, 0xffff
+  lea rax, [r9 + 16]
+  cmp rax, rsi
+  jbe .lenient_chars
+
+  ;; Fewer than 16 chars are left. Load the last 16 of the input instead, and
+  ;; drop the ones already seen from the mask.
+  cmp r9, rsi
+  jae .lenient_done
+  cmp rsi, 16
+  jb .lenient_done
+  sub rax, rsi
+  mov r9, rsi
+  sub r9, 16
+  xchg rcx, rax                 ; the output left is in rcx
+  shl r12d, cl
+  xchg rcx, rax
+  and r12d, 0xffff
+
+.lenient_chars:
+  vmovdqu xmm0, [rdi + r9]
+  vpcmpeqb xmm1, xmm0, xmm6
+  vpcmpeqb xmm2, xmm0, xmm7
+  vpor xmm1, xmm1, xmm2
+  vpcmpeqb xmm2, xmm0, xmm15
+  vpor xmm1, xmm1, xmm2
+  vpmovmskb ebx, xmm1
+  xor ebx, 0xffff
+  and ebx, r12d
+
+  ;; left pack each half, the high half with its indices moved up by 8
+  movzx eax, bl
+  mov r12d, ebx
+  shr r12d, 8
+  vmovq xmm1, [r8 + 8*rax]
+  vmovq xmm2, [r8 + 8*r12]
+  vpaddb xmm2, xmm2, [eights]
+  vpunpcklqdq xmm1, xmm1, xmm2
+  vpshufb xmm1, xmm0, xmm1
+  popcnt eax, eax
+  popcnt r12d, r12d
+  vmovq [rsp + r11], xmm1
+  add r11, rax
+  vpsrldq xmm1, xmm1, 8
+  vmovq [rsp + r11], xmm1
+  add r11, r12
+  add r9, 16
+  cmp r11, 64
+  jb .lenient_loop
+
+  cmp rcx, 32
+  jb .lenient_done
+  DECODE_HEX_BLOCK rsp, rdx, .lenient_done, 1
+  add rdx, 32
+  sub rcx, 32
+
+  ;; The block ends at digit eax of these 16 chars, counting from 1: the
+  ;; digits kept, less the ones left over. Clear the lowest bit of the mask
+  ;; eax - 1 times, and the lowest bit left is that digit.
+  popcnt eax, ebx
+  sub r11, 64
+  sub eax, r11d
+.nth_digit:
+  dec eax
+  jz .found_digit
+  lea r12d, [rbx - 1]
+  and ebx, r12d
+  jmp .nth_digit
+.found_digit:
+  bsf ebx, ebx
+  lea r10, [r9 + rbx - 15]
+
+  ;; the digits left over go to the front of the staging buffer
+  vmovdqu xmm0, [rsp + 64]
+  vmovdqu [rsp], xmm0
+  jmp .lenient_loop
+
+.lenient_done:
+  mov [r14], r10
+  mov rax, rdx
+  sub rax, r13
+  mov rsp, rbp
+  pop rbp
+  pop r14
+  pop r13
+  pop r12
+  pop rbx
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Fixed width decoders. 20 bytes is less than a block, so the second half
+;;; of the block is loaded from digit 8 on, and bytes 4-15 are decoded twice.
+;;; 33 bytes is a block and another one byte later. The bytes decoded twice
+;;; get the same values, so rewriting them is harmless.
+
+decode_hex160_avx2:
+  DECODE_HEX_CONSTANTS ascii_A, fiftyfive
+  vmovdqu ymm0, [rdi]
+  vmovdqu ymm1, [rdi+8]
+  DECODE_HEX_DIGITS .bad_hex_char, 1
+  vmovdqu [rsi], xmm0
+  vextracti128 [rsi+4], ymm0, 1
+  mov eax, 1
+  vzeroupper
+  ret
+
+.bad_hex_char:
+  xor eax, eax
+  vzeroupper
+  ret
+
+decode_hex264_avx2:
+  DECODE_HEX_CONSTANTS ascii_A, fiftyfive
+  DECODE_HEX_BLOCK rdi, rsi, .bad_hex_char, 1
+  DECODE_HEX_BLOCK rdi+2, rsi+1, .bad_hex_char, 1
+  mov eax, 1
+  vzeroupper
+  ret
+
+.bad_hex_char:
+  xor eax, eax
+  vzeroupper
+  ret
+
+decode_hex512_avx2:
+  DECODE_HEX_CONSTANTS ascii_A, fiftyfive
+  DECODE_HEX_BLOCK rdi, rsi, .bad_hex_char, 1
+  DECODE_HEX_BLOCK rdi+64, rsi+32, .bad_hex_char, 1
+  mov eax, 1
+  vzeroupper
+  ret
+
+.bad_hex_char:
+  xor eax, eax
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
 section   .data align=32               ; align on 256 bit boundary for avx2 instructions
   ;; Shuffle pattern. N.B. Shuffles happen independently in the two 128 bit lanes
   ;; If bit seven is set (0x80), then a zero is written to the result byte
 shuffle: db 1,3,5,7,9,11,13,15,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,  0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,1,3,5,7,9,11,13,15
+  ;; Shuffle pattern that packs the odd bytes into the low qword of both lanes
+shuffle_packed: db 1,3,5,7,9,11,13,15,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,  1,3,5,7,9,11,13,15,0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80
+lowercase_bits: times 32 db 0x20
+highnibbles: times 32 db 0xf0
+ascii_0: db '0'
 ascii_9: db '9'
 ascii_A: db 'A'
-;; mask used to clear bit six
-upcase_mask: db ~0x20
+ascii_a: db 'a'
+;; bit cleared to upcase a letter
+lowercase_bit: db 0x20
 fourtyeight: db 48
 fiftyfive: db 55
+eightyseven: db 87
 highnibble: db 0xf0
+eights: times 16 db 8
+ascii_space: db ' '
+ascii_colon: db ':'
+ascii_dash: db '-'
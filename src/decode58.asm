@@ -1,23 +1,94 @@
-;; extern int base58_8_coeff(unsigned char const* in, std::uint64_t* out, unsigned int const* alphabet);
+;; extern int base58_8_coeff_avx2(unsigned char const* in, std::uint64_t* out, unsigned char const* rows);
 
 ;; RDI is address of buf to decode (base58 rippled string). Must be 44 bytes.
 ;; RSI is the address of the output (must be 6 qwords)
-;; RDX is the address of the alphabet (must be 256 dwords, not bytes since vpgather can't handle bytes)
+;; RDX is the address of the digit rows of the alphabet (codec::base58::digit_rows, 80 bytes)
+;; Returns 1, or 0 if any char is not a base58 digit
+
+;; The chars are converted to values without a gather or a table of every
+;; char. Row h - 3 of the digit rows holds the values of the chars 0xh0 to
+;; 0xhf, so vpshufb looks up the low nibble of every char in each of the five
+;; rows, and the row that matches the high nibble is blended in. Chars in none
+;; of the rows keep the value 0xff.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Convert 32 chars to values through the digit rows
+;;;
+;;; %1 the chars, then their values (0xff for chars that are not digits)
+;;; %2, %3, %4, %5 scratch
+;;;
+;;; ymm8-ymm12: the digit rows for the high nibbles 3 to 7, in both lanes
+;;; ymm15: all bytes 0x0f
+
+%macro LOOKUP_32 5
+  vpsrlw %2, %1, 4
+  vpand %2, %2, ymm15           ; high nibbles
+  vpand %1, %1, ymm15           ; low nibbles
+  vpcmpeqd %5, %5, %5           ; chars in none of the rows are not digits
+  vpcmpeqb %3, %2, [high_nibbles]
+  vpshufb %4, ymm8, %1
+  vpblendvb %5, %5, %4, %3
+  vpcmpeqb %3, %2, [high_nibbles+32]
+  vpshufb %4, ymm9, %1
+  vpblendvb %5, %5, %4, %3
+  vpcmpeqb %3, %2, [high_nibbles+64]
+  vpshufb %4, ymm10, %1
+  vpblendvb %5, %5, %4, %3
+  vpcmpeqb %3, %2, [high_nibbles+96]
+  vpshufb %4, ymm11, %1
+  vpblendvb %5, %5, %4, %3
+  vpcmpeqb %3, %2, [high_nibbles+128]
+  vpshufb %4, ymm12, %1
+  vpblendvb %1, %5, %4, %3
+%endmacro
+
+default rel
 
 section   .text
 
-global base58_8_coeff
+global base58_8_coeff_avx2
+
+base58_8_coeff_avx2:
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Convert input to values through the digit rows
+;;;
+;;; ymm6: values of chars 28-43 in the low lane, and 12-27 in the high lane
+;;; ymm7: values of chars 0-15 in both lanes
+
+  vbroadcasti128 ymm8, [rdx]
+  vbroadcasti128 ymm9, [rdx+16]
+  vbroadcasti128 ymm10, [rdx+32]
+  vbroadcasti128 ymm11, [rdx+48]
+  vbroadcasti128 ymm12, [rdx+64]
+  vpbroadcastb ymm15, [low_nibble_mask]
+
+  ; input is big endian
+  vmovdqu xmm6, [rdi+28]
+  vinserti128 ymm6, ymm6, [rdi+12], 1
+  vbroadcasti128 ymm7, [rdi]
+  LOOKUP_32 ymm6, ymm0, ymm1, ymm2, ymm3
+  LOOKUP_32 ymm7, ymm0, ymm1, ymm2, ymm3
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Check that all the values are in range
+;;; ymm15: the values or'ed together. Digits are at most 57, so only the
+;;;        value of a bad char (0xff) sets the high bit of a byte.
+
+  vpor ymm15, ymm6, ymm7
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
-base58_8_coeff:
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;;; Initialize constants
 ;;;
 ;;; xmm12: all lanes 64-bit 58^4
 ;;; ymm13: all bits cleared
 ;;; ymm14: base58 powers from 0 to three in both lanes
-;;; ymm15: all bits set
 
-  vpcmpeqd ymm15, ymm15
   vmovdqa ymm14, [base58_powers_0_to_3]
   vpxor ymm13, ymm13, ymm13
   vpbroadcastq xmm12, [base58_powers_4]
@@ -25,49 +96,30 @@ base58_8_coeff:
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
-
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
-;;; Convert input to values through the LUT
-;;; ymm{0,1}: values for first 16 input digits
+;;; Zero extend the values to dwords, eight digits per register
+;;; ymm0: values of chars 36-43
+;;; ymm1: values of chars 28-35
+;;; ymm2: values of chars 20-27
+;;; ymm3: values of chars 12-19
+;;; ymm4: values of chars 4-11
+;;; ymm5: values of chars 0-3 in the high lane, low lane zero (to make computations regular)
+
+  vpsrldq xmm0, xmm6, 8
+  vpmovzxbd ymm0, xmm0
+  vpmovzxbd ymm1, xmm6
+  vextracti128 xmm8, ymm6, 1
+  vpsrldq xmm2, xmm8, 8
+  vpmovzxbd ymm2, xmm2
+  vpmovzxbd ymm3, xmm8
+  vpsrldq xmm4, xmm7, 4
+  vpmovzxbd ymm4, xmm4
+  vpmovzxbd xmm5, xmm7
+  vinserti128 ymm5, ymm13, xmm5, 1 ; Insert xmm5 into the high lane of ymm13 (zero) and store in ymm5
 
-  ; input is big endian
-  vmovdqu xmm6, [rdi+36]
-  vmovdqu xmm7, [rdi+28]
-  vmovdqu xmm8, [rdi+20]
-  vmovdqu xmm9, [rdi+12]
-  vmovdqu xmm10, [rdi+4]
-  vpmovzxbd ymm6, xmm6           ; zero extend 8 bytes in xmm0 to 8 double words in ymm0
-  vpmovzxbd ymm7, xmm7
-  vpmovzxbd ymm8, xmm8
-  vpmovzxbd ymm9, xmm9
-  vpmovzxbd ymm10, xmm10
-  ;; use a lut to convert the alpha-numeric chars to values
-  vpgatherdd ymm0, [rdx + ymm6 * 4], ymm15
-  vpcmpeqd ymm15, ymm15         ; the previous instruction clears ymm15
-  vpgatherdd ymm1, [rdx + ymm7 * 4], ymm15
-  vpcmpeqd ymm15, ymm15
-  vpgatherdd ymm2, [rdx + ymm8 * 4], ymm15
-  vpcmpeqd ymm15, ymm15
-  vpgatherdd ymm3, [rdx + ymm9 * 4], ymm15
-  vpcmpeqd ymm15, ymm15
-  vpgatherdd ymm4, [rdx + ymm10 * 4], ymm15
-  vpcmpeqd ymm15, ymm15
-
-  ;; Put the first four characters in the high lane of ymm5, low lane zero (to make computations regular)
-  vpxor xmm6, xmm6
-  movd xmm6, [rdi]
-  vpmovzxbd ymm6, xmm6           ; zero extend 8 bytes in xmm0 to 8 double words in ymm0 (high lane will be all zero)
-  vpgatherdd xmm5, [rdx + xmm6 * 4], xmm15
-  ; put low lane in high lane, clear low lane
-  vpxor ymm6, ymm6
-  vinserti128 ymm5, ymm6, xmm5, 1 ; Insert from the low lane of xmm5 into the high lane of ymm6 and store in ymm5
-  vpcmpeqd ymm15, ymm15
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
-
-;; TBD: Error check that all the values are in range
-
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;;; Multiply each set of 4 values by 58^0, 58^1, 58^2, 58^3
 
@@ -124,10 +176,22 @@ base58_8_coeff:
   vmovdqu [rsi], xmm0
   vmovdqu [rsi+16], xmm2
   vmovdqu [rsi+32], xmm4
-  mov eax, 1
+  vpmovmskb ecx, ymm15
+  xor eax, eax
+  test ecx, ecx                 ; ZF is set if no value is bad
+  setz al
   vzeroupper
   ret
 
 section   .data align=32               ; align on 256 bit boundary for avx2 instructions
 base58_powers_0_to_3: dd 0x2FA28, 0xD24, 0x3A, 0x1, 0x2FA28, 0xD24, 0x3A, 0x1 
 base58_powers_4: dq 0xACAD10    ; 58^4
+low_nibble_mask: db 0x0f
+align 32
+  ;; the high nibble of each digit row, in every byte
+high_nibbles:
+  times 32 db 3
+  times 32 db 4
+  times 32 db 5
+  times 32 db 6
+  times 32 db 7
@@ -0,0 +1,162 @@
+;; extern int base58_8_coeff_avx512(unsigned char const* in, std::uint64_t* out, unsigned char const* rows);
+
+;; RDI is address of buf to decode (base58 rippled string). Must be 44 bytes.
+;; RSI is the address of the output (must be 6 qwords)
+;; RDX is the address of the digit rows of the alphabet (codec::base58::digit_rows, 80 bytes)
+;; Returns 1, or 0 if any char is not a base58 digit
+
+;; This is the avx512 version of base58_8_coeff_avx2. All 44 chars are looked
+;; up in one zmm register, and the row that matches the high nibble of each
+;; char is merged in with a masked vpshufb instead of a blend. The 44 values,
+;; with four zero values in front to make the computation regular, fit in
+;; three zmm registers. Each 128-bit lane holds four values, and each pair of
+;; lanes one coefficient.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Compute two base 58^8 coefficients from 16 values
+;;;
+;;; %1 the values, then the coefficients: the more significant coefficient is
+;;;    in qword 0 and the less significant one in qword 4
+;;; %2 scratch
+;;;
+;;; zmm14: 58^0, 58^1, 58^2, 58^3 (big endian) in every lane
+;;; zmm15: all qwords 58^4
+
+%macro COEFF_2 2
+  ;; Multiply each set of 4 values by 58^0, 58^1, 58^2, 58^3
+  vpmulld %1, %1, zmm14
+
+  ;; Horizonal add within each lane; after this every dword of a lane holds
+  ;; the sum of the lane
+  vpshufd %2, %1, 0xb1          ; swap adjacent dwords
+  vpaddd %1, %1, %2
+  vpshufd %2, %1, 0x4e          ; swap adjacent qwords
+  vpaddd %1, %1, %2
+
+  ;; Multiply the sums of the high lanes (0 and 2) by 58^4 and add the sums of
+  ;; the low lanes (1 and 3)
+  vpsrlq %2, %1, 32
+  vshufi64x2 %2, %2, %2, 0x31   ; move lanes 1 and 3 to lanes 0 and 2
+  vpmuludq %1, %1, zmm15
+  vpaddq %1, %1, %2
+%endmacro
+
+default rel
+
+section   .text
+
+global base58_8_coeff_avx512
+
+base58_8_coeff_avx512:
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Initialize constants
+;;;
+;;; zmm16-zmm20: the digit rows for the high nibbles 3 to 7, in every lane
+;;; zmm21-zmm25: all bytes 3, 4, 5, 6 and 7
+;;; zmm26: all bytes 0x0f
+
+  vbroadcasti32x4 zmm14, [base58_powers_0_to_3]
+  vpbroadcastq zmm15, [base58_powers_4]
+  vbroadcasti32x4 zmm16, [rdx]
+  vbroadcasti32x4 zmm17, [rdx+16]
+  vbroadcasti32x4 zmm18, [rdx+32]
+  vbroadcasti32x4 zmm19, [rdx+48]
+  vbroadcasti32x4 zmm20, [rdx+64]
+  vpbroadcastb zmm21, [high_nibbles]
+  vpbroadcastb zmm22, [high_nibbles+1]
+  vpbroadcastb zmm23, [high_nibbles+2]
+  vpbroadcastb zmm24, [high_nibbles+3]
+  vpbroadcastb zmm25, [high_nibbles+4]
+  vpbroadcastb zmm26, [low_nibble_mask]
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Convert input to values through the digit rows
+;;; zmm3: chars 0-15, 12-27, 28-43 and 28-43 again, one set per lane, then
+;;;       their values (0xff for chars that are not digits)
+;;; zmm4: high nibbles
+;;; zmm5: the values of each row in turn
+
+  ; input is big endian
+  vmovdqu xmm3, [rdi]
+  vinserti32x4 zmm3, zmm3, [rdi+12], 1
+  vinserti32x4 zmm3, zmm3, [rdi+28], 2
+  vinserti32x4 zmm3, zmm3, [rdi+28], 3
+
+  vpsrlw zmm4, zmm3, 4
+  vpandd zmm4, zmm4, zmm26
+  vpandd zmm3, zmm3, zmm26
+  vpternlogd zmm5, zmm5, zmm5, 0xff   ; chars in none of the rows are not digits
+  vpcmpeqb k1, zmm4, zmm21
+  vpshufb zmm5{k1}, zmm16, zmm3
+  vpcmpeqb k1, zmm4, zmm22
+  vpshufb zmm5{k1}, zmm17, zmm3
+  vpcmpeqb k1, zmm4, zmm23
+  vpshufb zmm5{k1}, zmm18, zmm3
+  vpcmpeqb k1, zmm4, zmm24
+  vpshufb zmm5{k1}, zmm19, zmm3
+  vpcmpeqb k1, zmm4, zmm25
+  vpshufb zmm5{k1}, zmm20, zmm3
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Check that all the values are in range. Digits are at most 57, so only
+;;; the value of a bad char (0xff) sets the high bit of a byte.
+;;; k2: the bytes with a bad value
+
+  vpmovb2m k2, zmm5
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Zero extend the values to dwords
+;;; zmm0: four zero values, then the values of chars 0-11
+;;; zmm1: values of chars 12-27
+;;; zmm2: values of chars 28-43
+
+  vpslldq xmm0, xmm5, 4          ; make room for the four zero digits
+  vpmovzxbd zmm0, xmm0
+  vextracti32x4 xmm1, zmm5, 1
+  vpmovzxbd zmm1, xmm1
+  vextracti32x4 xmm2, zmm5, 2
+  vpmovzxbd zmm2, xmm2
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  COEFF_2 zmm0, zmm3              ; coefficients 5 and 4
+  COEFF_2 zmm1, zmm3              ; coefficients 3 and 2
+  COEFF_2 zmm2, zmm3              ; coefficients 1 and 0
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Put the coefficients in order, least significant first
+
+  vextracti64x4 ymm3, zmm2, 1
+  vpunpcklqdq xmm2, xmm3, xmm2    ; xmm2 contains the coefficients 0 and 1
+  vextracti64x4 ymm3, zmm1, 1
+  vpunpcklqdq xmm1, xmm3, xmm1    ; xmm1 contains the coefficients 2 and 3
+  vextracti64x4 ymm3, zmm0, 1
+  vpunpcklqdq xmm0, xmm3, xmm0    ; xmm0 contains the coefficients 4 and 5
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  vmovdqu [rsi], xmm2
+  vmovdqu [rsi+16], xmm1
+  vmovdqu [rsi+32], xmm0
+  xor eax, eax
+  kortestq k2, k2               ; ZF is set if no value is bad
+  setz al
+  vzeroupper
+  ret
+
+section   .data align=64               ; align on 512 bit boundary for avx512 instructions
+base58_powers_0_to_3: dd 0x2FA28, 0xD24, 0x3A, 0x1
+base58_powers_4: dq 0xACAD10    ; 58^4
+high_nibbles: db 3, 4, 5, 6, 7   ; the high nibble of each digit row
+low_nibble_mask: db 0x0f
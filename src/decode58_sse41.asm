@@ -0,0 +1,175 @@
+;; extern int base58_8_coeff_sse41(unsigned char const* in, std::uint64_t* out, unsigned char const* rows);
+
+;; RDI is address of buf to decode (base58 rippled string). Must be 44 bytes.
+;; RSI is the address of the output (must be 6 qwords)
+;; RDX is the address of the digit rows of the alphabet (codec::base58::digit_rows, 80 bytes)
+;; Returns 1, or 0 if any char is not a base58 digit
+
+;; This is the 128-bit version of base58_8_coeff_avx2 for cpus without avx2.
+;; The chars are looked up 16 at a time in the digit rows with pshufb, the
+;; same way as the avx2 version, and zero extended to dwords with pmovzxbd.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Convert 16 chars to values through the digit rows
+;;;
+;;; %1 the chars, then their values (0xff for chars that are not digits)
+;;; %2, %3, %4 scratch
+;;;
+;;; xmm0 is also scratch: it is the implicit mask of pblendvb
+;;; xmm7: all bytes 0x0f
+;;; xmm8-xmm12: the digit rows for the high nibbles 3 to 7
+
+%macro LOOKUP_16 4
+  movdqa %2, %1
+  psrlw %2, 4
+  pand %2, xmm7                 ; high nibbles
+  pand %1, xmm7                 ; low nibbles
+  pcmpeqd %4, %4                ; chars in none of the rows are not digits
+  LOOKUP_ROW %1, %2, %3, %4, xmm8, 0
+  LOOKUP_ROW %1, %2, %3, %4, xmm9, 16
+  LOOKUP_ROW %1, %2, %3, %4, xmm10, 32
+  LOOKUP_ROW %1, %2, %3, %4, xmm11, 48
+  LOOKUP_ROW %1, %2, %3, %4, xmm12, 64
+  movdqa %1, %4
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Blend the values of one digit row into the chars with its high nibble
+;;;
+;;; %1 low nibbles
+;;; %2 high nibbles
+;;; %3 scratch
+;;; %4 the values
+;;; %5 the digit row
+;;; %6 offset of the row's high nibble in high_nibbles
+
+%macro LOOKUP_ROW 6
+  movdqa xmm0, %2
+  pcmpeqb xmm0, [high_nibbles+%6]
+  movdqa %3, %5
+  pshufb %3, %1
+  pblendvb %4, %3
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Zero extend 16 values to dwords
+;;;
+;;; %1 the values, destroyed
+;;;
+;;; On exit xmm0-xmm3 hold the values, four in each.
+
+%macro EXPAND_16 1
+  pmovzxbd xmm0, %1
+  psrldq %1, 4
+  pmovzxbd xmm1, %1
+  psrldq %1, 4
+  pmovzxbd xmm2, %1
+  psrldq %1, 4
+  pmovzxbd xmm3, %1
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Compute two base 58^8 coefficients from four sets of four values
+;;;
+;;; %1 the high four values of the more significant coefficient, then the coefficients
+;;; %2 the low four values of the more significant coefficient
+;;; %3 the high four values of the less significant coefficient
+;;; %4 the low four values of the less significant coefficient
+;;;
+;;; On exit %1 has the less significant coefficient in the low qword and the
+;;; more significant coefficient in the high qword.
+;;;
+;;; xmm14: 58^0, 58^1, 58^2, 58^3 (big endian)
+;;; xmm15: both qwords 58^4
+
+%macro COEFF_2 4
+  ;; Multiply each set of 4 values by 58^0, 58^1, 58^2, 58^3
+  pmulld %1, xmm14
+  pmulld %2, xmm14
+  pmulld %3, xmm14
+  pmulld %4, xmm14
+
+  ;; Horizonal add. After this the dwords are the sums of the high and low
+  ;; values of the less significant coefficient, followed by the sums of the
+  ;; high and low values of the more significant coefficient
+  phaddd %3, %4
+  phaddd %1, %2
+  phaddd %3, %1
+  movdqa %1, %3
+
+  ;; Multiply the high sums by 58^4 and add the low sums
+  pmuludq %1, xmm15
+  psrlq %3, 32
+  paddq %1, %3
+%endmacro
+
+default rel
+
+section   .text
+
+global base58_8_coeff_sse41
+
+base58_8_coeff_sse41:
+  movdqu xmm8, [rdx]
+  movdqu xmm9, [rdx+16]
+  movdqu xmm10, [rdx+32]
+  movdqu xmm11, [rdx+48]
+  movdqu xmm12, [rdx+64]
+  movdqa xmm7, [low_nibble_mask]
+
+  ;; xmm4: values of chars 28-43
+  ;; xmm5: values of chars 12-27
+  ;; xmm6: values of chars 0-15
+  ;; input is big endian
+  movdqu xmm4, [rdi+28]
+  LOOKUP_16 xmm4, xmm1, xmm2, xmm3
+  movdqu xmm5, [rdi+12]
+  LOOKUP_16 xmm5, xmm1, xmm2, xmm3
+  movdqu xmm6, [rdi]
+  LOOKUP_16 xmm6, xmm1, xmm2, xmm3
+
+  ;; Digits are at most 57, so only the value of a bad char (0xff) sets the
+  ;; high bit of a byte
+  movdqa xmm13, xmm4
+  por xmm13, xmm5
+  por xmm13, xmm6
+
+  movdqa xmm14, [base58_powers_0_to_3]
+  movdqa xmm15, [base58_powers_4]
+
+  EXPAND_16 xmm4
+  COEFF_2 xmm0, xmm1, xmm2, xmm3  ; xmm0 contains the coefficients 0 and 1
+  movdqu [rsi], xmm0
+
+  EXPAND_16 xmm5
+  COEFF_2 xmm0, xmm1, xmm2, xmm3  ; xmm0 contains the coefficients 2 and 3
+  movdqu [rsi+16], xmm0
+
+  ;; The first four characters are the low values of coefficient 5. Its high
+  ;; values are zero to make the computation regular.
+  pmovzxbd xmm1, xmm6
+  psrldq xmm6, 4
+  pmovzxbd xmm2, xmm6
+  psrldq xmm6, 4
+  pmovzxbd xmm3, xmm6
+  pxor xmm0, xmm0
+  COEFF_2 xmm0, xmm1, xmm2, xmm3  ; xmm0 contains the coefficients 4 and 5
+  movdqu [rsi+32], xmm0
+
+  pmovmskb ecx, xmm13
+  xor eax, eax
+  test ecx, ecx                 ; ZF is set if no value is bad
+  setz al
+  ret
+
+section   .data align=16               ; align on 128 bit boundary for sse instructions
+base58_powers_0_to_3: dd 0x2FA28, 0xD24, 0x3A, 0x1
+base58_powers_4: dq 0xACAD10, 0xACAD10    ; 58^4
+low_nibble_mask: times 16 db 0x0f
+  ;; the high nibble of each digit row, in every byte
+high_nibbles:
+  times 16 db 3
+  times 16 db 4
+  times 16 db 5
+  times 16 db 6
+  times 16 db 7
@@ -0,0 +1,319 @@
+;; extern int base58_10_coeff_x8_avx2(unsigned char const* const* in, std::uint64_t* out, unsigned char const* rows);
+
+;; RDI is the address of 8 pointers to the bufs to decode (base58 strings). Each must be 44 bytes.
+;; RSI is the address of the output (must be 40 qwords). Coefficient k of string a is qword 8*k + a.
+;; RDX is the address of the digit rows of the alphabet (codec::base58::digit_rows, 80 bytes)
+;; Returns a mask with bit a set if string a has a char that is not a base58 digit
+
+;; This is a multi-buffer version of base58_8_coeff_avx2. Instead of spreading
+;; one string over the lanes and adding the lanes up, every dword lane holds a
+;; different string, so the coefficients are accumulated with vertical
+;; multiplies and adds only. The coefficients are base 58^10, least
+;; significant first, like the ones decode_base58_ref computes.
+;;
+;; The chars are transposed first. The 8 strings are loaded as rows, and three
+;; rounds of unpacks turn them into columns of 8 bytes, one for each char
+;; position, which are stored on the stack. The columns are converted to
+;; values in place, 32 bytes at a time, and vpmovzxbd loads each column back
+;; as 8 dwords.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Transpose 8 rows of 32 bytes
+;;;
+;;; ymm0-ymm7: the rows
+;;;
+;;; On exit ymm8-ymm15 hold the columns, 8 bytes each: ymm(8+r) holds the
+;;; columns 2r and 2r+1 in the low lane, and 16+2r and 17+2r in the high lane.
+;;; The rows are destroyed.
+
+%macro TRANSPOSE_8x32 0
+  ;; pairs of rows
+  vpunpcklbw ymm8, ymm0, ymm1
+  vpunpckhbw ymm9, ymm0, ymm1
+  vpunpcklbw ymm10, ymm2, ymm3
+  vpunpckhbw ymm11, ymm2, ymm3
+  vpunpcklbw ymm12, ymm4, ymm5
+  vpunpckhbw ymm13, ymm4, ymm5
+  vpunpcklbw ymm14, ymm6, ymm7
+  vpunpckhbw ymm15, ymm6, ymm7
+
+  ;; sets of four rows
+  vpunpcklwd ymm0, ymm8, ymm10
+  vpunpckhwd ymm1, ymm8, ymm10
+  vpunpcklwd ymm2, ymm9, ymm11
+  vpunpckhwd ymm3, ymm9, ymm11
+  vpunpcklwd ymm4, ymm12, ymm14
+  vpunpckhwd ymm5, ymm12, ymm14
+  vpunpcklwd ymm6, ymm13, ymm15
+  vpunpckhwd ymm7, ymm13, ymm15
+
+  ;; all eight rows
+  vpunpckldq ymm8, ymm0, ymm4
+  vpunpckhdq ymm9, ymm0, ymm4
+  vpunpckldq ymm10, ymm1, ymm5
+  vpunpckhdq ymm11, ymm1, ymm5
+  vpunpckldq ymm12, ymm2, ymm6
+  vpunpckhdq ymm13, ymm2, ymm6
+  vpunpckldq ymm14, ymm3, ymm7
+  vpunpckhdq ymm15, ymm3, ymm7
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Load the same 32 bytes of each string into ymm0-ymm7
+;;;
+;;; %1 the instruction: vmovdqu for 32 chars, vbroadcasti128 for 16
+;;; %2 offset of the first char
+
+%macro LOAD_ROWS 2
+  mov rax, [rdi]
+  %1 ymm0, [rax+%2]
+  mov rax, [rdi+8]
+  %1 ymm1, [rax+%2]
+  mov rax, [rdi+16]
+  %1 ymm2, [rax+%2]
+  mov rax, [rdi+24]
+  %1 ymm3, [rax+%2]
+  mov rax, [rdi+32]
+  %1 ymm4, [rax+%2]
+  mov rax, [rdi+40]
+  %1 ymm5, [rax+%2]
+  mov rax, [rdi+48]
+  %1 ymm6, [rax+%2]
+  mov rax, [rdi+56]
+  %1 ymm7, [rax+%2]
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Convert 32 chars to values through the digit rows. This is the same as
+;;; LOOKUP_32 in decode58.asm.
+;;;
+;;; %1 the chars, then their values (0xff for chars that are not digits)
+;;; %2, %3, %4, %5 scratch
+;;;
+;;; ymm8-ymm12: the digit rows for the high nibbles 3 to 7, in both lanes
+;;; ymm15: all bytes 0x0f
+
+%macro LOOKUP_32 5
+  vpsrlw %2, %1, 4
+  vpand %2, %2, ymm15           ; high nibbles
+  vpand %1, %1, ymm15           ; low nibbles
+  vpcmpeqd %5, %5, %5           ; chars in none of the rows are not digits
+  vpcmpeqb %3, %2, [high_nibbles]
+  vpshufb %4, ymm8, %1
+  vpblendvb %5, %5, %4, %3
+  vpcmpeqb %3, %2, [high_nibbles+32]
+  vpshufb %4, ymm9, %1
+  vpblendvb %5, %5, %4, %3
+  vpcmpeqb %3, %2, [high_nibbles+64]
+  vpshufb %4, ymm10, %1
+  vpblendvb %5, %5, %4, %3
+  vpcmpeqb %3, %2, [high_nibbles+96]
+  vpshufb %4, ymm11, %1
+  vpblendvb %5, %5, %4, %3
+  vpcmpeqb %3, %2, [high_nibbles+128]
+  vpshufb %4, ymm12, %1
+  vpblendvb %1, %5, %4, %3
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Accumulate five columns of values into base 58^5 coefficients, most
+;;; significant digit first. They are less than 2^30, so they fit in dwords.
+;;;
+;;; %1 the coefficients, one string per dword
+;;; %2 scratch
+;;; %3 the char position of the first digit
+;;;
+;;; ymm14: all dwords 58
+
+%macro GROUP_5 3
+  vpmovzxbd %1, [COLUMN(%3)]
+  vpmulld %1, %1, ymm14
+  vpmovzxbd %2, [COLUMN(%3+1)]
+  vpaddd %1, %1, %2
+  vpmulld %1, %1, ymm14
+  vpmovzxbd %2, [COLUMN(%3+2)]
+  vpaddd %1, %1, %2
+  vpmulld %1, %1, ymm14
+  vpmovzxbd %2, [COLUMN(%3+3)]
+  vpaddd %1, %1, %2
+  vpmulld %1, %1, ymm14
+  vpmovzxbd %2, [COLUMN(%3+4)]
+  vpaddd %1, %1, %2
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Combine two base 58^5 coefficients into a base 58^10 one, and store it
+;;; for all 8 strings
+;;;
+;;; %1 the more significant base 58^5 coefficients (dwords)
+;;; %2 the less significant base 58^5 coefficients (dwords)
+;;; %3 offset of the output
+;;; %4, %5 scratch
+;;;
+;;; ymm13: all qwords 58^5
+
+%macro COEFF_10 5
+  vpmovzxdq %4, xmm%1
+  vpmovzxdq %5, xmm%2
+  vpmuludq %4, %4, ymm13
+  vpaddq %4, %4, %5
+  vmovdqu [rsi+%3], %4          ; strings 0-3
+  vextracti128 xmm%1, ymm%1, 1
+  vextracti128 xmm%2, ymm%2, 1
+  vpmovzxdq %4, xmm%1
+  vpmovzxdq %5, xmm%2
+  vpmuludq %4, %4, ymm13
+  vpaddq %4, %4, %5
+  vmovdqu [rsi+%3+32], %4       ; strings 4-7
+%endmacro
+
+;; The column of char position j is at [rsp+8*j+8]. The column at [rsp] is
+;; all zero values, the digit in front of the first 4 digits that makes
+;; the coefficients regular.
+%define COLUMN(j) rsp+8*(j)+8
+
+default rel
+
+section   .text
+
+global base58_10_coeff_x8_avx2
+
+base58_10_coeff_x8_avx2:
+  push rbp
+  mov rbp, rsp
+  sub rsp, 384
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Transpose the chars into columns on the stack
+;;;
+;;; Chars 0-31 are transposed from full rows. Chars 28-43 are transposed from
+;;; rows that hold them in both lanes, and only the low lane is stored; chars
+;;; 28-31 are stored twice with the same values.
+
+  LOAD_ROWS vmovdqu, 0
+  TRANSPOSE_8x32
+  vmovdqu [COLUMN(0)], xmm8
+  vmovdqu [COLUMN(2)], xmm9
+  vmovdqu [COLUMN(4)], xmm10
+  vmovdqu [COLUMN(6)], xmm11
+  vmovdqu [COLUMN(8)], xmm12
+  vmovdqu [COLUMN(10)], xmm13
+  vmovdqu [COLUMN(12)], xmm14
+  vmovdqu [COLUMN(14)], xmm15
+  vextracti128 [COLUMN(16)], ymm8, 1
+  vextracti128 [COLUMN(18)], ymm9, 1
+  vextracti128 [COLUMN(20)], ymm10, 1
+  vextracti128 [COLUMN(22)], ymm11, 1
+  vextracti128 [COLUMN(24)], ymm12, 1
+  vextracti128 [COLUMN(26)], ymm13, 1
+  vextracti128 [COLUMN(28)], ymm14, 1
+  vextracti128 [COLUMN(30)], ymm15, 1
+
+  LOAD_ROWS vbroadcasti128, 28
+  TRANSPOSE_8x32
+  vmovdqu [COLUMN(28)], xmm8
+  vmovdqu [COLUMN(30)], xmm9
+  vmovdqu [COLUMN(32)], xmm10
+  vmovdqu [COLUMN(34)], xmm11
+  vmovdqu [COLUMN(36)], xmm12
+  vmovdqu [COLUMN(38)], xmm13
+  vmovdqu [COLUMN(40)], xmm14
+  vmovdqu [COLUMN(42)], xmm15
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Convert the columns to values, 32 bytes (four columns) at a time
+;;;
+;;; ymm7: the values or'ed together. Digits are at most 57, so only the value
+;;;       of a bad char (0xff) sets the high bit of a byte. Byte i of every
+;;;       column is string i.
+
+  vbroadcasti128 ymm8, [rdx]
+  vbroadcasti128 ymm9, [rdx+16]
+  vbroadcasti128 ymm10, [rdx+32]
+  vbroadcasti128 ymm11, [rdx+48]
+  vbroadcasti128 ymm12, [rdx+64]
+  vpbroadcastb ymm15, [low_nibble_mask]
+  vpxor ymm7, ymm7, ymm7
+
+  xor ecx, ecx
+.lookup:
+  vmovdqu ymm0, [COLUMN(0)+rcx]
+  LOOKUP_32 ymm0, ymm1, ymm2, ymm3, ymm4
+  vpor ymm7, ymm7, ymm0
+  vmovdqu [COLUMN(0)+rcx], ymm0
+  add ecx, 32
+  cmp ecx, 8*44
+  jb .lookup
+
+  xor eax, eax
+  mov [rsp], rax                ; the zero column
+
+  ;; fold the high bits of the four columns into one bit per string
+  vpmovmskb eax, ymm7
+  mov ecx, eax
+  shr ecx, 16
+  or eax, ecx
+  mov ecx, eax
+  shr ecx, 8
+  or eax, ecx
+  and eax, 0xff
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Accumulate the base 58^5 coefficients, most significant first
+;;; ymm0: the zero digit and chars 0-3
+;;; ymm1-ymm8: chars 4-8, 9-13, ..., 39-43
+
+  vpbroadcastd ymm14, [fiftyeight]
+  GROUP_5 ymm0, ymm9, -1
+  GROUP_5 ymm1, ymm9, 4
+  GROUP_5 ymm2, ymm9, 9
+  GROUP_5 ymm3, ymm9, 14
+  GROUP_5 ymm4, ymm9, 19
+  GROUP_5 ymm5, ymm9, 24
+  GROUP_5 ymm6, ymm9, 29
+  GROUP_5 ymm7, ymm9, 34
+  GROUP_5 ymm8, ymm9, 39
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Combine pairs into base 58^10 coefficients, least significant first. The
+;;; most significant one is the first four chars.
+
+  vpbroadcastq ymm13, [base58_powers_5]
+  COEFF_10 7, 8, 0, ymm10, ymm11
+  COEFF_10 5, 6, 64, ymm10, ymm11
+  COEFF_10 3, 4, 128, ymm10, ymm11
+  COEFF_10 1, 2, 192, ymm10, ymm11
+  vpmovzxdq ymm10, xmm0
+  vmovdqu [rsi+256], ymm10
+  vextracti128 xmm0, ymm0, 1
+  vpmovzxdq ymm10, xmm0
+  vmovdqu [rsi+288], ymm10
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  mov rsp, rbp
+  pop rbp
+  vzeroupper
+  ret
+
+section   .data align=32               ; align on 256 bit boundary for avx2 instructions
+  ;; the high nibble of each digit row, in every byte
+high_nibbles:
+  times 32 db 3
+  times 32 db 4
+  times 32 db 5
+  times 32 db 6
+  times 32 db 7
+base58_powers_5: dq 0x271F35A0  ; 58^5
+fiftyeight: dd 58
+low_nibble_mask: db 0x0f
@@ -0,0 +1,120 @@
+;; extern int decode_hex256_avx512(char const* in, char* out);
+;; extern int decode_hex256_upper_avx512(char const* in, char* out);
+;; extern int decode_hex256_lower_avx512(char const* in, char* out);
+
+;; RDI is address of buf to decode (hex string). Must be 64 bytes.
+;; RSI is the address of the output (must be 32 bytes)
+;; If this is ported to windows, the calling convention is RCX, RDX for the first two params
+
+;; This is the avx512bw version of decode_hex256_avx2. All 64 hex digits fit
+;; in one zmm register. The digit and letter ranges are found with unsigned
+;; compares into mask registers, so there is no upcase and error mask dance,
+;; and the nibbles are combined with vpmaddubsw and packed with vpmovwb, which
+;; crosses the lanes without any shuffles.
+;;
+;; The _upper and _lower variants skip the downcase, and compare the letters
+;; against 'A' or 'a', so they only accept the letters of one case.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a 64 digit decoder
+;;;
+;;; %1 name of the function
+;;; %2 the first letter: ascii_a, or ascii_A for the uppercase only variant
+;;; %3 1 to downcase the letters first, so both cases are accepted
+
+%macro DECODE_HEX256_FUNCTION 3
+%1:
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Initialize constants
+;;;
+;;; zmm10 all bytes '0'
+;;; zmm11 all bytes 'a' or 'A'
+;;; zmm12 all bytes 10
+;;; zmm13 all bytes 6
+;;; zmm14 all bytes 0x20 (the bit set to downcase a letter)
+;;; zmm15 all words 0x0110 (the bytes 16, 1)
+
+  vpbroadcastb zmm10, [ascii_0]
+  vpbroadcastb zmm11, [%2]
+  vpbroadcastb zmm12, [ten]
+  vpbroadcastb zmm13, [six]
+  vpbroadcastb zmm14, [lowercase_bit]
+  vpbroadcastw zmm15, [sixteen_one]
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Classify the hex digits
+;;;
+;;; zmm0 input of hex digits
+;;; zmm1 value of the digit if it is '0'-'9'
+;;; zmm2 value of the digit if it is an accepted letter, less 10
+;;; k1 mask of the digits '0'-'9'
+;;; k2 mask of the accepted letters
+
+  vmovdqu8 zmm0, [rdi]
+  vpsubb zmm1, zmm0, zmm10
+  vpcmpub k1, zmm1, zmm12, 1    ; unsigned less than 10
+%if %3
+  vpord zmm2, zmm0, zmm14       ; downcase
+  vpsubb zmm2, zmm2, zmm11
+%else
+  vpsubb zmm2, zmm0, zmm11
+%endif
+  vpcmpub k2, zmm2, zmm13, 1    ; unsigned less than 6
+
+  korq k3, k1, k2
+  kortestq k3, k3               ; CF is set if every byte is a hex digit
+  jnc .bad_hex_char
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Convert to numeric values and combine the pairs of nibbles
+;;;
+;;; zmm2 numeric values, then 32 words of 16 * even byte + odd byte
+;;; ymm2 the 32 byte result
+
+  vpaddb zmm2, zmm2, zmm12
+  vmovdqu8 zmm2{k1}, zmm1
+  vpmaddubsw zmm2, zmm2, zmm15
+  vpmovwb ymm2, zmm2
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  ;; save the result
+  vmovdqu [rsi], ymm2
+  mov eax, 1
+  vzeroupper
+  ret
+
+.bad_hex_char:
+  xor eax,eax
+  vzeroupper
+  ret
+%endmacro
+
+default rel
+
+section   .text
+
+global decode_hex256_avx512
+global decode_hex256_upper_avx512
+global decode_hex256_lower_avx512
+
+DECODE_HEX256_FUNCTION decode_hex256_avx512, ascii_a, 1
+DECODE_HEX256_FUNCTION decode_hex256_upper_avx512, ascii_A, 0
+DECODE_HEX256_FUNCTION decode_hex256_lower_avx512, ascii_a, 0
+
+section   .data align=64               ; align on 512 bit boundary for avx512 instructions
+sixteen_one: db 16, 1
+ascii_0: db '0'
+ascii_a: db 'a'
+ascii_A: db 'A'
+ten: db 10
+six: db 6
+;; bit set to downcase a letter
+lowercase_bit: db 0x20
@@ -0,0 +1,200 @@
+;; extern int decode_hex256_avx512vbmi(char const* in, char* out);
+;; extern int decode_hex_avx512vbmi(char const* in, size_t len, char* out);
+;; extern int decode_hex256_upper_avx512vbmi(char const* in, char* out);
+;; extern int decode_hex_upper_avx512vbmi(char const* in, size_t len, char* out);
+;; extern int decode_hex256_lower_avx512vbmi(char const* in, char* out);
+;; extern int decode_hex_lower_avx512vbmi(char const* in, size_t len, char* out);
+
+;; decode_hex256_avx512vbmi:
+;; RDI is address of buf to decode (hex string). Must be 64 bytes.
+;; RSI is the address of the output (must be 32 bytes)
+;;
+;; decode_hex_avx512vbmi:
+;; RDI is address of buf to decode (hex string). Must be 2*len bytes.
+;; RSI is the number of bytes to decode (len)
+;; RDX is the address of the output (must be len bytes)
+;;
+;; If this is ported to windows, the calling convention is RCX, RDX for the first two params
+
+;; This is the avx512 vbmi version of decode_hex256_avx2. All 64 hex digits
+;; fit in one zmm register. vpermi2b looks up the value of every char in a 128
+;; byte table in one instruction, with bit 7 set for chars that are not hex
+;; digits, so the validation is a single vpmovb2m. The nibbles are combined
+;; with vpmaddubsw and vpermb picks the low byte of every word, crossing the
+;; lanes without the vinserti128/vpshufb dance.
+;;
+;; The tail of decode_hex_avx512vbmi uses masked loads and stores, which
+;; don't fault on the masked off bytes, so it never touches memory past the
+;; end of the buffers.
+;;
+;; The _upper and _lower variants only differ in the table: the letters of the
+;; other case are marked as not hex digits.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Initialize constants
+;;;
+;;; zmm11 index of the even bytes
+;;; zmm12 all words 0x0110 (the bytes 16, 1)
+;;; zmm13 value of chars 0-63
+;;; zmm14 value of chars 64-127
+;;;
+;;; %1 the table of values: hex_values, hex_values_upper or hex_values_lower
+
+%macro DECODE_HEX_VBMI_CONSTANTS 1
+  vmovdqu64 zmm11, [even_bytes]
+  vpbroadcastw zmm12, [sixteen_one]
+  vmovdqu64 zmm13, [%1]
+  vmovdqu64 zmm14, [%1+64]
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode up to 64 hex digits into up to 32 bytes. Uses zmm0-zmm2 and k1 as scratch.
+;;;
+;;; %1 address of the hex digits
+;;; %2 address of the output
+;;; %3 mask of the hex digits to load (64 bits)
+;;; %4 mask of the bytes to store (32 bits)
+;;; %5 label to jump to if any of the loaded digits are not hex digits
+
+%macro DECODE_HEX_VBMI_BLOCK 5
+  vmovdqu8 zmm0{%3}{z}, [%1]
+
+  ;; look up the value of each char. vpermi2b only uses the low 7 bits of the
+  ;; index, so chars >= 128 are caught by or'ing in the char itself
+  vmovdqa64 zmm1, zmm0
+  vpermi2b zmm1, zmm13, zmm14
+  vpord zmm2, zmm1, zmm0
+  vpmovb2m k1, zmm2
+  ktestq k1, %3                 ; ZF is clear if any loaded char is bad
+  jnz %5
+
+  ;; combine pairs of nibbles into words (16 * even byte + odd byte) and pack
+  ;; the low bytes of the words into the low 32 bytes
+  vpmaddubsw zmm1, zmm1, zmm12
+  vpermb zmm1, zmm11, zmm1
+
+  vmovdqu8 [%2]{%4}, ymm1
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a 64 digit decoder
+;;;
+;;; %1 name of the function
+;;; %2 %1 of DECODE_HEX_VBMI_CONSTANTS
+
+%macro DECODE_HEX256_FUNCTION 2
+%1:
+  DECODE_HEX_VBMI_CONSTANTS %2
+  kxnorq k7, k7, k7
+  kxnord k6, k6, k6
+  DECODE_HEX_VBMI_BLOCK rdi, rsi, k7, k6, .bad_hex_char
+  mov eax, 1
+  vzeroupper
+  ret
+
+.bad_hex_char:
+  xor eax,eax
+  vzeroupper
+  ret
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a variable length decoder. The parameters are the same as
+;;; DECODE_HEX256_FUNCTION.
+
+%macro DECODE_HEX_FUNCTION 2
+%1:
+  DECODE_HEX_VBMI_CONSTANTS %2
+  kxnorq k7, k7, k7
+  kxnord k6, k6, k6
+
+.loop:
+  cmp rsi, 32
+  jb .tail
+  DECODE_HEX_VBMI_BLOCK rdi, rdx, k7, k6, .bad_hex_char
+  add rdi, 64
+  add rdx, 32
+  sub rsi, 32
+  jmp .loop
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode the remaining len < 32 bytes with masked loads and stores
+;;;
+;;; k5 mask of the 2*len hex digits
+;;; k4 mask of the len bytes
+
+.tail:
+  test rsi, rsi
+  jz .done
+  lea rcx, [rsi + rsi]
+  mov eax, 1
+  shl rax, cl
+  dec rax
+  kmovq k5, rax
+  mov ecx, esi
+  mov eax, 1
+  shl eax, cl
+  dec eax
+  kmovd k4, eax
+  DECODE_HEX_VBMI_BLOCK rdi, rdx, k5, k4, .bad_hex_char
+
+.done:
+  mov eax, 1
+  vzeroupper
+  ret
+
+.bad_hex_char:
+  xor eax,eax
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endmacro
+
+default rel
+
+section   .text
+
+global decode_hex256_avx512vbmi
+global decode_hex_avx512vbmi
+global decode_hex256_upper_avx512vbmi
+global decode_hex_upper_avx512vbmi
+global decode_hex256_lower_avx512vbmi
+global decode_hex_lower_avx512vbmi
+
+DECODE_HEX256_FUNCTION decode_hex256_avx512vbmi, hex_values
+DECODE_HEX_FUNCTION decode_hex_avx512vbmi, hex_values
+DECODE_HEX256_FUNCTION decode_hex256_upper_avx512vbmi, hex_values_upper
+DECODE_HEX_FUNCTION decode_hex_upper_avx512vbmi, hex_values_upper
+DECODE_HEX256_FUNCTION decode_hex256_lower_avx512vbmi, hex_values_lower
+DECODE_HEX_FUNCTION decode_hex_lower_avx512vbmi, hex_values_lower
+
+section   .data align=64               ; align on 512 bit boundary for avx512 instructions
+  ;; Value of each of the chars 0-127, or 0x80 if it is not a hex digit
+hex_values:
+  times 48 db 0x80
+  db 0, 1, 2, 3, 4, 5, 6, 7, 8, 9     ; '0'-'9'
+  times 7 db 0x80
+  db 10, 11, 12, 13, 14, 15           ; 'A'-'F'
+  times 26 db 0x80
+  db 10, 11, 12, 13, 14, 15           ; 'a'-'f'
+  times 25 db 0x80
+hex_values_upper:
+  times 48 db 0x80
+  db 0, 1, 2, 3, 4, 5, 6, 7, 8, 9     ; '0'-'9'
+  times 7 db 0x80
+  db 10, 11, 12, 13, 14, 15           ; 'A'-'F'
+  times 57 db 0x80
+hex_values_lower:
+  times 48 db 0x80
+  db 0, 1, 2, 3, 4, 5, 6, 7, 8, 9     ; '0'-'9'
+  times 39 db 0x80
+  db 10, 11, 12, 13, 14, 15           ; 'a'-'f'
+  times 25 db 0x80
+  ;; vpermb index of the even bytes
+even_bytes:
+  db 0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30
+  db 32, 34, 36, 38, 40, 42, 44, 46, 48, 50, 52, 54, 56, 58, 60, 62
+  times 32 db 0
+sixteen_one: db 16, 1
@@ -0,0 +1,134 @@
+;; extern int decode_hex256_sse41(char const* in, char* out);
+;; extern int decode_hex256_upper_sse41(char const* in, char* out);
+;; extern int decode_hex256_lower_sse41(char const* in, char* out);
+
+;; RDI is address of buf to decode (hex string). Must be 64 bytes.
+;; RSI is the address of the output (must be 32 bytes)
+;; If this is ported to windows, the calling convention is RCX, RDX for the first two params
+
+;; This is the 128-bit version of decode_hex256_avx2 for cpus without avx2.
+;; SSE has no three operand forms and pblendvb takes its mask implicitly in
+;; xmm0, so the letters are converted by subtracting an extra 7 instead of
+;; blending 48 and 55. The nibbles are combined with pmaddubsw and packed
+;; with packuswb, which avoids the lane shuffles the avx2 version needs.
+;;
+;; The _upper and _lower variants only accept the letters 'A'-'F' or 'a'-'f'.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Decode 16 hex digits into 8 words, each holding one decoded byte.
+;;;
+;;; %1 the hex digits, then the decoded words
+;;; %2, %3 scratch
+;;; %4 error accumulator. Non-zero bits are or'd in for bad hex chars.
+;;; %5 1 to upcase the letters first, so both cases are accepted. 0 to accept
+;;;    only letters of the case in xmm12.
+;;;
+;;; xmm8 all words 0x0110 (the bytes 16, 1)
+;;; xmm9 all bytes 0xf0 (high nibble)
+;;; xmm10 all bytes 7, or 39 for 'a'
+;;; xmm11 all bytes 48
+;;; xmm12 all bytes 'A' or 'a' (the first letter)
+;;; xmm13 all bytes '9'
+;;; xmm14 all bytes 0x20 (the bit cleared to upcase a letter)
+
+%macro DECODE_HEX_CHUNK 5
+%if %5
+  ;; upcase by clearing bit six of values > '9'
+  movdqa %2, %1
+  pcmpgtb %2, xmm13
+  pand %2, xmm14
+  pandn %2, %1
+  movdqa %1, %2
+%else
+  movdqa %2, %1
+%endif
+
+  ;; any resulting hex digit greater than '9' and less than the first letter
+  ;; is an error
+  pcmpgtb %2, xmm13             ; recomputed mask of values > '9'
+  movdqa %3, xmm12
+  pcmpgtb %3, %1                ; mask of values < the first letter
+  pand %3, %2
+  por %4, %3
+
+  ;; convert the bytes to numeric values: subtract 48, and another 7 (39) for letters
+  psubb %1, xmm11
+  pand %2, xmm10
+  psubb %1, %2
+
+  ;; any value greater than 15 is an error
+  movdqa %3, %1
+  pand %3, xmm9
+  por %4, %3
+
+  ;; combine pairs of nibbles: 16 * even byte + odd byte
+  pmaddubsw %1, xmm8
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a 64 digit decoder
+;;;
+;;; %1 name of the function
+;;; %2 the first letter: ascii_A, or ascii_a for the lowercase only variant
+;;; %3 the value to subtract from a letter after 48: seven for 'A', thirtynine for 'a'
+;;; %4 %5 of DECODE_HEX_CHUNK (1 to accept both cases)
+
+%macro DECODE_HEX256_FUNCTION 4
+%1:
+  movdqa xmm8, [sixteen_one]
+  movdqa xmm9, [highnibble]
+  movdqa xmm10, [%3]
+  movdqa xmm11, [fourtyeight]
+  movdqa xmm12, [%2]
+  movdqa xmm13, [ascii_9]
+  movdqa xmm14, [lowercase_bit]
+
+  pxor xmm7, xmm7
+  movdqu xmm0, [rdi]
+  movdqu xmm1, [rdi+16]
+  movdqu xmm2, [rdi+32]
+  movdqu xmm3, [rdi+48]
+  DECODE_HEX_CHUNK xmm0, xmm4, xmm5, xmm7, %4
+  DECODE_HEX_CHUNK xmm1, xmm4, xmm5, xmm7, %4
+  DECODE_HEX_CHUNK xmm2, xmm4, xmm5, xmm7, %4
+  DECODE_HEX_CHUNK xmm3, xmm4, xmm5, xmm7, %4
+  ptest xmm7, xmm7
+  jnz .bad_hex_char
+
+  packuswb xmm0, xmm1
+  packuswb xmm2, xmm3
+
+  ;; save the result
+  movdqu [rsi], xmm0
+  movdqu [rsi+16], xmm2
+  mov eax, 1
+  ret
+
+.bad_hex_char:
+  xor eax,eax
+  ret
+%endmacro
+
+default rel
+
+section   .text
+
+global decode_hex256_sse41
+global decode_hex256_upper_sse41
+global decode_hex256_lower_sse41
+
+DECODE_HEX256_FUNCTION decode_hex256_sse41, ascii_A, seven, 1
+DECODE_HEX256_FUNCTION decode_hex256_upper_sse41, ascii_A, seven, 0
+DECODE_HEX256_FUNCTION decode_hex256_lower_sse41, ascii_a, thirtynine, 0
+
+section   .data align=16               ; align on 128 bit boundary for sse instructions
+sixteen_one: times 8 db 16, 1
+highnibble: times 16 db 0xf0
+seven: times 16 db 7
+thirtynine: times 16 db 39
+fourtyeight: times 16 db 48
+ascii_A: times 16 db 'A'
+ascii_a: times 16 db 'a'
+ascii_9: times 16 db '9'
+;; bit cleared to upcase a letter
+lowercase_bit: times 16 db 0x20
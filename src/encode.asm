@@ -1,73 +1,292 @@
-;; extern void encode_hex256(char* in, char* out);
+;; extern void encode_hex256_avx2(char* in, char* out);
+;; extern void encode_hex_avx2(char const* in, size_t len, char* out);
+;; extern void encode_hex256_batch_avx2(char const* in, size_t count, char* out);
+;; extern void encode_hex256_lower_avx2(char const* in, char* out);
+;; extern void encode_hex_lower_avx2(char const* in, size_t len, char* out);
+;; extern void encode_hex160_avx2(char const* in, char* out);
+;; extern void encode_hex264_avx2(char const* in, char* out);
+;; extern void encode_hex512_avx2(char const* in, char* out);
 
+;; encode_hex256_avx2:
 ;; RDI is address of buf to encode (binary). Must be 32 bytes.
 ;; RSI is the address of the output (must be 64 bytes)
+;;
+;; encode_hex_avx2:
+;; RDI is address of buf to encode (binary). Must be len bytes.
+;; RSI is the number of bytes to encode (len)
+;; RDX is the address of the output (must be 2*len bytes, and must not overlap the input)
+;;
+;; encode_hex256_batch_avx2:
+;; RDI is address of the keys to encode (binary). Must be 32*count bytes.
+;; RSI is the number of keys to encode (count)
+;; RDX is the address of the output (must be 64*count bytes)
+;;
+;; The _lower variants take the same parameters as encode_hex256_avx2 and
+;; encode_hex_avx2, but write the letters 'a'-'f' instead of 'A'-'F'.
+;;
+;; encode_hex160_avx2, encode_hex264_avx2 and encode_hex512_avx2 encode 20, 33
+;; and 64 bytes into 40, 66 and 128 hex digits, and take the same parameters
+;; as encode_hex256_avx2. Where the bytes are not a whole number of blocks, the
+;; loads overlap rather than read past the end of the input.
+;;
 ;; If this is ported to windows, the calling convention is RCX, RDX for the first two params
 
-section   .text
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Load the constants used by ENCODE_HEX_BLOCK. They are kept in the high
+;;; registers so a loop can reuse them for every block.
+;;;
+;;; %1 the value to add to a nibble >= 10: fiftyfive for 'A'-'F', eightyseven
+;;;    for 'a'-'f'
+;;;
+;;; ymm12: all bytes 55 or 87
+;;; ymm13: all bytes 48
+;;; ymm14: all bytes 10
+;;; ymm15: mask for low bytes
 
-global encode_hex256
+%macro ENCODE_HEX_CONSTANTS 1
+  vpbroadcastb ymm12, [%1]
+  vpbroadcastb ymm13, [fourtyeight]
+  vpbroadcastb ymm14, [ten]
+  vpbroadcastw ymm15, [lownibble]
+%endmacro
 
-encode_hex256:
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Encode 32 bytes into 64 hex digits. The scratch registers are parameters
+;;; so independent keys can use disjoint registers and overlap in the pipeline.
 ;;;
-;;; ymm{0,1}: values to encode; 4 bits per byte
-;;; ymm2: mask for low bytes
-;;; ymm3: mask for high bytes
-;;; ymm{4,5}: low nibble of bytes to encode
-;;; ymm{6,7}: high nibble of bytes to encode
-
-  vmovdqu xmm4, [rdi]
-  vmovdqu xmm5, [rdi+16]
-  vpmovzxbw ymm4, xmm4
-  vpmovzxbw ymm5, xmm5
-  vpbroadcastw ymm2, [lownibble]
-  vpsllw ymm3, ymm2, 4          ; highnibble
-  vpand ymm6, ymm4, ymm3
-  vpand ymm7, ymm5, ymm3
-  vpand ymm4, ymm4, ymm2
-  vpand ymm5, ymm5, ymm2
-  vpsllw ymm4, ymm4, 8
-  vpsllw ymm5, ymm5, 8
-  vpsrlw ymm6, ymm6, 4
-  vpsrlw ymm7, ymm7, 4
-  vpaddb ymm0, ymm4, ymm6
-  vpaddb ymm1, ymm5, ymm7
+;;; %1 address of the 32 bytes to encode
+;;; %2 address of the 64 byte output
+;;; %3, %4 scratch: values to encode, then hex chars
+;;; %5, %6 scratch
+
+%macro ENCODE_HEX_BLOCK 6
+  vpmovzxbw %3, [%1]
+  vpmovzxbw %4, [%1+16]
+  ENCODE_HEX_DIGITS %3, %4, %5, %6
+  vmovdqu [%2], %3
+  vmovdqu [%2+32], %4
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Encode the 32 bytes zero extended to words in %1 and %2 into the 64 hex
+;;; digits of the same registers. %3 and %4 are scratch.
+
+%macro ENCODE_HEX_DIGITS 4
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;;
+;;; %1, %2: values to encode; 4 bits per byte
+;;; %3, %4: high nibble of bytes to encode. The bytes are zero extended
+;;;         to words, so a word shift moves the high nibble down without
+;;;         needing a mask
+
+  vpsrlw %3, %1, 4
+  vpsrlw %4, %2, 4
+  vpand %1, %1, ymm15
+  vpand %2, %2, ymm15
+  vpsllw %1, %1, 8
+  vpsllw %2, %2, 8
+  vpaddb %1, %1, %3
+  vpaddb %2, %2, %4
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;;; Replace values with hex chars
-;;; ymm{0,1} starts as from above. Transformed to hex chars
-;;; ymm2 all bytes 10
-;;; ymm{3,4} mask of all values less than 10
-;;; ymm5 all bytes 48
-;;; ymm6 all bytes 55
-;;; ymm{7,8} values to add to the input to get hex chars (either 48 or 55 depending if the value < 10)
-
-  vpbroadcastb ymm2, [ten]
-  vpcmpgtb ymm3, ymm2, ymm0
-  vpcmpgtb ymm4, ymm2, ymm1
-  vpbroadcastb ymm5, [fourtyeight]
-  vpbroadcastb ymm6, [fiftyfive]
-  vpblendvb ymm7, ymm6, ymm5, ymm3
-  vpblendvb ymm8, ymm6, ymm5, ymm4
-  vpaddb ymm0, ymm0, ymm7
-  vpaddb ymm1, ymm1, ymm8
+;;; %1, %2 starts as from above. Transformed to hex chars
+;;; %3, %4 mask of all values less than 10, then values to add to the input
+;;;        to get hex chars (either 48 or 55 (87) depending if the value < 10)
+
+  vpcmpgtb %3, ymm14, %1
+  vpcmpgtb %4, ymm14, %2
+  vpblendvb %3, ymm12, ymm13, %3
+  vpblendvb %4, ymm12, ymm13, %4
+  vpaddb %1, %1, %3
+  vpaddb %2, %2, %4
 
 ;;;
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a 32 byte encoder. The case variants share this body and only
+;;; differ in the constants.
+;;;
+;;; %1 name of the function
+;;; %2 %1 of ENCODE_HEX_CONSTANTS
+
+%macro ENCODE_HEX256_FUNCTION 2
+%1:
+  ENCODE_HEX_CONSTANTS %2
+  ENCODE_HEX_BLOCK rdi, rsi, ymm0, ymm1, ymm2, ymm3
+  vzeroupper
+  ret
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a variable length encoder. The parameters are the same as
+;;; ENCODE_HEX256_FUNCTION.
+
+%macro ENCODE_HEX_FUNCTION 2
+%1:
+  ENCODE_HEX_CONSTANTS %2
+  cmp rsi, 32
+  jb .short
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Encode 32 bytes at a time. The final block is aligned to the end of the
+;;; buffer, so it overlaps the previous block when len is not a multiple of 32.
+;;;
+;;; r8 address of the final input block
+;;; r9 address of the final output block
+
+  lea r8, [rdi + rsi - 32]
+  lea r9, [rdx + 2*rsi - 64]
+
+.loop:
+  cmp rdi, r8
+  jae .last_block
+  ENCODE_HEX_BLOCK rdi, rdx, ymm0, ymm1, ymm2, ymm3
+  add rdi, 32
+  add rdx, 64
+  jmp .loop
+
+.last_block:
+  ENCODE_HEX_BLOCK r8, r9, ymm0, ymm1, ymm2, ymm3
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Less than a full block: copy the input into a zeroed stack buffer so the
+;;; block never reads past the end of the input, encode it, and copy the hex
+;;; digits out.
+;;;
+;;; [rsp] 32 byte padded input
+;;; [rsp+32] 64 byte output
+;;; r10 address of the output
+;;; r11 number of bytes to encode
+
+.short:
+  test rsi, rsi
+  jz .empty
+  sub rsp, 96
+  vpxor xmm0, xmm0, xmm0
+  vmovdqu [rsp], ymm0
+
+  mov r10, rdx
+  mov r11, rsi
+  mov rcx, rsi
+  mov rsi, rdi
+  mov rdi, rsp
+  rep movsb
 
-  ; save the result
+  ENCODE_HEX_BLOCK rsp, rsp+32, ymm0, ymm1, ymm2, ymm3
+
+  lea rsi, [rsp + 32]
+  mov rdi, r10
+  lea rcx, [r11 + r11]
+  rep movsb
+  add rsp, 96
+
+.empty:
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endmacro
+
+default rel
+
+section   .text
+
+global encode_hex256_avx2
+global encode_hex_avx2
+global encode_hex256_batch_avx2
+global encode_hex256_lower_avx2
+global encode_hex_lower_avx2
+global encode_hex160_avx2
+global encode_hex264_avx2
+global encode_hex512_avx2
+
+ENCODE_HEX256_FUNCTION encode_hex256_avx2, fiftyfive
+ENCODE_HEX_FUNCTION encode_hex_avx2, fiftyfive
+ENCODE_HEX256_FUNCTION encode_hex256_lower_avx2, eightyseven
+ENCODE_HEX_FUNCTION encode_hex_lower_avx2, eightyseven
+
+
+encode_hex256_batch_avx2:
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Encode two keys per iteration. The keys use disjoint registers (ymm0-ymm3
+;;; and ymm4-ymm7), so the out of order core overlaps their latency.
+;;;
+;;; r8 address one past the last pair of keys
+
+  ENCODE_HEX_CONSTANTS fiftyfive
+  mov r8, rsi
+  and r8, -2
+  shl r8, 5
+  add r8, rdi
+
+.pair_loop:
+  cmp rdi, r8
+  jae .last_key
+  ENCODE_HEX_BLOCK rdi, rdx, ymm0, ymm1, ymm2, ymm3
+  ENCODE_HEX_BLOCK rdi+32, rdx+64, ymm4, ymm5, ymm6, ymm7
+  add rdi, 64
+  add rdx, 128
+  jmp .pair_loop
+
+.last_key:
+  test rsi, 1
+  jz .done
+  ENCODE_HEX_BLOCK rdi, rdx, ymm0, ymm1, ymm2, ymm3
+
+.done:
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Fixed width encoders. 20 bytes is less than a block, so the second half
+;;; of the block is loaded from byte 4 on, and bytes 4-15 are encoded twice.
+;;; 33 bytes is a block and another one byte later.
+
+encode_hex160_avx2:
+  ENCODE_HEX_CONSTANTS fiftyfive
+  vpmovzxbw ymm0, [rdi]
+  vpmovzxbw ymm1, [rdi+4]
+  ENCODE_HEX_DIGITS ymm0, ymm1, ymm2, ymm3
   vmovdqu [rsi], ymm0
-  vmovdqu [rsi+32], ymm1
+  vmovdqu [rsi+8], ymm1
+  vzeroupper
+  ret
 
+encode_hex264_avx2:
+  ENCODE_HEX_CONSTANTS fiftyfive
+  ENCODE_HEX_BLOCK rdi, rsi, ymm0, ymm1, ymm2, ymm3
+  ENCODE_HEX_BLOCK rdi+1, rsi+2, ymm4, ymm5, ymm6, ymm7
   vzeroupper
   ret
 
+encode_hex512_avx2:
+  ENCODE_HEX_CONSTANTS fiftyfive
+  ENCODE_HEX_BLOCK rdi, rsi, ymm0, ymm1, ymm2, ymm3
+  ENCODE_HEX_BLOCK rdi+32, rsi+64, ymm4, ymm5, ymm6, ymm7
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
 section   .data align=32               ; align on 256 bit boundary for avx2 instructions
 ten: db 10
 fourtyeight: db 48
 fiftyfive: db 55
+eightyseven: db 87
 lownibble: db 0x0f, 0x00
@@ -0,0 +1,62 @@
+;; extern void encode_hex256_avx512(char const* in, char* out);
+;; extern void encode_hex256_lower_avx512(char const* in, char* out);
+
+;; RDI is address of buf to encode (binary). Must be 32 bytes.
+;; RSI is the address of the output (must be 64 bytes)
+;; If this is ported to windows, the calling convention is RCX, RDX for the first two params
+
+;; This is the avx512bw version of encode_hex256_avx2. All 64 hex digits fit
+;; in one zmm register, and each nibble is used as a vpshufb index into a
+;; table of the hex digits that is repeated in every lane. The _lower variant
+;; uses a table with the letters 'a'-'f'.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a 32 byte encoder
+;;;
+;;; %1 name of the function
+;;; %2 the table of hex digits
+
+%macro ENCODE_HEX256_FUNCTION 2
+%1:
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;;
+;;; zmm0: values to encode; the high nibble in the low byte of each word, and
+;;;       the low nibble in the high byte
+;;; zmm1: high nibble of bytes to encode
+;;; zmm14: all words 0x0f00
+;;; zmm15: the hex digits in every lane
+
+  vbroadcasti32x4 zmm15, [%2]
+  vpbroadcastw zmm14, [lownibble_high_byte]
+
+  vpmovzxbw zmm0, [rdi]
+  vpsrlw zmm1, zmm0, 4
+  vpsllw zmm0, zmm0, 8
+  vpandd zmm0, zmm0, zmm14
+  vpord zmm0, zmm0, zmm1
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  ;; replace values with hex chars and save the result
+  vpshufb zmm0, zmm15, zmm0
+  vmovdqu8 [rsi], zmm0
+
+  vzeroupper
+  ret
+%endmacro
+
+default rel
+
+section   .text
+
+global encode_hex256_avx512
+global encode_hex256_lower_avx512
+
+ENCODE_HEX256_FUNCTION encode_hex256_avx512, hex_digits
+ENCODE_HEX256_FUNCTION encode_hex256_lower_avx512, hex_digits_lower
+
+section   .data align=64               ; align on 512 bit boundary for avx512 instructions
+hex_digits: db "0123456789ABCDEF"
+hex_digits_lower: db "0123456789abcdef"
+lownibble_high_byte: dw 0x0f00
@@ -0,0 +1,148 @@
+;; extern void encode_hex256_avx512vbmi(char const* in, char* out);
+;; extern void encode_hex_avx512vbmi(char const* in, size_t len, char* out);
+;; extern void encode_hex256_lower_avx512vbmi(char const* in, char* out);
+;; extern void encode_hex_lower_avx512vbmi(char const* in, size_t len, char* out);
+
+;; encode_hex256_avx512vbmi:
+;; RDI is address of buf to encode (binary). Must be 32 bytes.
+;; RSI is the address of the output (must be 64 bytes)
+;;
+;; encode_hex_avx512vbmi:
+;; RDI is address of buf to encode (binary). Must be len bytes.
+;; RSI is the number of bytes to encode (len)
+;; RDX is the address of the output (must be 2*len bytes)
+;;
+;; If this is ported to windows, the calling convention is RCX, RDX for the first two params
+
+;; This is the avx512 vbmi version of encode_hex256_avx2. vpermb moves every
+;; four input bytes into their own qword, vpmultishiftqb pulls the nibble for
+;; every output char out of that qword, and a second vpermb looks up the hex
+;; digit. There are no unpacks, masks or blends.
+;;
+;; The tail of encode_hex_avx512vbmi uses masked loads and stores, which
+;; don't fault on the masked off bytes, so it never touches memory past the
+;; end of the buffers.
+;;
+;; The _lower variants look up the letters 'a'-'f' instead of 'A'-'F'.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Initialize constants
+;;;
+;;; zmm12 vpermb index that puts input bytes 4k to 4k+3 in the low dword of qword k
+;;; zmm13 vpmultishiftqb bit offsets of the high and low nibble of each of the four bytes
+;;; zmm14 the hex digits in every lane
+;;;
+;;; %1 the table of hex digits: hex_digits or hex_digits_lower
+
+%macro ENCODE_HEX_VBMI_CONSTANTS 1
+  vmovdqu64 zmm12, [spread_bytes]
+  vpbroadcastq zmm13, [nibble_offsets]
+  vbroadcasti32x4 zmm14, [%1]
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Encode up to 32 bytes into up to 64 hex digits. Uses zmm0 as scratch.
+;;;
+;;; %1 address of the bytes to encode
+;;; %2 address of the output
+;;; %3 mask of the bytes to load (32 bits)
+;;; %4 mask of the hex digits to store (64 bits)
+
+%macro ENCODE_HEX_VBMI_BLOCK 4
+  vmovdqu8 ymm0{%3}{z}, [%1]
+  vpermb zmm0, zmm12, zmm0
+  vpmultishiftqb zmm0, zmm13, zmm0
+  ;; only the low 4 bits of the index are the nibble, but the table repeats
+  ;; every 16 bytes so the other bits don't matter
+  vpermb zmm0, zmm0, zmm14
+  vmovdqu8 [%2]{%4}, zmm0
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a 32 byte encoder
+;;;
+;;; %1 name of the function
+;;; %2 %1 of ENCODE_HEX_VBMI_CONSTANTS
+
+%macro ENCODE_HEX256_FUNCTION 2
+%1:
+  ENCODE_HEX_VBMI_CONSTANTS %2
+  kxnord k7, k7, k7
+  kxnorq k6, k6, k6
+  ENCODE_HEX_VBMI_BLOCK rdi, rsi, k7, k6
+  vzeroupper
+  ret
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a variable length encoder. The parameters are the same as
+;;; ENCODE_HEX256_FUNCTION.
+
+%macro ENCODE_HEX_FUNCTION 2
+%1:
+  ENCODE_HEX_VBMI_CONSTANTS %2
+  kxnord k7, k7, k7
+  kxnorq k6, k6, k6
+
+.loop:
+  cmp rsi, 32
+  jb .tail
+  ENCODE_HEX_VBMI_BLOCK rdi, rdx, k7, k6
+  add rdi, 32
+  add rdx, 64
+  sub rsi, 32
+  jmp .loop
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Encode the remaining len < 32 bytes with masked loads and stores
+;;;
+;;; k5 mask of the len bytes
+;;; k4 mask of the 2*len hex digits
+
+.tail:
+  test rsi, rsi
+  jz .done
+  mov ecx, esi
+  mov eax, 1
+  shl eax, cl
+  dec eax
+  kmovd k5, eax
+  lea rcx, [rsi + rsi]
+  mov eax, 1
+  shl rax, cl
+  dec rax
+  kmovq k4, rax
+  ENCODE_HEX_VBMI_BLOCK rdi, rdx, k5, k4
+
+.done:
+  vzeroupper
+  ret
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+%endmacro
+
+default rel
+
+section   .text
+
+global encode_hex256_avx512vbmi
+global encode_hex_avx512vbmi
+global encode_hex256_lower_avx512vbmi
+global encode_hex_lower_avx512vbmi
+
+ENCODE_HEX256_FUNCTION encode_hex256_avx512vbmi, hex_digits
+ENCODE_HEX_FUNCTION encode_hex_avx512vbmi, hex_digits
+ENCODE_HEX256_FUNCTION encode_hex256_lower_avx512vbmi, hex_digits_lower
+ENCODE_HEX_FUNCTION encode_hex_lower_avx512vbmi, hex_digits_lower
+
+section   .data align=64               ; align on 512 bit boundary for avx512 instructions
+spread_bytes:
+  db 0, 1, 2, 3, 0, 0, 0, 0, 4, 5, 6, 7, 0, 0, 0, 0
+  db 8, 9, 10, 11, 0, 0, 0, 0, 12, 13, 14, 15, 0, 0, 0, 0
+  db 16, 17, 18, 19, 0, 0, 0, 0, 20, 21, 22, 23, 0, 0, 0, 0
+  db 24, 25, 26, 27, 0, 0, 0, 0, 28, 29, 30, 31, 0, 0, 0, 0
+  ;; the high nibble comes first
+nibble_offsets: db 4, 0, 12, 8, 20, 16, 28, 24
+hex_digits: db "0123456789ABCDEF"
+hex_digits_lower: db "0123456789abcdef"
@@ -0,0 +1,73 @@
+;; extern void encode_hex256_sse41(char const* in, char* out);
+;; extern void encode_hex256_lower_sse41(char const* in, char* out);
+
+;; RDI is address of buf to encode (binary). Must be 32 bytes.
+;; RSI is the address of the output (must be 64 bytes)
+;; If this is ported to windows, the calling convention is RCX, RDX for the first two params
+
+;; This is the 128-bit version of encode_hex256_avx2 for cpus without avx2.
+;; Instead of comparing against 10 and blending 48 and 55, each nibble is used
+;; as a pshufb index into a 16 byte table of the hex digits. The _lower variant
+;; uses a table with the letters 'a'-'f'.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Encode 16 bytes into 32 hex digits. Uses xmm0-xmm2 as scratch.
+;;;
+;;; %1 address of the 16 bytes to encode
+;;; %2 address of the 32 byte output
+;;;
+;;; xmm14 all bytes 0x0f (low nibble)
+;;; xmm15 the hex digits
+
+%macro ENCODE_HEX_CHUNK 2
+  movdqu xmm0, [%1]
+  movdqa xmm1, xmm0
+  psrlw xmm1, 4
+  pand xmm0, xmm14              ; low nibbles
+  pand xmm1, xmm14              ; high nibbles
+
+  ;; interleave so the high nibble of each byte comes first
+  movdqa xmm2, xmm1
+  punpcklbw xmm2, xmm0
+  punpckhbw xmm1, xmm0
+
+  ;; replace values with hex chars
+  movdqa xmm0, xmm15
+  pshufb xmm0, xmm2
+  movdqa xmm2, xmm15
+  pshufb xmm2, xmm1
+
+  ;; save the result
+  movdqu [%2], xmm0
+  movdqu [%2+16], xmm2
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Define a 32 byte encoder
+;;;
+;;; %1 name of the function
+;;; %2 the table of hex digits
+
+%macro ENCODE_HEX256_FUNCTION 2
+%1:
+  movdqa xmm14, [lownibble]
+  movdqa xmm15, [%2]
+  ENCODE_HEX_CHUNK rdi, rsi
+  ENCODE_HEX_CHUNK rdi+16, rsi+32
+  ret
+%endmacro
+
+default rel
+
+section   .text
+
+global encode_hex256_sse41
+global encode_hex256_lower_sse41
+
+ENCODE_HEX256_FUNCTION encode_hex256_sse41, hex_digits
+ENCODE_HEX256_FUNCTION encode_hex256_lower_sse41, hex_digits_lower
+
+section   .data align=16               ; align on 128 bit boundary for sse instructions
+hex_digits: db "0123456789ABCDEF"
+hex_digits_lower: db "0123456789abcdef"
+lownibble: times 16 db 0x0f
@@ -0,0 +1,72 @@
+;; extern void field_masks_avx2(char const* in, std::size_t num_blocks, std::uint64_t* masks, unsigned char const* tables);
+
+;; RDI is address of the text to scan. Must be 64*num_blocks chars.
+;; RSI is the number of 64 char blocks (num_blocks)
+;; RDX is the address of the output (must be num_blocks qwords)
+;; RCX is the address of the separator tables (codec::hex::field_separators, 32 bytes)
+;;
+;; Bit i of masks[k] is set if char 64*k + i is part of a field, and clear if
+;; it is a separator.
+;;
+;; The separators are classified with two lookups, as in simdjson: the first
+;; 16 bytes of the tables are indexed by the low nibble of a char and the next
+;; 16 by its high nibble. Each separator has a bit for its high nibble in both
+;; entries, so a char is a separator if the two lookups have a bit in common.
+;;
+;; If this is ported to windows, the calling convention is RCX, RDX, R8, R9 for the params
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Classify 32 chars. Uses %2 as scratch.
+;;;
+;;; %1 the chars, then 0xff for the chars of fields and 0 for separators
+;;;
+;;; ymm4: all bits cleared
+;;; ymm5: all bytes 0x0f
+;;; ymm6: the low nibble table, in both lanes
+;;; ymm7: the high nibble table, in both lanes
+
+%macro CLASSIFY_32 2
+  vpsrlw %2, %1, 4
+  vpand %2, %2, ymm5            ; high nibbles
+  vpand %1, %1, ymm5            ; low nibbles
+  vpshufb %2, ymm7, %2
+  vpshufb %1, ymm6, %1
+  vpand %1, %1, %2
+  vpcmpeqb %1, %1, ymm4         ; no bit in common: not a separator
+%endmacro
+
+default rel
+
+section   .text
+
+global field_masks_avx2
+
+field_masks_avx2:
+  vpxor ymm4, ymm4, ymm4
+  vpbroadcastb ymm5, [low_nibble_mask]
+  vbroadcasti128 ymm6, [rcx]
+  vbroadcasti128 ymm7, [rcx+16]
+  test rsi, rsi
+  jz .done
+
+.loop:
+  vmovdqu ymm0, [rdi]
+  vmovdqu ymm1, [rdi+32]
+  CLASSIFY_32 ymm0, ymm2
+  CLASSIFY_32 ymm1, ymm3
+  vpmovmskb eax, ymm0
+  vpmovmskb r8d, ymm1
+  shl r8, 32
+  or rax, r8
+  mov [rdx], rax
+  add rdi, 64
+  add rdx, 8
+  dec rsi
+  jnz .loop
+
+.done:
+  vzeroupper
+  ret
+
+section   .data
+low_nibble_mask: db 0x0f
@@ -1,33 +1,119 @@
 #include "codec_base58.h"
+#include "codec_base64.h"
+#include "codec_cache.h"
+#include "codec_fields.h"
 #include "codec_hex.h"
+#include "codec_intrin.h"
+#include "codec_parallel.h"
+#include "codec_stream.h"
 
 int
 main()
 {
+    std::cout << "ISA: " << codec::cpu::name(codec::cpu::active_isa()) << '\n';
+
+    // Check every variant the cpu supports against the reference
+    {
+        auto const active = codec::cpu::active_isa();
+        for (auto const level : codec::cpu::supported_isas())
+        {
+            codec::cpu::set_isa(level);
+            if (!codec::base58::check_base58_8_coeff() ||
+                !codec::base58::random_test_base58_8_coeff(100'000) ||
+                !codec::base58::random_test_reduce_base58(10'000) ||
+                !codec::base58::random_test_alphabet_rows<
+                    codec::base58::alphabet::ripple>(10'000) ||
+                !codec::base58::random_test_alphabet_rows<
+                    codec::base58::alphabet::bitcoin>(10'000) ||
+                !codec::base58::check_alphabet_outside_rows() ||
+                !codec::base58::random_test_decode_base58_batch(1'000) ||
+                !codec::sha256::check_sha256() ||
+                !codec::sha256::random_test_sha256(1'000) ||
+                !codec::base58::random_test_base58check(1'000) ||
+                !codec::base58::random_test_decode_cache(10'000) ||
+                !codec::hex::random_test_encode(100'000) ||
+                !codec::hex::random_test_decode(100'000, 1) ||
+                !codec::hex::random_test_encode_bulk(10'000, 300) ||
+                !codec::hex::random_test_decode_bulk(10'000, 300, 1) ||
+                !codec::hex::random_test_encode_batch(10'000) ||
+                !codec::hex::random_test_decode_batch(10'000, 3) ||
+                !codec::hex::random_test_policies(10'000) ||
+                !codec::hex::random_test_fields(10'000) ||
+                !codec::hex::random_test_lenient(10'000) ||
+                !codec::hex::random_test_fixed_widths(10'000) ||
+                !codec::base64::check_base64() ||
+                !codec::base64::random_test_base64(10'000, 300) ||
+                !codec::random_test_parallel(20) ||
+                !codec::random_test_stream(100))
+            {
+                std::cerr << "Failed isa: " << codec::cpu::name(level) << '\n';
+                return 1;
+            }
+        }
+        codec::cpu::set_isa(active);
+    }
+
+    // The intrinsics kernels don't dispatch, so they are checked once
+    if (!codec::intrin::random_test_intrinsics(10'000))
+    {
+        std::cerr << "Failed intrinsics\n";
+        return 1;
+    }
+
     {
         using namespace codec::base58;
+        if (!random_test_encode_base58(100'000))
+            return 1;
+        benchmark_encode_base58();
+        if (!random_test_decode_base58(100'000))
+            return 1;
+        benchmark_decode_base58_widths();
+        benchmark_decode_base58_batch();
+        codec::sha256::benchmark_sha256();
+        benchmark_base58check();
+        codec::benchmark_parallel();
+        benchmark_decode_cache();
+        codec::base64::benchmark_base64();
+        codec::hex::benchmark_fields();
+        codec::hex::benchmark_lenient();
+        codec::hex::benchmark_fixed_widths();
+        codec::intrin::benchmark_intrinsics();
+        codec::benchmark_stream();
         test_base58();
-        return 1;
         benchmark_decode_base58();
-        return 1;
-        check_base58_8_coeff();
-        return 1;
     }
 
     {
         using namespace codec::hex;
-        if (!random_test_encode(1'000'000))
+        if (!random_test_encode(1'000'000) ||
+            !random_test_encode_batch(100'000))
         {
             return 1;
         }
         benchmark_encode();
 
         if (!random_test_decode(1'000'000, 0) ||
-            !random_test_decode(1'000'000, 1))
+            !random_test_decode(1'000'000, 1) ||
+            !random_test_decode_batch(100'000, 0) ||
+            !random_test_decode_batch(100'000, 3))
         {
             return 1;
         }
         benchmark_decode();
+
+        if (!random_test_encode_bulk(100'000, 300) ||
+            !random_test_decode_bulk(100'000, 300, 0) ||
+            !random_test_decode_bulk(100'000, 300, 1))
+        {
+            return 1;
+        }
+        benchmark_bulk();
+
+        if (!random_test_policies(100'000))
+        {
+            return 1;
+        }
+        benchmark_policy();
     }
 
     return 0;
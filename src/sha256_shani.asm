@@ -0,0 +1,166 @@
+;; extern void sha256_blocks_shani(unsigned char const* in, std::size_t num_blocks, std::uint32_t* state);
+
+;; RDI is address of the blocks to hash. Must be 64*num_blocks bytes.
+;; RSI is the number of blocks (num_blocks). Must not be 0.
+;; RDX is the address of the state of the hash (8 dwords, a-h)
+
+;; This is the sha256 compression function with the SHA extensions.
+;; sha256rnds2 runs two rounds, with the state split over two registers as
+;; ABEF and CDGH, and sha256msg1/sha256msg2 compute the message schedule four
+;; words at a time. The state is shuffled into that layout once, before the
+;; first block, and back after the last.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Four rounds
+;;;
+;;; %1 the rounds / 4
+;;; %2 the message words of the rounds
+;;;
+;;; xmm1: ABEF
+;;; xmm2: CDGH
+;;; rax: address of the round constants
+;;;
+;;; Uses xmm0 as scratch.
+
+%macro ROUNDS_4 2
+  movdqa xmm0, %2
+  paddd xmm0, [rax+16*%1]
+  sha256rnds2 xmm2, xmm1, xmm0
+  pshufd xmm0, xmm0, 0x0e
+  sha256rnds2 xmm1, xmm2, xmm0
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Finish the next four message words
+;;;
+;;; %1 the next words, with sha256msg1 already applied
+;;; %2 the current words
+;;; %3 the previous words
+;;;
+;;; Uses xmm7 as scratch.
+
+%macro MSG_NEXT 3
+  ;; w[i-7] for the next four words are the last three previous words and
+  ;; the first current one
+  movdqa xmm7, %2
+  palignr xmm7, %3, 4
+  paddd %1, xmm7
+  sha256msg2 %1, %2
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Load four message words from offset %1 of the block into %2
+
+%macro LOAD_MSG 2
+  movdqu %2, [rdi+%1]
+  pshufb %2, xmm8
+%endmacro
+
+default rel
+
+section   .text
+
+global sha256_blocks_shani
+
+sha256_blocks_shani:
+  lea rax, [round_constants]
+  movdqa xmm8, [bswap_dwords]
+
+  ;; a-d and e-h as ABEF and CDGH
+  movdqu xmm1, [rdx]
+  movdqu xmm2, [rdx+16]
+  pshufd xmm1, xmm1, 0xb1       ; CDAB
+  pshufd xmm2, xmm2, 0x1b       ; EFGH
+  movdqa xmm7, xmm1
+  palignr xmm1, xmm2, 8         ; ABEF
+  pblendw xmm2, xmm7, 0xf0      ; CDGH
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; xmm3-xmm6: four groups of four message words, used in turn
+;;; xmm9, xmm10: the state before the block
+
+.block:
+  movdqa xmm9, xmm1
+  movdqa xmm10, xmm2
+
+  LOAD_MSG 0, xmm3
+  ROUNDS_4 0, xmm3
+  LOAD_MSG 16, xmm4
+  ROUNDS_4 1, xmm4
+  sha256msg1 xmm3, xmm4
+  LOAD_MSG 32, xmm5
+  ROUNDS_4 2, xmm5
+  sha256msg1 xmm4, xmm5
+  LOAD_MSG 48, xmm6
+  ROUNDS_4 3, xmm6
+  MSG_NEXT xmm3, xmm6, xmm5
+  sha256msg1 xmm5, xmm6
+
+  ROUNDS_4 4, xmm3
+  MSG_NEXT xmm4, xmm3, xmm6
+  sha256msg1 xmm6, xmm3
+  ROUNDS_4 5, xmm4
+  MSG_NEXT xmm5, xmm4, xmm3
+  sha256msg1 xmm3, xmm4
+  ROUNDS_4 6, xmm5
+  MSG_NEXT xmm6, xmm5, xmm4
+  sha256msg1 xmm4, xmm5
+  ROUNDS_4 7, xmm6
+  MSG_NEXT xmm3, xmm6, xmm5
+  sha256msg1 xmm5, xmm6
+
+  ROUNDS_4 8, xmm3
+  MSG_NEXT xmm4, xmm3, xmm6
+  sha256msg1 xmm6, xmm3
+  ROUNDS_4 9, xmm4
+  MSG_NEXT xmm5, xmm4, xmm3
+  sha256msg1 xmm3, xmm4
+  ROUNDS_4 10, xmm5
+  MSG_NEXT xmm6, xmm5, xmm4
+  sha256msg1 xmm4, xmm5
+  ROUNDS_4 11, xmm6
+  MSG_NEXT xmm3, xmm6, xmm5
+  sha256msg1 xmm5, xmm6
+
+  ;; rounds 48-63; the schedule ends with the words of rounds 60-63
+  ROUNDS_4 12, xmm3
+  MSG_NEXT xmm4, xmm3, xmm6
+  sha256msg1 xmm6, xmm3
+  ROUNDS_4 13, xmm4
+  MSG_NEXT xmm5, xmm4, xmm3
+  ROUNDS_4 14, xmm5
+  MSG_NEXT xmm6, xmm5, xmm4
+  ROUNDS_4 15, xmm6
+
+  paddd xmm1, xmm9
+  paddd xmm2, xmm10
+  add rdi, 64
+  dec rsi
+  jnz .block
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  ;; ABEF and CDGH back to a-d and e-h
+  pshufd xmm1, xmm1, 0x1b       ; FEBA
+  pshufd xmm2, xmm2, 0xb1       ; DCHG
+  movdqa xmm7, xmm1
+  pblendw xmm1, xmm2, 0xf0      ; DCBA
+  palignr xmm2, xmm7, 8         ; HGFE
+  movdqu [rdx], xmm1
+  movdqu [rdx+16], xmm2
+  ret
+
+section   .data align=16               ; align on 128 bit boundary for sse instructions
+round_constants:
+  dd 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5
+  dd 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174
+  dd 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da
+  dd 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967
+  dd 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85
+  dd 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070
+  dd 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3
+  dd 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  ;; reverse the bytes of every dword
+bswap_dwords:
+  db 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
@@ -0,0 +1,293 @@
+;; extern void sha256_block_x8_avx2(unsigned char const* const* in, std::uint32_t* state);
+
+;; RDI is the address of 8 pointers to the blocks to hash. Each must be 64 bytes.
+;; RSI is the address of the state of the 8 hashes (64 dwords). Word i of hash a is dword 8*i + a.
+
+;; This is a multi-buffer sha256 compression function: it runs one block of 8
+;; independent hashes at a time, with every dword lane holding a different
+;; hash. All the operations are vertical, so the 64 rounds cost the same as
+;; one scalar hash. The state is kept transposed between calls, so only the
+;; message needs transposing.
+;;
+;; The message is loaded as 8 rows of 16 words, transposed in two halves of 8
+;; words, byte swapped, and stored on the stack. The rest of the 64 word
+;; schedule is computed there before the rounds. AVX2 has no rotate, so every
+;; rotate is two shifts and an or.
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Load 8 rows of 32 bytes from offset %1 of the blocks into ymm8-ymm15
+
+%macro LOAD_ROWS 1
+  mov rax, [rdi]
+  vmovdqu ymm8, [rax+%1]
+  mov rax, [rdi+8]
+  vmovdqu ymm9, [rax+%1]
+  mov rax, [rdi+16]
+  vmovdqu ymm10, [rax+%1]
+  mov rax, [rdi+24]
+  vmovdqu ymm11, [rax+%1]
+  mov rax, [rdi+32]
+  vmovdqu ymm12, [rax+%1]
+  mov rax, [rdi+40]
+  vmovdqu ymm13, [rax+%1]
+  mov rax, [rdi+48]
+  vmovdqu ymm14, [rax+%1]
+  mov rax, [rdi+56]
+  vmovdqu ymm15, [rax+%1]
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Transpose 8 rows of 8 dwords, byte swap them, and store the columns as
+;;; the message words %1 to %1+7 on the stack
+;;;
+;;; ymm8-ymm15: the rows
+;;;
+;;; Uses ymm0-ymm7 as scratch. The rows are destroyed.
+
+%macro TRANSPOSE_8x8 1
+  ;; pairs of rows
+  vpunpckldq ymm0, ymm8, ymm9
+  vpunpckhdq ymm1, ymm8, ymm9
+  vpunpckldq ymm2, ymm10, ymm11
+  vpunpckhdq ymm3, ymm10, ymm11
+  vpunpckldq ymm4, ymm12, ymm13
+  vpunpckhdq ymm5, ymm12, ymm13
+  vpunpckldq ymm6, ymm14, ymm15
+  vpunpckhdq ymm7, ymm14, ymm15
+
+  ;; sets of four rows; the low lane holds words 0-3 and the high lane 4-7
+  vpunpcklqdq ymm8, ymm0, ymm2
+  vpunpckhqdq ymm9, ymm0, ymm2
+  vpunpcklqdq ymm10, ymm1, ymm3
+  vpunpckhqdq ymm11, ymm1, ymm3
+  vpunpcklqdq ymm12, ymm4, ymm6
+  vpunpckhqdq ymm13, ymm4, ymm6
+  vpunpcklqdq ymm14, ymm5, ymm7
+  vpunpckhqdq ymm15, ymm5, ymm7
+
+  ;; all eight rows
+  vperm2i128 ymm0, ymm8, ymm12, 0x20
+  vperm2i128 ymm1, ymm9, ymm13, 0x20
+  vperm2i128 ymm2, ymm10, ymm14, 0x20
+  vperm2i128 ymm3, ymm11, ymm15, 0x20
+  vperm2i128 ymm4, ymm8, ymm12, 0x31
+  vperm2i128 ymm5, ymm9, ymm13, 0x31
+  vperm2i128 ymm6, ymm10, ymm14, 0x31
+  vperm2i128 ymm7, ymm11, ymm15, 0x31
+
+  vmovdqa ymm8, [bswap_dwords]
+  vpshufb ymm0, ymm0, ymm8
+  vpshufb ymm1, ymm1, ymm8
+  vpshufb ymm2, ymm2, ymm8
+  vpshufb ymm3, ymm3, ymm8
+  vpshufb ymm4, ymm4, ymm8
+  vpshufb ymm5, ymm5, ymm8
+  vpshufb ymm6, ymm6, ymm8
+  vpshufb ymm7, ymm7, ymm8
+  vmovdqa [W(%1)], ymm0
+  vmovdqa [W(%1+1)], ymm1
+  vmovdqa [W(%1+2)], ymm2
+  vmovdqa [W(%1+3)], ymm3
+  vmovdqa [W(%1+4)], ymm4
+  vmovdqa [W(%1+5)], ymm5
+  vmovdqa [W(%1+6)], ymm6
+  vmovdqa [W(%1+7)], ymm7
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; %1 = (%2 ror %4) ^ (%2 ror %5) ^ (%2 >> %6), the message schedule sigmas
+;;;
+;;; %3 is scratch
+
+%macro SMALL_SIGMA 6
+  vpsrld %1, %2, %6
+  vpsrld %3, %2, %4
+  vpxor %1, %1, %3
+  vpslld %3, %2, 32-%4
+  vpxor %1, %1, %3
+  vpsrld %3, %2, %5
+  vpxor %1, %1, %3
+  vpslld %3, %2, 32-%5
+  vpxor %1, %1, %3
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; %1 = (%2 ror %4) ^ (%2 ror %5) ^ (%2 ror %6), the round sigmas
+;;;
+;;; %3 is scratch
+
+%macro BIG_SIGMA 6
+  vpsrld %1, %2, %4
+  vpslld %3, %2, 32-%4
+  vpxor %1, %1, %3
+  vpsrld %3, %2, %5
+  vpxor %1, %1, %3
+  vpslld %3, %2, 32-%5
+  vpxor %1, %1, %3
+  vpsrld %3, %2, %6
+  vpxor %1, %1, %3
+  vpslld %3, %2, 32-%6
+  vpxor %1, %1, %3
+%endmacro
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; One round
+;;;
+;;; %1-%8: the registers that hold a-h. The new e is written to %4 (d) and
+;;;        the new a to %8 (h), so the next round is called with the
+;;;        registers rotated by one.
+;;; %9:    the round, from the start of the 8 rounds rax and rcx point at
+;;;
+;;; rax: address of the message words of the round, 8 lanes each
+;;; rcx: address of the round constant
+;;;
+;;; Uses ymm8-ymm10 as scratch.
+
+%macro ROUND 9
+  ;; t1 = h + S1(e) + ch(e, f, g) + k + w
+  vpbroadcastd ymm8, [rcx+4*%9]
+  vpaddd %8, %8, ymm8
+  vpaddd %8, %8, [rax+32*%9]
+  BIG_SIGMA ymm9, %5, ymm10, 6, 11, 25
+  vpaddd %8, %8, ymm9
+  ;; ch(e, f, g) = ((f ^ g) & e) ^ g
+  vpxor ymm9, %6, %7
+  vpand ymm9, ymm9, %5
+  vpxor ymm9, ymm9, %7
+  vpaddd %8, %8, ymm9
+
+  ;; e = d + t1
+  vpaddd %4, %4, %8
+
+  ;; a = t1 + S0(a) + maj(a, b, c)
+  BIG_SIGMA ymm9, %1, ymm10, 2, 13, 22
+  vpaddd %8, %8, ymm9
+  ;; maj(a, b, c) = ((a ^ b) & (b ^ c)) ^ b
+  vpxor ymm9, %1, %2
+  vpxor ymm10, %2, %3
+  vpand ymm9, ymm9, ymm10
+  vpxor ymm9, ymm9, %2
+  vpaddd %8, %8, ymm9
+%endmacro
+
+;; The message word i of the 8 lanes is at [W(i)]. rsp is 32 byte aligned.
+%define W(i) rsp+32*(i)
+
+default rel
+
+section   .text
+
+global sha256_block_x8_avx2
+
+sha256_block_x8_avx2:
+  push rbp
+  mov rbp, rsp
+  and rsp, -32
+  sub rsp, 64*32
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Message schedule
+;;;
+;;; w[i] = s1(w[i-2]) + w[i-7] + s0(w[i-15]) + w[i-16] for i from 16 to 63
+;;;
+;;; rax: address of w[i]
+;;; rcx: address of w[64], the end
+
+  LOAD_ROWS 0
+  TRANSPOSE_8x8 0
+  LOAD_ROWS 32
+  TRANSPOSE_8x8 8
+
+  lea rax, [W(16)]
+  lea rcx, [W(64)]
+.schedule:
+  vmovdqa ymm0, [rax-32*2]
+  SMALL_SIGMA ymm1, ymm0, ymm2, 17, 19, 10
+  vmovdqa ymm0, [rax-32*15]
+  SMALL_SIGMA ymm3, ymm0, ymm2, 7, 18, 3
+  vpaddd ymm1, ymm1, ymm3
+  vpaddd ymm1, ymm1, [rax-32*7]
+  vpaddd ymm1, ymm1, [rax-32*16]
+  vmovdqa [rax], ymm1
+  add rax, 32
+  cmp rax, rcx
+  jne .schedule
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+;;; Rounds, 8 at a time so the registers are back in place after each
+;;; iteration
+;;;
+;;; ymm0-ymm7: a-h
+;;; rax: address of the message words of the first of the 8 rounds
+;;; rcx: address of the round constant of the first of the 8 rounds
+;;; rdx: address of w[64], the end
+
+  vmovdqu ymm0, [rsi]
+  vmovdqu ymm1, [rsi+32]
+  vmovdqu ymm2, [rsi+64]
+  vmovdqu ymm3, [rsi+96]
+  vmovdqu ymm4, [rsi+128]
+  vmovdqu ymm5, [rsi+160]
+  vmovdqu ymm6, [rsi+192]
+  vmovdqu ymm7, [rsi+224]
+
+  lea rax, [W(0)]
+  lea rcx, [round_constants]
+  lea rdx, [W(64)]
+.rounds:
+  ROUND ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7, 0
+  ROUND ymm7, ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, 1
+  ROUND ymm6, ymm7, ymm0, ymm1, ymm2, ymm3, ymm4, ymm5, 2
+  ROUND ymm5, ymm6, ymm7, ymm0, ymm1, ymm2, ymm3, ymm4, 3
+  ROUND ymm4, ymm5, ymm6, ymm7, ymm0, ymm1, ymm2, ymm3, 4
+  ROUND ymm3, ymm4, ymm5, ymm6, ymm7, ymm0, ymm1, ymm2, 5
+  ROUND ymm2, ymm3, ymm4, ymm5, ymm6, ymm7, ymm0, ymm1, 6
+  ROUND ymm1, ymm2, ymm3, ymm4, ymm5, ymm6, ymm7, ymm0, 7
+  add rax, 32*8
+  add rcx, 4*8
+  cmp rax, rdx
+  jne .rounds
+
+  ;; add the compressed block to the state
+  vpaddd ymm0, ymm0, [rsi]
+  vpaddd ymm1, ymm1, [rsi+32]
+  vpaddd ymm2, ymm2, [rsi+64]
+  vpaddd ymm3, ymm3, [rsi+96]
+  vpaddd ymm4, ymm4, [rsi+128]
+  vpaddd ymm5, ymm5, [rsi+160]
+  vpaddd ymm6, ymm6, [rsi+192]
+  vpaddd ymm7, ymm7, [rsi+224]
+  vmovdqu [rsi], ymm0
+  vmovdqu [rsi+32], ymm1
+  vmovdqu [rsi+64], ymm2
+  vmovdqu [rsi+96], ymm3
+  vmovdqu [rsi+128], ymm4
+  vmovdqu [rsi+160], ymm5
+  vmovdqu [rsi+192], ymm6
+  vmovdqu [rsi+224], ymm7
+
+;;;
+;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
+
+  mov rsp, rbp
+  pop rbp
+  vzeroupper
+  ret
+
+section   .data align=32               ; align on 256 bit boundary for avx2 instructions
+  ;; reverse the bytes of every dword
+bswap_dwords:
+  db 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+  db 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+round_constants:
+  dd 0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5
+  dd 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174
+  dd 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da
+  dd 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967
+  dd 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85
+  dd 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070
+  dd 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3
+  dd 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
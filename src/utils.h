@@ -3,6 +3,7 @@
 #include <iomanip>
 #include <iostream>
 
+inline
 void
 print_it(char const* in, int num_chars, bool hex)
 {
@@ -23,6 +24,7 @@ print_it(char const* in, int num_chars, bool hex)
     std::cerr.flags(f);
 };
 
+inline
 void
 print_diff(
     char const* input,
@@ -51,6 +53,7 @@ print_diff(
         }
 }
 
+inline
 void
 print_diff_encode(
     char const* input,